@@ -0,0 +1,103 @@
+/* Asynchronous IO benchmark: reads and writes a file on AsyncRamIO (a RAM
+ * disk with artificial latency) while each cluster gets processed by the
+ * CPU, once with read()/write() and once with readAsync()/writeAsync(),
+ * where the transfers of the following clusters overlap with the
+ * processing. The data must be identical.
+ */
+#include <cstring>
+
+#include "bench_common.h"
+
+using namespace fatfs;
+
+static const int SECTORS = 8000;  // 4 MB
+static const int CLUSTER = 4096;
+static const int CLUSTERS = 256;  // 1 MB
+static const long WORK_US = 200;  // processing time per cluster
+
+AsyncRamIO drv{SECTORS, 512, 200, 5};
+
+static uint8_t data[CLUSTERS * CLUSTER];
+static uint8_t buf[CLUSTERS * CLUSTER];
+static uint32_t checksum;
+
+/// simulated processing of the data (e.g. decoding) which takes WORK_US
+static void work(const uint8_t* part, size_t len, void*) {
+  for (size_t pos = 0; pos < len; pos += CLUSTER) {
+    StopWatch watch;
+    for (size_t i = pos; i < pos + CLUSTER && i < len; i++) {
+      checksum = checksum * 31 + part[i];
+    }
+    while (watch.us() < WORK_US) {
+    }
+  }
+}
+
+static long long run_sync(File& f, bool write) {
+  StopWatch watch;
+  for (int j = 0; j < CLUSTERS; j++) {
+    uint8_t* part = (write ? data : buf) + j * CLUSTER;
+    if (write) {
+      work(part, CLUSTER, nullptr);
+      CHECK(f.write(part, CLUSTER) == CLUSTER, "write failed");
+    } else {
+      CHECK(f.read(part, CLUSTER) == CLUSTER, "read failed");
+      work(part, CLUSTER, nullptr);
+    }
+  }
+  return watch.us();
+}
+
+static long long run_async(File& f, bool write) {
+  StopWatch watch;
+  if (write) {
+    // each written cluster gets processed while the next ones are written
+    CHECK(f.writeAsync(data, sizeof(data), work) == sizeof(data),
+          "writeAsync failed");
+  } else {
+    CHECK(f.readAsync(buf, sizeof(buf), work) == sizeof(buf),
+          "readAsync failed");
+  }
+  return watch.us();
+}
+
+void setup() {
+  static uint8_t mkfs_work[FF_MAX_SS];
+  FatFs fs(drv);
+  MKFS_PARM opt = {FM_FAT, 1, 0, CLUSTER, 0};
+  CHECK(fs.f_mkfs("0:", &opt, mkfs_work, sizeof(mkfs_work)) == FR_OK,
+        "f_mkfs failed");
+  SDClass sd(drv);
+  CHECK(sd.begin(), "SD.begin() failed");
+  for (size_t i = 0; i < sizeof(data); i++) data[i] = (uint8_t)(i * 7 + i / 997);
+
+  long long us[2][2];
+  uint32_t sums[2][2];
+  for (int async = 0; async < 2; async++) {
+    File f = sd.open("0:/async.bin", FA_READ | FA_WRITE | FA_CREATE_ALWAYS);
+    checksum = 0;
+    us[async][0] = async ? run_async(f, true) : run_sync(f, true);
+    sums[async][0] = checksum;
+    f.close();
+    f = sd.open("0:/async.bin", FILE_READ);
+    memset(buf, 0, sizeof(buf));
+    checksum = 0;
+    us[async][1] = async ? run_async(f, false) : run_sync(f, false);
+    sums[async][1] = checksum;
+    CHECK(memcmp(buf, data, sizeof(buf)) == 0, "data mismatch");
+    f.close();
+    printf("%-5s: write %6.2f MB/s, read %6.2f MB/s\n",
+           async ? "async" : "sync", (double)sizeof(data) / us[async][0],
+           (double)sizeof(data) / us[async][1]);
+  }
+  CHECK(sums[0][0] == sums[1][0] && sums[0][1] == sums[1][1],
+        "processed data differs");
+  CHECK(us[1][1] < us[0][1], "readAsync does not overlap the transfers");
+  CHECK(us[1][0] < us[0][0], "writeAsync does not overlap the transfers");
+  sd.end();
+
+  printf("PASS: async io benchmark\n");
+  TEST_EXIT_OK();
+}
+
+void loop() {}
@@ -0,0 +1,91 @@
+#pragma once
+/* Helpers shared by the desktop benchmarks.
+ *
+ * CountingIO wraps any other IO driver and counts the disk_read() and
+ * disk_write() calls which reach it, so the benchmarks can report how much
+ * I/O an optimization saves in addition to the (noisy) run time.
+ */
+#include <chrono>
+#include <cstdio>
+
+#include "fatfs.h"
+#include "test_common.h"
+
+namespace fatfs {
+
+/**
+ * @brief IO driver which forwards all calls to another driver and counts
+ * the read and write requests. Optionally the requests which touch a
+ * sector range (e.g. the FAT) can be counted separately.
+ */
+class CountingIO : public IO {
+ public:
+  CountingIO(IO& io) : p_io(&io) {}
+
+  DSTATUS disk_initialize(BYTE pdrv) override {
+    return p_io->disk_initialize(pdrv);
+  }
+  DSTATUS disk_status(BYTE pdrv) override { return p_io->disk_status(pdrv); }
+
+  DRESULT disk_read(BYTE pdrv, BYTE* buff, LBA_t sector, UINT count) override {
+    reads++;
+    read_sectors += count;
+    if (inRange(sector, count)) range_reads++;
+    return p_io->disk_read(pdrv, buff, sector, count);
+  }
+
+  DRESULT disk_write(BYTE pdrv, const BYTE* buff, LBA_t sector,
+                     UINT count) override {
+    writes++;
+    write_sectors += count;
+    if (inRange(sector, count)) range_writes++;
+    return p_io->disk_write(pdrv, buff, sector, count);
+  }
+
+  DRESULT disk_ioctl(BYTE pdrv, ioctl_cmd_t cmd, void* buff) override {
+    return p_io->disk_ioctl(pdrv, cmd, buff);
+  }
+
+  /// defines the sector range which is counted by rangeReads()/rangeWrites()
+  void setRange(LBA_t first, LBA_t count) {
+    range_first = first;
+    range_count = count;
+  }
+
+  void reset() {
+    reads = writes = read_sectors = write_sectors = 0;
+    range_reads = range_writes = 0;
+  }
+
+  unsigned long reads = 0;
+  unsigned long writes = 0;
+  unsigned long read_sectors = 0;
+  unsigned long write_sectors = 0;
+  unsigned long range_reads = 0;
+  unsigned long range_writes = 0;
+
+ protected:
+  IO* p_io;
+  LBA_t range_first = 0;
+  LBA_t range_count = 0;
+
+  bool inRange(LBA_t sector, UINT count) {
+    return sector < range_first + range_count && sector + count > range_first;
+  }
+};
+
+/// Simple stop watch which measures in microseconds
+class StopWatch {
+ public:
+  void start() { begin = std::chrono::steady_clock::now(); }
+  long long us() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now() - begin)
+        .count();
+  }
+
+ protected:
+  std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+};
+
+}  // namespace fatfs
@@ -0,0 +1,121 @@
+/* CompressedRamIO benchmark: writes log files (text) to a RamIO and to a
+ * CompressedRamIO volume and reports the compression ratio, the memory which
+ * is used by both drives and the latency of single sector reads from the
+ * LRU cache (hot), of reads which need to decompress the sector (cold) and
+ * of writes (which compress the evicted sectors), as well as the throughput
+ * of file reads and writes with FatFs. The data must be identical.
+ */
+#include <cstring>
+
+#include "bench_common.h"
+
+using namespace fatfs;
+
+static const int SECTORS = 16384;  // 8 MB
+static const int FILES = 4;
+static const int FILE_SIZE = 1024 * 1024;
+
+static char data[FILE_SIZE];
+static char buf[FILE_SIZE];
+
+struct Result {
+  size_t memory;
+  double us[3];   // hot read, cold read, write per sector
+  double mbs[2];  // file write, file read
+};
+
+/// writes and reads the log files with FatFs
+static void files(IO& drv, Result& result) {
+  FatFs fs(drv);
+  FIL fil;
+  UINT n;
+  char path[16];
+  CHECK(drv.mount(fs) == FR_OK, "mount failed");
+  StopWatch watch;
+  for (int f = 0; f < FILES; f++) {
+    snprintf(path, sizeof(path), "0:/log%d.txt", f);
+    CHECK(fs.f_open(&fil, path, FA_WRITE | FA_CREATE_ALWAYS) == FR_OK,
+          "f_open failed");
+    CHECK(fs.f_write(&fil, data, FILE_SIZE, &n) == FR_OK && n == FILE_SIZE,
+          "f_write failed");
+    CHECK(fs.f_close(&fil) == FR_OK, "f_close failed");
+  }
+  result.mbs[0] = (double)FILES * FILE_SIZE / watch.us();
+  watch.start();
+  for (int f = 0; f < FILES; f++) {
+    snprintf(path, sizeof(path), "0:/log%d.txt", f);
+    memset(buf, 0, sizeof(buf));
+    CHECK(fs.f_open(&fil, path, FA_READ) == FR_OK, "f_open failed");
+    CHECK(fs.f_read(&fil, buf, FILE_SIZE, &n) == FR_OK && n == FILE_SIZE,
+          "f_read failed");
+    fs.f_close(&fil);
+    CHECK(memcmp(buf, data, FILE_SIZE) == 0, "data mismatch");
+  }
+  result.mbs[1] = (double)FILES * FILE_SIZE / watch.us();
+  CHECK(drv.un_mount(fs) == FR_OK, "un_mount failed");
+  CHECK(drv.disk_ioctl(0, CTRL_SYNC, nullptr) == RES_OK, "sync failed");
+}
+
+/// measures the latency of single sector requests in the used area
+static void sectors(IO& drv, Result& result) {
+  const int count = FILES * FILE_SIZE / 512;
+  uint8_t sector[512];
+  StopWatch watch;
+  for (int j = 0; j < count; j++) drv.disk_read(0, sector, 100, 1);
+  result.us[0] = (double)watch.us() / count;
+  watch.start();
+  for (int j = 0; j < count; j++) drv.disk_read(0, sector, 100 + j, 1);
+  result.us[1] = (double)watch.us() / count;
+  watch.start();
+  for (int j = 0; j < count; j++) {
+    CHECK(drv.disk_read(0, sector, 100 + j, 1) == RES_OK, "read failed");
+    CHECK(drv.disk_write(0, sector, 100 + j, 1) == RES_OK, "write failed");
+  }
+  CHECK(drv.disk_ioctl(0, CTRL_SYNC, nullptr) == RES_OK, "sync failed");
+  result.us[2] = (double)watch.us() / count - result.us[1];
+}
+
+void setup() {
+  for (int pos = 0, i = 0; pos < FILE_SIZE; i++) {
+    char line[80];
+    int len = snprintf(line, sizeof(line),
+                       "2024-01-%02d %02d:%02d:%02d INFO sensor %d value %d\n",
+                       1 + i / 86400 % 28, i / 3600 % 24, i / 60 % 60, i % 60,
+                       i % 8, (i * 7919) % 1000);
+    if (len > FILE_SIZE - pos) len = FILE_SIZE - pos;
+    memcpy(data + pos, line, len);
+    pos += len;
+  }
+
+  Result r[2];
+  RamIO ram{SECTORS, 512};
+  files(ram, r[0]);
+  sectors(ram, r[0]);
+  r[0].memory = ram.memoryUsage();
+
+  CompressedRamIO zram{SECTORS, 512};
+  files(zram, r[1]);
+  sectors(zram, r[1]);
+  r[1].memory = zram.memoryUsage();
+  float ratio = zram.compressionRatio();
+
+  const char* names[2] = {"RamIO", "CompressedRamIO"};
+  printf("%-16s %10s %8s %8s %8s %8s %8s\n", "drive", "memory", "hot rd",
+         "cold rd", "write", "f_write", "f_read");
+  for (int j = 0; j < 2; j++) {
+    printf("%-16s %10zu %8.3f %8.3f %8.3f %8.0f %8.0f\n", names[j],
+           r[j].memory, r[j].us[0], r[j].us[1], r[j].us[2], r[j].mbs[0],
+           r[j].mbs[1]);
+  }
+  printf("(us per sector, MB/s)\n");
+  printf("compression ratio: %.2f (%zu of %zu bytes), cache hits %u misses %u\n",
+         ratio, zram.compressedBytes(), zram.rawBytes(),
+         (unsigned)zram.getCache().hits(), (unsigned)zram.getCache().misses());
+  CHECK(ratio > 2, "log files not compressed");
+  CHECK(r[1].memory < r[0].memory / 2, "compressed drive uses more memory");
+
+  printf("PASS: compressed ram benchmark\n");
+  TEST_EXIT_OK();
+}
+
+void loop() {}
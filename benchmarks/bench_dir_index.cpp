@@ -0,0 +1,70 @@
+/* Directory index benchmark (FF_USE_DIRINDEX).
+ *
+ * Creates N data logger files in one directory and measures the f_open()
+ * latency for all of them in random order, without and with the directory
+ * hash index. The sector reads which reach the driver are counted as well.
+ */
+#include <cstdlib>
+#include <cstring>
+
+#include "bench_common.h"
+
+using namespace fatfs;
+
+static const int N = 1000;
+
+RamIO ram{16000, 512};
+CountingIO drv{ram};
+
+static void create_files(FatFs& fs) {
+  char path[48];
+  FIL fil;
+  for (int j = 0; j < N; j++) {
+    snprintf(path, sizeof(path), "0:/log/datalog-%05d.csv", j);
+    CHECK(fs.f_open(&fil, path, FA_WRITE | FA_CREATE_ALWAYS) == FR_OK,
+          "could not create file");
+    fs.f_close(&fil);
+  }
+}
+
+static void run(FatFs& fs, UINT entries) {
+  char path[48];
+  FIL fil;
+  StopWatch watch;
+  fs.setDirIndexSize(entries);
+  CHECK(fs.f_mount(&drv.fatfs, "0:", 1) == FR_OK, "f_mount failed");
+  srand(1);
+  drv.reset();
+  watch.start();
+  for (int j = 0; j < N; j++) {
+    snprintf(path, sizeof(path), "0:/log/datalog-%05d.csv", rand() % N);
+    CHECK(fs.f_open(&fil, path, FA_READ) == FR_OK, "f_open failed");
+    fs.f_close(&fil);
+  }
+  long long us = watch.us();
+  printf("dir index %5u entries: %6.1f us per f_open, %5.1f sector reads\n",
+         entries, (double)us / N, (double)drv.read_sectors / N);
+  fs.f_unmount("0:");
+}
+
+void setup() {
+  static uint8_t work[FF_MAX_SS];
+  FatFs fs(drv);
+  MKFS_PARM opt = {FM_FAT, 1, 0, 0, 0};
+  CHECK(fs.f_mkfs("0:", &opt, work, sizeof(work)) == FR_OK, "f_mkfs failed");
+  fs.setDirIndexSize(2 * N + 10);
+  CHECK(fs.f_mount(&drv.fatfs, "0:", 1) == FR_OK, "f_mount failed");
+  CHECK(fs.f_mkdir("0:/log") == FR_OK, "f_mkdir failed");
+  create_files(fs);
+  fs.f_unmount("0:");
+
+  run(fs, 0);
+  unsigned long without = drv.read_sectors;
+  run(fs, 2 * N + 10);
+  CHECK(drv.read_sectors < without, "directory index does not save reads");
+
+  printf("PASS: directory index benchmark\n");
+  TEST_EXIT_OK();
+}
+
+void loop() {}
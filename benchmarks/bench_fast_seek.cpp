@@ -0,0 +1,79 @@
+/* File::seek() benchmark: random seek() + read() in a large fragmented
+ * file, with and without the cluster link map table of
+ * File::enableFastSeek(). The FAT reads which reach the driver are counted
+ * as well.
+ */
+#include <cstdlib>
+#include <cstring>
+
+#include "bench_common.h"
+
+using namespace fatfs;
+
+static const int SECTORS = 24000;  // 12 MB
+static const int CHUNK = 4096;
+static const int CHUNKS = 1024;    // 4 MB per file
+static const int SEEKS = 2000;
+
+RamIO ram{SECTORS, 512};
+CountingIO drv{ram};
+
+static uint8_t value(int pos) { return (uint8_t)(pos * 13 + pos / 251); }
+
+static void create_files(SDClass& sd) {
+  static uint8_t buf[CHUNK];
+  // the clusters of both files alternate: 1024 fragments each
+  File a = sd.open("0:/a.bin", FILE_WRITE);
+  File b = sd.open("0:/b.bin", FILE_WRITE);
+  for (int j = 0; j < CHUNKS; j++) {
+    for (int i = 0; i < CHUNK; i++) buf[i] = value(j * CHUNK + i);
+    a.write(buf, CHUNK);
+    b.write(buf, CHUNK);
+  }
+  a.close();
+  b.close();
+}
+
+static void run(SDClass& sd, bool fastSeek) {
+  File f = sd.open("0:/a.bin", FILE_READ);
+  CHECK((bool)f, "could not open file");
+  if (fastSeek) CHECK(f.enableFastSeek(), "enableFastSeek failed");
+  FATFS& fatfs = drv.fatfs;
+  drv.setRange(fatfs.fatbase, fatfs.fsize);
+  drv.reset();
+  srand(1);
+  uint8_t buf[64];
+  StopWatch watch;
+  for (int j = 0; j < SEEKS; j++) {
+    int pos = rand() % (CHUNKS * CHUNK - sizeof(buf));
+    f.seek(pos);
+    CHECK(f.read(buf, sizeof(buf)) == sizeof(buf), "read failed");
+    CHECK(buf[0] == value(pos), "data mismatch");
+  }
+  long long us = watch.us();
+  printf("fast seek %-3s: %7.1f us per seek+read, %6.1f FAT reads (%u fragments)\n",
+         fastSeek ? "on" : "off", (double)us / SEEKS,
+         (double)drv.range_reads / SEEKS, (unsigned)f.fastSeekFragments());
+  f.close();
+}
+
+void setup() {
+  static uint8_t work[FF_MAX_SS];
+  FatFs fs(drv);
+  MKFS_PARM opt = {FM_FAT, 1, 0, 2048, 0};
+  CHECK(fs.f_mkfs("0:", &opt, work, sizeof(work)) == FR_OK, "f_mkfs failed");
+  SDClass sd(drv);
+  CHECK(sd.begin(), "SD.begin() failed");
+  create_files(sd);
+
+  run(sd, false);
+  unsigned long without = drv.range_reads;
+  run(sd, true);
+  CHECK(drv.range_reads * 10 < without, "fast seek does not save FAT reads");
+  sd.end();
+
+  printf("PASS: fast seek benchmark\n");
+  TEST_EXIT_OK();
+}
+
+void loop() {}
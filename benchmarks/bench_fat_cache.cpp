@@ -0,0 +1,99 @@
+/* FAT chain cache benchmark (FF_USE_FATCACHE).
+ *
+ * Two fragmented files are read alternately in small chunks with a f_stat()
+ * in between, so the disk access window never stays on the FAT sector of
+ * the chain which is followed. The FAT sector reads which reach the driver
+ * are counted with CountingIO, once without and once with the FAT cache.
+ * The sector cache is switched off to measure the FAT cache on its own.
+ */
+#include <cstring>
+
+#include "bench_common.h"
+
+using namespace fatfs;
+
+static const int FILE_SIZE = 256 * 1024;
+static const int CHUNK = 512;
+
+RamIO ram{4200, 512};
+CountingIO drv{ram};
+
+static void write_files(FatFs& fs) {
+  FIL a, b;
+  UINT bw;
+  uint8_t buf[CHUNK];
+  CHECK(fs.f_open(&a, "0:/a.bin", FA_WRITE | FA_CREATE_ALWAYS) == FR_OK,
+        "f_open a failed");
+  CHECK(fs.f_open(&b, "0:/b.bin", FA_WRITE | FA_CREATE_ALWAYS) == FR_OK,
+        "f_open b failed");
+  // writing alternately interleaves the cluster chains of both files
+  for (int j = 0; j < FILE_SIZE; j += CHUNK) {
+    memset(buf, j / CHUNK, sizeof(buf));
+    CHECK(fs.f_write(&a, buf, CHUNK, &bw) == FR_OK && bw == CHUNK,
+          "f_write a failed");
+    CHECK(fs.f_write(&b, buf, CHUNK, &bw) == FR_OK && bw == CHUNK,
+          "f_write b failed");
+  }
+  fs.f_close(&a);
+  fs.f_close(&b);
+}
+
+static long long read_files(FatFs& fs) {
+  FIL a, b;
+  UINT br;
+  FILINFO info;
+  uint8_t buf[CHUNK];
+  StopWatch watch;
+  CHECK(fs.f_open(&a, "0:/a.bin", FA_READ) == FR_OK, "f_open a failed");
+  CHECK(fs.f_open(&b, "0:/b.bin", FA_READ) == FR_OK, "f_open b failed");
+  drv.reset();
+  watch.start();
+  for (int j = 0; j < FILE_SIZE; j += CHUNK) {
+    CHECK(fs.f_read(&a, buf, CHUNK, &br) == FR_OK && br == CHUNK,
+          "f_read a failed");
+    CHECK(buf[0] == (uint8_t)(j / CHUNK), "content mismatch in a");
+    CHECK(fs.f_stat("0:/a.bin", &info) == FR_OK, "f_stat failed");
+    CHECK(fs.f_read(&b, buf, CHUNK, &br) == FR_OK && br == CHUNK,
+          "f_read b failed");
+    CHECK(buf[0] == (uint8_t)(j / CHUNK), "content mismatch in b");
+  }
+  long long us = watch.us();
+  fs.f_close(&a);
+  fs.f_close(&b);
+  return us;
+}
+
+static unsigned long run(FatFs& fs, UINT regions) {
+  fs.setFatCacheSize(regions);
+  CHECK(fs.f_mount(&drv.fatfs, "0:", 1) == FR_OK, "f_mount failed");
+  drv.setRange(drv.fatfs.fatbase, drv.fatfs.fsize);
+  long long us = read_files(fs);
+  unsigned long fat_reads = drv.range_reads;
+  printf("fat cache %2u regions: %6lu FAT reads, %6lu total reads, %8lld us\n",
+         regions, fat_reads, drv.reads, us);
+  fs.f_unmount("0:");
+  return fat_reads;
+}
+
+void setup() {
+  static uint8_t work[FF_MAX_SS];
+  FatFs fs(drv);
+#if FF_USE_WINCACHE
+  fs.setSectorCacheSize(0);
+#endif
+  // FAT16 with 1 sector clusters: every 512 bytes need a FAT lookup
+  MKFS_PARM opt = {FM_FAT, 1, 0, 512, 0};
+  CHECK(fs.f_mkfs("0:", &opt, work, sizeof(work)) == FR_OK, "f_mkfs failed");
+  CHECK(fs.f_mount(&drv.fatfs, "0:", 1) == FR_OK, "f_mount failed");
+  write_files(fs);
+  fs.f_unmount("0:");
+
+  unsigned long without = run(fs, 0);
+  unsigned long with = run(fs, 4);
+  CHECK(with < without, "FAT cache does not save FAT reads");
+
+  printf("PASS: FAT cache benchmark\n");
+  TEST_EXIT_OK();
+}
+
+void loop() {}
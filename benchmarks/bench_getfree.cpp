@@ -0,0 +1,103 @@
+/* f_getfree() benchmark: counts the free clusters of large FAT32 and exFAT
+ * volumes and compares the time with a plain entry by entry count of the
+ * same FAT/bitmap sectors. The results must be identical.
+ */
+#include <cstring>
+
+#include "bench_common.h"
+
+using namespace fatfs;
+
+static const int SECTORS = 128 * 1024;  // 64 MB
+static const int LOOPS = 5;
+
+RamIO drv{SECTORS, 512};
+
+// reference: counts one entry (or bit) at a time like FatFs did before
+static DWORD reference_count(FATFS& fs) {
+  uint8_t buf[512];
+  DWORD nfree = 0;
+  if (fs.fs_type == FS_EXFAT) {
+    DWORD clst = fs.n_fatent - 2;
+    for (LBA_t sect = fs.bitbase; clst; sect++) {
+      drv.disk_read(0, buf, sect, 1);
+      for (int i = 0; i < 512 && clst; i++) {
+        for (int b = 0; b < 8 && clst; b++, clst--) {
+          if (!(buf[i] & (1 << b))) nfree++;
+        }
+      }
+    }
+  } else {
+    DWORD clst = fs.n_fatent;
+    for (LBA_t sect = fs.fatbase; clst; sect++) {
+      drv.disk_read(0, buf, sect, 1);
+      for (int i = 0; i < 512 && clst; i += 4, clst--) {
+        DWORD v;
+        memcpy(&v, buf + i, 4);
+        if ((v & 0x0FFFFFFF) == 0) nfree++;
+      }
+    }
+  }
+  return nfree;
+}
+
+static void fill(FatFs& fs) {
+  // some files so that the FAT is not completely empty
+  FIL fil;
+  UINT bw;
+  char path[16];
+  static uint8_t buf[4096];
+  for (int j = 0; j < 20; j++) {
+    snprintf(path, sizeof(path), "0:/f%d", j);
+    CHECK(fs.f_open(&fil, path, FA_WRITE | FA_CREATE_ALWAYS) == FR_OK,
+          "f_open failed");
+    for (int k = 0; k < j * 4; k++) fs.f_write(&fil, buf, sizeof(buf), &bw);
+    fs.f_close(&fil);
+  }
+  for (int j = 0; j < 20; j += 3) {
+    snprintf(path, sizeof(path), "0:/f%d", j);
+    fs.f_unlink(path);
+  }
+}
+
+static void run(FatFs& fs, BYTE fmt, const char* name) {
+  static uint8_t work[FF_MAX_SS];
+  MKFS_PARM opt = {fmt, 1, 0, 512, 0};
+  CHECK(fs.f_mkfs("0:", &opt, work, sizeof(work)) == FR_OK, "f_mkfs failed");
+  CHECK(fs.f_mount(&drv.fatfs, "0:", 1) == FR_OK, "f_mount failed");
+  fill(fs);
+
+  StopWatch watch;
+  DWORD nfree = 0;
+  FATFS* fatfs;
+  long long us = 0;
+  for (int j = 0; j < LOOPS; j++) {
+    drv.fatfs.free_clst = 0xFFFFFFFF;  // force a new scan
+    watch.start();
+    CHECK(fs.f_getfree("0:", &nfree, &fatfs) == FR_OK, "f_getfree failed");
+    us += watch.us();
+  }
+
+  long long ref_us = 0;
+  DWORD ref = 0;
+  for (int j = 0; j < LOOPS; j++) {
+    watch.start();
+    ref = reference_count(drv.fatfs);
+    ref_us += watch.us();
+  }
+  printf("%-6s %7u clusters, %7u free: f_getfree %6lld us, reference %6lld us\n",
+         name, (unsigned)(drv.fatfs.n_fatent - 2), (unsigned)nfree,
+         us / LOOPS, ref_us / LOOPS);
+  CHECK(nfree == ref, "f_getfree differs from reference count");
+  fs.f_unmount("0:");
+}
+
+void setup() {
+  FatFs fs(drv);
+  run(fs, FM_FAT32, "FAT32");
+  run(fs, FM_EXFAT, "exFAT");
+  printf("PASS: f_getfree benchmark\n");
+  TEST_EXIT_OK();
+}
+
+void loop() {}
@@ -0,0 +1,126 @@
+/* Disk image benchmark: compares the stdio based FileIO with the memory
+ * mapped MmapFileIO and with PosixFileIO (pread/pwrite, with and without
+ * O_DIRECT) on a 64 MB disk image. It reports the throughput of
+ * single and multi-sector disk_read()/disk_write() calls over the whole
+ * image, of random single sector reads and of file reads and writes with
+ * FatFs. The data must be identical.
+ */
+#include <cstring>
+
+#include "bench_common.h"
+
+using namespace fatfs;
+
+static const char* IMG_PATH = "bench_image_io.img";
+static const int SECTORS = 131072;  // 64 MB
+static const int MULTI = 64;        // sectors per multi-sector request
+static const int FILE_SIZE = 16 * 1024 * 1024;
+
+static uint8_t data[FILE_SIZE];
+static uint8_t buf[FILE_SIZE];
+
+/// transfers the whole disk with requests of count sectors; returns MB/s
+static double transfer(IO& drv, UINT count, bool write) {
+  StopWatch watch;
+  for (LBA_t s = 0; s + count <= SECTORS; s += count) {
+    uint8_t* mem = buf + (s * 512) % (FILE_SIZE - count * 512 + 1);
+    DRESULT res = write ? drv.disk_write(0, mem, s, count)
+                        : drv.disk_read(0, mem, s, count);
+    CHECK(res == RES_OK, "transfer failed");
+  }
+  return (double)SECTORS * 512 / watch.us();
+}
+
+static double random_reads(IO& drv) {
+  uint32_t rnd = 1;
+  StopWatch watch;
+  for (int j = 0; j < SECTORS / 4; j++) {
+    rnd = rnd * 1103515245 + 12345;
+    CHECK(drv.disk_read(0, buf, (rnd >> 8) % SECTORS, 1) == RES_OK,
+          "read failed");
+  }
+  return (double)SECTORS / 4 * 512 / watch.us();
+}
+
+/// runs all measurements: rd 1, wr 1, rd 64, wr 64, random, f_write, f_read
+static void run(IO& drv, double mbs[7]) {
+  CHECK(drv.disk_initialize(0) == STA_CLEAR, "disk_initialize failed");
+  transfer(drv, MULTI, true);  // allocate the blocks of the image
+  mbs[0] = transfer(drv, 1, false);
+  mbs[1] = transfer(drv, 1, true);
+  mbs[2] = transfer(drv, MULTI, false);
+  mbs[3] = transfer(drv, MULTI, true);
+  mbs[4] = random_reads(drv);
+
+  static uint8_t mkfs_work[FF_MAX_SS];
+  FatFs fs(drv);
+  CHECK(fs.f_mkfs("0:", nullptr, mkfs_work, sizeof(mkfs_work)) == FR_OK,
+        "f_mkfs failed");
+  CHECK(drv.mount(fs) == FR_OK, "mount failed");
+  FIL fil;
+  UINT n;
+  StopWatch watch;
+  CHECK(fs.f_open(&fil, "0:/mmap.bin", FA_WRITE | FA_CREATE_ALWAYS) == FR_OK,
+        "f_open failed");
+  CHECK(fs.f_write(&fil, data, FILE_SIZE, &n) == FR_OK && n == FILE_SIZE,
+        "f_write failed");
+  CHECK(fs.f_close(&fil) == FR_OK, "f_close failed");
+  mbs[5] = (double)FILE_SIZE / watch.us();
+  memset(buf, 0, sizeof(buf));
+  watch.start();
+  CHECK(fs.f_open(&fil, "0:/mmap.bin", FA_READ) == FR_OK, "f_open failed");
+  CHECK(fs.f_read(&fil, buf, FILE_SIZE, &n) == FR_OK && n == FILE_SIZE,
+        "f_read failed");
+  fs.f_close(&fil);
+  mbs[6] = (double)FILE_SIZE / watch.us();
+  CHECK(memcmp(buf, data, FILE_SIZE) == 0, "data mismatch");
+  drv.un_mount(fs);
+}
+
+void setup() {
+  for (int i = 0; i < FILE_SIZE; i++) data[i] = (uint8_t)(i * 13 + i / 4093);
+
+  double mbs[4][7];
+  remove(IMG_PATH);
+  {
+    FileIO drv{IMG_PATH, SECTORS, 512};
+    run(drv, mbs[0]);
+  }
+  remove(IMG_PATH);
+  {
+    MmapFileIO drv{IMG_PATH, SECTORS, 512};
+    run(drv, mbs[1]);
+  }
+  remove(IMG_PATH);
+  {
+    PosixFileIO drv{IMG_PATH, SECTORS, 512};
+    run(drv, mbs[2]);
+  }
+  remove(IMG_PATH);
+  bool direct;
+  {
+    PosixFileIO drv{IMG_PATH, SECTORS, 512};
+    drv.setDirect(true);
+    run(drv, mbs[3]);
+    direct = drv.isDirect();
+  }
+  remove(IMG_PATH);
+
+  const char* names[4] = {"FileIO", "MmapFileIO", "PosixFileIO",
+                          direct ? "O_DIRECT" : "(no O_DIRECT)"};
+  printf("%-13s %8s %8s %8s %8s %8s %8s %8s\n", "driver", "rd 1", "wr 1",
+         "rd 64", "wr 64", "random", "f_write", "f_read");
+  for (int j = 0; j < 4; j++) {
+    printf("%-13s", names[j]);
+    for (double v : mbs[j]) printf(" %8.0f", v);
+    printf("\n");
+  }
+  printf("(MB/s)\n");
+  CHECK(mbs[1][0] > mbs[0][0] && mbs[1][4] > mbs[0][4],
+        "mapped sector reads not faster");
+
+  printf("PASS: image io benchmark\n");
+  TEST_EXIT_OK();
+}
+
+void loop() {}
@@ -0,0 +1,150 @@
+/* MultiIO mirroring benchmark: writes and reads a file with large f_read()/
+ * f_write() calls on 1 and 2 AsyncRamIO drives which are combined with
+ * MULTI_MIRROR. Each drive has a latency of 50 us per request and 5 us per
+ * sector; the reads are split into stripes of 32 sectors.
+ *
+ * The mirror is measured healthy, degraded (one drive failed) and while a
+ * replaced drive is rebuilt: there a resync() step of 256 sectors follows
+ * every f_read()/f_write() call. At the end the time of a complete resync()
+ * is reported. The data must be identical in all cases, and the reads of
+ * the healthy mirror need to be spread evenly over the drives. The MB/s are
+ * only reported: they depend on the load of the machine.
+ */
+#include <cstring>
+
+#include "bench_common.h"
+
+using namespace fatfs;
+
+static const int SECTORS = 8192;  // 4 MB per drive
+static const UINT STRIPE = 32;
+static const int FILE_SIZE = 2 * 1024 * 1024;
+static const UINT CHUNK = 256 * 1024;
+static const UINT RESYNC_STEP = 256;
+
+static uint8_t data[FILE_SIZE];
+static uint8_t buf[FILE_SIZE];
+static AsyncRamIO* counted[2];   // drives whose reads are counted
+static size_t read_requests[2];  // of the last run()
+
+/// writes and reads the file; calls resync() after each chunk if requested
+static void run(FatFs& fs, MultiIO* rebuild, double mbs[2]) {
+  FIL fil;
+  UINT n;
+  StopWatch watch;
+  CHECK(
+      fs.f_open(&fil, "0:/mirror.bin", FA_WRITE | FA_CREATE_ALWAYS) == FR_OK,
+      "f_open failed");
+  for (int pos = 0; pos < FILE_SIZE; pos += CHUNK) {
+    CHECK(fs.f_write(&fil, data + pos, CHUNK, &n) == FR_OK && n == CHUNK,
+          "f_write failed");
+    if (rebuild) rebuild->resync(RESYNC_STEP);
+  }
+  CHECK(fs.f_close(&fil) == FR_OK, "f_close failed");
+  mbs[0] = (double)FILE_SIZE / watch.us();
+
+  memset(buf, 0, sizeof(buf));
+  size_t before[2];
+  for (int j = 0; j < 2; j++) {
+    before[j] = counted[j] ? counted[j]->submitted() : 0;
+  }
+  watch.start();
+  CHECK(fs.f_open(&fil, "0:/mirror.bin", FA_READ) == FR_OK, "f_open failed");
+  for (int pos = 0; pos < FILE_SIZE; pos += CHUNK) {
+    CHECK(fs.f_read(&fil, buf + pos, CHUNK, &n) == FR_OK && n == CHUNK,
+          "f_read failed");
+    if (rebuild) rebuild->resync(RESYNC_STEP);
+  }
+  fs.f_close(&fil);
+  mbs[1] = (double)FILE_SIZE / watch.us();
+  CHECK(memcmp(buf, data, FILE_SIZE) == 0, "data mismatch");
+  for (int j = 0; j < 2; j++) {
+    read_requests[j] = counted[j] ? counted[j]->submitted() - before[j] : 0;
+  }
+}
+
+static void print(const char* name, double mbs[2]) {
+  printf("%-12s %8.1f %8.1f\n", name, mbs[0], mbs[1]);
+}
+
+void setup() {
+  static uint8_t mkfs_work[FF_MAX_SS];
+  for (int i = 0; i < FILE_SIZE; i++) data[i] = (uint8_t)(i * 13 + i / 4093);
+  MKFS_PARM opt = {FM_FAT, 1, 0, 0, 65536};  // 128 sectors per request
+
+  printf("%-12s %8s %8s\n", "drives", "f_write", "f_read");
+  double single[2], healthy[2], degraded[2], rebuilding[2];
+  {
+    // same request path: a mirror with one drive
+    AsyncRamIO ram{SECTORS, 512, 50, 5};
+    MultiIO one;
+    one.add(ram);
+    one.setMode(MULTI_MIRROR, STRIPE);
+    FatFs fs(one);
+    CHECK(one.disk_initialize(0) == STA_CLEAR, "disk_initialize failed");
+    CHECK(fs.f_mkfs("0:", &opt, mkfs_work, sizeof(mkfs_work)) == FR_OK,
+          "f_mkfs failed");
+    CHECK(one.mount(fs) == FR_OK, "mount failed");
+    run(fs, nullptr, single);
+    print("single", single);
+    one.un_mount(fs);
+  }
+
+  AsyncRamIO a{SECTORS, 512, 50, 5}, b{SECTORS, 512, 50, 5};
+  AsyncRamIO c{SECTORS, 512, 50, 5}, d{SECTORS, 512, 50, 5};
+  MultiIO multi;
+  multi.add(a);
+  multi.add(b);
+  multi.setMode(MULTI_MIRROR, STRIPE);
+  FatFs fs(multi);
+  CHECK(multi.disk_initialize(0) == STA_CLEAR, "disk_initialize failed");
+  CHECK(fs.f_mkfs("0:", &opt, mkfs_work, sizeof(mkfs_work)) == FR_OK,
+        "f_mkfs failed");
+  CHECK(multi.mount(fs) == FR_OK, "mount failed");
+  counted[0] = &a;
+  counted[1] = &b;
+  run(fs, nullptr, healthy);
+  print("mirror", healthy);
+  // each drive reads half of the stripes of the file
+  size_t stripes = FILE_SIZE / (512 * STRIPE);
+  printf("read requests: %zu + %zu\n", read_requests[0], read_requests[1]);
+  CHECK(read_requests[0] >= stripes / 2 && read_requests[1] >= stripes / 2,
+        "mirrored reads not balanced");
+  counted[0] = counted[1] = nullptr;
+
+  multi.setFailed(1);
+  run(fs, nullptr, degraded);
+  print("degraded", degraded);
+
+  CHECK(multi.replace(1, c), "replace failed");
+  run(fs, &multi, rebuilding);
+  print("rebuilding", rebuilding);
+  printf("(MB/s, rebuilding: resync(%u) after each %u KB)\n", RESYNC_STEP,
+         CHUNK / 1024);
+  while (!multi.resync(RESYNC_STEP)) {
+  }
+  CHECK(!multi.isDegraded(), "not rebuilt");
+
+  // complete rebuild of a second replacement
+  multi.setFailed(0);
+  CHECK(multi.replace(0, d), "replace failed");
+  StopWatch watch;
+  int steps = 1;
+  while (!multi.resync(RESYNC_STEP)) steps++;
+  double resync_mbs = (double)SECTORS * 512 / watch.us();
+  printf("resync: %d steps, %.1f MB/s\n", steps, resync_mbs);
+  CHECK(!multi.isDegraded(), "not rebuilt");
+  const UINT half = FILE_SIZE / 2 / 512;
+  for (LBA_t s = 0; s < SECTORS; s += half) {
+    CHECK(d.disk_read(0, buf, s, half) == RES_OK &&
+              c.disk_read(0, buf + FILE_SIZE / 2, s, half) == RES_OK &&
+              memcmp(buf, buf + FILE_SIZE / 2, FILE_SIZE / 2) == 0,
+          "rebuilt drives differ");
+  }
+  multi.un_mount(fs);
+
+  printf("PASS: multiio mirror benchmark\n");
+  TEST_EXIT_OK();
+}
+
+void loop() {}
@@ -0,0 +1,93 @@
+/* MultiIO striping benchmark: reads and writes a file with large f_read()/
+ * f_write() calls on one AsyncRamIO drive and on 2 and 4 AsyncRamIO drives
+ * which are combined with MULTI_STRIPE (stripes of 32 sectors). Each drive
+ * has a latency of 50 us per request and 5 us per sector. The clusters of
+ * 128 sectors are split into stripes which are submitted to all drives
+ * before they are completed, so the drives work in parallel.
+ * The data must be identical and each drive needs to get its share of the
+ * stripes. The MB/s are only reported: they depend on the load of the
+ * machine.
+ */
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "bench_common.h"
+
+using namespace fatfs;
+
+static const int SECTORS = 16384;  // 8 MB in total
+static const UINT STRIPE = 32;
+static const int FILE_SIZE = 2 * 1024 * 1024;
+static const UINT CHUNK = 256 * 1024;
+
+static uint8_t data[FILE_SIZE];
+static uint8_t buf[FILE_SIZE];
+
+/// measures the MB/s of writing and reading the file
+static void run(int drives, double mbs[2]) {
+  static uint8_t mkfs_work[FF_MAX_SS];
+  std::vector<std::unique_ptr<AsyncRamIO>> members;
+  MultiIO multi;
+  for (int j = 0; j < drives; j++) {
+    members.emplace_back(new AsyncRamIO(SECTORS / drives, 512, 50, 5));
+    multi.add(*members.back());
+  }
+  multi.setMode(MULTI_STRIPE, STRIPE);
+  FatFs fs(multi);
+  CHECK(multi.disk_initialize(0) == STA_CLEAR, "disk_initialize failed");
+  MKFS_PARM opt = {FM_FAT, 1, 0, 0, 65536};  // 128 sectors per request
+  CHECK(fs.f_mkfs("0:", &opt, mkfs_work, sizeof(mkfs_work)) == FR_OK,
+        "f_mkfs failed");
+  CHECK(multi.mount(fs) == FR_OK, "mount failed");
+
+  FIL fil;
+  UINT n;
+  StopWatch watch;
+  CHECK(
+      fs.f_open(&fil, "0:/stripe.bin", FA_WRITE | FA_CREATE_ALWAYS) == FR_OK,
+      "f_open failed");
+  for (int pos = 0; pos < FILE_SIZE; pos += CHUNK) {
+    CHECK(fs.f_write(&fil, data + pos, CHUNK, &n) == FR_OK && n == CHUNK,
+          "f_write failed");
+  }
+  CHECK(fs.f_close(&fil) == FR_OK, "f_close failed");
+  mbs[0] = (double)FILE_SIZE / watch.us();
+
+  memset(buf, 0, sizeof(buf));
+  watch.start();
+  CHECK(fs.f_open(&fil, "0:/stripe.bin", FA_READ) == FR_OK, "f_open failed");
+  for (int pos = 0; pos < FILE_SIZE; pos += CHUNK) {
+    CHECK(fs.f_read(&fil, buf + pos, CHUNK, &n) == FR_OK && n == CHUNK,
+          "f_read failed");
+  }
+  fs.f_close(&fil);
+  mbs[1] = (double)FILE_SIZE / watch.us();
+  CHECK(memcmp(buf, data, FILE_SIZE) == 0, "data mismatch");
+  multi.un_mount(fs);
+
+  // every drive gets its stripes of the file (written and read)
+  size_t stripes = 2 * FILE_SIZE / (512 * STRIPE);
+  for (auto& member : members) {
+    CHECK(member->submitted() >= stripes / drives,
+          "requests not spread over the drives");
+  }
+}
+
+void setup() {
+  for (int i = 0; i < FILE_SIZE; i++) data[i] = (uint8_t)(i * 13 + i / 4093);
+
+  printf("drives  f_write   f_read\n");
+  double mbs[3][2];
+  const int drives[3] = {1, 2, 4};
+  for (int j = 0; j < 3; j++) {
+    run(drives[j], mbs[j]);
+    printf("%6d %8.1f %8.1f\n", drives[j], mbs[j][0], mbs[j][1]);
+  }
+  printf("(MB/s)\n");
+
+  printf("PASS: multiio stripe benchmark\n");
+  TEST_EXIT_OK();
+}
+
+void loop() {}
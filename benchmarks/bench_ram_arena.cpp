@@ -0,0 +1,101 @@
+/* RamIO arena benchmark: compares one allocation per sector (chunk size 1,
+ * the former layout) with the contiguous arena. It reports the number of
+ * allocations, the memory footprint (including an estimated allocator
+ * overhead of 16 bytes per allocation) and the throughput of single and
+ * multi-sector disk_read()/disk_write() calls and of file reads and writes
+ * with FatFs. The data must be identical.
+ */
+#include <cstring>
+
+#include "bench_common.h"
+
+using namespace fatfs;
+
+static const int SECTORS = 16384;  // 8 MB
+static const int MULTI = 64;       // sectors per multi-sector request
+static const int FILE_SIZE = 4 * 1024 * 1024;
+static const size_t MALLOC_OVERHEAD = 16;  // estimated bytes per allocation
+
+static uint8_t data[FILE_SIZE];
+static uint8_t buf[FILE_SIZE];
+
+struct Result {
+  size_t allocations;
+  size_t footprint;
+  double mbs[6];  // read 1, write 1, read 64, write 64, file read, file write
+};
+
+/// transfers the whole disk with requests of count sectors
+static double transfer(RamIO& ram, UINT count, bool write) {
+  StopWatch watch;
+  for (int rep = 0; rep < 4; rep++) {
+    for (LBA_t s = 0; s + count <= SECTORS; s += count) {
+      uint8_t* mem = buf + (s * 512) % (FILE_SIZE - count * 512 + 1);
+      DRESULT res = write ? ram.disk_write(0, mem, s, count)
+                          : ram.disk_read(0, mem, s, count);
+      CHECK(res == RES_OK, "transfer failed");
+    }
+  }
+  return 4.0 * SECTORS * 512 / watch.us();
+}
+
+static Result run(size_t chunkSize) {
+  Result result;
+  RamIO ram{SECTORS, 512};
+  ram.setChunkSize(chunkSize);
+  CHECK(ram.disk_initialize(0) == STA_CLEAR, "disk_initialize failed");
+  result.allocations = ram.chunkCount();
+  result.footprint = ram.memoryUsage() + MALLOC_OVERHEAD * ram.chunkCount();
+
+  transfer(ram, MULTI, true);  // the first write maps the pages of the arena
+  result.mbs[0] = transfer(ram, 1, false);
+  result.mbs[1] = transfer(ram, 1, true);
+  result.mbs[2] = transfer(ram, MULTI, false);
+  result.mbs[3] = transfer(ram, MULTI, true);
+
+  FatFs fs(ram);
+  CHECK(ram.mount(fs) == FR_OK, "mount failed");
+  FIL fil;
+  UINT n;
+  StopWatch watch;
+  CHECK(fs.f_open(&fil, "0:/arena.bin", FA_WRITE | FA_CREATE_ALWAYS) == FR_OK,
+        "f_open failed");
+  CHECK(fs.f_write(&fil, data, FILE_SIZE, &n) == FR_OK && n == FILE_SIZE,
+        "f_write failed");
+  CHECK(fs.f_close(&fil) == FR_OK, "f_close failed");
+  result.mbs[5] = (double)FILE_SIZE / watch.us();
+  memset(buf, 0, sizeof(buf));
+  watch.start();
+  CHECK(fs.f_open(&fil, "0:/arena.bin", FA_READ) == FR_OK, "f_open failed");
+  CHECK(fs.f_read(&fil, buf, FILE_SIZE, &n) == FR_OK && n == FILE_SIZE,
+        "f_read failed");
+  fs.f_close(&fil);
+  result.mbs[4] = (double)FILE_SIZE / watch.us();
+  CHECK(memcmp(buf, data, FILE_SIZE) == 0, "data mismatch");
+  ram.un_mount(fs);
+  return result;
+}
+
+void setup() {
+  for (int i = 0; i < FILE_SIZE; i++) data[i] = (uint8_t)(i * 13 + i / 4093);
+
+  Result r[2] = {run(1), run(0)};
+  const char* names[2] = {"per sector", "arena"};
+  printf("%-10s %7s %10s %8s %8s %8s %8s %8s %8s\n", "layout", "allocs",
+         "footprint", "rd 1", "wr 1", "rd 64", "wr 64", "f_read", "f_write");
+  for (int j = 0; j < 2; j++) {
+    printf("%-10s %7zu %10zu", names[j], r[j].allocations, r[j].footprint);
+    for (double mbs : r[j].mbs) printf(" %8.0f", mbs);
+    printf("\n");
+  }
+  printf("(MB/s)\n");
+  CHECK(r[1].allocations == 1, "arena not allocated in one block");
+  CHECK(r[1].footprint < r[0].footprint, "arena uses more memory");
+  CHECK(r[1].mbs[2] + r[1].mbs[3] > r[0].mbs[2] + r[0].mbs[3],
+        "multi-sector transfers not faster");
+
+  printf("PASS: ram arena benchmark\n");
+  TEST_EXIT_OK();
+}
+
+void loop() {}
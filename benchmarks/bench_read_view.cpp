@@ -0,0 +1,101 @@
+/* Zero-copy read benchmark: reads a large file in small chunks (like an
+ * audio or network stream) with readBytes(), readView() and forward(), with
+ * and without a read buffer, and reports the throughput and the driver
+ * reads. All methods must provide the same data.
+ */
+#include <cstring>
+
+#include "bench_common.h"
+
+using namespace fatfs;
+
+static const int SECTORS = 24000;  // 12 MB
+static const int SIZE = 8 * 1024 * 1024;
+static const int CHUNK = 256;
+static const int RBUF_SECTORS = 32;
+
+RamIO ram{SECTORS, 512};
+CountingIO drv{ram};
+
+static uint8_t rbuf[RBUF_SECTORS * 512];
+
+static uint32_t sum(uint32_t s, const uint8_t* data, size_t len) {
+  for (size_t i = 0; i < len; i++) s = s * 31 + data[i];
+  return s;
+}
+
+static uint32_t fwd_sum;
+
+static UINT receive(const BYTE* data, UINT len) {
+  if (len == 0) return 1;  // sense call: ready to receive
+  if (len > CHUNK) len = CHUNK;
+  fwd_sum = sum(fwd_sum, data, len);
+  return len;
+}
+
+enum Method { READ_BYTES, READ_VIEW, FORWARD };
+
+static uint32_t run(SDClass& sd, Method method, bool readBuffer) {
+  static const char* names[] = {"readBytes", "readView", "forward"};
+  File f = sd.open("0:/stream.bin", FILE_READ);
+  CHECK((bool)f, "could not open file");
+  if (readBuffer) CHECK(f.setReadBuffer(rbuf, sizeof(rbuf)), "no read buffer");
+  drv.reset();
+  uint32_t s = 0;
+  size_t total = 0, len;
+  StopWatch watch;
+  if (method == READ_BYTES) {
+    uint8_t buf[CHUNK];
+    while ((len = f.readBytes(buf, CHUNK)) > 0) {
+      s = sum(s, buf, len);
+      total += len;
+    }
+  } else if (method == READ_VIEW) {
+    const uint8_t* data;
+    while ((len = f.readView(&data, CHUNK)) > 0) {
+      s = sum(s, data, len);
+      total += len;
+    }
+  } else {
+    fwd_sum = 0;
+    total = f.forward(SIZE, receive);
+    s = fwd_sum;
+  }
+  long long us = watch.us();
+  printf("%-9s %-11s: %7.1f MB/s, %6lu driver reads\n", names[method],
+         readBuffer ? "read-ahead" : "", (double)SIZE / (us ? us : 1),
+         drv.reads);
+  CHECK(total == SIZE, "not all data read");
+  f.close();
+  return s;
+}
+
+void setup() {
+  static uint8_t work[FF_MAX_SS];
+  FatFs fs(drv);
+  MKFS_PARM opt = {FM_FAT, 1, 0, 4096, 0};
+  CHECK(fs.f_mkfs("0:", &opt, work, sizeof(work)) == FR_OK, "f_mkfs failed");
+  SDClass sd(drv);
+  CHECK(sd.begin(), "SD.begin() failed");
+  File f = sd.open("0:/stream.bin", FILE_WRITE);
+  static uint8_t buf[4096];
+  for (int j = 0; j < SIZE; j += sizeof(buf)) {
+    for (size_t i = 0; i < sizeof(buf); i++) buf[i] = (uint8_t)((j + i) * 7);
+    CHECK(f.write(buf, sizeof(buf)) == sizeof(buf), "write failed");
+  }
+  f.close();
+
+  uint32_t ref = run(sd, READ_BYTES, false);
+  unsigned long reads = drv.reads;
+  CHECK(run(sd, READ_VIEW, false) == ref, "readView data differs");
+  CHECK(run(sd, FORWARD, false) == ref, "forward data differs");
+  CHECK(run(sd, READ_BYTES, true) == ref, "readBytes data differs");
+  CHECK(run(sd, READ_VIEW, true) == ref, "readView data differs");
+  CHECK(drv.reads * 10 < reads, "read buffer does not save driver reads");
+  sd.end();
+
+  printf("PASS: read view benchmark\n");
+  TEST_EXIT_OK();
+}
+
+void loop() {}
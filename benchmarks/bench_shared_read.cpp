@@ -0,0 +1,162 @@
+/* Shared read benchmark: 1, 2, 4 and 8 threads read their own file on a
+ * FileIO disk image in small pieces, once with exclusive volume locks and
+ * once with shared reader locks (FF_FS_SHARED_READ). This is done on the
+ * plain image (where the readers can only gain from several CPU cores) and
+ * with an artificial latency per disk access (like an SD card or a network
+ * disk), where the shared readers overlap their waits even on one core.
+ * The data must be identical.
+ */
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "bench_common.h"
+
+using namespace fatfs;
+
+static const char* IMG_PATH = "bench_shared_read.img";
+static const int MAX_THREADS = 8;
+static const int FILE_SIZE = 1024 * 1024;
+static const int LATENCY_FILE_SIZE = 256 * 1024;
+static const int CHUNK = 100;  // bytes per f_read()
+
+/// IO driver which forwards all calls and adds a latency to each read
+class LatencyIO : public IO {
+ public:
+  LatencyIO(IO& io) : p_io(&io) {}
+
+  DSTATUS disk_initialize(BYTE pdrv) override {
+    return p_io->disk_initialize(pdrv);
+  }
+  DSTATUS disk_status(BYTE pdrv) override { return p_io->disk_status(pdrv); }
+
+  DRESULT disk_read(BYTE pdrv, BYTE* buff, LBA_t sector, UINT count) override {
+    if (latency_us) {
+      std::this_thread::sleep_for(std::chrono::microseconds(latency_us));
+    }
+    return p_io->disk_read(pdrv, buff, sector, count);
+  }
+
+  DRESULT disk_write(BYTE pdrv, const BYTE* buff, LBA_t sector,
+                     UINT count) override {
+    return p_io->disk_write(pdrv, buff, sector, count);
+  }
+
+  DRESULT disk_ioctl(BYTE pdrv, ioctl_cmd_t cmd, void* buff) override {
+    return p_io->disk_ioctl(pdrv, cmd, buff);
+  }
+
+  bool allowsConcurrentReads() override {
+    return p_io->allowsConcurrentReads();
+  }
+
+  void setLatency(long us) { latency_us = us; }
+
+ protected:
+  IO* p_io;
+  long latency_us = 0;
+};
+
+FatFs fs;
+std::atomic<int> failures{0};
+
+static uint8_t value(int id, int i) { return (uint8_t)(id * 37 + i + i / 509); }
+
+static void reader(int id, int size) {
+  char path[16];
+  uint8_t buf[CHUNK];
+  FIL fil;
+  UINT n;
+  snprintf(path, sizeof(path), "0:/r%d.bin", id);
+  if (fs.f_open(&fil, path, FA_READ) != FR_OK) {
+    failures++;
+    return;
+  }
+  for (int pos = 0; pos < size; pos += n) {
+    UINT len = size - pos < CHUNK ? size - pos : CHUNK;
+    if (fs.f_read(&fil, buf, len, &n) != FR_OK || n != len) {
+      failures++;
+      break;
+    }
+    for (UINT i = 0; i < n; i++) {
+      if (buf[i] != value(id, pos + i)) {
+        failures++;
+        break;
+      }
+    }
+  }
+  fs.f_close(&fil);
+}
+
+/// reads size bytes of each file with the indicated number of threads and
+/// returns the throughput in MB/s
+static double run(int threads, int size) {
+  std::vector<std::thread> list;
+  StopWatch watch;
+  for (int id = 0; id < threads; id++) list.emplace_back(reader, id, size);
+  for (auto& t : list) t.join();
+  long long us = watch.us();
+  CHECK(failures == 0, "read failed");
+  return (double)threads * size / us;
+}
+
+/// measures exclusive and shared locks; returns the MB/s of both modes with
+/// the maximum number of threads
+static void measure(const char* title, int size, double result[2]) {
+  printf("%s:\n", title);
+  printf("threads  exclusive     shared\n");
+  for (int threads = 1; threads <= MAX_THREADS; threads *= 2) {
+    double mbs[2];
+    for (int shared = 0; shared < 2; shared++) {
+      fs.setSharedRead(shared);
+      mbs[shared] = run(threads, size);
+      result[shared] = mbs[shared];
+    }
+    printf("%7d %6.2f MB/s %6.2f MB/s\n", threads, mbs[0], mbs[1]);
+  }
+}
+
+void setup() {
+  static uint8_t mkfs_work[FF_MAX_SS];
+  static uint8_t data[FILE_SIZE];
+  remove(IMG_PATH);
+  FileIO file{IMG_PATH, 40000, 512};  // 20 MB
+  LatencyIO drv{file};
+  fs.setDriver(drv);
+  CHECK(drv.disk_initialize(0) == STA_CLEAR, "disk_initialize failed");
+  MKFS_PARM opt = {FM_FAT, 1, 0, 4096, 0};
+  CHECK(fs.f_mkfs("0:", &opt, mkfs_work, sizeof(mkfs_work)) == FR_OK,
+        "f_mkfs failed");
+  CHECK(drv.mount(fs) == FR_OK, "mount failed");
+
+  for (int id = 0; id < MAX_THREADS; id++) {
+    char path[16];
+    FIL fil;
+    UINT n;
+    snprintf(path, sizeof(path), "0:/r%d.bin", id);
+    for (int i = 0; i < FILE_SIZE; i++) data[i] = value(id, i);
+    CHECK(fs.f_open(&fil, path, FA_WRITE | FA_CREATE_ALWAYS) == FR_OK,
+          "f_open failed");
+    CHECK(fs.f_write(&fil, data, FILE_SIZE, &n) == FR_OK && n == FILE_SIZE,
+          "f_write failed");
+    CHECK(fs.f_close(&fil) == FR_OK, "f_close failed");
+  }
+
+  double plain[2], latency[2];
+  measure("FileIO", FILE_SIZE, plain);
+  drv.setLatency(100);
+  measure("FileIO with 100 us latency per read", LATENCY_FILE_SIZE, latency);
+  CHECK(latency[1] > 2 * latency[0], "shared readers do not overlap");
+  if (std::thread::hardware_concurrency() < 4) {
+    printf("(less than 4 cores: the plain FileIO can not scale)\n");
+  }
+
+  fs.setSharedRead(true);
+  drv.un_mount(fs);
+  remove(IMG_PATH);
+  printf("PASS: shared read benchmark\n");
+  TEST_EXIT_OK();
+}
+
+void loop() {}
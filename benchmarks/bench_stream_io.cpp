@@ -0,0 +1,166 @@
+/* StreamIO benchmark: writes and reads a file with FatFs over a memory
+ * stream which counts the seek() calls and the transfer calls. Before the
+ * position was tracked, StreamIO did a seek() for every request: this is
+ * the number of requests reported by CountingIO. A second stream provides
+ * readSectors()/writeSectors(), which StreamIO uses instead of seek() and
+ * readBytes()/write().
+ *
+ * The streams model the time of a device (like a card or a flash chip with
+ * a command per access): 50 us per seek, 10 us per transfer call and
+ * 10 MB/s. The data must be identical.
+ */
+#include <cstring>
+#include <vector>
+
+#include "bench_common.h"
+#include "driver/StreamIO.h"
+
+using namespace fatfs;
+
+static const int SECTORS = 8192;  // 4 MB
+static const int FILE_SIZE = 1024 * 1024;
+static const double SEEK_US = 50, CALL_US = 10, US_PER_BYTE = 0.1;
+
+static uint8_t data[FILE_SIZE];
+static uint8_t buf[FILE_SIZE];
+
+/// memory stream which counts the calls and models their time
+class CountingStream {
+ public:
+  CountingStream() : mem(SECTORS * 512, 0) {}
+
+  int sectorSize() { return 512; }
+  bool begin() { return true; }
+  void flush() {}
+  uint32_t sectorCount() { return SECTORS; }
+  void eraseSector(uint32_t, uint32_t) {}
+
+  void seek(uint64_t pos) {
+    seeks++;
+    position = pos;
+  }
+
+  size_t readBytes(uint8_t* out, size_t len) {
+    if (position + len > mem.size()) return 0;
+    transfer(len);
+    memcpy(out, mem.data() + position, len);
+    position += len;
+    return len;
+  }
+
+  size_t write(const uint8_t* in, size_t len) {
+    if (position + len > mem.size()) return 0;
+    transfer(len);
+    memcpy(mem.data() + position, in, len);
+    position += len;
+    return len;
+  }
+
+  /// time of the device in us
+  double deviceUs() { return seeks * SEEK_US + device_us; }
+
+  void reset() {
+    seeks = calls = 0;
+    device_us = 0;
+  }
+
+  unsigned long seeks = 0;
+  unsigned long calls = 0;
+
+ protected:
+  std::vector<uint8_t> mem;
+  uint64_t position = 0;
+  double device_us = 0;
+
+  void transfer(size_t len) {
+    calls++;
+    device_us += CALL_US + len * US_PER_BYTE;
+  }
+};
+
+/// stream which also provides the multi-sector fast path
+class SectorStream : public CountingStream {
+ public:
+  bool readSectors(uint8_t* out, uint64_t sector, size_t count) {
+    position = sector * 512;
+    return readBytes(out, count * 512) == count * 512;
+  }
+
+  bool writeSectors(const uint8_t* in, uint64_t sector, size_t count) {
+    position = sector * 512;
+    return write(in, count * 512) == count * 512;
+  }
+};
+
+struct Result {
+  unsigned long requests, seeks, calls;
+  double device_ms;
+};
+
+/// writes the file in pieces of chunk bytes and reads it back
+template <class T>
+static Result run(UINT chunk) {
+  static uint8_t mkfs_work[FF_MAX_SS];
+  T stream;
+  StreamIO<T> io(stream);
+  CountingIO drv(io);
+  FatFs fs(drv);
+  CHECK(drv.disk_initialize(0) == STA_CLEAR, "disk_initialize failed");
+  CHECK(fs.f_mkfs("0:", nullptr, mkfs_work, sizeof(mkfs_work)) == FR_OK,
+        "f_mkfs failed");
+  CHECK(drv.mount(fs) == FR_OK, "mount failed");
+  drv.reset();
+  stream.reset();
+
+  FIL fil;
+  UINT n;
+  CHECK(
+      fs.f_open(&fil, "0:/stream.bin", FA_WRITE | FA_CREATE_ALWAYS) == FR_OK,
+      "f_open failed");
+  for (int pos = 0; pos < FILE_SIZE; pos += chunk) {
+    CHECK(fs.f_write(&fil, data + pos, chunk, &n) == FR_OK && n == chunk,
+          "f_write failed");
+  }
+  CHECK(fs.f_close(&fil) == FR_OK, "f_close failed");
+  memset(buf, 0, sizeof(buf));
+  CHECK(fs.f_open(&fil, "0:/stream.bin", FA_READ) == FR_OK, "f_open failed");
+  for (int pos = 0; pos < FILE_SIZE; pos += chunk) {
+    CHECK(fs.f_read(&fil, buf + pos, chunk, &n) == FR_OK && n == chunk,
+          "f_read failed");
+  }
+  fs.f_close(&fil);
+  CHECK(memcmp(buf, data, FILE_SIZE) == 0, "data mismatch");
+  drv.un_mount(fs);
+  return {drv.reads + drv.writes, stream.seeks, stream.calls,
+          stream.deviceUs() / 1000};
+}
+
+static void print(const char* name, UINT chunk, Result r) {
+  double before = r.device_ms + (r.requests - r.seeks) * SEEK_US / 1000;
+  printf("%-13s %6u %9lu %7lu %7lu %12.1f %12.1f\n", name, chunk, r.requests,
+         r.seeks, r.calls, before, r.device_ms);
+}
+
+void setup() {
+  for (int i = 0; i < FILE_SIZE; i++) data[i] = (uint8_t)(i * 13 + i / 4093);
+
+  printf("%-13s %6s %9s %7s %7s %12s %12s\n", "stream", "chunk", "requests",
+         "seeks", "calls", "ms (before)", "ms (device)");
+  const UINT chunks[3] = {128, 512, 4096};
+  for (UINT chunk : chunks) {
+    Result plain = run<CountingStream>(chunk);
+    Result fast = run<SectorStream>(chunk);
+    print("seek/read", chunk, plain);
+    print("readSectors", chunk, fast);
+    CHECK(plain.seeks * 2 < plain.requests, "sequential requests did seek");
+    CHECK(fast.seeks == 0 && fast.calls == fast.requests,
+          "fast path not used");
+    CHECK(fast.device_ms <= plain.device_ms, "fast path slower");
+  }
+  printf("(ms (before): one seek per request)\n");
+
+  printf("PASS: stream io benchmark\n");
+  TEST_EXIT_OK();
+}
+
+void loop() {}
@@ -16,18 +16,22 @@
 
 // Option 2: SD card with hardware SPI (default)
 // If you want to test the RAM disk instead, uncomment the RamIO line above
-// and comment out the SD section below.
+// and comment out the SD section below together with the testMultiBlock()
+// calls, which measure the SPI pipelining of this driver.
 #define MISO 2
 #define MOSI 15
 #define SCLK 14
 #define CS 13
+ArduinoSpiIO sdDriver;
 
 // Test configuration
 #define TEST_FILE_SIZE_KB   100      // Size of test file in KB
 #define BUFFER_SIZE         512      // Buffer size for operations
 #define NUM_ITERATIONS      10       // Number of test iterations
+#define BULK_SIZE           8192     // Buffer size for multi-block operations
 
 static uint8_t buffer[BUFFER_SIZE];
+static uint8_t bulk[BULK_SIZE];
 
 void fillBuffer(uint8_t* buf, size_t size, uint8_t pattern) {
   for (size_t i = 0; i < size; i++) {
@@ -208,6 +212,56 @@ void testRandomRead() {
          (endTime - startTime) / (float)NUM_ITERATIONS);
 }
 
+// Writes and reads the test file with BULK_SIZE requests, which the
+// driver transfers with CMD25/CMD18 (multiple blocks)
+void testMultiBlock(bool pipeline) {
+  sdDriver.setPipeline(pipeline);
+  printf("\n==== Multi-Block Test (pipeline %s) ====\n",
+         pipeline ? "on" : "off");
+
+  unsigned long totalBytes = TEST_FILE_SIZE_KB * 1024UL / BULK_SIZE * BULK_SIZE;
+  fillBuffer(bulk, BULK_SIZE, 0);
+  File file = SD.open("bulktest.dat", FILE_WRITE);
+  if (!file) {
+    printf("Failed to open file for writing!\n");
+    return;
+  }
+  unsigned long startTime = millis();
+  for (unsigned long pos = 0; pos < totalBytes; pos += BULK_SIZE) {
+    if (file.write(bulk, BULK_SIZE) != BULK_SIZE) {
+      printf("Write error at byte %lu\n", pos);
+      break;
+    }
+  }
+  file.flush();
+  unsigned long writeMs = millis() - startTime;
+  file.close();
+
+  file = SD.open("bulktest.dat", FILE_READ);
+  if (!file) {
+    printf("Failed to open file for reading!\n");
+    return;
+  }
+  bool verified = true;
+  startTime = millis();
+  for (unsigned long pos = 0; pos < totalBytes; pos += BULK_SIZE) {
+    if (file.read(bulk, BULK_SIZE) != BULK_SIZE) {
+      printf("Read error at byte %lu\n", pos);
+      break;
+    }
+    if (!verifyBuffer(bulk, BULK_SIZE, 0)) verified = false;
+  }
+  unsigned long readMs = millis() - startTime;
+  file.close();
+  SD.remove("bulktest.dat");
+
+  printf("Multi-Block Write: %.2f MB/s\n",
+         totalBytes / 1000.0 / (writeMs > 0 ? writeMs : 1));
+  printf("Multi-Block Read: %.2f MB/s\n",
+         totalBytes / 1000.0 / (readMs > 0 ? readMs : 1));
+  printf("Data verification: %s\n", verified ? "PASSED" : "FAILED");
+}
+
 void testFileOperations() {
   printf("\n==== File Operations Test ====\n");
   
@@ -265,7 +319,8 @@ void setup() {
   printf("Initializing SD card...\n");
   SPI.begin(SCLK, MISO, MOSI);
   delay(100);
-  if (!SD.begin(CS, SPI)) {  // uses internal ArduinoSpiIO driver
+  sdDriver.setSPI(CS, SPI);
+  if (!SD.begin(sdDriver)) {
     printf("SD card initialization failed!\n");
     while (true);
   }
@@ -316,6 +371,8 @@ void setup() {
   testSequentialRead();
   testRandomWrite();
   testRandomRead();
+  testMultiBlock(false);  // before: one block after the other
+  testMultiBlock(true);   // after: pipelined blocks
   testFileOperations();
   
   // Clean up
@@ -37,6 +37,13 @@ namespace fatfs {
 
 /**
  * @brief Accessing a SD card via the Arduino SPI API
+ *
+ * Multi-block transfers (CMD18/CMD25) are pipelined (FF_SPI_PIPELINE): the
+ * CRC of a block and the wait for the next data token or for the end of the
+ * busy state are clocked in short bursts instead of single bytes, and data
+ * bytes which arrive in the same burst as the token are kept. The blocks are
+ * transferred with the buffer API of the core, which uses DMA on the RP2040
+ * and the FIFO of the ESP32; other cores use SPIClass::transfer(buf, len).
  * @ingroup io
  */
 
@@ -72,6 +79,11 @@ class ArduinoSpiIO : public BaseIO {
     spi_fast = SPISettings(speedHz, MSBFIRST, SPI_MODE0);
   }
 
+  /// Switches the pipelined multi-block transfers on or off (e.g. to compare
+  /// the speed)
+  void setPipeline(bool active) { pipeline = active; }
+  bool isPipeline() { return pipeline; }
+
   DSTATUS disk_initialize(BYTE drv /* Physical drive number (0) */
                           ) override {
     BYTE n, cmd, ty, ocr[4];
@@ -163,10 +175,14 @@ class ArduinoSpiIO : public BaseIO {
       }
     } else {                              /* Multiple sector read */
       if (send_cmd(CMD18, sector) == 0) { /* READ_MULTIPLE_BLOCK */
-        do {
-          if (!rcvr_datablock(buff, 512)) break;
-          buff += 512;
-        } while (--count);
+        if (pipeline) {
+          count = rcvr_datablocks(buff, count);
+        } else {
+          do {
+            if (!rcvr_datablock(buff, 512)) break;
+            buff += 512;
+          } while (--count);
+        }
         send_cmd(CMD12, 0); /* STOP_TRANSMISSION */
         wait_ready(500);     /* Wait for card to be ready after stop transmission */
       }
@@ -196,17 +212,21 @@ class ArduinoSpiIO : public BaseIO {
 
     if (count == 1) {                    /* Single sector write */
       if ((send_cmd(CMD24, sector) == 0) /* WRITE_BLOCK */
-          && xmit_datablock((BYTE*)buff, 0xFE)) {
+          && xmit_datablock(buff, 0xFE)) {
         count = 0;
       }
     } else { /* Multiple sector write */
       if (CardType & CT_SDC)
         send_cmd(ACMD23, count);          /* Predefine number of sectors */
       if (send_cmd(CMD25, sector) == 0) { /* WRITE_MULTIPLE_BLOCK */
-        do {
-          if (!xmit_datablock((BYTE*)buff, 0xFC)) break;
-          buff += 512;
-        } while (--count);
+        if (pipeline) {
+          count = xmit_datablocks(buff, count);
+        } else {
+          do {
+            if (!xmit_datablock(buff, 0xFC)) break;
+            buff += 512;
+          } while (--count);
+        }
         if (!xmit_datablock(0, 0xFD)) count = 1; /* STOP_TRAN token */
       }
     }
@@ -324,6 +344,8 @@ class ArduinoSpiIO : public BaseIO {
   SPISettings spi_settings;
   uint32_t spi_timeout;
   int cs = -1;
+  bool pipeline = FF_SPI_PIPELINE;
+  static const int BURST = 8; /* Bytes per poll in the pipelined transfers */
 
   void spi_timer_on(uint32_t waitTicks) { spi_timeout = millis() + waitTicks; }
 
@@ -342,6 +364,11 @@ class ArduinoSpiIO : public BaseIO {
 
   /* Receive multiple byte */
   void rcvr_spi_multi(BYTE *buff, UINT btr) {
+#if defined(ARDUINO_ARCH_RP2040)
+    p_spi->transfer(dummy_block(), buff, btr); /* DMA, sends 0xFF */
+#elif defined(ESP32)
+    p_spi->transferBytes(dummy_block(), buff, btr);
+#else
     // SPIClass::transfer(buf, len) transmits buf's own contents while
     // overwriting it with the received bytes, so pre-fill with the dummy
     // 0xFF clock-out byte, then do the whole block in one call instead of
@@ -349,13 +376,37 @@ class ArduinoSpiIO : public BaseIO {
     // transfer instead of paying per-byte call overhead each time.
     memset(buff, 0xFF, btr);
     p_spi->transfer(buff, btr);
+#endif
   }
-  
+
   /* Send multiple bytes */
-  void xmit_spi_multi(BYTE *buff, UINT btr) {
-    p_spi->transfer(buff, btr);
+  void xmit_spi_multi(const BYTE *buff, UINT btr) {
+#if defined(ARDUINO_ARCH_RP2040)
+    p_spi->transfer(buff, nullptr, btr); /* DMA, discards the input */
+#elif defined(ESP32)
+    p_spi->writeBytes(buff, btr);
+#else
+    // transfer(buf, len) overwrites buf with the received bytes: send a
+    // copy, so that the data of the caller (e.g. the FatFs window) is kept
+    BYTE chunk[64];
+    for (UINT pos = 0; pos < btr; pos += sizeof(chunk)) {
+      UINT n = btr - pos < sizeof(chunk) ? btr - pos : sizeof(chunk);
+      memcpy(chunk, buff + pos, n);
+      p_spi->transfer(chunk, n);
+    }
+#endif
   }
 
+#if defined(ARDUINO_ARCH_RP2040) || defined(ESP32)
+  /* 0xFF bytes which are sent while receiving */
+  static const BYTE *dummy_block() {
+    static BYTE block[512];
+    static bool filled = (memset(block, 0xFF, sizeof(block)), true);
+    (void)filled;
+    return block;
+  }
+#endif
+
   /* Wait for card ready                                                   */
   int wait_ready(        /* 1:Ready, 0:Timeout */
                  UINT wt /* Timeout [ms] */
@@ -374,6 +425,18 @@ class ArduinoSpiIO : public BaseIO {
     return (d == 0xFF) ? 1 : 0;
   }
 
+  /* Wait for card ready, polling in bursts (the card sends 0x00 while it
+     is busy, and 0xFF after that)                                         */
+  int wait_ready_burst(UINT wt) { /* 1:Ready, 0:Timeout */
+    BYTE burst[BURST];
+    uint32_t timeout = millis() + wt;
+    do {
+      rcvr_spi_multi(burst, BURST);
+      if (burst[BURST - 1] == 0xFF) return 1;
+    } while (millis() < timeout);
+    return 0;
+  }
+
   /* Despiselect card and release SPI                                         */
 
   void despiselect(void) {
@@ -419,11 +482,49 @@ class ArduinoSpiIO : public BaseIO {
     return 1; /* Function succeeded */
   }
 
+  /* Receive the data packets of a multiple block read (CMD18)           */
+
+  UINT rcvr_datablocks(            /* Number of blocks not received */
+                       BYTE *buff, /* Data buffer */
+                       UINT count  /* Number of 512 byte blocks */
+  ) {
+    BYTE burst[BURST];
+    UINT have = 0, pos = 0; /* received and processed bytes of burst */
+
+    while (count) {
+      BYTE token = 0xFF;
+      uint32_t end = millis() + 200;
+      for (;;) { /* Wait for DataStart token in timeout of 200ms */
+        while (pos < have && (token = burst[pos++]) == 0xFF);
+        if (token != 0xFF || millis() >= end) break;
+        rcvr_spi_multi(burst, BURST);
+        have = BURST;
+        pos = 0;
+      }
+      if (token != 0xFE) break; /* Invalid DataStart token or timeout */
+
+      UINT ready = have - pos; /* Data bytes from the burst of the token */
+      memcpy(buff, burst + pos, ready);
+      rcvr_spi_multi(buff + ready, 512 - ready);
+      buff += 512;
+      if (--count) {
+        /* CRC of this block and start of the wait for the next one */
+        rcvr_spi_multi(burst, BURST);
+        have = BURST;
+        pos = 2;
+      } else {
+        xchg_spi(0xFF);
+        xchg_spi(0xFF); /* Discard CRC */
+      }
+    }
+    return count;
+  }
+
   /* Send a data packet to the MMC                                         */
 
 #if FF_IO_USE_WRITE
-  int xmit_datablock(            /* 1:OK, 0:Failed */
-                     BYTE *buff, /* Ponter to 512 byte data to be sent */
+  int xmit_datablock(                  /* 1:OK, 0:Failed */
+                     const BYTE *buff, /* Ponter to 512 byte data to be sent */
                      BYTE token  /* Token */
   ) {
     BYTE resp;
@@ -442,6 +543,27 @@ class ArduinoSpiIO : public BaseIO {
     }
     return 1;
   }
+
+  /* Send the data packets of a multiple block write (CMD25)              */
+
+  UINT xmit_datablocks(                  /* Number of blocks not written */
+                       const BYTE *buff, /* Data of count blocks */
+                       UINT count        /* Number of 512 byte blocks */
+  ) {
+    BYTE tail[3]; /* Dummy CRC and data resp */
+
+    while (count) {
+      if (!wait_ready_burst(500)) return count;
+      xchg_spi(0xFC); /* Send token */
+      xmit_spi_multi(buff, 512);
+      rcvr_spi_multi(tail, sizeof(tail));
+      if ((tail[2] & 0x1F) != 0x05)
+        return count; /* The data packet was not accepted */
+      buff += 512;
+      count--;
+    }
+    return 0;
+  }
 #endif
 
   /* Send a command packet to the MMC                                      */
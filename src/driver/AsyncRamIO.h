@@ -0,0 +1,161 @@
+// SPDX-License-Identifier: MIT
+#pragma once
+
+#ifndef ARDUINO
+
+#include <chrono>
+#include <deque>
+#include <thread>
+#include "RamIO.h"
+
+#if FF_USE_ASYNC
+
+namespace fatfs {
+
+/**
+ * @brief RamIO with an asynchronous request queue and artificial latency,
+ * for the desktop/native build only. It behaves like a controller with a
+ * single DMA channel: the submitted requests are processed one after the
+ * other (each one takes latencyUs plus sectorUs per sector) while the
+ * caller keeps running, and the data is only transferred when a request
+ * finishes. Synchronous disk_read()/disk_write() calls first wait for all
+ * pending requests and take the same time. The request queue is not
+ * synchronized: use it from one thread only. FatFs does not let readers
+ * share the volume lock on it (allowsConcurrentReads() is false).
+ * @ingroup io
+ */
+class AsyncRamIO : public RamIO {
+ public:
+  AsyncRamIO(int sectorCount, int sectorSize = FF_MAX_SS, long latencyUs = 200,
+             long sectorUs = 5)
+      : RamIO(sectorCount, sectorSize),
+        latency_us(latencyUs),
+        sector_us(sectorUs) {}
+
+  DRESULT disk_read(BYTE pdrv, BYTE* buff, LBA_t sector, UINT count) override {
+    wait_until(finish_all());
+    wait_until(clock::now() + duration(count));
+    return RamIO::disk_read(pdrv, buff, sector, count);
+  }
+
+  DRESULT disk_write(BYTE pdrv, const BYTE* buff, LBA_t sector,
+                     UINT count) override {
+    wait_until(finish_all());
+    wait_until(clock::now() + duration(count));
+    return RamIO::disk_write(pdrv, buff, sector, count);
+  }
+
+  bool isAsync() override { return true; }
+  bool allowsConcurrentReads() override { return false; }
+
+  io_request_t disk_read_submit(BYTE pdrv, BYTE* buff, LBA_t sector,
+                                UINT count) override {
+    return submit(pdrv, false, buff, sector, count);
+  }
+
+  io_request_t disk_write_submit(BYTE pdrv, const BYTE* buff, LBA_t sector,
+                                 UINT count) override {
+    return submit(pdrv, true, (BYTE*)buff, sector, count);
+  }
+
+  bool disk_poll(io_request_t req) override {
+    process(clock::now());
+    Request* r = find(req);
+    return r == nullptr || r->done;
+  }
+
+  DRESULT disk_complete(io_request_t req) override {
+    Request* r = find(req);
+    if (r == nullptr) return RES_PARERR;
+    wait_until(r->due);
+    process(r->due);
+    DRESULT result = r->result;
+    r->req = 0;  // released
+    while (!queue.empty() && queue.front().req == 0) queue.pop_front();
+    return result;
+  }
+
+  /// Number of requests which have been submitted and not completed yet
+  size_t pending() {
+    size_t result = 0;
+    for (auto& r : queue) {
+      if (r.req != 0) result++;
+    }
+    return result;
+  }
+  /// Maximum number of requests which were in flight at the same time
+  size_t maxPending() { return max_pending; }
+  /// Number of requests which have been submitted
+  size_t submitted() { return submit_count; }
+
+ protected:
+  using clock = std::chrono::steady_clock;
+  struct Request {
+    io_request_t req;
+    BYTE pdrv;
+    bool write;
+    bool done;
+    BYTE* buff;
+    LBA_t sector;
+    UINT count;
+    clock::time_point due;
+    DRESULT result;
+  };
+  std::deque<Request> queue;
+  clock::time_point channel_free = clock::now();
+  long latency_us;
+  long sector_us;
+  size_t max_pending = 0;
+  size_t submit_count = 0;
+
+  clock::duration duration(UINT count) {
+    return std::chrono::microseconds(latency_us + sector_us * (long)count);
+  }
+
+  void wait_until(clock::time_point time) {
+    std::this_thread::sleep_until(time);
+  }
+
+  io_request_t submit(BYTE pdrv, bool write, BYTE* buff, LBA_t sector,
+                      UINT count) {
+    if (pdrv != 0 || status == STA_NOINIT) return 0;
+    clock::time_point now = clock::now();
+    clock::time_point start = channel_free > now ? channel_free : now;
+    channel_free = start + duration(count);
+    queue.push_back({async_next_req(), pdrv, write, false, buff, sector, count,
+                     channel_free, RES_OK});
+    submit_count++;
+    if (pending() > max_pending) max_pending = pending();
+    return queue.back().req;
+  }
+
+  Request* find(io_request_t req) {
+    for (auto& r : queue) {
+      if (r.req == req && req != 0) return &r;
+    }
+    return nullptr;
+  }
+
+  /// transfers the data of the requests which are due (in submit order)
+  void process(clock::time_point now) {
+    for (auto& r : queue) {
+      if (r.due > now) break;
+      if (r.done) continue;
+      r.result = r.write ? RamIO::disk_write(r.pdrv, r.buff, r.sector, r.count)
+                         : RamIO::disk_read(r.pdrv, r.buff, r.sector, r.count);
+      r.done = true;
+      if (async_cb) async_cb(r.req, r.result, async_ref);
+    }
+  }
+
+  /// processes all pending requests and returns the time when they end
+  clock::time_point finish_all() {
+    process(channel_free);
+    return channel_free;
+  }
+};
+
+}  // namespace fatfs
+
+#endif  // FF_USE_ASYNC
+#endif  // !ARDUINO
@@ -0,0 +1,398 @@
+// SPDX-License-Identifier: MIT
+#pragma once
+
+#include <stdlib.h>
+#include <cstring>
+#include <vector>
+#include "IO.h"
+#include "../ff/ffcache.h"
+#if FF_FS_SHARED_READ
+#include <mutex>
+#endif
+
+namespace fatfs {
+
+/**
+ * @brief Fast LZ77 codec which uses the LZ4 block format: sequences of a
+ * token (literal length / match length - 4), the literals and a 2 byte
+ * offset of the match. The compressor finds matches of 4 bytes with a hash
+ * table, which the caller provides, so it does not need any stack or heap.
+ * @ingroup io
+ */
+class Lz4Codec {
+ public:
+  static const int HASH_BITS = 10;
+  static const int HASH_SIZE = 1 << HASH_BITS;
+
+  /// compresses n bytes and returns the compressed size (0: it does not fit
+  /// into cap bytes)
+  static size_t compress(const uint8_t* src, size_t n, uint8_t* dst,
+                         size_t cap, uint16_t table[HASH_SIZE]) {
+    const size_t MINMATCH = 4;
+    size_t ip = 0, anchor = 0, op = 0;
+    memset(table, 0, HASH_SIZE * sizeof(uint16_t));
+    while (ip + MINMATCH <= n) {
+      uint32_t seq = read32(src + ip);
+      uint32_t h = (seq * 2654435761u) >> (32 - HASH_BITS);
+      size_t ref = table[h];  // position + 1 (0: empty)
+      table[h] = (uint16_t)(ip + 1);
+      if (ref == 0 || read32(src + ref - 1) != seq) {
+        ip++;
+        continue;
+      }
+      ref--;
+      size_t len = MINMATCH;
+      while (ip + len < n && src[ref + len] == src[ip + len]) len++;
+      if (!sequence(src + anchor, ip - anchor, ip - ref, len, dst, cap, op))
+        return 0;
+      ip += len;
+      anchor = ip;
+    }
+    // the last sequence only has literals
+    if (!sequence(src + anchor, n - anchor, 0, 0, dst, cap, op)) return 0;
+    return op;
+  }
+
+  /// decompresses into n bytes: returns false if the data is corrupt
+  static bool decompress(const uint8_t* src, size_t len, uint8_t* dst,
+                         size_t n) {
+    size_t ip = 0, op = 0;
+    while (ip < len) {
+      uint8_t token = src[ip++];
+      size_t lit = token >> 4;
+      if (lit == 15 && !length(src, len, ip, lit)) return false;
+      if (ip + lit > len || op + lit > n) return false;
+      memcpy(dst + op, src + ip, lit);
+      ip += lit;
+      op += lit;
+      if (ip == len) return op == n;  // the last sequence has no match
+      if (ip + 2 > len) return false;
+      size_t ofs = src[ip] | (src[ip + 1] << 8);
+      ip += 2;
+      size_t match = token & 15;
+      if (match == 15 && !length(src, len, ip, match)) return false;
+      match += 4;
+      if (ofs == 0 || ofs > op || op + match > n) return false;
+      if (ofs >= match) {
+        memcpy(dst + op, dst + op - ofs, match);
+        op += match;
+      } else {  // overlapping: repeats the last ofs bytes
+        for (size_t j = 0; j < match; j++, op++) dst[op] = dst[op - ofs];
+      }
+    }
+    return false;
+  }
+
+ protected:
+  static uint32_t read32(const uint8_t* p) {
+    uint32_t result;
+    memcpy(&result, p, sizeof(result));
+    return result;
+  }
+
+  /// writes the rest of a length of 15 or more
+  static bool put_length(size_t len, uint8_t* dst, size_t cap, size_t& op) {
+    for (; len >= 255; len -= 255) {
+      if (op >= cap) return false;
+      dst[op++] = 255;
+    }
+    if (op >= cap) return false;
+    dst[op++] = (uint8_t)len;
+    return true;
+  }
+
+  /// reads the rest of a length of 15 or more
+  static bool length(const uint8_t* src, size_t len, size_t& ip,
+                     size_t& value) {
+    uint8_t b;
+    do {
+      if (ip >= len) return false;
+      b = src[ip++];
+      value += b;
+    } while (b == 255);
+    return true;
+  }
+
+  /// writes a sequence (match 0: literals only)
+  static bool sequence(const uint8_t* lit, size_t nlit, size_t ofs,
+                       size_t match, uint8_t* dst, size_t cap, size_t& op) {
+    size_t m = match ? match - 4 : 0;
+    if (op >= cap) return false;
+    dst[op++] = (uint8_t)(((nlit < 15 ? nlit : 15) << 4) | (m < 15 ? m : 15));
+    if (nlit >= 15 && !put_length(nlit - 15, dst, cap, op)) return false;
+    if (op + nlit > cap) return false;
+    memcpy(dst + op, lit, nlit);
+    op += nlit;
+    if (match == 0) return true;
+    if (op + 2 > cap) return false;
+    dst[op++] = (uint8_t)ofs;
+    dst[op++] = (uint8_t)(ofs >> 8);
+    if (m >= 15 && !put_length(m - 15, dst, cap, op)) return false;
+    return true;
+  }
+};
+
+/**
+ * @brief RAM disk which keeps each sector compressed (Lz4Codec), so that a
+ * larger volume fits into the available memory: FAT and directory sectors,
+ * free space and text files typically compress very well. Sectors which
+ * only contain zeros take no memory at all, and sectors which do not
+ * compress are stored as they are.
+ *
+ * The recently used sectors are kept uncompressed in an LRU cache
+ * (SectorCache, 8 sectors by default), which also collects the writes: a
+ * sector only gets compressed when it leaves the cache or with CTRL_SYNC.
+ * CTRL_TRIM releases the sectors.
+ * @ingroup io
+ */
+class CompressedRamIO : public IO {
+ public:
+  CompressedRamIO(int sectorCount, int sectorSize = FF_MAX_SS,
+                  int cacheSectors = 8)
+      : sector_count(sectorCount),
+        sector_size(sectorSize),
+        cache_sectors(cacheSectors) {}
+
+  ~CompressedRamIO() {
+    release();
+    delete[] work_buffer;
+  }
+
+  /// Defines the number of uncompressed sectors in the LRU cache. This is
+  /// applied in disk_initialize().
+  void setCacheSize(int sectors) { cache_sectors = sectors; }
+  /// Provides access to the cache (e.g. hit/miss counters)
+  SectorCache& getCache() { return cache; }
+
+  /// Provides the size of the data which has been written (sectors which
+  /// are not empty) when it leaves the cache
+  size_t rawBytes() { return used_sectors * sector_size; }
+  /// Provides the memory which is used for the compressed sectors
+  size_t compressedBytes() { return stored_bytes; }
+  /// Provides the compression ratio (raw / compressed bytes)
+  float compressionRatio() {
+    return stored_bytes == 0 ? 1.0f : (float)rawBytes() / stored_bytes;
+  }
+  /// Provides the memory which is used in total: compressed sectors, the
+  /// sector table, the cache and the work buffers
+  size_t memoryUsage() {
+    return stored_bytes + blocks.capacity() * sizeof(uint8_t*) +
+           (cache.size() + 1) * sector_size +
+           sizeof(uint16_t) * Lz4Codec::HASH_SIZE;
+  }
+
+  // custom logic on mount: we need to format the drive (only once)
+  FRESULT mount(FatFs& fs, BYTE pdrv = 0) override;
+
+  DSTATUS disk_initialize(BYTE pdrv) override {
+    if (pdrv != 0) return STA_NODISK;
+    if (blocks.empty()) {
+      blocks.assign(sector_count, nullptr);
+      scratch = (uint8_t*)malloc(sector_size);
+      UINT entries = cache_sectors > 0 ? cache_sectors : 1;
+      if (scratch == nullptr || !cache.begin(entries, sector_size)) {
+        release();
+        return STA_NOINIT;
+      }
+    }
+    status = STA_CLEAR;
+    return status;
+  }
+
+  DSTATUS disk_status(BYTE pdrv) override {
+    if (pdrv != 0) return STA_NODISK;
+    return status;
+  }
+
+  DRESULT disk_read(BYTE pdrv, BYTE* buffer, LBA_t sectorNo,
+                    UINT sectorCount) override {
+    if (pdrv != 0 || status == STA_NOINIT) return RES_NOTRDY;
+    if (sectorNo + sectorCount > sector_count) return RES_ERROR;
+#if FF_FS_SHARED_READ
+    std::lock_guard<std::mutex> guard(mtx);  // concurrent readers
+#endif
+    for (UINT j = 0; j < sectorCount; j++, buffer += sector_size) {
+      BYTE* data = load(sectorNo + j);
+      if (data == nullptr) return RES_ERROR;
+      memcpy(buffer, data, sector_size);
+    }
+    return RES_OK;
+  }
+
+  DRESULT disk_write(BYTE pdrv, const BYTE* buffer, LBA_t sectorNo,
+                     UINT sectorCount) override {
+    if (pdrv != 0 || status == STA_NOINIT) return RES_NOTRDY;
+    if (sectorNo + sectorCount > sector_count) return RES_ERROR;
+#if FF_FS_SHARED_READ
+    std::lock_guard<std::mutex> guard(mtx);
+#endif
+    for (UINT j = 0; j < sectorCount; j++, buffer += sector_size) {
+      int idx = cache.find(sectorNo + j);
+      if (idx < 0) {
+        idx = evict();
+        if (idx < 0) return RES_ERROR;
+      }
+      memcpy(cache.buffer(idx), buffer, sector_size);
+      cache.assign(idx, sectorNo + j, true);
+    }
+    return RES_OK;
+  }
+
+  bool allowsConcurrentReads() override { return true; }
+
+  DRESULT disk_ioctl(BYTE pdrv, ioctl_cmd_t cmd, void* buffer) override {
+    if (pdrv) return RES_PARERR;
+#if FF_FS_SHARED_READ
+    std::lock_guard<std::mutex> guard(mtx);
+#endif
+    switch (cmd) {
+      case CTRL_SYNC:  // compress the dirty sectors of the cache
+        for (UINT j = 0; j < cache.size(); j++) {
+          if (cache.isDirty(j) && !store(j)) return RES_ERROR;
+        }
+        return RES_OK;
+
+      case GET_SECTOR_COUNT: {
+        DWORD result = sector_count;
+        memcpy(buffer, &result, sizeof(result));
+        return RES_OK;
+      }
+
+      case GET_BLOCK_SIZE: {
+        DWORD result = 1;
+        memcpy(buffer, &result, sizeof(result));
+        return RES_OK;
+      }
+
+      case CTRL_TRIM: {
+        DWORD range[2];
+        memcpy(&range, buffer, sizeof(range));
+        if (blocks.empty() || range[0] > range[1] || range[1] >= sector_count)
+          return RES_PARERR;
+        cache.invalidate(range[0], range[1] - range[0] + 1);
+        for (DWORD s = range[0]; s <= range[1]; s++) put(s, nullptr, 0);
+        return RES_OK;
+      }
+
+      default:
+        return RES_PARERR;
+    }
+  }
+
+ protected:
+  std::vector<uint8_t*> blocks;  // per sector: 2 byte length + data
+  SectorCache cache;
+  uint8_t* scratch = nullptr;    // compressed data
+  uint16_t table[Lz4Codec::HASH_SIZE];
+  size_t sector_count;
+  int sector_size;
+  int cache_sectors;
+  size_t stored_bytes = 0;
+  size_t used_sectors = 0;
+  bool has_volume = false;
+  DSTATUS status = STA_NOINIT;
+  uint8_t* work_buffer = nullptr;
+#if FF_FS_SHARED_READ
+  std::mutex mtx;
+#endif
+
+  /// provides the cache entry with the sector (nullptr if out of memory)
+  BYTE* load(LBA_t sectorNo) {
+    int idx = cache.find(sectorNo);
+    if (idx >= 0) {
+      cache.countHit();
+      cache.touch(idx);
+      return cache.buffer(idx);
+    }
+    cache.countMiss();
+    idx = evict();
+    if (idx < 0) return nullptr;
+    BYTE* data = cache.buffer(idx);
+    uint8_t* block = blocks[sectorNo];
+    if (block == nullptr) {
+      memset(data, 0, sector_size);
+    } else {
+      size_t len = block[0] | (block[1] << 8);
+      if (len == (size_t)sector_size) {
+        memcpy(data, block + 2, sector_size);
+      } else if (!Lz4Codec::decompress(block + 2, len, data, sector_size)) {
+        return nullptr;
+      }
+    }
+    cache.assign(idx, sectorNo, false);
+    return data;
+  }
+
+  /// provides a free cache entry: the least recently used one gets
+  /// compressed if it is dirty (-1: out of memory)
+  int evict() {
+    int idx = cache.victim();
+    if (cache.isDirty(idx) && !store(idx)) return -1;
+    return idx;
+  }
+
+  /// compresses a dirty cache entry
+  bool store(int idx) {
+    const uint8_t* data = cache.buffer(idx);
+    size_t len = 0;
+    bool zero = true;
+    for (int j = 0; j < sector_size && zero; j++) zero = data[j] == 0;
+    if (!zero) {
+      len = Lz4Codec::compress(data, sector_size, scratch, sector_size - 1,
+                               table);
+      if (len == 0) {  // does not compress: keep it as it is
+        memcpy(scratch, data, sector_size);
+        len = sector_size;
+      }
+    }
+    if (!put(cache.sector(idx), scratch, len)) return false;
+    cache.setDirty(idx, false);
+    return true;
+  }
+
+  /// replaces the stored data of a sector (len 0: empty sector)
+  bool put(LBA_t sectorNo, const uint8_t* data, size_t len) {
+    uint8_t* block = nullptr;
+    if (len > 0) {
+      block = (uint8_t*)malloc(len + 2);
+      if (block == nullptr) return false;
+      block[0] = (uint8_t)len;
+      block[1] = (uint8_t)(len >> 8);
+      memcpy(block + 2, data, len);
+      stored_bytes += len + 2;
+      used_sectors++;
+    }
+    uint8_t* old = blocks[sectorNo];
+    if (old != nullptr) {
+      stored_bytes -= (old[0] | (old[1] << 8)) + 2;
+      used_sectors--;
+      free(old);
+    }
+    blocks[sectorNo] = block;
+    return true;
+  }
+
+  void release() {
+    for (auto* ptr : blocks) free(ptr);
+    blocks.clear();
+    blocks.shrink_to_fit();
+    free(scratch);
+    scratch = nullptr;
+    cache.end();
+    stored_bytes = 0;
+    used_sectors = 0;
+    has_volume = false;
+  }
+};
+
+inline FRESULT CompressedRamIO::mount(FatFs& fs, BYTE pdrv) {
+  if (!has_volume) {
+    if (work_buffer == nullptr) work_buffer = new uint8_t[FF_MAX_SS];
+    char path[6];
+    snprintf(path, sizeof(path), "%d:", pdrv);
+    has_volume = fs.f_mkfs(path, nullptr, work_buffer, FF_MAX_SS) == FR_OK;
+  }
+  return IO::mount(fs, pdrv);
+}
+
+}  // namespace fatfs
@@ -4,7 +4,9 @@
 #ifndef ARDUINO
 
 #include <cstdio>
+#include <cstdint>
 #include <cstring>
+#include <mutex>
 #include "IO.h"
 
 namespace fatfs {
@@ -21,6 +23,9 @@ namespace fatfs {
  * the same way RamIO always does - but only once, since after that the
  * image is no longer blank. To force-reformat an existing image, either
  * delete the file first or call SDClass::mkfs() explicitly.
+ *
+ * Sector reads and writes may come from several threads at the same time
+ * (FF_FS_SHARED_READ): each seek and transfer is done as one step.
  * @ingroup io
  */
 class FileIO : public IO {
@@ -36,7 +41,8 @@ class FileIO : public IO {
   }
 
   FRESULT mount(FatFs& fs, BYTE pdrv = 0) override {
-    if (disk_initialize(pdrv) & STA_NOINIT) return FR_NOT_READY;
+    // pdrv is the logical drive (e.g. in a MultiIO): only open the image here
+    if (file == nullptr && !open_or_create()) return FR_NOT_READY;
     if (just_created) {
       char drive_path[6];
       snprintf(drive_path, sizeof(drive_path), "%d:", pdrv);
@@ -61,8 +67,8 @@ class FileIO : public IO {
   DRESULT disk_read(BYTE pdrv, BYTE* buff, LBA_t sector, UINT count) override {
     if (pdrv != 0) return RES_NOTRDY;
     if (status == STA_NOINIT) return RES_NOTRDY;
-    if (fseek(file, (long)(sector * sector_size), SEEK_SET) != 0)
-      return RES_ERROR;
+    std::lock_guard<std::mutex> guard(file_mutex);
+    if (seek((uint64_t)sector * sector_size) != 0) return RES_ERROR;
     size_t n = fread(buff, sector_size, count, file);
     return n == count ? RES_OK : RES_ERROR;
   }
@@ -71,20 +77,24 @@ class FileIO : public IO {
                      UINT count) override {
     if (pdrv != 0) return RES_NOTRDY;
     if (status == STA_NOINIT) return RES_NOTRDY;
-    if (fseek(file, (long)(sector * sector_size), SEEK_SET) != 0)
-      return RES_ERROR;
+    std::lock_guard<std::mutex> guard(file_mutex);
+    if (seek((uint64_t)sector * sector_size) != 0) return RES_ERROR;
     size_t n = fwrite(buff, sector_size, count, file);
     return n == count ? RES_OK : RES_ERROR;
   }
 
+  bool allowsConcurrentReads() override { return true; }
+
   DRESULT disk_ioctl(BYTE pdrv, ioctl_cmd_t cmd, void* buff) override {
     if (pdrv != 0) return RES_PARERR;
     switch (cmd) {
-      case CTRL_SYNC:
+      case CTRL_SYNC: {
+        std::lock_guard<std::mutex> guard(file_mutex);
         return fflush(file) == 0 ? RES_OK : RES_ERROR;
+      }
 
       case GET_SECTOR_COUNT: {
-        DWORD result = (DWORD)sector_count;
+        LBA_t result = (LBA_t)sector_count;
         memcpy(buff, &result, sizeof(result));
         return RES_OK;
       }
@@ -105,10 +115,30 @@ class FileIO : public IO {
   size_t sector_count;
   size_t sector_size;
   FILE* file = nullptr;
+  std::mutex file_mutex;  // the file position is shared by all threads
   uint8_t* work_buffer = nullptr;
   DSTATUS status = STA_NOINIT;
   bool just_created = false;
 
+  /// sets the file position: fseek() only supports offsets up to LONG_MAX
+  /// (2 GB with a 32 bit long)
+  int seek(uint64_t pos) {
+#ifdef _WIN32
+    return _fseeki64(file, (__int64)pos, SEEK_SET);
+#else
+    if ((uint64_t)(off_t)pos != pos) return -1;  // 32 bit off_t
+    return fseeko(file, (off_t)pos, SEEK_SET);
+#endif
+  }
+
+  uint64_t tell() {
+#ifdef _WIN32
+    return (uint64_t)_ftelli64(file);
+#else
+    return (uint64_t)ftello(file);
+#endif
+  }
+
   bool open_or_create() {
     file = fopen(path, "r+b");
     just_created = (file == nullptr);
@@ -119,10 +149,10 @@ class FileIO : public IO {
     // grow (sparsely) to the requested size if the file is smaller, whether
     // freshly created or a pre-existing image that's too small
     if (fseek(file, 0, SEEK_END) != 0) return false;
-    long current_size = ftell(file);
-    long wanted_size = (long)(sector_count * sector_size);
+    uint64_t current_size = tell();
+    uint64_t wanted_size = (uint64_t)sector_count * sector_size;
     if (current_size < wanted_size) {
-      if (fseek(file, wanted_size - 1, SEEK_SET) != 0) return false;
+      if (seek(wanted_size - 1) != 0) return false;
       uint8_t zero = 0;
       if (fwrite(&zero, 1, 1, file) != 1) return false;
       fflush(file);
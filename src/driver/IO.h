@@ -8,6 +8,9 @@
 #pragma once
 #include <cstdio>
 #include "../ff/ffdef.h"
+#if FF_USE_ASYNC && FF_FS_SHARED_READ
+#include <mutex>
+#endif
 
 
 namespace fatfs {
@@ -66,6 +69,13 @@ enum ioctl_cmd_t {
   ATA_GET_SN = 22     /* Get serial number */
 };
 
+#if FF_USE_ASYNC
+/// Identifies a request which has been submitted to a driver (0: invalid)
+typedef uint32_t io_request_t;
+/// Called by a driver when a submitted request has been completed
+typedef void (*io_callback_t)(io_request_t req, DRESULT result, void* ref);
+#endif
+
 /**
  *  @brief FatFS interface definition
  *  @ingroup io
@@ -86,8 +96,126 @@ class IO {
   virtual DRESULT disk_write(BYTE pdrv, const BYTE* buff, LBA_t sector,
                              UINT count) = 0;
   virtual DRESULT disk_ioctl(BYTE pdrv, ioctl_cmd_t cmd, void* buff) = 0;
+  /// Returns true if disk_read() can be called by several threads at the
+  /// same time. Only then FatFs lets readers share the lock of a volume
+  /// (FF_FS_SHARED_READ); otherwise every call locks it exclusively.
+  virtual bool allowsConcurrentReads() { return false; }
+
+#if FF_USE_ASYNC
+  /// Starts reading sectors and returns the id of the request (0: not
+  /// started, the caller reads synchronously instead). The buffer must stay
+  /// valid until the request has been completed. The default implementation
+  /// reads synchronously.
+  virtual io_request_t disk_read_submit(BYTE pdrv, BYTE* buff, LBA_t sector,
+                                        UINT count) {
+    io_request_t req = async_reserve();
+    if (req != 0) async_done(req, disk_read(pdrv, buff, sector, count));
+    return req;
+  }
+  /// Starts writing sectors and returns the id of the request (0: not
+  /// started, the caller writes synchronously instead). The buffer must stay
+  /// valid until the request has been completed. The default implementation
+  /// writes synchronously.
+  virtual io_request_t disk_write_submit(BYTE pdrv, const BYTE* buff,
+                                         LBA_t sector, UINT count) {
+    io_request_t req = async_reserve();
+    if (req != 0) async_done(req, disk_write(pdrv, buff, sector, count));
+    return req;
+  }
+  /// Returns true when the request has been completed
+  virtual bool disk_poll(io_request_t) { return true; }
+  /// Waits for the end of the request and returns its result: each request
+  /// needs to be completed once. The default implementation keeps the
+  /// results of FF_ASYNC_DEPTH requests (from all threads together): when
+  /// they are all pending, the submit returns 0.
+  virtual DRESULT disk_complete(io_request_t req) {
+    DRESULT result = RES_PARERR;
+    async_lock();
+    for (auto& slot : async_results) {
+      if (req != 0 && slot.req == req) {
+        slot.req = 0;
+        result = slot.result;
+        break;
+      }
+    }
+    async_unlock();
+    return result;
+  }
+  /// Returns true if the driver implements the requests itself, false if it
+  /// uses the synchronous default implementation
+  virtual bool isAsync() { return false; }
+  /// Defines the function which is called when a request has been completed
+  /// (by the default implementation already before the submit returns)
+  void setCompletionCallback(io_callback_t cb, void* ref = nullptr) {
+    async_cb = cb;
+    async_ref = ref;
+  }
+#endif
 
   FATFS fatfs;
+
+#if FF_USE_ASYNC
+ protected:
+  struct AsyncResult {
+    io_request_t req = 0;
+    DRESULT result = RES_OK;
+  };
+  AsyncResult async_results[FF_ASYNC_DEPTH];
+  io_request_t async_last_req = 0;
+  io_callback_t async_cb = nullptr;
+  void* async_ref = nullptr;
+#if FF_FS_SHARED_READ
+  std::mutex async_mutex;  // ids and results: concurrent readers
+#endif
+
+  void async_lock() {
+#if FF_FS_SHARED_READ
+    async_mutex.lock();
+#endif
+  }
+
+  void async_unlock() {
+#if FF_FS_SHARED_READ
+    async_mutex.unlock();
+#endif
+  }
+
+  /// provides a new request id (never 0)
+  io_request_t async_next_req() {
+    async_lock();
+    if (++async_last_req == 0) async_last_req = 1;
+    io_request_t req = async_last_req;
+    async_unlock();
+    return req;
+  }
+
+  /// synchronous adapter: provides a new request id with a free result slot
+  /// (0: all slots are taken by pending requests)
+  io_request_t async_reserve() {
+    io_request_t req = 0;
+    async_lock();
+    for (auto& s : async_results) {
+      if (s.req == 0) {
+        if (++async_last_req == 0) async_last_req = 1;
+        req = async_last_req;
+        s = {req, RES_OK};
+        break;
+      }
+    }
+    async_unlock();
+    return req;
+  }
+
+  /// synchronous adapter: records the result of a request which is done
+  void async_done(io_request_t req, DRESULT result) {
+    async_lock();
+    for (auto& s : async_results) {
+      if (s.req == req) s.result = result;
+    }
+    async_unlock();
+    if (async_cb) async_cb(req, result, async_ref);
+  }
+#endif
 };
 
 }  // namespace fatfs
@@ -0,0 +1,207 @@
+// SPDX-License-Identifier: MIT
+#pragma once
+
+#if !defined(ARDUINO) && !defined(_WIN32)
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cstdint>
+#include <cstring>
+#include "IO.h"
+
+namespace fatfs {
+
+/**
+ * @brief Disk image like FileIO, but the file is mapped into memory (POSIX
+ * mmap): sector reads and writes are plain memory copies from and to the
+ * mapping, and the OS pages the image in and out. This is for the host side
+ * image tooling which processes large (multi GB) images; on a 32 bit host
+ * the image needs to fit into the address space.
+ *
+ * CTRL_SYNC writes the changes back to the file (msync, see setDurable())
+ * and CTRL_TRIM punches holes into the image file (fallocate on Linux,
+ * otherwise the sectors are only cleared). As with FileIO, a new image is formatted on
+ * the first mount().
+ *
+ * Concurrent reads (FF_FS_SHARED_READ) do not need any lock.
+ * @ingroup io
+ */
+class MmapFileIO : public IO {
+ public:
+  /// path is the disk image file; it is created (sectorCount * sectorSize
+  /// bytes, sparse) if it does not exist yet, or opened as-is if it does.
+  MmapFileIO(const char* path, size_t sectorCount, size_t sectorSize = 512)
+      : path(path), sector_count(sectorCount), sector_size(sectorSize) {}
+
+  ~MmapFileIO() {
+    close();
+    delete[] work_buffer;
+  }
+
+  FRESULT mount(FatFs& fs, BYTE pdrv = 0) override {
+    if (disk_initialize(0) & STA_NOINIT) return FR_NOT_READY;
+    if (just_created) {
+      char drive_path[6];
+      snprintf(drive_path, sizeof(drive_path), "%d:", pdrv);
+      if (work_buffer == nullptr) work_buffer = new uint8_t[FF_MAX_SS];
+      fs.f_mkfs(drive_path, nullptr, work_buffer, FF_MAX_SS);
+    }
+    return IO::mount(fs, pdrv);
+  }
+
+  DSTATUS disk_initialize(BYTE pdrv) override {
+    if (pdrv != 0) return STA_NODISK;
+    if (map == nullptr && !open_or_create()) {
+      close();
+      return STA_NODISK;
+    }
+    status = STA_CLEAR;
+    return status;
+  }
+
+  DSTATUS disk_status(BYTE pdrv) override {
+    if (pdrv != 0) return STA_NODISK;
+    return status;
+  }
+
+  DRESULT disk_read(BYTE pdrv, BYTE* buff, LBA_t sector, UINT count) override {
+    if (pdrv != 0) return RES_NOTRDY;
+    if (status == STA_NOINIT) return RES_NOTRDY;
+    if (!isValid(sector, count)) return RES_ERROR;
+    memcpy(buff, map + (uint64_t)sector * sector_size,
+           (size_t)count * sector_size);
+    return RES_OK;
+  }
+
+  DRESULT disk_write(BYTE pdrv, const BYTE* buff, LBA_t sector,
+                     UINT count) override {
+    if (pdrv != 0) return RES_NOTRDY;
+    if (status == STA_NOINIT) return RES_NOTRDY;
+    if (!isValid(sector, count)) return RES_ERROR;
+    memcpy(map + (uint64_t)sector * sector_size, buff,
+           (size_t)count * sector_size);
+    return RES_OK;
+  }
+
+  bool allowsConcurrentReads() override { return true; }
+
+  DRESULT disk_ioctl(BYTE pdrv, ioctl_cmd_t cmd, void* buff) override {
+    if (pdrv != 0) return RES_PARERR;
+    switch (cmd) {
+      case CTRL_SYNC:
+        if (map == nullptr) return RES_NOTRDY;
+        return msync(map, map_size, durable ? MS_SYNC : MS_ASYNC) == 0
+                   ? RES_OK
+                   : RES_ERROR;
+
+      case GET_SECTOR_COUNT: {
+        LBA_t result = (LBA_t)sector_count;
+        memcpy(buff, &result, sizeof(result));
+        return RES_OK;
+      }
+
+      case GET_BLOCK_SIZE: {
+        DWORD result = 1;
+        memcpy(buff, &result, sizeof(result));
+        return RES_OK;
+      }
+
+      case CTRL_TRIM: {
+        LBA_t range[2];
+        memcpy(&range, buff, sizeof(range));
+        if (map == nullptr || range[0] > range[1] ||
+            !isValid(range[0], range[1] - range[0] + 1))
+          return RES_PARERR;
+        return trim(range[0], range[1] - range[0] + 1) ? RES_OK : RES_ERROR;
+      }
+
+      default:
+        return RES_PARERR;
+    }
+  }
+
+  /// With true, CTRL_SYNC waits until the changes are on the disk (like
+  /// fsync). By default it only schedules the write back: the changes are
+  /// visible to the other processes as soon as they are in the mapping.
+  void setDurable(bool flag) { durable = flag; }
+  bool isDurable() { return durable; }
+
+  /// Provides direct access to the mapped image (nullptr before
+  /// disk_initialize())
+  uint8_t* data() { return map; }
+  /// Provides the size of the mapped image in bytes
+  size_t size() { return map_size; }
+
+ protected:
+  const char* path;
+  size_t sector_count;
+  size_t sector_size;
+  int fd = -1;
+  uint8_t* map = nullptr;
+  size_t map_size = 0;
+  uint8_t* work_buffer = nullptr;
+  DSTATUS status = STA_NOINIT;
+  bool just_created = false;
+  bool durable = false;
+
+  bool isValid(LBA_t sector, LBA_t count) {
+    return sector < sector_count && count <= sector_count - sector;
+  }
+
+  /// releases the sectors: the file gets a hole and the mapping reads zeros
+  bool trim(LBA_t sector, LBA_t count) {
+    uint64_t pos = (uint64_t)sector * sector_size;
+    uint64_t len = (uint64_t)count * sector_size;
+#if defined(__linux__) && defined(FALLOC_FL_PUNCH_HOLE)
+    if (fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, (off_t)pos,
+                  (off_t)len) == 0)
+      return true;
+#endif
+    // no hole punching (file system or OS): just clear the sectors
+    memset(map + pos, 0, len);
+    return true;
+  }
+
+  bool open_or_create() {
+    uint64_t wanted_size = (uint64_t)sector_count * sector_size;
+    if (wanted_size == 0 || wanted_size > SIZE_MAX ||
+        (uint64_t)(off_t)wanted_size != wanted_size)
+      return false;
+    fd = ::open(path, O_RDWR);
+    just_created = fd < 0;
+    if (just_created) {
+      fd = ::open(path, O_RDWR | O_CREAT, 0644);
+      if (fd < 0) return false;
+    }
+    // grow (sparsely) to the requested size if the file is smaller
+    struct stat st;
+    if (fstat(fd, &st) != 0) return false;
+    if ((uint64_t)st.st_size < wanted_size &&
+        ftruncate(fd, (off_t)wanted_size) != 0)
+      return false;
+    void* ptr = mmap(nullptr, (size_t)wanted_size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED, fd, 0);
+    if (ptr == MAP_FAILED) return false;
+    map = (uint8_t*)ptr;
+    map_size = (size_t)wanted_size;
+    return true;
+  }
+
+  void close() {
+    if (map != nullptr) {
+      if (durable) msync(map, map_size, MS_SYNC);
+      munmap(map, map_size);
+      map = nullptr;
+      map_size = 0;
+    }
+    if (fd >= 0) ::close(fd);
+    fd = -1;
+    status = STA_NOINIT;
+  }
+};
+
+}  // namespace fatfs
+
+#endif  // !ARDUINO && !_WIN32
@@ -8,13 +8,64 @@
 // include path), which isn't guaranteed if src/ gets vendored into
 // another project instead of installed as a regular dependency.
 #include "../fatfs.h"
+#include <algorithm>
+#if FF_FS_SHARED_READ
+#include <mutex>
+#endif
 
 namespace fatfs {
 
+/// How MultiIO presents its drivers
+enum MultiIOMode {
+  /// each driver is a separate volume on its own logical drive number
+  MULTI_VOLUMES,
+  /// all drivers form one device: the sectors are distributed over the
+  /// drivers in stripes (RAID-0)
+  MULTI_STRIPE,
+  /// all drivers form one device: each sector is stored on every driver
+  /// (RAID-1)
+  MULTI_MIRROR,
+  /// all drivers form one device: the sectors of the drivers follow each
+  /// other (linear span)
+  MULTI_CONCAT,
+};
+
+/// State of a driver in MULTI_MIRROR mode
+enum MirrorState {
+  /// the driver contains all data
+  MIRROR_OK,
+  /// the driver had an error: it is no longer used
+  MIRROR_FAILED,
+  /// the driver gets all writes, and resync() copies the other sectors
+  MIRROR_REBUILDING,
+};
+
 /**
  * @brief File system driver which supports multiple drives:
  * Add the drivers by calling add()
  * then call mount() to mount the drives.
+ *
+ * With setMode(MULTI_STRIPE) the drivers are combined into one device on
+ * drive 0 instead: the consecutive stripes go to the drivers in turn, so a
+ * large request is split and each driver transfers its part. With
+ * FF_USE_ASYNC the parts for drivers with asynchronous requests (isAsync())
+ * are submitted before the first one is completed, so these drivers work in
+ * parallel; the other drivers are called directly. The
+ * combined device is not formatted automatically: call f_mkfs() (or
+ * SDClass::mkfs()) once.
+ *
+ * With setMode(MULTI_MIRROR) every sector is written to all drivers, and the
+ * reads are distributed over the drivers: the requests in turn, and large
+ * requests in parts of stripeSectors. A driver which reports an error is
+ * marked as failed and no longer used, and the device keeps working
+ * (degraded) as long as one driver is left. A new or repaired driver is
+ * added with replace() and then copied in steps by resync(), e.g. from
+ * loop(); resync() must not run at the same time as a write.
+ *
+ * With setMode(MULTI_CONCAT) the device consists of all sectors of the first
+ * driver, followed by all sectors of the second one and so on; the drivers
+ * can have different sizes. Requests which cross the end of a driver are
+ * split.
  * @ingroup io
  */
 
@@ -22,13 +73,108 @@ class MultiIO : public IO {
  public:
   MultiIO() = default;
 
-  void add(IO& io) { io_vector.push_back(&io); }
+  void add(IO& io) {
+    io_vector.push_back(&io);
+    states.push_back(MIRROR_OK);
+    error_counts.push_back(0);
+  }
+
+  /// Defines how the drivers are presented: stripeSectors is the number of
+  /// consecutive sectors which are stored on one driver (MULTI_STRIPE)
+  void setMode(MultiIOMode mode, UINT stripeSectors = 64) {
+    this->mode = mode;
+    stripe = stripeSectors > 0 ? stripeSectors : 1;
+  }
+  MultiIOMode getMode() { return mode; }
+
+  /// State of a driver (MULTI_MIRROR)
+  MirrorState getState(int member) {
+    lock();
+    MirrorState result = states[member];
+    unlock();
+    return result;
+  }
+  /// Number of errors which were reported by the driver
+  unsigned long errors(int member) { return error_counts[member]; }
+  /// Returns true if not all drivers contain all data (MULTI_MIRROR)
+  bool isDegraded() {
+    for (auto state : states) {
+      if (state != MIRROR_OK) return true;
+    }
+    return false;
+  }
+  /// Stops using a driver (e.g. when the card has been removed)
+  void setFailed(int member) { fail(member); }
+
+  /// Replaces a driver (or adds the same one again after it has failed):
+  /// it gets all writes from now on, and resync() copies the data
+  bool replace(int member, IO& io) {
+    if (member < 0 || member >= (int)io_vector.size()) return false;
+    if (io.disk_initialize(0) & (STA_NOINIT | STA_NODISK)) return false;
+    LBA_t count = 0;
+    if (io.disk_ioctl(0, GET_SECTOR_COUNT, &count) != RES_OK ||
+        count < member_sectors)
+      return false;
+    lock();
+    io_vector[member] = &io;
+    states[member] = MIRROR_REBUILDING;
+    resync_pos = 0;
+    unlock();
+    return true;
+  }
+
+  /// Copies the next sectors to the drivers which are rebuilt: returns true
+  /// when there is nothing left to do
+  bool resync(UINT sectors = 64) {
+    int source = -1;
+    bool rebuilding = false;
+    for (int j = 0; j < (int)states.size(); j++) {
+      if (states[j] == MIRROR_OK && source < 0) source = j;
+      if (states[j] == MIRROR_REBUILDING) rebuilding = true;
+    }
+    if (!rebuilding) return true;
+    if (source < 0) return false;  // no driver with the data
+    if (resync_pos < member_sectors) {
+      LBA_t left = member_sectors - resync_pos;
+      UINT count = left < sectors ? (UINT)left : sectors;
+      resync_buffer.resize((size_t)count * sector_size());
+      if (io_vector[source]->disk_read(0, resync_buffer.data(), resync_pos,
+                                       count) != RES_OK) {
+        fail(source);
+        return false;
+      }
+      for (int j = 0; j < (int)states.size(); j++) {
+        if (states[j] == MIRROR_REBUILDING &&
+            io_vector[j]->disk_write(0, resync_buffer.data(), resync_pos,
+                                     count) != RES_OK)
+          fail(j);
+      }
+      resync_pos += count;
+      if (resync_pos < member_sectors) return false;
+    }
+    // all sectors copied: the drivers are complete after a sync
+    for (int j = 0; j < (int)states.size(); j++) {
+      if (states[j] != MIRROR_REBUILDING) continue;
+      if (io_vector[j]->disk_ioctl(0, CTRL_SYNC, nullptr) == RES_OK) {
+        lock();
+        states[j] = MIRROR_OK;
+        unlock();
+      } else {
+        fail(j);
+      }
+    }
+    return true;
+  }
+
+  /// Next sector which resync() copies
+  LBA_t resyncPosition() { return resync_pos; }
 
   /// mount all the added drivers, each on its own logical drive number
   /// matching its index (requires FF_VOLUMES >= io_vector.size())
   FRESULT mount(FatFs& fs, BYTE pdrv = 0) override {
+    if (mode != MULTI_VOLUMES) return IO::mount(fs, pdrv);
     FRESULT rc = FR_OK;
-    for (int j = 0; j < io_vector.size(); j++) {
+    for (int j = 0; j < (int)io_vector.size(); j++) {
       rc = io_vector[j]->mount(fs, j);
       if (rc != FR_OK) break;
     }
@@ -37,8 +183,9 @@ class MultiIO : public IO {
 
   /// unmount all drivers
   FRESULT un_mount(FatFs& fs, BYTE pdrv = 0) override {
+    if (mode != MULTI_VOLUMES) return IO::un_mount(fs, pdrv);
     FRESULT result = FR_OK;
-    for (int j = 0; j < io_vector.size(); j++) {
+    for (int j = 0; j < (int)io_vector.size(); j++) {
       auto rc = io_vector[j]->un_mount(fs, j);
       if (rc != FR_OK) result = rc;
     }
@@ -46,29 +193,401 @@ class MultiIO : public IO {
   }
 
   DSTATUS disk_initialize(BYTE pdrv) override {
+    if (mode != MULTI_VOLUMES) return initialize_all(pdrv);
     if (pdrv >= io_vector.size()) return STA_NODISK;
     return io_vector[pdrv]->disk_initialize(0);
   };
   DSTATUS disk_status(BYTE pdrv) override {
+    if (mode != MULTI_VOLUMES) return status_all(pdrv);
     if (pdrv >= io_vector.size()) return STA_NODISK;
     return io_vector[pdrv]->disk_status(0);
   }
   DRESULT disk_read(BYTE pdrv, BYTE* buff, LBA_t sector, UINT count) override {
+    if (mode != MULTI_VOLUMES)
+      return transfer(pdrv, buff, sector, count, false);
     if (pdrv >= io_vector.size()) return RES_NOTRDY;
     return io_vector[pdrv]->disk_read(0, buff, sector, count);
   }
   DRESULT disk_write(BYTE pdrv, const BYTE* buff, LBA_t sector,
                      UINT count) override {
+    if (mode != MULTI_VOLUMES)
+      return transfer(pdrv, (BYTE*)buff, sector, count, true);
     if (pdrv >= io_vector.size()) return RES_NOTRDY;
     return io_vector[pdrv]->disk_write(0, buff, sector, count);
   }
+  /// true if all drivers accept concurrent reads
+  bool allowsConcurrentReads() override {
+    for (auto io : io_vector) {
+      if (!io->allowsConcurrentReads()) return false;
+    }
+    return true;
+  }
   DRESULT disk_ioctl(BYTE pdrv, ioctl_cmd_t cmd, void* buff) override {
+    if (mode != MULTI_VOLUMES) return ioctl_all(pdrv, cmd, buff);
     if (pdrv >= io_vector.size()) return RES_NOTRDY;
     return io_vector[pdrv]->disk_ioctl(0, cmd, buff);
   }
 
  protected:
+  /// part of a request which is handled by one driver
+  struct Piece {
+    int member;
+    LBA_t sector;  // on the driver
+    UINT count;
+    BYTE* buff;
+    DRESULT result;
+  };
+  static const int MAX_ROUND = 16;  // pieces which are submitted together
   std::vector<IO*> io_vector;
+  MultiIOMode mode = MULTI_VOLUMES;
+  UINT stripe = 64;
+  LBA_t member_sectors = 0;  // usable sectors per driver
+  LBA_t total_sectors = 0;   // of the combined device
+  std::vector<LBA_t> ends;   // first sector after each driver (MULTI_CONCAT)
+  std::vector<MirrorState> states;
+  std::vector<unsigned long> error_counts;
+  std::vector<BYTE> resync_buffer;
+  LBA_t resync_pos = 0;
+  unsigned next_read = 0;  // first driver of the next read (MULTI_MIRROR)
+#if FF_FS_SHARED_READ
+  std::mutex state_mutex;  // states and next_read: concurrent readers
+  std::mutex round_mutex;  // pending requests of asynchronous drivers
+#endif
+
+  void lock() {
+#if FF_FS_SHARED_READ
+    state_mutex.lock();
+#endif
+  }
+
+  void unlock() {
+#if FF_FS_SHARED_READ
+    state_mutex.unlock();
+#endif
+  }
+
+  /// marks a driver as failed (MULTI_MIRROR)
+  void fail(int member) {
+    lock();
+    states[member] = MIRROR_FAILED;
+    error_counts[member]++;
+    unlock();
+  }
+
+  /// marks a driver as failed after an error of the medium: RES_PARERR is
+  /// an error of the request
+  void on_error(int member, DRESULT result) {
+    if (result != RES_OK && result != RES_PARERR) fail(member);
+  }
+
+  bool isValid(BYTE pdrv, LBA_t sector, LBA_t count) {
+    return pdrv == 0 && !io_vector.empty() && sector < total_sectors &&
+           count <= total_sectors - sector;
+  }
+
+  /// determines the driver of a sector and the number of the following
+  /// sectors (up to count) which are stored there in one piece
+  Piece locate(LBA_t sector, LBA_t count) {
+    if (mode == MULTI_CONCAT) return locate_concat(sector, count);
+    LBA_t n = io_vector.size();
+    LBA_t index = sector / stripe;  // stripe of the device
+    UINT offset = sector % stripe;
+    UINT avail = stripe - offset;
+    Piece result;
+    result.member = (int)(index % n);
+    result.sector = (index / n) * stripe + offset;
+    result.count = count < avail ? (UINT)count : avail;
+    return result;
+  }
+
+  /// binary search in the end sectors of the drivers
+  Piece locate_concat(LBA_t sector, LBA_t count) {
+    auto end = std::upper_bound(ends.begin(), ends.end(), sector);
+    int member = (int)(end - ends.begin());
+    LBA_t first = member == 0 ? 0 : ends[member - 1];
+    LBA_t avail = *end - sector;
+    Piece result;
+    result.member = member;
+    result.sector = sector - first;
+    result.count = (UINT)(count < avail ? count : avail);
+    return result;
+  }
+
+  DSTATUS initialize_all(BYTE pdrv) {
+    if (pdrv != 0 || io_vector.empty()) return STA_NODISK;
+    bool mirror = mode == MULTI_MIRROR;
+    bool found = false;
+    member_sectors = 0;
+    ends.clear();
+    for (int j = 0; j < (int)io_vector.size(); j++) {
+      if (mirror && states[j] == MIRROR_FAILED) continue;
+      DSTATUS rc = io_vector[j]->disk_initialize(0);
+      LBA_t count = 0;
+      if (!(rc & (STA_NOINIT | STA_NODISK))) {
+        rc = io_vector[j]->disk_ioctl(0, GET_SECTOR_COUNT, &count) == RES_OK
+                 ? STA_CLEAR
+                 : STA_NOINIT;
+      }
+      if (rc & (STA_NOINIT | STA_NODISK)) {
+        if (!mirror) return rc;
+        fail(j);  // degraded
+        continue;
+      }
+      if (!found || count < member_sectors) member_sectors = count;
+      found = true;
+      ends.push_back((ends.empty() ? 0 : ends.back()) + count);
+    }
+    if (!found) return STA_NOINIT;
+    if (mirror) {
+      total_sectors = member_sectors;
+    } else if (mode == MULTI_CONCAT) {
+      total_sectors = ends.back();
+    } else {
+      // only complete stripes
+      member_sectors = member_sectors / stripe * stripe;
+      total_sectors = member_sectors * io_vector.size();
+    }
+    return STA_CLEAR;
+  }
+
+  DSTATUS status_all(BYTE pdrv) {
+    if (pdrv != 0 || io_vector.empty()) return STA_NODISK;
+    DSTATUS result = STA_CLEAR;
+    bool found = false;
+    for (int j = 0; j < (int)io_vector.size(); j++) {
+      if (mode == MULTI_MIRROR && states[j] == MIRROR_FAILED) continue;
+      result = (DSTATUS)(result | io_vector[j]->disk_status(0));
+      found = true;
+    }
+    return found ? result : STA_NOINIT;
+  }
+
+  /// splits the request into pieces: each round submits up to
+  /// FF_ASYNC_DEPTH pieces per driver, which are then completed
+  DRESULT transfer(BYTE pdrv, BYTE* buff, LBA_t sector, LBA_t count,
+                   bool write) {
+    if (!isValid(pdrv, sector, count)) return RES_PARERR;
+    if (mode == MULTI_MIRROR) {
+      return write ? mirror_write(buff, sector, count)
+                   : mirror_read(buff, sector, count);
+    }
+    UINT size = sector_size();
+    Piece pieces[MAX_ROUND];
+    while (count > 0) {
+      int n = 0;
+      while (count > 0 && n < round_size((int)io_vector.size())) {
+        Piece& p = pieces[n++];
+        p = locate(sector, count);
+        p.buff = buff;
+        buff += (size_t)p.count * size;
+        sector += p.count;
+        count -= p.count;
+      }
+      execute(pieces, n, write);
+      for (int j = 0; j < n; j++) {
+        if (pieces[j].result != RES_OK) return pieces[j].result;
+      }
+    }
+    return RES_OK;
+  }
+
+  /// writes the sectors to all drivers which are not failed: at least one
+  /// driver with all data needs to succeed
+  DRESULT mirror_write(BYTE* buff, LBA_t sector, LBA_t count) {
+    Piece pieces[MAX_ROUND];
+    bool complete[MAX_ROUND];
+    bool written = false;
+    for (int first = 0; first < (int)io_vector.size(); first += MAX_ROUND) {
+      int n = 0;
+      for (int j = first; j < (int)io_vector.size() && n < MAX_ROUND; j++) {
+        MirrorState state = getState(j);
+        if (state == MIRROR_FAILED) continue;
+        complete[n] = state == MIRROR_OK;
+        pieces[n++] = {j, sector, (UINT)count, buff, RES_OK};
+      }
+      execute(pieces, n, true);
+      for (int j = 0; j < n; j++) {
+        if (pieces[j].result != RES_OK) {
+          on_error(pieces[j].member, pieces[j].result);
+        } else if (complete[j]) {
+          written = true;
+        }
+      }
+    }
+    return written ? RES_OK : RES_ERROR;
+  }
+
+  /// reads the sectors from the drivers with all data: large requests are
+  /// split into stripes which are read from the drivers in turn, and a
+  /// failed part is read again from another driver
+  DRESULT mirror_read(BYTE* buff, LBA_t sector, LBA_t count) {
+    int ok[MAX_ROUND];
+    int n_ok = 0;
+    lock();
+    for (int j = 0; j < (int)states.size() && n_ok < MAX_ROUND; j++) {
+      if (states[j] == MIRROR_OK) ok[n_ok++] = j;
+    }
+    unsigned start = next_read++;
+    unlock();
+    if (n_ok == 0) return RES_ERROR;
+
+    UINT size = sector_size();
+    Piece pieces[MAX_ROUND];
+    for (unsigned k = 0; count > 0;) {
+      int n = 0;
+      while (count > 0 && n < round_size(n_ok)) {
+        Piece& p = pieces[n++];
+        p.member = ok[(start + k++) % n_ok];
+        p.sector = sector;
+        p.count = count < stripe ? (UINT)count : stripe;
+        p.buff = buff;
+        buff += (size_t)p.count * size;
+        sector += p.count;
+        count -= p.count;
+      }
+      execute(pieces, n, false);
+      for (int j = 0; j < n; j++) {
+        Piece& p = pieces[j];
+        if (p.result == RES_OK) continue;
+        on_error(p.member, p.result);
+        for (int m = 0; m < n_ok && p.result != RES_OK; m++) {
+          if (getState(ok[m]) != MIRROR_OK) continue;
+          p.result = io_vector[ok[m]]->disk_read(0, p.buff, p.sector, p.count);
+          on_error(ok[m], p.result);
+        }
+        if (p.result != RES_OK) return RES_ERROR;
+      }
+    }
+    return RES_OK;
+  }
+
+  /// number of pieces which are transferred together by the drivers
+  int round_size(int drivers) {
+#if FF_USE_ASYNC
+    int result = drivers * FF_ASYNC_DEPTH;
+    return result < MAX_ROUND ? result : MAX_ROUND;
+#else
+    return 1;
+#endif
+  }
+
+  /// transfers the pieces: with FF_USE_ASYNC the pieces of asynchronous
+  /// drivers are all submitted before the first one is completed, and the
+  /// other pieces are transferred directly in the meantime
+  void execute(Piece* pieces, int n, bool write) {
+#if FF_USE_ASYNC
+    io_request_t req[MAX_ROUND];
+    bool async = false;
+    for (int j = 0; j < n; j++) {
+      if (io_vector[pieces[j].member]->isAsync()) async = true;
+    }
+    // the drivers only keep FF_ASYNC_DEPTH requests: one round at a time
+#if FF_FS_SHARED_READ
+    if (async) round_mutex.lock();
+#endif
+    for (int j = 0; j < n; j++) {
+      Piece& p = pieces[j];
+      IO* io = io_vector[p.member];
+      req[j] = 0;
+      if (!io->isAsync()) {
+        p.result = transfer_piece(p, write);
+      } else {
+        req[j] = write ? io->disk_write_submit(0, p.buff, p.sector, p.count)
+                       : io->disk_read_submit(0, p.buff, p.sector, p.count);
+        // not started by the driver: transfer it directly
+        if (req[j] == 0) p.result = transfer_piece(p, write);
+      }
+    }
+    for (int j = 0; j < n; j++) {
+      if (req[j] == 0) continue;
+      Piece& p = pieces[j];
+      p.result = io_vector[p.member]->disk_complete(req[j]);
+    }
+#if FF_FS_SHARED_READ
+    if (async) round_mutex.unlock();
+#endif
+#else
+    for (int j = 0; j < n; j++) {
+      pieces[j].result = transfer_piece(pieces[j], write);
+    }
+#endif
+  }
+
+  /// transfers a piece synchronously
+  DRESULT transfer_piece(Piece& p, bool write) {
+    IO* io = io_vector[p.member];
+    return write ? io->disk_write(0, p.buff, p.sector, p.count)
+                 : io->disk_read(0, p.buff, p.sector, p.count);
+  }
+
+  DRESULT ioctl_all(BYTE pdrv, ioctl_cmd_t cmd, void* buff) {
+    if (pdrv != 0 || io_vector.empty()) return RES_PARERR;
+    switch (cmd) {
+      case CTRL_SYNC: {
+        DRESULT result = RES_OK;
+        for (int j = 0; j < (int)io_vector.size(); j++) {
+          if (mode == MULTI_MIRROR && states[j] == MIRROR_FAILED) continue;
+          DRESULT rc = io_vector[j]->disk_ioctl(0, CTRL_SYNC, nullptr);
+          if (rc == RES_OK) continue;
+          if (mode == MULTI_MIRROR) {
+            fail(j);
+          } else {
+            result = rc;
+          }
+        }
+        if (mode == MULTI_MIRROR && status_all(pdrv) == STA_NOINIT)
+          result = RES_ERROR;
+        return result;
+      }
+
+      case GET_SECTOR_COUNT:
+        memcpy(buff, &total_sectors, sizeof(total_sectors));
+        return RES_OK;
+
+      case GET_BLOCK_SIZE: {
+        if (mode == MULTI_CONCAT) return io_vector[0]->disk_ioctl(0, cmd, buff);
+        DWORD result = stripe;
+        memcpy(buff, &result, sizeof(result));
+        return RES_OK;
+      }
+
+      case CTRL_TRIM: {
+        LBA_t range[2];
+        memcpy(range, buff, sizeof(range));
+        if (range[0] > range[1] ||
+            !isValid(pdrv, range[0], range[1] - range[0] + 1))
+          return RES_PARERR;
+        if (mode == MULTI_MIRROR) {
+          for (int j = 0; j < (int)io_vector.size(); j++) {
+            if (states[j] != MIRROR_FAILED)
+              io_vector[j]->disk_ioctl(0, CTRL_TRIM, range);
+          }
+          return RES_OK;
+        }
+        for (LBA_t s = range[0]; s <= range[1];) {
+          Piece p = locate(s, range[1] - s + 1);
+          LBA_t piece[2] = {p.sector, p.sector + p.count - 1};
+          io_vector[p.member]->disk_ioctl(0, CTRL_TRIM, piece);
+          s += p.count;
+        }
+        return RES_OK;
+      }
+
+      default:
+        return io_vector[0]->disk_ioctl(0, cmd, buff);
+    }
+  }
+
+  /// sector size of the drivers (all need to use the same)
+  UINT sector_size() {
+#if FF_MAX_SS != FF_MIN_SS
+    WORD size = FF_MIN_SS;
+    io_vector[0]->disk_ioctl(0, GET_SECTOR_SIZE, &size);
+    return size;
+#else
+    return FF_MAX_SS;
+#endif
+  }
 };
 
-}  // namespace fatfs
\ No newline at end of file
+}  // namespace fatfs
@@ -0,0 +1,223 @@
+// SPDX-License-Identifier: MIT
+#pragma once
+
+#if !defined(ARDUINO) && !defined(_WIN32)
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include "IO.h"
+
+namespace fatfs {
+
+/**
+ * @brief Disk image like FileIO, but on a POSIX file descriptor with
+ * positional I/O (pread/pwrite with 64 bit offsets): there is no shared file
+ * position, so concurrent sector reads (FF_FS_SHARED_READ) do not need any
+ * lock.
+ *
+ * With setDirect(true) the image is opened with O_DIRECT (where the OS and
+ * the file system support it) to bypass the page cache. The transfers then
+ * need aligned memory: aligned buffers are used as they are, and all others
+ * are copied through an internal aligned buffer. The sector size should be
+ * a multiple of the logical block size of the device (usually 512 or 4096).
+ *
+ * GET_BLOCK_SIZE reports the preferred I/O size of the file (st_blksize) in
+ * sectors.
+ * @ingroup io
+ */
+class PosixFileIO : public IO {
+ public:
+  /// path is the disk image file; it is created (sectorCount * sectorSize
+  /// bytes, sparse) if it does not exist yet, or opened as-is if it does.
+  PosixFileIO(const char* path, size_t sectorCount, size_t sectorSize = 512)
+      : path(path), sector_count(sectorCount), sector_size(sectorSize) {}
+
+  ~PosixFileIO() {
+    if (fd >= 0) close(fd);
+    free(bounce);
+    delete[] work_buffer;
+  }
+
+  /// Requests O_DIRECT: this is applied in disk_initialize()
+  void setDirect(bool flag) { direct = flag; }
+  /// Returns true if the image has been opened with O_DIRECT
+  bool isDirect() { return is_direct; }
+
+  FRESULT mount(FatFs& fs, BYTE pdrv = 0) override {
+    if (disk_initialize(0) & STA_NOINIT) return FR_NOT_READY;
+    if (just_created) {
+      char drive_path[6];
+      snprintf(drive_path, sizeof(drive_path), "%d:", pdrv);
+      if (work_buffer == nullptr) work_buffer = new uint8_t[FF_MAX_SS];
+      fs.f_mkfs(drive_path, nullptr, work_buffer, FF_MAX_SS);
+    }
+    return IO::mount(fs, pdrv);
+  }
+
+  DSTATUS disk_initialize(BYTE pdrv) override {
+    if (pdrv != 0) return STA_NODISK;
+    if (fd < 0 && !open_or_create()) return STA_NODISK;
+    status = STA_CLEAR;
+    return status;
+  }
+
+  DSTATUS disk_status(BYTE pdrv) override {
+    if (pdrv != 0) return STA_NODISK;
+    return status;
+  }
+
+  DRESULT disk_read(BYTE pdrv, BYTE* buff, LBA_t sector, UINT count) override {
+    if (pdrv != 0) return RES_NOTRDY;
+    if (status == STA_NOINIT) return RES_NOTRDY;
+    if (!isValid(sector, count)) return RES_ERROR;
+    uint64_t pos = (uint64_t)sector * sector_size;
+    size_t len = (size_t)count * sector_size;
+    if (!is_direct || isAligned(buff)) {
+      return transfer(buff, len, pos, false) ? RES_OK : RES_ERROR;
+    }
+    std::lock_guard<std::mutex> guard(bounce_mutex);
+    for (size_t done = 0; done < len; done += BOUNCE_SIZE) {
+      size_t n = len - done < BOUNCE_SIZE ? len - done : BOUNCE_SIZE;
+      if (!transfer(bounce, n, pos + done, false)) return RES_ERROR;
+      memcpy(buff + done, bounce, n);
+    }
+    return RES_OK;
+  }
+
+  DRESULT disk_write(BYTE pdrv, const BYTE* buff, LBA_t sector,
+                     UINT count) override {
+    if (pdrv != 0) return RES_NOTRDY;
+    if (status == STA_NOINIT) return RES_NOTRDY;
+    if (!isValid(sector, count)) return RES_ERROR;
+    uint64_t pos = (uint64_t)sector * sector_size;
+    size_t len = (size_t)count * sector_size;
+    if (!is_direct || isAligned(buff)) {
+      return transfer((BYTE*)buff, len, pos, true) ? RES_OK : RES_ERROR;
+    }
+    std::lock_guard<std::mutex> guard(bounce_mutex);
+    for (size_t done = 0; done < len; done += BOUNCE_SIZE) {
+      size_t n = len - done < BOUNCE_SIZE ? len - done : BOUNCE_SIZE;
+      memcpy(bounce, buff + done, n);
+      if (!transfer(bounce, n, pos + done, true)) return RES_ERROR;
+    }
+    return RES_OK;
+  }
+
+  bool allowsConcurrentReads() override { return true; }
+
+  DRESULT disk_ioctl(BYTE pdrv, ioctl_cmd_t cmd, void* buff) override {
+    if (pdrv != 0) return RES_PARERR;
+    switch (cmd) {
+      case CTRL_SYNC:
+        if (fd < 0) return RES_NOTRDY;
+#ifdef __APPLE__
+        return fsync(fd) == 0 ? RES_OK : RES_ERROR;  // no fdatasync()
+#else
+        return fdatasync(fd) == 0 ? RES_OK : RES_ERROR;
+#endif
+
+      case GET_SECTOR_COUNT: {
+        LBA_t result = (LBA_t)sector_count;
+        memcpy(buff, &result, sizeof(result));
+        return RES_OK;
+      }
+
+      case GET_BLOCK_SIZE: {
+        DWORD result = block_size / sector_size;
+        if (result == 0) result = 1;
+        memcpy(buff, &result, sizeof(result));
+        return RES_OK;
+      }
+
+      default:
+        return RES_PARERR;
+    }
+  }
+
+ protected:
+  static const size_t ALIGNMENT = 4096;
+  static const size_t BOUNCE_SIZE = 64 * 1024;
+  const char* path;
+  size_t sector_count;
+  size_t sector_size;
+  size_t block_size = 0;  // st_blksize
+  int fd = -1;
+  uint8_t* bounce = nullptr;  // aligned buffer for O_DIRECT
+  std::mutex bounce_mutex;
+  uint8_t* work_buffer = nullptr;
+  DSTATUS status = STA_NOINIT;
+  bool just_created = false;
+  bool direct = false;
+  bool is_direct = false;
+
+  bool isValid(LBA_t sector, UINT count) {
+    return sector < sector_count && count <= sector_count - sector;
+  }
+
+  bool isAligned(const BYTE* buff) {
+    return (uintptr_t)buff % ALIGNMENT == 0;
+  }
+
+  /// reads or writes len bytes at pos: continues after partial transfers
+  /// and interrupts
+  bool transfer(BYTE* buff, size_t len, uint64_t pos, bool write) {
+    while (len > 0) {
+      ssize_t n = write ? pwrite(fd, buff, len, (off_t)pos)
+                        : pread(fd, buff, len, (off_t)pos);
+      if (n < 0 && errno == EINTR) continue;
+      if (n <= 0) return false;
+      buff += n;
+      pos += n;
+      len -= n;
+    }
+    return true;
+  }
+
+  int open_file(int flags) {
+#ifdef O_DIRECT
+    if (direct) {
+      int result = ::open(path, flags | O_DIRECT, 0644);
+      if (result >= 0) {
+        is_direct = true;
+        return result;
+      }
+      // O_DIRECT is not supported by the file system (e.g. tmpfs)
+      if (errno != EINVAL) return result;
+    }
+#endif
+    is_direct = false;
+    return ::open(path, flags, 0644);
+  }
+
+  bool open_or_create() {
+    uint64_t wanted_size = (uint64_t)sector_count * sector_size;
+    if ((uint64_t)(off_t)wanted_size != wanted_size) return false;
+    fd = open_file(O_RDWR);
+    just_created = fd < 0;
+    if (just_created) fd = open_file(O_RDWR | O_CREAT);
+    if (fd < 0) return false;
+    // grow (sparsely) to the requested size if the file is smaller
+    struct stat st;
+    if (fstat(fd, &st) != 0 ||
+        ((uint64_t)st.st_size < wanted_size &&
+         ftruncate(fd, (off_t)wanted_size) != 0) ||
+        (is_direct && bounce == nullptr &&
+         posix_memalign((void**)&bounce, ALIGNMENT, BOUNCE_SIZE) != 0)) {
+      close(fd);
+      fd = -1;
+      return false;
+    }
+    block_size = st.st_blksize;
+    return true;
+  }
+};
+
+}  // namespace fatfs
+
+#endif  // !ARDUINO && !_WIN32
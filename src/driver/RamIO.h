@@ -2,7 +2,9 @@
 #pragma once
 
 #include <stdlib.h>
+#include <atomic>
 #include <cstring>
+#include <new>
 #include <vector>
 #include "IO.h"
 
@@ -12,9 +14,104 @@
 
 namespace fatfs {
 
+/**
+ * @brief Memory of a chunk of RamIO sectors with a reference count in front
+ * of the data, so that snapshots and clones can share it (copy-on-write).
+ * @ingroup io
+ */
+class RamChunk {
+ public:
+  /// allocates a zeroed chunk with one reference (nullptr if out of memory)
+  static uint8_t* alloc(size_t bytes) {
+    uint8_t* ptr = nullptr;
+#ifdef ESP32
+    ptr = (uint8_t*)ps_calloc(1, HEADER + bytes);
+#endif
+    if (ptr == nullptr) ptr = (uint8_t*)calloc(1, HEADER + bytes);
+    if (ptr == nullptr) return nullptr;
+    new (ptr) std::atomic<int>(1);
+    return ptr + HEADER;
+  }
+  /// adds a reference
+  static void retain(uint8_t* data) {
+    if (data != nullptr) refs(data).fetch_add(1);
+  }
+  /// removes a reference and frees the chunk with the last one
+  static void release(uint8_t* data) {
+    if (data != nullptr && refs(data).fetch_sub(1) == 1) free(data - HEADER);
+  }
+  /// true if the chunk is referenced more than once
+  static bool isShared(uint8_t* data) { return refs(data).load() > 1; }
+
+ protected:
+  static const size_t HEADER = 16;  // keeps the data aligned
+  static std::atomic<int>& refs(uint8_t* data) {
+    return *(std::atomic<int>*)(data - HEADER);
+  }
+};
+
+/**
+ * @brief Content of a RamIO at one point of time (see RamIO::snapshot()). It
+ * shares the memory with the drive (copy-on-write): only the chunks which get
+ * changed afterwards are copied.
+ * @ingroup io
+ */
+class RamSnapshot {
+ public:
+  RamSnapshot() = default;
+  RamSnapshot(const RamSnapshot& other) { *this = other; }
+  ~RamSnapshot() { clear(); }
+
+  RamSnapshot& operator=(const RamSnapshot& other) {
+    if (this == &other) return *this;
+    for (auto* ptr : other.chunks) RamChunk::retain(ptr);
+    clear();
+    chunks = other.chunks;
+    chunk_sectors = other.chunk_sectors;
+    sector_count = other.sector_count;
+    sector_size = other.sector_size;
+    sparse = other.sparse;
+    return *this;
+  }
+
+  /// true if the snapshot contains data
+  explicit operator bool() const { return !chunks.empty(); }
+
+ protected:
+  friend class RamIO;
+  std::vector<uint8_t*> chunks;
+  size_t chunk_sectors = 0;
+  size_t sector_count = 0;
+  int sector_size = 0;
+  bool sparse = false;
+
+  void clear() {
+    for (auto* ptr : chunks) RamChunk::release(ptr);
+    chunks.clear();
+  }
+};
+
 /**
  * @brief The data is stored in RAM. In a ESP32 when PSRAM has been activated we
  * store it is PSRAM.
+ *
+ * The sectors are kept in an arena: one contiguous block, or a few large
+ * chunks of the same size when the memory can not provide a single block
+ * (the chunk size is halved until the allocation succeeds). So there is no
+ * allocator overhead per sector and a multi-sector transfer is a single
+ * memcpy() (one per chunk which it touches).
+ *
+ * In sparse mode (setSparse()) the chunks are only allocated when data is
+ * written to them: unwritten sectors read as zero, writing zeros to them
+ * allocates nothing and CTRL_TRIM releases the chunks which it covers
+ * completely (FatFs sends it for removed data with FF_USE_TRIM). So a large
+ * virtual disk only costs the memory of the sectors which are in use.
+ *
+ * snapshot(), clone() (or the copy constructor) and restore() share the
+ * chunks copy-on-write: e.g. a formatted and populated volume can be forked
+ * for each test without copying any data, and only the chunks which a test
+ * changes get copied. Use small chunks (sparse mode or setChunkSize()) for
+ * this, since a change copies the whole chunk.
  * @ingroup io
  */
 class RamIO : public IO {
@@ -25,30 +122,102 @@ class RamIO : public IO {
     sector_count = sectorCount;
   }
 
+  /// Copy-on-write clone of the current content of another drive
+  RamIO(const RamIO& source) : RamIO(source.snapshot()) {}
+
+  /// Drive with the content of a snapshot (copy-on-write)
+  RamIO(const RamSnapshot& snapshot) {
+    sector_size = snapshot.sector_size;
+    sector_count = snapshot.sector_count;
+    restore(snapshot);
+  }
+
+  RamIO& operator=(const RamIO&) = delete;
+
   ~RamIO() {
-    for (auto* ptr : sectors) {
-      free(ptr);
-    }
+    release();
     delete[] work_buffer;
   }
 
-  // custom logic on mount: we need to format the drive - implementation at end of header
+  /// Defines the maximum number of sectors per allocated chunk (0: as large
+  /// as possible, 1: one allocation per sector). This is applied when the
+  /// memory gets allocated in disk_initialize().
+  void setChunkSize(size_t sectors) { max_chunk_sectors = sectors; }
+  /// Provides the number of sectors per allocated chunk
+  size_t chunkSize() { return chunk_sectors; }
+  /// Provides the number of chunks (in sparse mode also the ones which are
+  /// not allocated)
+  size_t chunkCount() { return chunks.size(); }
+  /// Allocates the chunks of SPARSE_CHUNK_SECTORS sectors (or the chunk
+  /// size) when they are written first. This is applied in disk_initialize().
+  void setSparse(bool active) { sparse = active; }
+  /// Provides true if the chunks are allocated on demand
+  bool isSparse() { return sparse; }
+  /// Provides the memory in bytes which is allocated for sectors (including
+  /// the chunks which are shared with snapshots and clones)
+  size_t residentBytes() { return resident; }
+  /// Provides the memory in bytes of the chunks which are shared with
+  /// snapshots or clones
+  size_t sharedBytes() {
+    size_t result = 0;
+    for (size_t j = 0; j < chunks.size(); j++) {
+      if (chunks[j] != nullptr && RamChunk::isShared(chunks[j]))
+        result += chunk_length(j) * sector_size;
+    }
+    return result;
+  }
+  /// Provides the memory which is used for the sectors and the chunk table
+  size_t memoryUsage() {
+    return resident + chunks.capacity() * sizeof(uint8_t*);
+  }
+
+  /// Default number of sectors per chunk in sparse mode
+  static const size_t SPARSE_CHUNK_SECTORS = 32;
+
+  /// Provides the current content, which shares the memory with the drive.
+  /// FatFs keeps changes in its buffers: unmount the volume (or at least
+  /// close or sync the files) before.
+  RamSnapshot snapshot() const {
+    RamSnapshot result;
+    for (auto* ptr : chunks) RamChunk::retain(ptr);
+    result.chunks = chunks;
+    result.chunk_sectors = chunk_sectors;
+    result.sector_count = sector_count;
+    result.sector_size = sector_size;
+    result.sparse = sparse;
+    return result;
+  }
+
+  /// Copy-on-write clone of the current content
+  RamIO clone() { return RamIO(snapshot()); }
+
+  /// Replaces the content with a snapshot of a drive with the same geometry.
+  /// A mounted volume needs to be mounted again afterwards.
+  bool restore(const RamSnapshot& snapshot) {
+    if (!snapshot.chunks.empty() && (snapshot.sector_count != sector_count ||
+                                     snapshot.sector_size != sector_size))
+      return false;
+    for (auto* ptr : snapshot.chunks) RamChunk::retain(ptr);
+    release();
+    chunks = snapshot.chunks;
+    chunk_sectors = snapshot.chunk_sectors;
+    sparse = snapshot.sparse;
+    for (size_t j = 0; j < chunks.size(); j++) {
+      if (chunks[j] != nullptr) resident += chunk_length(j) * sector_size;
+    }
+    has_volume = !chunks.empty();
+    return true;
+  }
+
+  // custom logic on mount: we need to format the drive (unless it contains a
+  // volume already) - implementation at end of header
   FRESULT mount(FatFs& fs, BYTE pdrv = 0) override;
 
   DSTATUS disk_initialize(BYTE pdrv) override {
     if (pdrv != 0) return STA_NODISK;
     // allocate sectors
-    if (sectors.size() == 0) {
-      for (int j = 0; j < sector_count; j++) {
-        uint8_t* ptr = nullptr;
-#ifdef ESP32
-        ptr = (uint8_t*)ps_malloc(sector_size);
-#endif
-        if (ptr == nullptr) ptr = (uint8_t*)malloc(sector_size);
-        memset(ptr, 0, sector_size);
-        sectors.push_back(ptr);
-      }
-    }
+    if (chunks.empty() && !(sparse ? allocate_sparse() : allocate()))
+      return STA_NOINIT;
     status = STA_CLEAR;
     return status;
   }
@@ -61,11 +230,15 @@ class RamIO : public IO {
   DRESULT disk_read(BYTE pdrv, BYTE* buffer, LBA_t sectorNo, UINT sectorCount) override {
     if (pdrv != 0) return RES_NOTRDY;
     if (status == STA_NOINIT) return RES_NOTRDY;
-    if (sectors.size() == 0 || sectorNo + sectorCount > sector_count) return RES_ERROR;
-    for (int j = sectorNo; j < sectorNo + sectorCount; j++) {
-      int idx = j - sectorNo;
-      uint8_t* source = sectors[j];
-      memcpy(buffer + (idx * sector_size), source , sector_size);
+    if (chunks.empty() || sectorNo + sectorCount > sector_count) return RES_ERROR;
+    for (UINT n; sectorCount > 0; sectorCount -= n, sectorNo += n) {
+      uint8_t* source = run(sectorNo, sectorCount, n);
+      if (source != nullptr) {
+        memcpy(buffer, source, n * sector_size);
+      } else {
+        memset(buffer, 0, n * sector_size);  // sparse: not written yet
+      }
+      buffer += n * sector_size;
     }
     return RES_OK;
   }
@@ -74,15 +247,21 @@ class RamIO : public IO {
                      UINT sectorCount) override {
     if (pdrv != 0) return RES_NOTRDY;
     if (status == STA_NOINIT) return RES_NOTRDY;
-    if (sectors.size() == 0 || sectorNo + sectorCount > sector_count) return RES_ERROR;
-    for (int j = sectorNo; j < sectorNo + sectorCount; j++) {
-      int idx = j - sectorNo;
-      uint8_t* target = sectors[j];
-      memcpy(target, buffer + (idx * sector_size), sector_size);
+    if (chunks.empty() || sectorNo + sectorCount > sector_count) return RES_ERROR;
+    for (UINT n; sectorCount > 0; sectorCount -= n, sectorNo += n) {
+      uint8_t* target = run(sectorNo, sectorCount, n);
+      if (target != nullptr || !is_zero(buffer, n * sector_size)) {
+        target = writable(sectorNo);
+        if (target == nullptr) return RES_ERROR;
+        memcpy(target, buffer, n * sector_size);
+      }
+      buffer += n * sector_size;
     }
     return RES_OK;
   }
 
+  bool allowsConcurrentReads() override { return true; }
+
   DRESULT disk_ioctl(BYTE pdrv, ioctl_cmd_t cmd, void* buffer) override {
     DRESULT res;
     if (pdrv) return RES_PARERR; /* Check parameter */
@@ -110,9 +289,23 @@ class RamIO : public IO {
         DWORD range[2];
         // determine range
         memcpy(&range, buffer, sizeof(range));
-        // clear memory
-        for (int j = range[0]; j <= range[1]; j++) {
-          memset(sectors[j], 0, sector_size);
+        if (chunks.empty() || range[0] > range[1] || range[1] >= sector_count)
+          return RES_PARERR;
+        // clear memory or release the chunks which are covered completely
+        UINT count = range[1] - range[0] + 1;
+        for (UINT n; count > 0; count -= n, range[0] += n) {
+          uint8_t* target = run(range[0], count, n);
+          if (target == nullptr) continue;
+          size_t idx = range[0] / chunk_sectors;
+          if (sparse && n == chunk_length(idx)) {
+            RamChunk::release(chunks[idx]);
+            chunks[idx] = nullptr;
+            resident -= n * sector_size;
+          } else {
+            target = writable(range[0]);
+            if (target == nullptr) return RES_ERROR;
+            memset(target, 0, n * sector_size);
+          }
         }
         res = RES_OK; /* FatFs does not check result of this command */
       } break;
@@ -125,23 +318,116 @@ class RamIO : public IO {
   }
 
  protected:
-  std::vector<uint8_t*> sectors;
+  std::vector<uint8_t*> chunks;  // arena: chunk_sectors sectors per chunk
+  size_t chunk_sectors = 0;
+  size_t max_chunk_sectors = 0;
+  size_t resident = 0;  // allocated bytes
+  bool sparse = false;
+  bool has_volume = false;  // formatted or restored: mount() keeps the data
   DSTATUS status = STA_NOINIT;
   int sector_size = 512;
   size_t sector_count = 0;
   uint8_t *work_buffer = nullptr;
+
+  /// provides the memory of the sector (nullptr if it is not allocated) and
+  /// the number of sectors (up to count) which follow it contiguously
+  uint8_t* run(LBA_t sectorNo, UINT count, UINT& n) {
+    size_t ofs = sectorNo % chunk_sectors;
+    n = chunk_sectors - ofs < count ? (UINT)(chunk_sectors - ofs) : count;
+    uint8_t* chunk = chunks[sectorNo / chunk_sectors];
+    return chunk == nullptr ? nullptr : chunk + ofs * sector_size;
+  }
+
+  /// number of sectors of a chunk (the last one can be shorter)
+  size_t chunk_length(size_t idx) {
+    size_t rest = sector_count - idx * chunk_sectors;
+    return rest < chunk_sectors ? rest : chunk_sectors;
+  }
+
+  /// sparse: only sets up the chunk table
+  bool allocate_sparse() {
+    chunk_sectors = max_chunk_sectors;
+    if (chunk_sectors == 0) chunk_sectors = SPARSE_CHUNK_SECTORS;
+    chunks.assign((sector_count + chunk_sectors - 1) / chunk_sectors, nullptr);
+    return !chunks.empty();
+  }
+
+  /// provides the sector in a chunk which only belongs to this drive: it
+  /// allocates a missing chunk (sparse) and copies a shared one
+  uint8_t* writable(LBA_t sectorNo) {
+    size_t idx = sectorNo / chunk_sectors;
+    uint8_t* chunk = chunks[idx];
+    if (chunk == nullptr || RamChunk::isShared(chunk)) {
+      size_t bytes = chunk_length(idx) * sector_size;
+      uint8_t* copy = RamChunk::alloc(bytes);
+      if (copy == nullptr) return nullptr;
+      if (chunk != nullptr) {
+        memcpy(copy, chunk, bytes);
+        RamChunk::release(chunk);
+      } else {
+        resident += bytes;
+      }
+      chunks[idx] = chunk = copy;
+    }
+    return chunk + sectorNo % chunk_sectors * sector_size;
+  }
+
+  static bool is_zero(const BYTE* data, size_t len) {
+    for (size_t j = 0; j < len; j++) {
+      if (data[j] != 0) return false;
+    }
+    return true;
+  }
+
+  /// allocates zeroed chunks: the largest size which is available
+  bool allocate() {
+    size_t size = sector_count;
+    if (max_chunk_sectors > 0 && max_chunk_sectors < size)
+      size = max_chunk_sectors;
+    for (; size > 0; size /= 2) {
+      size_t count = (sector_count + size - 1) / size;
+      chunks.reserve(count);
+      for (size_t j = 0; j < count; j++) {
+        size_t sectors = j < count - 1 ? size : sector_count - j * size;
+        uint8_t* ptr = RamChunk::alloc(sectors * sector_size);
+        if (ptr == nullptr) break;
+        chunks.push_back(ptr);
+      }
+      if (chunks.size() == count) {
+        chunk_sectors = size;
+        resident = sector_count * sector_size;
+        return true;
+      }
+      release();
+    }
+    return false;
+  }
+
+  void release() {
+    for (auto* ptr : chunks) {
+      RamChunk::release(ptr);
+    }
+    chunks.clear();
+    chunks.shrink_to_fit();
+    chunk_sectors = 0;
+    resident = 0;
+    has_volume = false;
+  }
 };
 
 // Inline implementation (moved from RamIO.cpp)
 inline FRESULT RamIO::mount(FatFs& fs, BYTE pdrv) {
-  // the file system is empty so we need to format it
-  if (work_buffer == nullptr) work_buffer = new uint8_t[FF_MAX_SS];
-  char path[6];
-  snprintf(path, sizeof(path), "%d:", pdrv);
-  fs.f_mkfs(path, nullptr, work_buffer, FF_MAX_SS);
+  // the file system is empty so we need to format it (only once: the
+  // volume is kept when it gets mounted again)
+  if (!has_volume) {
+    if (work_buffer == nullptr) work_buffer = new uint8_t[FF_MAX_SS];
+    char path[6];
+    snprintf(path, sizeof(path), "%d:", pdrv);
+    has_volume = fs.f_mkfs(path, nullptr, work_buffer, FF_MAX_SS) == FR_OK;
+  }
 
   // standard mount logic
   return IO::mount(fs, pdrv);
 }
 
-}  // namespace fatfs
\ No newline at end of file
+}  // namespace fatfs
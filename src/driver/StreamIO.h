@@ -11,6 +11,21 @@ namespace fatfs {
     - seek()
     - sectorCount()
     - eraseSector(from, to)
+ *
+ * The stream position is tracked, so a sequential transfer only calls seek()
+ * for its first request. seek() gets a 64 bit byte offset. If the stream is
+ * also used outside of the driver, call disk_initialize() again afterwards.
+ *
+ * The stream and its tracked position are not locked, so the driver is used
+ * by one thread at a time: it does not allow concurrent reads
+ * (allowsConcurrentReads()), and FatFs locks the volume exclusively for
+ * every call, also with FF_FS_SHARED_READ.
+ *
+ * If the stream also provides
+    - bool readSectors(uint8_t* data, uint64_t sector, size_t count)
+    - bool writeSectors(const uint8_t* data, uint64_t sector, size_t count)
+ * these are used instead of seek() and readBytes()/write() (e.g. for a
+ * multi-block command of a card). This is detected at compile time.
  * @ingroup io
  */
 
@@ -26,6 +41,7 @@ class StreamIO : public IO {
     // we support only 1 disk
     if (pdrv != 0) return STA_NODISK;
     ok = p_stream->begin();
+    position = INVALID;
     if (!ok) return STA_NODISK;
     status = STA_CLEAR;
     return status;
@@ -39,20 +55,14 @@ class StreamIO : public IO {
   DRESULT disk_read(BYTE pdrv, BYTE* buff, LBA_t sector, UINT sectorCount) {
     if (pdrv != 0) return RES_PARERR;
     if (status == STA_NOINIT) return RES_NOTRDY;
-    p_stream->seek(sector * sector_size);
-    size_t len = sectorCount * sector_size;
-    size_t res = p_stream->readBytes(buff, len);
-    return res == len ? RES_OK : RES_ERROR;
+    return read(p_stream, buff, sector, sectorCount, 0);
   }
 
   DRESULT disk_write(BYTE pdrv, const BYTE* buff, LBA_t sector,
                      UINT sectorCount) {
     if (pdrv != 0) return RES_PARERR;
     if (status == STA_NOINIT) return RES_NOTRDY;
-    p_stream->seek(sector * sector_size);
-    size_t len = sectorCount * sector_size;
-    size_t res = p_stream->write(buff, len);
-    return res == len ? RES_OK : RES_ERROR;
+    return write(p_stream, buff, sector, sectorCount, 0);
   }
 
   DRESULT disk_ioctl(BYTE pdrv, ioctl_cmd_t cmd, void* buff) {
@@ -65,7 +75,7 @@ class StreamIO : public IO {
         break;
 
       case GET_SECTOR_COUNT: {  // Get drive capacity in unit of sector (DWORD)
-        DWORD result = p_stream->sectorCount();
+        LBA_t result = p_stream->sectorCount();
         memcpy(buff, &result, (sizeof(result)));
         res = RES_OK;
       } break;
@@ -77,11 +87,12 @@ class StreamIO : public IO {
       } break;
 
       case CTRL_TRIM: {  // Erase a block of sectors (used when _USE_ERASE == 1)
-        DWORD range[2];
+        LBA_t range[2];
         // determine range
         memcpy(range, buff, sizeof(range));
         // clear memory
         p_stream->eraseSector(range[0], range[1]);
+        position = INVALID;
         res = RES_OK; /* FatFs does not check result of this command */
       } break;
 
@@ -93,10 +104,59 @@ class StreamIO : public IO {
   }
 
  protected:
+  static const uint64_t INVALID = ~(uint64_t)0;
   T* p_stream = nullptr;
+  uint64_t position = INVALID;  // of the stream: INVALID if unknown
   bool ok = false;
   int sector_size = 512;
   DSTATUS status = STA_NOINIT;
+
+  /// positions the stream unless it is already there
+  void seek(uint64_t pos) {
+    if (pos != position) p_stream->seek(pos);
+  }
+
+  /// the stream provides readSectors()
+  template <class S>
+  auto read(S* stream, BYTE* buff, LBA_t sector, UINT count, int)
+      -> decltype(stream->readSectors(buff, (uint64_t)sector, (size_t)count),
+                  DRESULT()) {
+    position = INVALID;
+    return stream->readSectors(buff, (uint64_t)sector, (size_t)count)
+               ? RES_OK
+               : RES_ERROR;
+  }
+
+  template <class S>
+  DRESULT read(S* stream, BYTE* buff, LBA_t sector, UINT count, long) {
+    uint64_t pos = (uint64_t)sector * sector_size;
+    size_t len = (size_t)count * sector_size;
+    seek(pos);
+    size_t res = stream->readBytes(buff, len);
+    position = res == len ? pos + len : INVALID;
+    return res == len ? RES_OK : RES_ERROR;
+  }
+
+  /// the stream provides writeSectors()
+  template <class S>
+  auto write(S* stream, const BYTE* buff, LBA_t sector, UINT count, int)
+      -> decltype(stream->writeSectors(buff, (uint64_t)sector, (size_t)count),
+                  DRESULT()) {
+    position = INVALID;
+    return stream->writeSectors(buff, (uint64_t)sector, (size_t)count)
+               ? RES_OK
+               : RES_ERROR;
+  }
+
+  template <class S>
+  DRESULT write(S* stream, const BYTE* buff, LBA_t sector, UINT count, long) {
+    uint64_t pos = (uint64_t)sector * sector_size;
+    size_t len = (size_t)count * sector_size;
+    seek(pos);
+    size_t res = stream->write(buff, len);
+    position = res == len ? pos + len : INVALID;
+    return res == len ? RES_OK : RES_ERROR;
+  }
 };
 
 }
\ No newline at end of file
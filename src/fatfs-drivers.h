@@ -1,9 +1,13 @@
 // SPDX-License-Identifier: MIT
 #pragma once
 #include "driver/RamIO.h"
+#include "driver/CompressedRamIO.h"
 #include "driver/MultiIO.h"
 #ifndef ARDUINO
 #include "driver/FileIO.h"
+#include "driver/MmapFileIO.h"
+#include "driver/PosixFileIO.h"
+#include "driver/AsyncRamIO.h"
 #endif
 #ifdef ARDUINO
 #include "driver/StreamIO.h"
@@ -41,6 +41,9 @@
 
 #include "fatfs-drivers.h"
 #include "ff/ff.h"
+#if FF_USE_FASTSEEK
+#include <vector>
+#endif
 
 #define FILE_READ FA_READ
 #define FILE_WRITE (FA_READ | FA_WRITE | FA_CREATE_ALWAYS | FA_OPEN_APPEND)
@@ -68,12 +71,14 @@ class File : public Stream {
 
   virtual size_t write(uint8_t ch) override {
     if (fs == nullptr) return 0;
+    prepare_fast_seek(1);
     int rc = fs->f_putc(ch, &file);
     return rc == EOF ? 0 : 1;
   }
 
   virtual size_t write(const uint8_t *buf, size_t size) override {
     if (fs == nullptr) return 0;
+    prepare_fast_seek(size);
     UINT result;
     FRESULT rc = fs->f_write(&file, buf, size, &result);
     return rc == FR_OK ? result : 0;
@@ -98,12 +103,73 @@ class File : public Stream {
 
   int availableForWrite() override { return get_free_space(); }
 
+  /// Bounded variant of availableForWrite(): provides the number of bytes
+  /// which can be written, but at most limit. While the free cluster count
+  /// is not known, the FAT is only scanned as far as needed to find the
+  /// clusters for limit bytes, and the next call continues the scan where
+  /// it stopped. So the FAT is read at most once in total, even when this is
+  /// called before every write.
+  size_t availableForWrite(size_t limit) {
+#if FF_FS_MINIMIZE == 0
+    if (fs == nullptr || isDirectory() || file.obj.fs == nullptr) return 0;
+    FATFS *fatfs = file.obj.fs;
+#if FF_MAX_SS != FF_MIN_SS
+    size_t cluster_size = (size_t)fatfs->csize * fatfs->ssize;
+#else
+    size_t cluster_size = (size_t)fatfs->csize * FF_MAX_SS;
+#endif
+    // space left in the current cluster does not need a new cluster
+    size_t ofs = file.fptr % cluster_size;
+    size_t room = ofs ? cluster_size - ofs : 0;
+    if (room >= limit) return limit;
+
+    DWORD needed = (limit - room + cluster_size - 1) / cluster_size;
+    DWORD fre_clust;
+    if (fs->f_getfree_file(&file, needed, &fre_clust) != FR_OK) return room;
+    // the bytes of all free clusters may not fit into a size_t
+    if (fre_clust >= needed) return limit;
+    return room + fre_clust * cluster_size;
+#else
+    return Stream::availableForWrite() < (int)limit ? Stream::availableForWrite()
+                                                     : limit;
+#endif
+  }
+
   void flush() override {
     if (!isDirectory()) fs->f_sync(&file);
   }
 
+#if FF_USE_WRITEBEHIND && !FF_FS_READONLY
+  /// Collects the sectors which are completed one at a time by small writes
+  /// (e.g. print()) in the provided buffer, so that the driver gets a single
+  /// multi-sector write for them. The buffer must hold at least 2 sectors and
+  /// must stay valid until the file is closed (nullptr: no buffer).
+  bool setWriteBuffer(void *buffer, size_t len) {
+    if (fs == nullptr || isDirectory()) return false;
+    return fs->f_setwbuf(&file, buffer, len) == FR_OK;
+  }
+#endif
+
+#if FF_USE_READAHEAD
+  /// Lets small sequential reads (e.g. read() of single bytes or lines) load
+  /// the following sectors of the file with the same multi-sector read into
+  /// the provided buffer. The buffer must hold at least 2 sectors and must
+  /// stay valid until the file is closed (nullptr: no buffer).
+  bool setReadBuffer(void *buffer, size_t len) {
+    if (fs == nullptr || isDirectory()) return false;
+    return fs->f_setrbuf(&file, buffer, len) == FR_OK;
+  }
+  /// Current read-ahead window in sectors (0: random access)
+  size_t readAheadWindow() { return file.ra_win; }
+  /// Number of sector loads which were served from the read-ahead buffer
+  size_t readAheadHits() { return file.ra_hit; }
+  /// Number of sector loads which needed a read from the driver
+  size_t readAheadMisses() { return file.ra_miss; }
+#endif
+
   virtual size_t readBytes(uint8_t *data, size_t len)  {
     if (isDirectory()) return 0;
+    prepare_fast_seek(0);
     UINT result;
     auto rc = fs->f_read(&file, data, len, &result);
     return rc == FR_OK ? result : 0;
@@ -111,11 +177,105 @@ class File : public Stream {
 
   int read(void *buf, size_t nbyte) { return readBytes((uint8_t *)buf, nbyte); }
 
+#if FF_USE_READVIEW
+  /// Zero-copy read: points data to up to maxLen bytes of the file at the
+  /// current position and advances the position. The data stays in the
+  /// sector buffer of the file (or in the read buffer) and is only valid
+  /// until the next call on this file. Returns the number of bytes
+  /// provided, which can be less than maxLen (0: end of file or error).
+  size_t readView(const uint8_t **data, size_t maxLen) {
+    if (isDirectory()) return 0;
+    prepare_fast_seek(0);
+    UINT result;
+    auto rc = fs->f_readview(&file, data, maxLen, &result);
+    return rc == FR_OK ? result : 0;
+  }
+#endif
+
+#if FF_USE_ASYNC
+  /// Receives the parts of the data of readAsync()/writeAsync() in file order
+  /// as soon as their transfer has been completed
+  typedef void (*AsyncCallback)(const uint8_t *data, size_t len, void *ref);
+
+  /// Reads len bytes with cluster-sized asynchronous driver requests, where
+  /// up to asyncDepth() requests are kept in flight: the following clusters
+  /// are mapped and submitted while the driver transfers the previous ones
+  /// and while the callback processes the completed ones. Returns the number
+  /// of bytes read.
+  size_t readAsync(void *data, size_t len, AsyncCallback cb = nullptr,
+                   void *ref = nullptr) {
+    return transfer_async(FA_READ, (uint8_t *)data, len, cb, ref);
+  }
+
+#if !FF_FS_READONLY
+  /// Writes len bytes with cluster-sized asynchronous driver requests (see
+  /// readAsync()). Returns the number of bytes written.
+  size_t writeAsync(const void *data, size_t len, AsyncCallback cb = nullptr,
+                    void *ref = nullptr) {
+    return transfer_async(FA_WRITE, (uint8_t *)data, len, cb, ref);
+  }
+#endif
+
+  /// Defines the number of requests which are kept in flight (1 to
+  /// FF_ASYNC_DEPTH)
+  void setAsyncDepth(int depth) {
+    async_depth = depth < 1 ? 1 : depth > FF_ASYNC_DEPTH ? FF_ASYNC_DEPTH : depth;
+  }
+  int asyncDepth() { return async_depth; }
+#endif
+
+#if FF_USE_FORWARD
+  /// Passes up to len bytes from the current position to func without
+  /// copying them (see f_forward). Returns the number of bytes forwarded.
+  size_t forward(size_t len, UINT (*func)(const BYTE *, UINT)) {
+    if (isDirectory()) return 0;
+    prepare_fast_seek(0);
+    UINT result;
+    auto rc = fs->f_forward(&file, func, len, &result);
+    return rc == FR_OK ? result : 0;
+  }
+#endif
+
   bool seek(uint32_t pos) {
     if (isDirectory()) return 0;
-    return fs->f_lseek(&file, pos);
+#if FF_USE_FASTSEEK
+    if (fast_seek_enabled) {
+      // the cluster link map table can not extend the file
+      if (pos > size())
+        fast_seek_stale = true;
+      else if (fast_seek_stale)
+        fast_seek_enabled = build_fast_seek();
+    }
+    prepare_fast_seek(0);
+#endif
+    return fs->f_lseek(&file, pos) == FR_OK;
   }
 
+#if FF_USE_FASTSEEK
+  /// Builds a cluster link map table of the file, so that seek() does not
+  /// need to follow the FAT chain from the start of the file. entries is the
+  /// maximum number of fragments of the file (0: sized automatically). The
+  /// table is rebuilt by the next seek() after the file has been extended.
+  bool enableFastSeek(size_t entries = 0) {
+    if (fs == nullptr || isDirectory() || file.obj.fs == nullptr) return false;
+    fast_seek_entries = entries;
+    fast_seek_enabled = build_fast_seek();
+    return fast_seek_enabled;
+  }
+  /// Stops using the cluster link map table
+  void disableFastSeek() {
+    fast_seek_enabled = fast_seek_stale = false;
+    file.cltbl = nullptr;
+    fast_seek_table.clear();
+  }
+  /// true if the cluster link map table is used
+  bool isFastSeek() { return fast_seek_enabled; }
+  /// Number of fragments in the cluster link map table
+  size_t fastSeekFragments() {
+    return fast_seek_table.empty() ? 0 : (fast_seek_table[0] - 2) / 2;
+  }
+#endif
+
   uint32_t position() {
     if (isDirectory()) return 0;
     return fs->f_tell(&file);
@@ -133,6 +293,9 @@ class File : public Stream {
     memset(&file,0,sizeof(file));
     memset(&info, 0, sizeof(info));
     is_open = false;
+#if FF_USE_FASTSEEK
+    disableFastSeek();
+#endif
   }
 
   char *name() { return info.fname; }
@@ -185,6 +348,151 @@ class File : public Stream {
   FILINFO info = {0};
   FatFs *fs = nullptr;
   bool is_open = false;
+#if FF_USE_FASTSEEK
+  std::vector<DWORD> fast_seek_table;
+  size_t fast_seek_entries = 0;
+  bool fast_seek_enabled = false;
+  bool fast_seek_stale = false;
+
+  /// creates the cluster link map table (resizing it if automatic)
+  bool build_fast_seek() {
+    size_t items = fast_seek_entries ? 2 * fast_seek_entries + 2 : 32;
+    fast_seek_stale = false;
+    for (int attempt = 0; attempt < 2; attempt++) {
+      fast_seek_table.assign(items, 0);
+      fast_seek_table[0] = items;
+      file.cltbl = fast_seek_table.data();
+      FRESULT rc = fs->f_lseek(&file, CREATE_LINKMAP);
+      if (rc == FR_OK) return true;
+      if (rc != FR_NOT_ENOUGH_CORE || fast_seek_entries) break;
+      items = fast_seek_table[0];  // required size
+    }
+    file.cltbl = nullptr;
+    fast_seek_table.clear();
+    return false;
+  }
+#endif
+
+  /// (re)attaches the cluster link map table before the file is accessed:
+  /// writes which extend the file can not use it and make it stale
+  void prepare_fast_seek(size_t growth) {
+#if FF_USE_FASTSEEK
+    if (!fast_seek_enabled) return;
+    if (growth > 0 && file.fptr + growth > file.obj.objsize)
+      fast_seek_stale = true;
+    file.cltbl = fast_seek_stale ? nullptr : fast_seek_table.data();
+#endif
+  }
+
+#if FF_USE_ASYNC
+  int async_depth = FF_ASYNC_DEPTH;
+
+  /// regular read or write of a part which is not made of whole sectors
+  size_t transfer_sync(BYTE mode, uint8_t *data, size_t len) {
+    UINT result = 0;
+    FRESULT rc = mode == FA_READ ? fs->f_read(&file, data, len, &result)
+#if !FF_FS_READONLY
+                                 : fs->f_write(&file, data, len, &result);
+#else
+                                 : FR_DENIED;
+#endif
+    return rc == FR_OK ? result : 0;
+  }
+
+  size_t transfer_async(BYTE mode, uint8_t *data, size_t len,
+                        AsyncCallback cb, void *ref) {
+    if (isDirectory() || fs == nullptr || file.obj.fs == nullptr) return 0;
+    prepare_fast_seek(mode == FA_WRITE ? len : 0);
+    IO *io = getDriver();
+    BYTE pdrv = file.obj.fs->pdrv;
+#if FF_MAX_SS != FF_MIN_SS
+    size_t ss = file.obj.fs->ssize;
+#else
+    size_t ss = FF_MAX_SS;
+#endif
+    FSIZE_t start = file.fptr;
+    FSIZE_t size = file.obj.objsize;
+    size_t done = 0;
+
+    // up to the sector boundary
+    size_t head = (ss - file.fptr % ss) % ss;
+    if (head > len) head = len;
+    if (head > 0) {
+      done = transfer_sync(mode, data, head);
+      if (done > 0 && cb) cb(data, done, ref);
+      if (done < head) return done;
+    }
+
+    // whole sectors: one request per cluster, completed in file order
+    struct Pending {
+      io_request_t req;  // 0: transferred synchronously with the result
+      DRESULT result;
+      size_t ofs;
+      size_t len;
+    } queue[FF_ASYNC_DEPTH];
+    int first = 0, count = 0;
+    size_t mapped = done;
+    bool ok = true, more = true;
+    while (true) {
+      if (ok && more && count < async_depth && len - mapped >= ss) {
+        LBA_t sect;
+        UINT sc;
+        if (fs->f_mapsect(&file, len - mapped, mode, &sect, &sc) != FR_OK) {
+          ok = false;
+          continue;
+        }
+        if (sc == 0) {  // end of file or disk full
+          more = false;
+          continue;
+        }
+        io_request_t req =
+            mode == FA_READ
+                ? io->disk_read_submit(pdrv, data + mapped, sect, sc)
+                : io->disk_write_submit(pdrv, data + mapped, sect, sc);
+        DRESULT result = RES_OK;
+        if (req == 0) {  // not started by the driver: transfer it directly
+          result = mode == FA_READ
+                       ? io->disk_read(pdrv, data + mapped, sect, sc)
+                       : io->disk_write(pdrv, data + mapped, sect, sc);
+        }
+        queue[(first + count++) % FF_ASYNC_DEPTH] = {req, result, mapped,
+                                                     sc * ss};
+        mapped += sc * ss;
+        continue;
+      }
+      if (count == 0) break;
+      Pending &p = queue[first];
+      first = (first + 1) % FF_ASYNC_DEPTH;
+      count--;
+      DRESULT result = p.req != 0 ? io->disk_complete(p.req) : p.result;
+      if (result != RES_OK) ok = false;
+      if (ok) {
+        done += p.len;
+        if (cb) cb(data + p.ofs, p.len, ref);
+      }
+    }
+    if (!ok) {
+      // the data after the failed request has not been transferred
+      FSIZE_t end = start + done;
+      if (mode == FA_WRITE && file.obj.objsize > size) {
+        // f_mapsect() has grown the file also for the sectors which were
+        // not written: they must not become part of the file
+        fs->f_lseek(&file, end > size ? end : size);
+        fs->f_truncate(&file);
+      }
+      fs->f_lseek(&file, end);
+      return done;
+    }
+
+    // the rest of the last sector
+    if (done < len) {
+      size_t rest = transfer_sync(mode, data + done, len - done);
+      if (rest > 0 && cb) cb(data + done, rest, ref);
+      done += rest;
+    }
+    return done;
+  }
+#endif
 
   /// update fs, info and is_open
   bool update_stat(FatFs &fat_fs, const char *filepath) {
@@ -28,6 +28,19 @@
 #include "ff.h"			/* Declarations of FatFs API */
 #include "ffconf.h"
 
+#if FF_USE_SIMD && !defined(ARDUINO)	/* Vector kernels for f_getfree() on host builds */
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define FF_SIMD_AVX2 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define FF_SIMD_SSE2 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define FF_SIMD_NEON 1
+#endif
+#endif
+
 /*--------------------------------------------------------------------------
 
    Module Private Definitions
@@ -238,6 +251,13 @@
 #else
 #define LEAVE_FF(fs, res)	return res
 #endif
+#if FF_FS_SHARED_READ	/* Readers with a shared grant serialize on the sector window */
+#define LOCK_WIN(fs)		ff_req_window((fs)->sobj)
+#define UNLOCK_WIN(fs)		ff_rel_window((fs)->sobj)
+#else
+#define LOCK_WIN(fs)
+#define UNLOCK_WIN(fs)
+#endif
 
 
 /* Definitions of logical drive - physical location conversion */
@@ -826,6 +846,16 @@ static int lock_fs (		/* 1:Ok, 0:timeout */
 }
 
 
+#if FF_FS_SHARED_READ
+static int lock_fs_shared (	/* 1:Ok, 0:timeout */
+	FATFS* fs		/* Filesystem object */
+)
+{
+	return ff_req_shared(fs->sobj);
+}
+#endif
+
+
 static void unlock_fs (
 	FATFS* fs,		/* Filesystem object */
 	FRESULT res		/* Result code to be returned */
@@ -961,6 +991,9 @@ FRESULT FatFs::sync_window (	/* Returns FR_OK or FR_DISK_ERR */
 
 
 	if (fs->wflag) {	/* Is the disk access window dirty? */
+#if FF_USE_WINCACHE
+		if (fs->wcache && fs->wcache->size()) return cache_store(fs);	/* Park it in the sector cache (written back on eviction or sync) */
+#endif
 		if (p_io->disk_write(fs->pdrv, fs->win, fs->winsect, 1) == RES_OK) {	/* Write it back into the volume */
 			fs->wflag = 0;	/* Clear window dirty flag */
 			if (fs->winsect - fs->fatbase < fs->fsize) {	/* Is it in the 1st FAT? */
@@ -984,9 +1017,28 @@ FRESULT FatFs::move_window (	/* Returns FR_OK or FR_DISK_ERR */
 
 
 	if (sect != fs->winsect) {	/* Window offset changed? */
+#if FF_USE_WINCACHE
+		if (fs->wcache && fs->wcache->size()) {	/* Is the sector cache active? */
+			int i;
+
+			res = cache_store(fs);		/* Park the window in the cache */
+			if (res != FR_OK) return res;
+			i = fs->wcache->find(sect);
+			if (i >= 0) {				/* Cache hit: fill the window from the cache */
+				fs->wcache->touch(i);
+				fs->wcache->countHit();
+				mem_cpy(fs->win, fs->wcache->buffer(i), SS(fs));
+				fs->winsect = sect;
+				return FR_OK;
+			}
+			fs->wcache->countMiss();
+		} else
+#endif
+		{
 #if !FF_FS_READONLY
-		res = sync_window(fs);		/* Flush the window */
+			res = sync_window(fs);		/* Flush the window */
 #endif
+		}
 		if (res == FR_OK) {			/* Fill sector window with new data */
 			if (p_io->disk_read(fs->pdrv, fs->win, sect, 1) != RES_OK) {
 				sect = (LBA_t)0 - 1;	/* Invalidate window if read data is not valid */
@@ -1000,6 +1052,87 @@ FRESULT FatFs::move_window (	/* Returns FR_OK or FR_DISK_ERR */
 
 
 
+#if FF_USE_WINCACHE
+/*-----------------------------------------------------------------------*/
+/* Sector cache layered under the disk access window                     */
+/*-----------------------------------------------------------------------*/
+
+#if !FF_FS_READONLY
+FRESULT FatFs::cache_write_back (	/* Returns FR_OK or FR_DISK_ERR */
+	FATFS* fs,		/* Filesystem object */
+	int idx			/* Index of the dirty cache entry */
+)
+{
+	SectorCache *sc = fs->wcache;
+	LBA_t sect = sc->sector(idx);
+
+
+	if (p_io->disk_write(fs->pdrv, sc->buffer(idx), sect, 1) != RES_OK) return FR_DISK_ERR;
+	sc->setDirty(idx, false);
+	if (sect - fs->fatbase < fs->fsize) {	/* Is it in the 1st FAT? */
+		if (fs->n_fats == 2) p_io->disk_write(fs->pdrv, sc->buffer(idx), sect + fs->fsize, 1);	/* Reflect it to 2nd FAT if needed */
+	}
+	return FR_OK;
+}
+
+
+FRESULT FatFs::cache_flush (	/* Returns FR_OK or FR_DISK_ERR */
+	FATFS* fs		/* Filesystem object */
+)
+{
+	SectorCache *sc = fs->wcache;
+	UINT i;
+
+
+	if (!sc) return FR_OK;
+	for (i = 0; i < sc->size(); i++) {	/* Write back all dirty entries */
+		if (sc->isDirty(i) && cache_write_back(fs, i) != FR_OK) return FR_DISK_ERR;
+	}
+	return FR_OK;
+}
+#endif
+
+
+FRESULT FatFs::cache_store (	/* Returns FR_OK or FR_DISK_ERR */
+	FATFS* fs		/* Filesystem object */
+)
+{
+	SectorCache *sc = fs->wcache;
+	int i;
+
+
+	if (fs->winsect == (LBA_t)0 - 1) return FR_OK;	/* Window does not hold valid data */
+	i = sc->find(fs->winsect);
+	if (i < 0) {						/* Not cached yet: recycle the LRU entry */
+		i = sc->victim();
+#if !FF_FS_READONLY
+		if (sc->isDirty(i) && cache_write_back(fs, i) != FR_OK) return FR_DISK_ERR;
+#endif
+		sc->assign(i, fs->winsect, false);
+	} else {
+		sc->touch(i);
+	}
+	mem_cpy(sc->buffer(i), fs->win, SS(fs));
+	if (fs->wflag) {					/* Hand over the dirty state to the cache */
+		sc->setDirty(i, true);
+		fs->wflag = 0;
+	}
+	return FR_OK;
+}
+
+
+void FatFs::cache_invalidate (
+	FATFS* fs,		/* Filesystem object */
+	LBA_t sect,		/* First sector which is released or overwritten directly */
+	DWORD count		/* Number of sectors */
+)
+{
+	if (fs->wcache) fs->wcache->invalidate(sect, count);
+}
+#endif	/* FF_USE_WINCACHE */
+
+
+
 
 #if !FF_FS_READONLY
 /*-----------------------------------------------------------------------*/
@@ -1014,6 +1147,9 @@ FRESULT FatFs::sync_fs (	/* Returns FR_OK or FR_DISK_ERR */
 
 
 	res = sync_window(fs);
+#if FF_USE_WINCACHE
+	if (res == FR_OK) res = cache_flush(fs);	/* Write back the sector cache */
+#endif
 	if (res == FR_OK) {
 		if (fs->fs_type == FS_FAT32 && fs->fsi_flag == 1) {	/* FAT32: Update FSInfo sector if needed */
 			/* Create FSInfo structure */
@@ -1039,6 +1175,52 @@ FRESULT FatFs::sync_fs (	/* Returns FR_OK or FR_DISK_ERR */
 
 
 
+#if FF_USE_WRITEBEHIND && !FF_FS_READONLY
+/*-----------------------------------------------------------------------*/
+/* Write-behind buffer: write the collected sectors of a file            */
+/*-----------------------------------------------------------------------*/
+
+FRESULT FatFs::sync_wbuf (	/* Returns FR_OK or FR_DISK_ERR */
+	FIL* fp			/* File object */
+)
+{
+	if (fp->wb_cnt) {
+		if (p_io->disk_write(fp->obj.fs->pdrv, fp->wbuf, fp->wb_sect, fp->wb_cnt) != RES_OK) return FR_DISK_ERR;
+		fp->wb_cnt = 0;
+	}
+	return FR_OK;
+}
+
+
+/*-----------------------------------------------------------------------*/
+/* Write-behind buffer: write back the dirty file buffer                 */
+/*-----------------------------------------------------------------------*/
+
+FRESULT FatFs::put_fbuf (	/* Returns FR_OK or FR_DISK_ERR */
+	FIL* fp			/* File object with dirty buf[] */
+)
+{
+	FATFS *fs = fp->obj.fs;
+
+
+	if (fp->wb_size == 0) {		/* No write-behind buffer: write the sector */
+		if (p_io->disk_write(fs->pdrv, fp->buf, fp->sect, 1) != RES_OK) return FR_DISK_ERR;
+	} else {
+		if (fp->wb_cnt && fp->sect != fp->wb_sect + fp->wb_cnt) {	/* Not consecutive to the collected sectors? */
+			if (sync_wbuf(fp) != FR_OK) return FR_DISK_ERR;
+		}
+		if (fp->wb_cnt == 0) fp->wb_sect = fp->sect;
+		mem_cpy(fp->wbuf + fp->wb_cnt * SS(fs), fp->buf, SS(fs));	/* Append the sector */
+		if (++fp->wb_cnt == fp->wb_size && sync_wbuf(fp) != FR_OK) return FR_DISK_ERR;	/* Write them when the buffer is full */
+	}
+	fp->flag &= (BYTE)~FA_DIRTY;
+	return FR_OK;
+}
+
+#endif
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Get physical sector number from cluster number                        */
 /*-----------------------------------------------------------------------*/
@@ -1056,6 +1238,94 @@ static LBA_t clst2sect (	/* !=0:Sector number, 0:Failed (invalid cluster#) */
 
 
 
+/*-----------------------------------------------------------------------*/
+/* FAT access - Decode a FAT entry from the table                        */
+/*-----------------------------------------------------------------------*/
+
+ DWORD FatFs::decode_fat (	/* 0xFFFFFFFF:Disk error, else:Value of the entry */
+	FATFS* fs,		/* Filesystem object */
+	DWORD clst		/* FAT index number (cluster number) to get the value */
+)
+{
+	UINT wc, bc;
+	DWORD val = 0xFFFFFFFF;	/* Default value falls on disk error */
+
+
+	switch (fs->fs_type) {
+	case FS_FAT12 :
+		bc = (UINT)clst; bc += bc / 2;
+		if (move_window(fs, fs->fatbase + (bc / SS(fs))) != FR_OK) break;
+		wc = fs->win[bc++ % SS(fs)];		/* Get 1st byte of the entry */
+		if (move_window(fs, fs->fatbase + (bc / SS(fs))) != FR_OK) break;
+		wc |= fs->win[bc % SS(fs)] << 8;	/* Merge 2nd byte of the entry */
+		val = (clst & 1) ? (wc >> 4) : (wc & 0xFFF);	/* Adjust bit position */
+		break;
+
+	case FS_FAT16 :
+		if (move_window(fs, fs->fatbase + (clst / (SS(fs) / 2))) != FR_OK) break;
+		val = ld_word(fs->win + clst * 2 % SS(fs));		/* Simple WORD array */
+		break;
+
+	case FS_FAT32 :
+		if (move_window(fs, fs->fatbase + (clst / (SS(fs) / 4))) != FR_OK) break;
+		val = ld_dword(fs->win + clst * 4 % SS(fs)) & 0x0FFFFFFF;	/* Simple DWORD array but mask out upper 4 bits */
+		break;
+#if FF_FS_EXFAT
+	case FS_EXFAT :
+		if (move_window(fs, fs->fatbase + (clst / (SS(fs) / 4))) != FR_OK) break;
+		val = ld_dword(fs->win + clst * 4 % SS(fs)) & 0x7FFFFFFF;
+		break;
+#endif
+	}
+	return val;
+}
+
+
+/*-----------------------------------------------------------------------*/
+/* FAT access - Read a FAT entry (through the FAT chain cache if active) */
+/*-----------------------------------------------------------------------*/
+
+ DWORD FatFs::read_fat (	/* 0xFFFFFFFF:Disk error, else:Value of the entry */
+	FATFS* fs,		/* Filesystem object */
+	DWORD clst		/* FAT index number (cluster number) to get the value */
+)
+{
+#if FF_USE_FATCACHE
+	FatCache *fc = fs->fcache;
+	DWORD *lnk, cl, ncl, n;
+	int i;
+
+
+	if (fc && fc->size()) {		/* Is the FAT chain cache active? */
+		i = fc->findCluster(clst);
+		if (i >= 0) {			/* Cache hit */
+			fc->touch(i);
+			fc->countHit();
+			return fc->links(i)[clst % fc->span()];
+		}
+		fc->countMiss();
+		i = fc->victim();		/* Decode the whole FAT region into the LRU entry */
+		lnk = fc->links(i);
+		cl = clst - clst % fc->span();
+		ncl = fs->n_fatent - cl;
+		if (ncl > fc->span()) ncl = fc->span();
+		for (n = 0; n < ncl; n++) {
+			lnk[n] = decode_fat(fs, cl + n);
+			if (lnk[n] == 0xFFFFFFFF) {	/* Disk error: drop the overwritten entry */
+				fc->invalidate(fc->sector(i), 1);
+				return 0xFFFFFFFF;
+			}
+		}
+		fc->assign(i, clst / fc->span(), false);
+		return lnk[clst % fc->span()];
+	}
+#endif
+	return decode_fat(fs, clst);
+}
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* FAT access - Read value of a FAT entry                                */
 /*-----------------------------------------------------------------------*/
@@ -1065,7 +1335,6 @@ static LBA_t clst2sect (	/* !=0:Sector number, 0:Failed (invalid cluster#) */
 	DWORD clst		/* Cluster number to get the value */
 )
 {
-	UINT wc, bc;
 	DWORD val;
 	FATFS *fs = obj->fs;
 
@@ -1078,22 +1347,9 @@ static LBA_t clst2sect (	/* !=0:Sector number, 0:Failed (invalid cluster#) */
 
 		switch (fs->fs_type) {
 		case FS_FAT12 :
-			bc = (UINT)clst; bc += bc / 2;
-			if (move_window(fs, fs->fatbase + (bc / SS(fs))) != FR_OK) break;
-			wc = fs->win[bc++ % SS(fs)];		/* Get 1st byte of the entry */
-			if (move_window(fs, fs->fatbase + (bc / SS(fs))) != FR_OK) break;
-			wc |= fs->win[bc % SS(fs)] << 8;	/* Merge 2nd byte of the entry */
-			val = (clst & 1) ? (wc >> 4) : (wc & 0xFFF);	/* Adjust bit position */
-			break;
-
 		case FS_FAT16 :
-			if (move_window(fs, fs->fatbase + (clst / (SS(fs) / 2))) != FR_OK) break;
-			val = ld_word(fs->win + clst * 2 % SS(fs));		/* Simple WORD array */
-			break;
-
 		case FS_FAT32 :
-			if (move_window(fs, fs->fatbase + (clst / (SS(fs) / 4))) != FR_OK) break;
-			val = ld_dword(fs->win + clst * 4 % SS(fs)) & 0x0FFFFFFF;	/* Simple DWORD array but mask out upper 4 bits */
+			val = read_fat(fs, clst);	/* Get value from the FAT */
 			break;
 #if FF_FS_EXFAT
 		case FS_EXFAT :
@@ -1113,8 +1369,7 @@ static LBA_t clst2sect (	/* !=0:Sector number, 0:Failed (invalid cluster#) */
 					if (obj->n_frag != 0) {	/* Is it on the growing edge? */
 						val = 0x7FFFFFFF;	/* Generate EOC */
 					} else {
-						if (move_window(fs, fs->fatbase + (clst / (SS(fs) / 4))) != FR_OK) break;
-						val = ld_dword(fs->win + clst * 4 % SS(fs)) & 0x7FFFFFFF;
+						val = read_fat(fs, clst);
 					}
 					break;
 				}
@@ -1184,6 +1439,14 @@ FRESULT FatFs::put_fat (	/* FR_OK(0):succeeded, !=0:error */
 			fs->wflag = 1;
 			break;
 		}
+#if FF_USE_FATCACHE
+		if (res == FR_OK && fs->fcache) {	/* Keep the cached link coherent */
+			fs->fcache->update(clst, val & (fs->fs_type == FS_FAT12 ? 0xFFF : fs->fs_type == FS_FAT16 ? 0xFFFF : fs->fs_type == FS_FAT32 ? 0x0FFFFFFF : 0x7FFFFFFF));
+		}
+#endif
+#if FF_USE_FREEMAP
+		if (res == FR_OK && fs->fmap) fs->fmap->update(clst, val == 0);	/* Keep the free cluster map up to date */
+#endif
 	}
 	return res;
 }
@@ -1365,6 +1628,10 @@ FRESULT FatFs::change_bitmap (
 			fs->free_clst++;
 			fs->fsi_flag |= 1;
 		}
+		if (clst < fs->fcnt_clst) fs->fcnt_free++;	/* Update the count in progress */
+#if FF_USE_WINCACHE
+		cache_invalidate(fs, clst2sect(fs, clst), fs->csize);	/* Drop cached sectors of the released cluster */
+#endif
 #if FF_FS_EXFAT || FF_USE_TRIM
 		if (ecl + 1 == nxt) {	/* Is next cluster contiguous? */
 			ecl = nxt;
@@ -1418,6 +1685,75 @@ FRESULT FatFs::change_bitmap (
 
 
 
+#if FF_USE_FREEMAP
+/*-----------------------------------------------------------------------*/
+/* FAT handling - Fill the free cluster map by a FAT scan                */
+/*-----------------------------------------------------------------------*/
+
+FRESULT FatFs::build_freemap (	/* FR_OK(0):succeeded, !=0:error */
+	FATFS* fs		/* Filesystem object (FAT12/16/32) */
+)
+{
+	FreeMap *fm = fs->fmap;
+	DWORD clst, stat, nfree = 0;
+
+
+	fm->clear();
+	for (clst = 2; clst < fs->n_fatent; clst++) {
+		stat = decode_fat(fs, clst);
+		if (stat == 0xFFFFFFFF) return FR_DISK_ERR;
+		if (stat == 0) {
+			fm->setFree(fm->group(clst));
+			nfree++;
+		}
+	}
+	fm->setValid();
+	fs->free_clst = nfree;	/* The number of free clusters is known as well */
+	fs->fsi_flag |= 1;
+	return FR_OK;
+}
+
+
+/*-----------------------------------------------------------------------*/
+/* FAT handling - Find a free cluster with the free cluster map          */
+/*-----------------------------------------------------------------------*/
+
+DWORD FatFs::find_free (	/* 0:No free cluster, 1:Internal error, 0xFFFFFFFF:Disk error, >=2:Free cluster# */
+	FFOBJID* obj,		/* Corresponding object */
+	DWORD scl			/* Cluster# to start to find */
+)
+{
+	FATFS *fs = obj->fs;
+	FreeMap *fm = fs->fmap;
+	DWORD g, eg, cl, ecl, cs;
+	int pass;
+
+
+	if (!fm->isValid() && build_freemap(fs) != FR_OK) return 0xFFFFFFFF;
+	g = fm->group(scl);
+	for (pass = 0; pass < 2; pass++) {	/* Scan from the group of scl to the end, then from the top */
+		eg = pass ? fm->group(scl) + 1 : fm->size();
+		while ((g = fm->next(g)) < eg) {	/* Skip the full groups */
+			cl = g * fm->granule(); ecl = cl + fm->granule();
+			if (cl < 2) cl = 2;
+			if (ecl > fs->n_fatent) ecl = fs->n_fatent;
+			for ( ; cl < ecl; cl++) {	/* Check the clusters of the group on the FAT */
+				cs = get_fat(obj, cl);
+				if (cs == 0) return cl;			/* Found a free cluster */
+				if (cs == 1 || cs == 0xFFFFFFFF) return cs;	/* Test for error */
+			}
+			fm->setFull(g);		/* No free cluster in this group */
+			g++;
+		}
+		g = 0;
+	}
+	return 0;
+}
+#endif
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* FAT handling - Stretch a chain or Create a new chain                  */
 /*-----------------------------------------------------------------------*/
@@ -1484,6 +1820,12 @@ FRESULT FatFs::change_bitmap (
 				ncl = 0;
 			}
 		}
+#if FF_USE_FREEMAP
+		if (ncl == 0 && fs->fmap && fs->fmap->size()) {	/* Find another fragment with the free cluster map */
+			ncl = find_free(obj, scl);
+			if (ncl < 2 || ncl == 0xFFFFFFFF) return ncl;	/* No free cluster or error? */
+		}
+#endif
 		if (ncl == 0) {	/* The new cluster cannot be contiguous and find another fragment */
 			ncl = scl;	/* Start cluster */
 			for (;;) {
@@ -1507,6 +1849,7 @@ FRESULT FatFs::change_bitmap (
 	if (res == FR_OK) {			/* Update FSINFO if function succeeded. */
 		fs->last_clst = ncl;
 		if (fs->free_clst <= fs->n_fatent - 2) fs->free_clst--;
+		if (ncl < fs->fcnt_clst) fs->fcnt_free--;	/* Update the count in progress */
 		fs->fsi_flag |= 1;
 	} else {
 		ncl = (res == FR_DISK_ERR) ? 0xFFFFFFFF : 1;	/* Failed. Generate error status */
@@ -1567,6 +1910,9 @@ static DWORD clmt_clust (	/* <2:Error, >=2:Cluster number */
 
 	if (sync_window(fs) != FR_OK) return FR_DISK_ERR;	/* Flush disk access window */
 	sect = clst2sect(fs, clst);		/* Top of the cluster */
+#if FF_USE_WINCACHE
+	cache_invalidate(fs, sect, fs->csize);	/* The cluster is overwritten directly */
+#endif
 	fs->winsect = sect;				/* Set window to top of the cluster */
 	mem_set(fs->win, 0, sizeof fs->win);	/* Clear window buffer */
 #if FF_USE_LFN == 3		/* Quick table clear by using multi-secter write */
@@ -1964,6 +2310,93 @@ static BYTE sum_sfn (
 	return sum;
 }
 
+
+
+#if FF_USE_DIRINDEX
+/*-----------------------------------------------------------------------*/
+/* Directory index: Hash key of an up-cased file name                    */
+/*-----------------------------------------------------------------------*/
+/* The key is a sum of terms for each character and its position, so that it can be
+/  accumulated from the LFN entries in any order. An ASCII SFN gets the key of its
+/  "NAME.EXT" form, which is the key of every name matching it. */
+
+static DWORD name_hash_chr (	/* Hash term of a character at a position */
+	DWORD chr,		/* Character (UTF-16) */
+	UINT pos		/* Position in the name */
+)
+{
+	DWORD x = ((DWORD)pos << 16) ^ ff_wtoupper(chr);
+
+	x ^= x >> 16; x *= 0x7FEB352D;
+	x ^= x >> 15; x *= 0x846CA68B;
+	return x ^ (x >> 16);
+}
+
+
+static DWORD name_key (	/* 16-bit hash key from the sum of the terms */
+	DWORD sum
+)
+{
+	return (sum ^ (sum >> 16)) & 0xFFFF;
+}
+
+
+static DWORD lfn_key (	/* Hash key of a name in the LFN working buffer */
+	const WCHAR* lfn
+)
+{
+	DWORD sum = 0;
+	UINT i;
+
+	for (i = 0; lfn[i]; i++) sum += name_hash_chr(lfn[i], i);
+	return name_key(sum);
+}
+
+
+static DWORD sfn_key (	/* Hash key of an SFN (DirIndex::WILD if it is not ASCII) */
+	const BYTE* sfn
+)
+{
+	DWORD sum = 0;
+	UINT i, b, n = 0;
+
+	for (i = 0; i < 11; i++) {
+		if (sfn[i] >= 0x80 || sfn[i] == RDDEM) return DirIndex::WILD;
+	}
+	for (b = 8; b && sfn[b - 1] == ' '; b--) ;	/* Length of the body */
+	for (i = 0; i < b; i++) sum += name_hash_chr(sfn[i], n++);
+	if (sfn[8] != ' ') {	/* Extension */
+		sum += name_hash_chr('.', n++);
+		for (i = 8; i < 11 && sfn[i] != ' '; i++) sum += name_hash_chr(sfn[i], n++);
+	}
+	return name_key(sum);
+}
+
+
+static DWORD dir_index_id (	/* Directory identification used by the index (0:root) */
+	DIR* dp
+)
+{
+	DWORD cl = dp->obj.sclust;
+
+	if (dp->obj.fs->fs_type >= FS_FAT32 && cl == (DWORD)dp->obj.fs->dirbase) cl = 0;
+	return cl;
+}
+
+
+static void dir_index_clear (	/* Drop the index of a removed or new directory */
+	FATFS* fs,		/* Filesystem object */
+	DWORD clst		/* Start cluster of the directory */
+)
+{
+	UINT i;
+
+	if (fs->dindex) {
+		for (i = 0; i < FF_DIRINDEX_DIRS; i++) fs->dindex[i].clear(clst);
+	}
+}
+#endif	/* FF_USE_DIRINDEX */
+
 #endif	/* FF_USE_LFN */
 
 
@@ -2319,62 +2752,303 @@ static void create_xdir (
 
 
 
+#if FF_FS_EXFAT
 /*-----------------------------------------------------------------------*/
-/* Directory handling - Find an object in the directory                  */
+/* exFAT: Compare the name in the entry block with the LFN working buffer */
 /*-----------------------------------------------------------------------*/
 
- FRESULT FatFs::dir_find (	/* FR_OK(0):succeeded, !=0:error */
-	DIR* dp					/* Pointer to the directory object with the file name */
+static int cmp_xname (	/* 1:matched, 0:not matched */
+	FATFS* fs		/* Filesystem object with the entry block in dirbuf[] */
 )
 {
-	FRESULT res;
-	FATFS *fs = dp->obj.fs;
-	BYTE c;
-#if FF_USE_LFN
-	BYTE a, ord, sum;
-#endif
-
-	res = dir_sdi(dp, 0);			/* Rewind directory object */
-	if (res != FR_OK) return res;
-#if FF_FS_EXFAT
-	if (fs->fs_type == FS_EXFAT) {	/* On the exFAT volume */
-		BYTE nc;
-		UINT di, ni;
-		WORD hash = xname_sum(fs->lfnbuf);		/* Hash value of the name to find */
+	BYTE nc;
+	UINT di, ni;
 
-		while ((res = DIR_READ_FILE(dp)) == FR_OK) {	/* Read an item */
 #if FF_MAX_LFN < 255
-			if (fs->dirbuf[XDIR_NumName] > FF_MAX_LFN) continue;			/* Skip comparison if inaccessible object name */
+	if (fs->dirbuf[XDIR_NumName] > FF_MAX_LFN) return 0;	/* Skip comparison if inaccessible object name */
 #endif
-			if (ld_word(fs->dirbuf + XDIR_NameHash) != hash) continue;	/* Skip comparison if hash mismatched */
-			for (nc = fs->dirbuf[XDIR_NumName], di = SZDIRE * 2, ni = 0; nc; nc--, di += 2, ni++) {	/* Compare the name */
-				if ((di % SZDIRE) == 0) di += 2;
-				if (ff_wtoupper(ld_word(fs->dirbuf + di)) != ff_wtoupper(fs->lfnbuf[ni])) break;
-			}
-			if (nc == 0 && !fs->lfnbuf[ni]) break;	/* Name matched? */
-		}
-		return res;
+	for (nc = fs->dirbuf[XDIR_NumName], di = SZDIRE * 2, ni = 0; nc; nc--, di += 2, ni++) {	/* Compare the name */
+		if ((di % SZDIRE) == 0) di += 2;
+		if (ff_wtoupper(ld_word(fs->dirbuf + di)) != ff_wtoupper(fs->lfnbuf[ni])) break;
 	}
+	return nc == 0 && !fs->lfnbuf[ni];
+}
 #endif
-	/* On the FAT/FAT32 volume */
-#if FF_USE_LFN
-	ord = sum = 0xFF; dp->blk_ofs = 0xFFFFFFFF;	/* Reset LFN sequence */
-#endif
-	do {
-		res = move_window(fs, dp->sect);
-		if (res != FR_OK) break;
-		c = dp->dir[DIR_Name];
-		if (c == 0) { res = FR_NO_FILE; break; }	/* Reached to end of table */
-#if FF_USE_LFN		/* LFN configuration */
-		dp->obj.attr = a = dp->dir[DIR_Attr] & AM_MASK;
-		if (c == DDEM || ((a & AM_VOL) && a != AM_LFN)) {	/* An entry without valid data */
-			ord = 0xFF; dp->blk_ofs = 0xFFFFFFFF;	/* Reset LFN sequence */
-		} else {
-			if (a == AM_LFN) {			/* An LFN entry is found */
-				if (!(dp->fn[NSFLAG] & NS_NOLFN)) {
-					if (c & LLEF) {		/* Is it start of LFN sequence? */
-						sum = dp->dir[LDIR_Chksum];
-						c &= (BYTE)~LLEF; ord = c;	/* LFN start order */
+
+
+
+#if FF_USE_DIRINDEX
+/*-----------------------------------------------------------------------*/
+/* Directory index - Get the index of a directory                        */
+/*-----------------------------------------------------------------------*/
+
+DirIndex* FatFs::dir_index_get (	/* Index holding all names of the directory or null */
+	DIR* dp		/* Directory object */
+)
+{
+	DirIndex *di = dp->obj.fs->dindex;
+	DWORD id = dir_index_id(dp);
+	UINT i;
+
+	if (di && di->size()) {	/* Is the directory index active? */
+		for (i = 0; i < FF_DIRINDEX_DIRS; i++) {
+			if (di[i].isIndexed(id)) return &di[i];
+		}
+	}
+	return 0;
+}
+
+
+/*-----------------------------------------------------------------------*/
+/* Directory index - Index all names of a directory                      */
+/*-----------------------------------------------------------------------*/
+
+FRESULT FatFs::dir_index_build (	/* FR_OK(0):succeeded, !=0:error */
+	DIR* dp,		/* Directory object */
+	DirIndex* di	/* Index to be filled */
+)
+{
+	FRESULT res;
+	FATFS *fs = dp->obj.fs;
+	BYTE c, a, ord = 0xFF, sum = 0xFF;
+	DWORD lsum = 0, blk = 0, uc;
+	UINT s, pos;
+
+
+	di->reset(dir_index_id(dp));
+	res = dir_sdi(dp, 0);			/* Rewind directory object */
+#if FF_FS_EXFAT
+	if (fs->fs_type == FS_EXFAT) {	/* On the exFAT volume: use the name hash of the entry block */
+		while (res == FR_OK && (res = DIR_READ_FILE(dp)) == FR_OK) {
+			di->add(ld_word(fs->dirbuf + XDIR_NameHash), dp->blk_ofs);
+		}
+	} else
+#endif
+	{	/* On the FAT/FAT32 volume: hash the LFN while collecting it and the SFN */
+		while (res == FR_OK) {
+			res = move_window(fs, dp->sect);
+			if (res != FR_OK) break;
+			c = dp->dir[DIR_Name];
+			if (c == 0) { res = FR_NO_FILE; break; }	/* Reached to end of table */
+			a = dp->dir[DIR_Attr] & AM_MASK;
+			if (c == DDEM || ((a & AM_VOL) && a != AM_LFN)) {	/* An entry without valid data */
+				ord = 0xFF;
+			} else if (a == AM_LFN) {	/* An LFN entry is found */
+				if (c & LLEF) {		/* Is it start of LFN sequence? */
+					sum = dp->dir[LDIR_Chksum];
+					c &= (BYTE)~LLEF; ord = c;
+					blk = dp->dptr; lsum = 0;
+				}
+				if (c == ord && sum == dp->dir[LDIR_Chksum] && ld_word(dp->dir + LDIR_FstClusLO) == 0) {
+					for (s = 0, pos = (c - 1) * 13; s < 13; s++, pos++) {	/* Add the characters of this entry */
+						uc = ld_word(dp->dir + LfnOfs[s]);
+						if (uc == 0) break;
+						lsum += name_hash_chr(uc, pos);
+					}
+					ord--;
+				} else {
+					ord = 0xFF;
+				}
+			} else {					/* An SFN entry is found */
+				if (ord == 0 && sum == sum_sfn(dp->dir)) {	/* With a valid LFN? */
+					di->add(name_key(lsum), blk);
+					di->add(sfn_key(dp->dir), blk);
+				} else {
+					di->add(sfn_key(dp->dir), dp->dptr);
+				}
+				ord = 0xFF;
+			}
+			res = dir_next(dp, 0);	/* Next entry */
+		}
+	}
+	if (res == FR_NO_FILE) res = FR_OK;	/* End of the directory */
+	if (res != FR_OK) di->clear();
+	return res;
+}
+
+
+/*-----------------------------------------------------------------------*/
+/* Directory index - Find an object with the index                       */
+/*-----------------------------------------------------------------------*/
+
+FRESULT FatFs::dir_index_find (	/* FR_OK(0):succeeded, !=0:error */
+	DIR* dp,		/* Pointer to the directory object with the file name */
+	DirIndex* di	/* Index of the directory */
+)
+{
+	FRESULT res;
+	FATFS *fs = dp->obj.fs;
+	DWORD key, k, ofs;
+	BYTE c, a, ord, sum;
+	int i, pass;
+
+
+#if FF_FS_EXFAT
+	if (fs->fs_type == FS_EXFAT) {
+		key = xname_sum(fs->lfnbuf);
+	} else
+#endif
+	{
+		key = (dp->fn[NSFLAG] & NS_NOLFN) ? sfn_key(dp->fn) : lfn_key(fs->lfnbuf);
+	}
+	for (pass = 0; pass < 2; pass++) {	/* Check the names with the key, then the ones without a key */
+		k = pass ? DirIndex::WILD : key;
+		for (i = di->first(k); i >= 0; i = di->next(i)) {
+			ofs = di->offset(i);
+			if (di->key(i) != k || ofs == DirIndex::INVALID) continue;
+			res = dir_sdi(dp, ofs);	/* Go to the entry block */
+			if (res != FR_OK) return res;
+#if FF_FS_EXFAT
+			if (fs->fs_type == FS_EXFAT) {
+				res = DIR_READ_FILE(dp);
+				if (res == FR_OK && dp->blk_ofs == ofs && cmp_xname(fs)) return FR_OK;	/* Name matched? */
+				if (res != FR_OK && res != FR_NO_FILE) return res;
+				continue;
+			}
+#endif
+			ord = sum = 0xFF; dp->blk_ofs = 0xFFFFFFFF;	/* Reset LFN sequence */
+			do {	/* Compare the entry block like dir_find() */
+				res = move_window(fs, dp->sect);
+				if (res != FR_OK) return res;
+				c = dp->dir[DIR_Name];
+				dp->obj.attr = a = dp->dir[DIR_Attr] & AM_MASK;
+				if (c == 0 || c == DDEM || ((a & AM_VOL) && a != AM_LFN)) break;	/* The entry has been removed */
+				if (a != AM_LFN) {	/* An SFN entry ends the block */
+					if (ord == 0 && sum == sum_sfn(dp->dir)) return FR_OK;	/* LFN matched? */
+					if (!(dp->fn[NSFLAG] & NS_LOSS) && !mem_cmp(dp->dir, dp->fn, 11)) return FR_OK;	/* SFN matched? */
+					break;
+				}
+				if (!(dp->fn[NSFLAG] & NS_NOLFN)) {
+					if (c & LLEF) {		/* Is it start of LFN sequence? */
+						sum = dp->dir[LDIR_Chksum];
+						c &= (BYTE)~LLEF; ord = c;	/* LFN start order */
+						dp->blk_ofs = dp->dptr;	/* Start offset of LFN */
+					}
+					/* Check validity of the LFN entry and compare it with given name */
+					ord = (c == ord && sum == dp->dir[LDIR_Chksum] && cmp_lfn(fs->lfnbuf, dp->dir)) ? ord - 1 : 0xFF;
+				}
+				res = dir_next(dp, 0);	/* Next entry */
+			} while (res == FR_OK);
+			if (res != FR_OK && res != FR_NO_FILE) return res;
+		}
+	}
+	return FR_NO_FILE;
+}
+
+
+#if !FF_FS_READONLY
+/*-----------------------------------------------------------------------*/
+/* Directory index - Add or remove the names of an entry block           */
+/*-----------------------------------------------------------------------*/
+
+void FatFs::dir_index_add (
+	DIR* dp,		/* Directory object with the name in lfnbuf and fn[] */
+	DWORD ofs,		/* Offset of the entry block */
+	BYTE nsflag		/* Name status flags (NS_LFN: LFN entries have been created) */
+)
+{
+	FATFS *fs = dp->obj.fs;
+	DirIndex *di = dir_index_get(dp);
+
+	if (!di) return;
+#if FF_FS_EXFAT
+	if (fs->fs_type == FS_EXFAT) {
+		di->add(xname_sum(fs->lfnbuf), ofs);
+		return;
+	}
+#endif
+	if (nsflag & NS_LFN) di->add(lfn_key(fs->lfnbuf), ofs);
+	di->add(sfn_key(dp->fn), ofs);
+}
+
+
+void FatFs::dir_index_remove (
+	DIR* dp,		/* Directory object */
+	DWORD ofs		/* Offset of the entry block */
+)
+{
+	DirIndex *di = dir_index_get(dp);
+
+	if (di) di->remove(ofs);
+}
+#endif
+#endif	/* FF_USE_DIRINDEX */
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Directory handling - Find an object in the directory                  */
+/*-----------------------------------------------------------------------*/
+
+ FRESULT FatFs::dir_find (	/* FR_OK(0):succeeded, !=0:error */
+	DIR* dp					/* Pointer to the directory object with the file name */
+)
+{
+	FRESULT res;
+	FATFS *fs = dp->obj.fs;
+	BYTE c;
+#if FF_USE_LFN
+	BYTE a, ord, sum;
+#endif
+#if FF_USE_DIRINDEX
+	DirIndex *di = dir_index_get(dp);
+	DWORD id;
+	UINT i;
+
+	if (!di && fs->dindex && fs->dindex->size()) {	/* Is the directory index active but the directory not indexed? */
+		id = dir_index_id(dp);
+		for (i = 0; i < FF_DIRINDEX_DIRS && !fs->dindex[i].isTooLarge(id); i++) ;
+		if (i < FF_DIRINDEX_DIRS) {		/* Known to have too many names: keep this information */
+			fs->dindex[i].touch(++fs->dindex_tick);
+		} else {						/* Replace the least recently used index */
+			di = fs->dindex;
+			for (i = 1; i < FF_DIRINDEX_DIRS; i++) {
+				if (fs->dindex[i].lastUsed() < di->lastUsed()) di = &fs->dindex[i];
+			}
+			res = dir_index_build(dp, di);
+			if (res != FR_OK) return res;
+			if (!di->isIndexed(id)) di = 0;	/* Too many names: search as usual */
+		}
+	}
+	if (di) {
+		di->touch(++fs->dindex_tick);
+		return dir_index_find(dp, di);
+	}
+#endif
+
+	res = dir_sdi(dp, 0);			/* Rewind directory object */
+	if (res != FR_OK) return res;
+#if FF_FS_EXFAT
+	if (fs->fs_type == FS_EXFAT) {	/* On the exFAT volume */
+		WORD hash = xname_sum(fs->lfnbuf);		/* Hash value of the name to find */
+
+		while ((res = DIR_READ_FILE(dp)) == FR_OK) {	/* Read an item */
+			if (ld_word(fs->dirbuf + XDIR_NameHash) != hash) continue;	/* Skip comparison if hash mismatched */
+			if (cmp_xname(fs)) break;	/* Name matched? */
+		}
+		return res;
+	}
+#endif
+	/* On the FAT/FAT32 volume */
+#if FF_USE_LFN
+	ord = sum = 0xFF; dp->blk_ofs = 0xFFFFFFFF;	/* Reset LFN sequence */
+#endif
+	do {
+		res = move_window(fs, dp->sect);
+		if (res != FR_OK) break;
+		c = dp->dir[DIR_Name];
+		if (c == 0) { res = FR_NO_FILE; break; }	/* Reached to end of table */
+#if FF_USE_LFN		/* LFN configuration */
+		dp->obj.attr = a = dp->dir[DIR_Attr] & AM_MASK;
+		if (c == DDEM || ((a & AM_VOL) && a != AM_LFN)) {	/* An entry without valid data */
+			ord = 0xFF; dp->blk_ofs = 0xFFFFFFFF;	/* Reset LFN sequence */
+		} else {
+			if (a == AM_LFN) {			/* An LFN entry is found */
+				if (!(dp->fn[NSFLAG] & NS_NOLFN)) {
+					if (c & LLEF) {		/* Is it start of LFN sequence? */
+						sum = dp->dir[LDIR_Chksum];
+						c &= (BYTE)~LLEF; ord = c;	/* LFN start order */
 						dp->blk_ofs = dp->dptr;	/* Start offset of LFN */
 					}
 					/* Check validity of the LFN entry and compare it with given name */
@@ -2442,10 +3116,16 @@ static void create_xdir (
 				fs->dirbuf[XDIR_GenFlags] = dp->obj.stat | 1;			/* Update the allocation status */
 				res = store_xdir(&dj);				/* Store the object status */
 				if (res != FR_OK) return res;
+#if FF_USE_PATHCACHE
+				fs->pcache->remove(dp->obj.sclust);	/* The cached size of the directory is outdated */
+#endif
 			}
 		}
 
 		create_xdir(fs->dirbuf, fs->lfnbuf);	/* Create on-memory directory block to be written later */
+#if FF_USE_DIRINDEX
+		dir_index_add(dp, dp->blk_ofs, 0);
+#endif
 		return FR_OK;
 	}
 #endif
@@ -2495,6 +3175,9 @@ static void create_xdir (
 			dp->dir[DIR_NTres] = dp->fn[NSFLAG] & (NS_BODY | NS_EXT);	/* Put NT flag */
 #endif
 			fs->wflag = 1;
+#if FF_USE_DIRINDEX
+			dir_index_add(dp, dp->dptr - ((sn[NSFLAG] & NS_LFN) ? (nlen + 12) / 13 * SZDIRE : 0), sn[NSFLAG]);
+#endif
 		}
 	}
 
@@ -2519,6 +3202,9 @@ static void create_xdir (
 #if FF_USE_LFN		/* LFN configuration */
 	DWORD last = dp->dptr;
 
+#if FF_USE_DIRINDEX
+	dir_index_remove(dp, (dp->blk_ofs == 0xFFFFFFFF) ? dp->dptr : dp->blk_ofs);
+#endif
 	res = (dp->blk_ofs == 0xFFFFFFFF) ? FR_OK : dir_sdi(dp, dp->blk_ofs);	/* Goto top of the entry block if LFN is exist */
 	if (res == FR_OK) {
 		do {
@@ -2937,6 +3623,55 @@ static FRESULT create_name (	/* FR_OK: successful, FR_INVALID_NAME: could not cr
 
 
 
+#if FF_USE_PATHCACHE
+/*-----------------------------------------------------------------------*/
+/* Path cache: normalize the directory segments of a path                */
+/*-----------------------------------------------------------------------*/
+
+#define PC_DEPTH	8	/* Maximum number of directory levels looked up in the path cache */
+
+static UINT path_split (	/* Number of cacheable directory segments (0:none) */
+	const TCHAR* path,		/* Path name without heading separator */
+	TCHAR* key,				/* Buffer for the normalized path (FF_PATHCACHE_PATHLEN) */
+	UINT mlen,				/* Maximum length of a cached path */
+	UINT* klen,				/* Key length after each directory segment */
+	DWORD* khash,			/* Key hash after each directory segment */
+	const TCHAR** rest		/* Remaining path after each directory segment */
+)
+{
+	UINT n = 0, i = 0, s;
+	DWORD h = 0x811C9DC5;	/* FNV-1a */
+	TCHAR c;
+
+
+	if (mlen > FF_PATHCACHE_PATHLEN) mlen = FF_PATHCACHE_PATHLEN;
+	for (;;) {
+		for (s = i; ; path++) {	/* Copy a segment in upper case */
+			c = *path;
+			if ((UINT)c < (FF_USE_LFN ? ' ' : '!') || c == '/' || c == '\\') break;
+#if FF_LFN_UNICODE == 0 && (FF_CODE_PAGE == 0 || FF_CODE_PAGE >= 900)
+			if ((UINT)c >= 0x80) return n;	/* The 2nd byte of a DBC can be a separator */
+#endif
+			if (i >= mlen) return n;		/* Too long to be cached */
+			if (IsLower(c)) c -= 0x20;
+			key[i++] = c;
+			h = (h ^ (DWORD)c) * 0x01000193;
+		}
+		if (c != '/' && c != '\\') return n;	/* Last segment is not a directory to be cached */
+		if (key[s] == '.' && (i - s == 1 || (i - s == 2 && key[s + 1] == '.'))) return n;	/* Dot names are not cached */
+		while (*path == '/' || *path == '\\') path++;
+		if ((UINT)*path < (FF_USE_LFN ? ' ' : '!')) return n;	/* Trailing separator */
+		klen[n] = i; khash[n] = h; rest[n] = path;
+		if (++n == PC_DEPTH || i >= mlen) return n;
+		key[i++] = '/';
+		h = (h ^ (DWORD)'/') * 0x01000193;
+	}
+}
+#endif	/* FF_USE_PATHCACHE */
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Follow a file path                                                    */
 /*-----------------------------------------------------------------------*/
@@ -2949,6 +3684,13 @@ static FRESULT create_name (	/* FR_OK: successful, FR_INVALID_NAME: could not cr
 	FRESULT res;
 	BYTE ns;
 	FATFS *fs = dp->obj.fs;
+#if FF_USE_PATHCACHE
+	TCHAR key[FF_PATHCACHE_PATHLEN];
+	UINT klen[PC_DEPTH], nseg = 0, lv = 0;
+	DWORD khash[PC_DEPTH];
+	const TCHAR *rest[PC_DEPTH];
+	PathCache::Entry *pe = 0;
+#endif
 
 
 #if FF_FS_RPATH != 0
@@ -2975,6 +3717,24 @@ static FRESULT create_name (	/* FR_OK: successful, FR_INVALID_NAME: could not cr
 		dp->obj.stat = fs->dirbuf[XDIR_GenFlags] & 2;
 	}
 #endif
+#endif
+#if FF_USE_PATHCACHE
+	if (dp->obj.sclust == 0 && fs->pcache->size()) {	/* Look up the deepest known directory of the path */
+		nseg = path_split(path, key, fs->pcache->pathLength(), klen, khash, rest);
+		for (lv = nseg; lv > 0 && !(pe = fs->pcache->find(key, klen[lv - 1], khash[lv - 1])); lv--) ;
+		if (nseg) fs->pcache->record(pe != 0);
+		if (pe) {							/* Continue the walk in the directory */
+			path = rest[lv - 1];
+			dp->obj.sclust = pe->sclust;
+#if FF_FS_EXFAT
+			dp->obj.stat = pe->stat;
+			dp->obj.objsize = pe->objsize;
+			dp->obj.c_scl = pe->c_scl;
+			dp->obj.c_size = pe->c_size;
+			dp->obj.c_ofs = pe->c_ofs;
+#endif
+		}
+	}
 #endif
 
 	if ((UINT)*path < ' ') {				/* Null path name is the origin directory itself */
@@ -3015,6 +3775,10 @@ static FRESULT create_name (	/* FR_OK: successful, FR_INVALID_NAME: could not cr
 			{
 				dp->obj.sclust = ld_clust(fs, fs->win + dp->dptr % SS(fs));	/* Open next directory */
 			}
+#if FF_USE_PATHCACHE
+			if (lv < nseg) fs->pcache->add(key, klen[lv], khash[lv], &dp->obj);	/* Remember the directory */
+			lv++;
+#endif
 		}
 	}
 
@@ -3254,7 +4018,8 @@ static DWORD make_rand (
  FRESULT FatFs::mount_volume (	/* FR_OK(0): successful, !=0: an error occurred */
 	const TCHAR** path,			/* Pointer to pointer to the path name (drive number) */
 	FATFS** rfs,				/* Pointer to pointer to the found filesystem object */
-	BYTE mode					/* !=0: Check write protection for write access */
+	BYTE mode,					/* !=0: Check write protection for write access */
+	BYTE shared					/* !=0: Read-only access, which can share the volume with other readers */
 )
 {
 	int vol;
@@ -3274,6 +4039,16 @@ static DWORD make_rand (
 	/* Check if the filesystem object is valid or not */
 	fs = FatFsDir[vol];					/* Get pointer to the filesystem object */
 	if (!fs) return FR_NOT_ENABLED;		/* Is the filesystem object available? */
+#if FF_FS_SHARED_READ
+	if (shared && shared_read && p_io && p_io->allowsConcurrentReads()) {	/* Share the volume with other readers if it is ready (and the driver allows it) */
+		if (!lock_fs_shared(fs)) return FR_TIMEOUT;
+		if (fs->fs_type != 0 && !(p_io->disk_status(fs->pdrv) & STA_NOINIT)) {
+			*rfs = fs;
+			return FR_OK;
+		}
+		unlock_fs(fs, FR_OK);			/* It needs to be mounted: exclusive access */
+	}
+#endif
 #if FF_FS_REENTRANT
 	if (!lock_fs(fs)) return FR_TIMEOUT;	/* Lock the volume */
 #endif
@@ -3306,6 +4081,13 @@ static DWORD make_rand (
 	if (p_io->disk_ioctl(fs->pdrv, GET_SECTOR_SIZE, &SS(fs)) != RES_OK) return FR_DISK_ERR;
 	if (SS(fs) > FF_MAX_SS || SS(fs) < FF_MIN_SS || (SS(fs) & (SS(fs) - 1))) return FR_DISK_ERR;
 #endif
+#if FF_USE_WINCACHE
+	fs->wcache = &WinCache[vol];		/* Attach the sector cache of the volume and drop stale entries */
+	fs->wcache->begin(wcache_sectors, SS(fs));	/* (It stays inactive if there is not enough memory) */
+#endif
+#if FF_USE_FATCACHE
+	fs->fcache = 0;		/* (Attached when the FAT type is known) */
+#endif
 
 	/* Find an FAT volume on the drive */
 	fmt = find_volume(fs, LD2PT(vol));
@@ -3374,6 +4156,7 @@ static DWORD make_rand (
 
 #if !FF_FS_READONLY
 		fs->last_clst = fs->free_clst = 0xFFFFFFFF;		/* Initialize cluster allocation information */
+		fs->fcnt_clst = 2; fs->fcnt_free = 0;			/* No free cluster counted yet */
 #endif
 		fmt = FS_EXFAT;			/* FAT sub-type */
 	} else
@@ -3433,6 +4216,7 @@ static DWORD make_rand (
 #if !FF_FS_READONLY
 		/* Get FSInfo if available */
 		fs->last_clst = fs->free_clst = 0xFFFFFFFF;		/* Initialize cluster allocation information */
+		fs->fcnt_clst = 2; fs->fcnt_free = 0;			/* No free cluster counted yet */
 		fs->fsi_flag = 0x80;
 #if (FF_FS_NOFSINFO & 3) != 3
 		if (fmt == FS_FAT32				/* Allow to update FSInfo only if BPB_FSInfo32 == 1 */
@@ -3458,6 +4242,23 @@ static DWORD make_rand (
 
 	fs->fs_type = (BYTE)fmt;/* FAT sub-type */
 	fs->id = ++Fsid;		/* Volume mount ID */
+#if FF_USE_FREEMAP
+	fs->fmap = &FreeMaps[vol];		/* Attach the free cluster map of the volume (filled on first use) */
+	fs->fmap->begin(fmt == FS_EXFAT ? 0 : fs->n_fatent, fmap_bytes);	/* (exFAT has its own allocation bitmap) */
+#endif
+#if FF_USE_FATCACHE
+	fs->fcache = &FatCaches[vol];		/* Attach the FAT chain cache of the volume and drop stale entries */
+	fs->fcache->begin(fcache_regions, (fmt == FS_FAT32 || fmt == FS_EXFAT) ? SS(fs) / 4 : SS(fs) / 2);	/* A region covers a FAT sector (It stays inactive if there is not enough memory) */
+#endif
+#if FF_USE_DIRINDEX
+	fs->dindex = DirIndexes[vol];	/* Attach the directory indexes of the volume and drop stale ones */
+	fs->dindex_tick = 0;
+	for (fmt = 0; fmt < FF_DIRINDEX_DIRS; fmt++) fs->dindex[fmt].begin(dindex_entries);
+#endif
+#if FF_USE_PATHCACHE
+	fs->pcache = &PathCaches[vol];	/* Attach the path cache of the volume and drop stale paths */
+	fs->pcache->begin(pcache_entries, FF_PATHCACHE_PATHLEN);
+#endif
 #if FF_USE_LFN == 1
 	fs->lfnbuf = LfnBuf;	/* Static LFN working buffer */
 #if FF_FS_EXFAT
@@ -3482,15 +4283,24 @@ static DWORD make_rand (
 
 FRESULT FatFs::validate (	/* Returns FR_OK or FR_INVALID_OBJECT */
 	FFOBJID* obj,			/* Pointer to the FFOBJID, the 1st member in the FIL/DIR object, to check validity */
-	FATFS** rfs				/* Pointer to pointer to the owner filesystem object to return */
+	FATFS** rfs,			/* Pointer to pointer to the owner filesystem object to return */
+	BYTE shared				/* !=0: Read-only access, which can share the volume with other readers */
 )
 {
 	FRESULT res = FR_INVALID_OBJECT;
+#if FF_FS_REENTRANT
+	int locked;
+#endif
 
 
 	if (obj && obj->fs && obj->fs->fs_type && obj->id == obj->fs->id) {	/* Test if the object is valid */
 #if FF_FS_REENTRANT
-		if (lock_fs(obj->fs)) {	/* Obtain the filesystem object */
+#if FF_FS_SHARED_READ
+		locked = (shared && shared_read && p_io->allowsConcurrentReads()) ? lock_fs_shared(obj->fs) : lock_fs(obj->fs);
+#else
+		locked = lock_fs(obj->fs);
+#endif
+		if (locked) {	/* Obtain the filesystem object */
 			if (!(p_io->disk_status(obj->fs->pdrv) & STA_NOINIT)) { /* Test if the phsical drive is kept initialized */
 				res = FR_OK;
 			} else {
@@ -3549,6 +4359,9 @@ FRESULT FatFs::f_mount (
 		if (!ff_del_syncobj(cfs->sobj)) return FR_INT_ERR;
 #endif
 		cfs->fs_type = 0;				/* Clear old fs object */
+#if FF_USE_PATHCACHE
+		PathCaches[vol].clear();		/* Drop the resolved paths of the volume */
+#endif
 	}
 
 	if (fs) {
@@ -3713,6 +4526,15 @@ FRESULT FatFs::f_open (
 			}
 #if FF_USE_FASTSEEK
 			fp->cltbl = 0;			/* Disable fast seek mode */
+#endif
+#if FF_USE_WRITEBEHIND && !FF_FS_READONLY
+			fp->wbuf = 0;			/* No write-behind buffer */
+			fp->wb_size = fp->wb_cnt = 0;
+#endif
+#if FF_USE_READAHEAD
+			fp->rbuf = 0;			/* No read-ahead buffer */
+			fp->ra_size = fp->ra_win = fp->ra_cnt = 0;
+			fp->ra_hit = fp->ra_miss = 0;
 #endif
 			fp->obj.fs = fs;	 	/* Validate the file object */
 			fp->obj.id = fs->id;
@@ -3760,6 +4582,64 @@ FRESULT FatFs::f_open (
 
 
 
+#if FF_USE_READAHEAD
+/*-----------------------------------------------------------------------*/
+/* Read-ahead buffer: load a data sector into the file buffer            */
+/*-----------------------------------------------------------------------*/
+
+FRESULT FatFs::load_fbuf (	/* Returns FR_OK or FR_DISK_ERR */
+	FIL* fp,		/* File object (fptr is on the top of the sector) */
+	LBA_t sect,		/* Sector to be loaded into buf[] */
+	UINT csect		/* Sector offset of the sector in the current cluster */
+)
+{
+	FATFS *fs = fp->obj.fs;
+	DWORD clst, nxt;
+	UINT n, run;
+	FSIZE_t rem;
+
+
+	if (fp->ra_size == 0) {		/* No read-ahead buffer: read the sector */
+		return p_io->disk_read(fs->pdrv, fp->buf, sect, 1) == RES_OK ? FR_OK : FR_DISK_ERR;
+	}
+	if (fp->ra_cnt && sect - fp->ra_sect < fp->ra_cnt) {	/* Has the sector been read ahead? */
+		mem_cpy(fp->buf, fp->rbuf + (sect - fp->ra_sect) * SS(fs), SS(fs));
+		fp->ra_hit++;
+		return FR_OK;
+	}
+	fp->ra_miss++;
+	if (sect == fp->sect + 1 || (fp->ra_cnt && sect == fp->ra_sect + fp->ra_cnt)) {	/* Sequential access: grow the window (1:no read-ahead yet) */
+		fp->ra_win = fp->ra_win ? fp->ra_win * 2 : 1;
+		if (fp->ra_win > fp->ra_size) fp->ra_win = fp->ra_size;
+	} else {						/* Random access: no read-ahead */
+		fp->ra_win = 0;
+	}
+	n = fp->ra_win;
+	rem = (fp->obj.objsize - fp->fptr + SS(fs) - 1) / SS(fs);	/* Sectors up to the end of the file */
+	if (n > rem) n = (UINT)rem;
+	run = fs->csize - csect;		/* Sectors up to the end of the contiguous cluster run */
+	LOCK_WIN(fs);
+	for (clst = fp->clust; run < n; clst = nxt, run += fs->csize) {
+		nxt = get_fat(&fp->obj, clst);
+		if (nxt != clst + 1) break;
+	}
+	UNLOCK_WIN(fs);
+	if (n > run) n = run;
+	if (n < 2) {
+		return p_io->disk_read(fs->pdrv, fp->buf, sect, 1) == RES_OK ? FR_OK : FR_DISK_ERR;
+	}
+	fp->ra_cnt = 0;
+	if (p_io->disk_read(fs->pdrv, fp->rbuf, sect, n) != RES_OK) return FR_DISK_ERR;
+	fp->ra_sect = sect;
+	fp->ra_cnt = n;
+	mem_cpy(fp->buf, fp->rbuf, SS(fs));
+	return FR_OK;
+}
+#endif
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Read File                                                             */
 /*-----------------------------------------------------------------------*/
@@ -3781,9 +4661,12 @@ FRESULT FatFs::f_read (
 
 
 	*br = 0;	/* Clear read byte counter */
-	res = validate(&fp->obj, &fs);				/* Check validity of the file object */
+	res = validate(&fp->obj, &fs, 1);			/* Check validity of the file object (shared with other readers) */
 	if (res != FR_OK || (res = (FRESULT)fp->err) != FR_OK) LEAVE_FF(fs, res);	/* Check validity */
 	if (!(fp->flag & FA_READ)) LEAVE_FF(fs, FR_DENIED); /* Check access mode */
+#if FF_USE_WRITEBEHIND && !FF_FS_READONLY
+	if (sync_wbuf(fp) != FR_OK) ABORT(fs, FR_DISK_ERR);	/* The collected sectors need to be on the disk */
+#endif
 	remain = fp->obj.objsize - fp->fptr;
 	if (btr > remain) btr = (UINT)remain;		/* Truncate btr by remaining bytes */
 
@@ -3801,7 +4684,9 @@ FRESULT FatFs::f_read (
 					} else
 #endif
 					{
+						LOCK_WIN(fs);
 						clst = get_fat(&fp->obj, fp->clust);	/* Follow cluster chain on the FAT */
+						UNLOCK_WIN(fs);
 					}
 				}
 				if (clst < 2) ABORT(fs, FR_INT_ERR);
@@ -3828,34 +4713,267 @@ FRESULT FatFs::f_read (
 				}
 #endif
 #endif
-				rcnt = SS(fs) * cc;				/* Number of bytes transferred */
-				continue;
+				rcnt = SS(fs) * cc;				/* Number of bytes transferred */
+				continue;
+			}
+#if !FF_FS_TINY
+			if (fp->sect != sect) {			/* Load data sector if not in cache */
+#if !FF_FS_READONLY
+				if (fp->flag & FA_DIRTY) {		/* Write-back dirty sector cache */
+					if (p_io->disk_write(fs->pdrv, fp->buf, fp->sect, 1) != RES_OK) ABORT(fs, FR_DISK_ERR);
+					fp->flag &= (BYTE)~FA_DIRTY;
+				}
+#endif
+#if FF_USE_READAHEAD
+				if (load_fbuf(fp, sect, csect) != FR_OK) ABORT(fs, FR_DISK_ERR);	/* Fill sector cache (with read-ahead) */
+#else
+				if (p_io->disk_read(fs->pdrv, fp->buf, sect, 1) != RES_OK)	ABORT(fs, FR_DISK_ERR);	/* Fill sector cache */
+#endif
+			}
+#endif
+			fp->sect = sect;
+		}
+		rcnt = SS(fs) - (UINT)fp->fptr % SS(fs);	/* Number of bytes remains in the sector */
+		if (rcnt > btr) rcnt = btr;					/* Clip it by btr if needed */
+#if FF_FS_TINY
+		LOCK_WIN(fs);
+		if (move_window(fs, fp->sect) != FR_OK) { UNLOCK_WIN(fs); ABORT(fs, FR_DISK_ERR); }	/* Move sector window */
+		mem_cpy(rbuff, fs->win + fp->fptr % SS(fs), rcnt);	/* Extract partial sector */
+		UNLOCK_WIN(fs);
+#else
+		mem_cpy(rbuff, fp->buf + fp->fptr % SS(fs), rcnt);	/* Extract partial sector */
+#endif
+	}
+
+	LEAVE_FF(fs, FR_OK);
+}
+
+
+
+#if FF_USE_READVIEW
+/*-----------------------------------------------------------------------*/
+/* Read File without Copying                                             */
+/*-----------------------------------------------------------------------*/
+
+FRESULT FatFs::f_readview (
+	FIL* fp, 			/* Pointer to the file object */
+	const BYTE** data,	/* Pointer to the pointer to the data (valid until the next access to the file) */
+	UINT btr,			/* Maximum number of bytes to read */
+	UINT* br			/* Pointer to number of bytes read (less than btr at the end of a buffer) */
+)
+{
+	FRESULT res;
+	FATFS *fs;
+	DWORD clst;
+	LBA_t sect;
+	FSIZE_t remain;
+	UINT rcnt, csect;
+#if FF_USE_READAHEAD
+	UINT loaded;
+#endif
+	BYTE *dbuf;
+
+
+	*data = 0; *br = 0;	/* Clear read byte counter */
+	res = validate(&fp->obj, &fs, !FF_FS_TINY);	/* Check validity of the file object (shared with other readers unless the data is lent from the window) */
+	if (res != FR_OK || (res = (FRESULT)fp->err) != FR_OK) LEAVE_FF(fs, res);	/* Check validity */
+	if (!(fp->flag & FA_READ)) LEAVE_FF(fs, FR_DENIED);	/* Check access mode */
+#if FF_USE_WRITEBEHIND && !FF_FS_READONLY
+	if (sync_wbuf(fp) != FR_OK) ABORT(fs, FR_DISK_ERR);	/* The collected sectors need to be on the disk */
+#endif
+	remain = fp->obj.objsize - fp->fptr;
+	if (btr > remain) btr = (UINT)remain;		/* Truncate btr by remaining bytes */
+	if (btr == 0) LEAVE_FF(fs, FR_OK);
+
+	csect = (UINT)(fp->fptr / SS(fs) & (fs->csize - 1));	/* Sector offset in the cluster */
+	if (fp->fptr % SS(fs) == 0 && csect == 0) {	/* On the cluster boundary? */
+		if (fp->fptr == 0) {				/* On the top of the file? */
+			clst = fp->obj.sclust;			/* Follow cluster chain from the origin */
+		} else {							/* Middle or end of the file */
+#if FF_USE_FASTSEEK
+			if (fp->cltbl) {
+				clst = clmt_clust(fp, fp->fptr);	/* Get cluster# from the CLMT */
+			} else
+#endif
+			{
+				LOCK_WIN(fs);
+				clst = get_fat(&fp->obj, fp->clust);	/* Follow cluster chain on the FAT */
+				UNLOCK_WIN(fs);
+			}
+		}
+		if (clst < 2) ABORT(fs, FR_INT_ERR);
+		if (clst == 0xFFFFFFFF) ABORT(fs, FR_DISK_ERR);
+		fp->clust = clst;					/* Update current cluster */
+	}
+	sect = clst2sect(fs, fp->clust);		/* Get current sector */
+	if (sect == 0) ABORT(fs, FR_INT_ERR);
+	sect += csect;
+#if FF_FS_TINY
+	if (move_window(fs, sect) != FR_OK) ABORT(fs, FR_DISK_ERR);	/* Move sector window to the file data */
+	dbuf = fs->win;
+#else
+	if (fp->sect != sect) {					/* Load data sector if not in cache */
+#if !FF_FS_READONLY
+		if (fp->flag & FA_DIRTY) {			/* Write-back dirty sector cache */
+			if (p_io->disk_write(fs->pdrv, fp->buf, fp->sect, 1) != RES_OK) ABORT(fs, FR_DISK_ERR);
+			fp->flag &= (BYTE)~FA_DIRTY;
+		}
+#endif
+#if FF_USE_READAHEAD
+		loaded = 0;
+		if (!fp->ra_cnt || sect - fp->ra_sect >= fp->ra_cnt) {	/* Not read ahead yet? */
+			if (load_fbuf(fp, sect, csect) != FR_OK) ABORT(fs, FR_DISK_ERR);	/* Fill sector cache (with read-ahead) */
+			fp->sect = sect;
+			loaded = 1;						/* The sector has been loaded */
+		}
+		if (fp->ra_cnt && sect - fp->ra_sect < fp->ra_cnt) {	/* Lend the sectors which have been read ahead */
+			rcnt = (UINT)(fp->ra_sect + fp->ra_cnt - sect) * SS(fs);
+			if (rcnt > btr) rcnt = btr;
+			*data = fp->rbuf + (sect - fp->ra_sect) * SS(fs);
+			if (rcnt % SS(fs)) {			/* Ends in a sector: it needs to appear in buf[] */
+				mem_cpy(fp->buf, *data + rcnt / SS(fs) * SS(fs), SS(fs));
+				fp->sect = sect + rcnt / SS(fs);
+			}
+			fp->clust += (csect + (rcnt - 1) / SS(fs)) / fs->csize;	/* Cluster of the last byte (read-ahead does not cross fragments) */
+			fp->ra_hit += (rcnt + SS(fs) - 1) / SS(fs) - loaded;
+			fp->fptr += rcnt;
+			*br = rcnt;
+			LEAVE_FF(fs, FR_OK);
+		}
+#else
+		if (p_io->disk_read(fs->pdrv, fp->buf, sect, 1) != RES_OK) ABORT(fs, FR_DISK_ERR);	/* Fill sector cache */
+#endif
+	}
+	dbuf = fp->buf;
+#endif
+	fp->sect = sect;
+	rcnt = SS(fs) - (UINT)fp->fptr % SS(fs);	/* Number of bytes remains in the sector */
+	if (rcnt > btr) rcnt = btr;					/* Clip it by btr if needed */
+	*data = dbuf + fp->fptr % SS(fs);
+	fp->fptr += rcnt;
+	*br = rcnt;
+
+	LEAVE_FF(fs, FR_OK);
+}
+#endif
+
+
+
+#if FF_USE_ASYNC
+/*-----------------------------------------------------------------------*/
+/* Map File Sectors for a Direct Transfer                                */
+/*-----------------------------------------------------------------------*/
+/* Provides the sectors which hold the data at the file pointer (which needs
+/  to be on a sector boundary), up to the end of the current cluster, and moves
+/  the file pointer behind them. The caller transfers the data of the sectors
+/  with its own (e.g. asynchronous) disk requests. FA_WRITE allocates the
+/  cluster and extends the file like f_write() does. */
+
+FRESULT FatFs::f_mapsect (
+	FIL* fp,		/* Pointer to the file object */
+	UINT btx,		/* Maximum number of bytes to transfer */
+	BYTE mode,		/* FA_READ: map the data to read, FA_WRITE: map (and allocate) the data to write */
+	LBA_t* sect,	/* Pointer to the first sector of the run */
+	UINT* sc		/* Pointer to number of sectors in the run (0: end of file or disk full) */
+)
+{
+	FRESULT res;
+	FATFS *fs;
+	DWORD clst;
+	FSIZE_t remain;
+	UINT cc, csect;
+
+
+	*sect = 0; *sc = 0;
+	res = validate(&fp->obj, &fs);				/* Check validity of the file object */
+	if (res != FR_OK || (res = (FRESULT)fp->err) != FR_OK) LEAVE_FF(fs, res);	/* Check validity */
+	if (mode != FA_READ && (FF_FS_READONLY || mode != FA_WRITE)) LEAVE_FF(fs, FR_INVALID_PARAMETER);
+	if (!(fp->flag & mode)) LEAVE_FF(fs, FR_DENIED);	/* Check access mode */
+	if (fp->fptr % SS(fs) != 0) LEAVE_FF(fs, FR_INVALID_PARAMETER);	/* Not on the sector boundary */
+#if !FF_FS_READONLY
+#if FF_USE_WRITEBEHIND
+	if (sync_wbuf(fp) != FR_OK) ABORT(fs, FR_DISK_ERR);	/* The collected sectors need to be on the disk */
+#endif
+	if (mode == FA_WRITE) {
+#if FF_USE_READAHEAD
+		fp->ra_cnt = 0;		/* The sectors read ahead may get outdated */
+#endif
+		if ((!FF_FS_EXFAT || fs->fs_type != FS_EXFAT) && (DWORD)(fp->fptr + btx) < (DWORD)fp->fptr) {
+			btx = (UINT)(0xFFFFFFFF - (DWORD)fp->fptr);	/* File size cannot reach 4 GiB at FAT volume */
+		}
+	} else
+#endif
+	{
+		remain = fp->obj.objsize - fp->fptr;
+		if (btx > remain) btx = (UINT)remain;	/* Truncate btx by remaining bytes */
+	}
+	cc = btx / SS(fs);							/* Number of whole sectors */
+	if (cc == 0) LEAVE_FF(fs, FR_OK);
+
+	csect = (UINT)(fp->fptr / SS(fs) & (fs->csize - 1));	/* Sector offset in the cluster */
+	if (csect == 0) {							/* On the cluster boundary? */
+		if (fp->fptr == 0) {					/* On the top of the file? */
+			clst = fp->obj.sclust;				/* Follow cluster chain from the origin */
+#if !FF_FS_READONLY
+			if (clst == 0 && mode == FA_WRITE) {	/* If no cluster is allocated, */
+				clst = create_chain(&fp->obj, 0);	/* create a new cluster chain */
+				if (clst == 0) LEAVE_FF(fs, FR_OK);	/* Disk full */
 			}
-#if !FF_FS_TINY
-			if (fp->sect != sect) {			/* Load data sector if not in cache */
+#endif
+		} else {								/* Middle or end of the file */
+#if FF_USE_FASTSEEK
+			if (fp->cltbl) {
+				clst = clmt_clust(fp, fp->fptr);	/* Get cluster# from the CLMT */
+			} else
+#endif
 #if !FF_FS_READONLY
-				if (fp->flag & FA_DIRTY) {		/* Write-back dirty sector cache */
-					if (p_io->disk_write(fs->pdrv, fp->buf, fp->sect, 1) != RES_OK) ABORT(fs, FR_DISK_ERR);
-					fp->flag &= (BYTE)~FA_DIRTY;
-				}
+			if (mode == FA_WRITE) {
+				clst = create_chain(&fp->obj, fp->clust);	/* Follow or stretch cluster chain on the FAT */
+				if (clst == 0) LEAVE_FF(fs, FR_OK);	/* Disk full */
+			} else
 #endif
-				if (p_io->disk_read(fs->pdrv, fp->buf, sect, 1) != RES_OK)	ABORT(fs, FR_DISK_ERR);	/* Fill sector cache */
+			{
+				clst = get_fat(&fp->obj, fp->clust);	/* Follow cluster chain on the FAT */
 			}
-#endif
-			fp->sect = sect;
 		}
-		rcnt = SS(fs) - (UINT)fp->fptr % SS(fs);	/* Number of bytes remains in the sector */
-		if (rcnt > btr) rcnt = btr;					/* Clip it by btr if needed */
+		if (clst < 2) ABORT(fs, FR_INT_ERR);
+		if (clst == 0xFFFFFFFF) ABORT(fs, FR_DISK_ERR);
+		fp->clust = clst;						/* Update current cluster */
+		if (fp->obj.sclust == 0) fp->obj.sclust = clst;	/* Set start cluster if the first write */
+	}
+	*sect = clst2sect(fs, fp->clust);			/* Get current sector */
+	if (*sect == 0) ABORT(fs, FR_INT_ERR);
+	*sect += csect;
+	if (csect + cc > fs->csize) cc = fs->csize - csect;	/* Clip at cluster boundary */
+
+#if !FF_FS_READONLY
 #if FF_FS_TINY
-		if (move_window(fs, fp->sect) != FR_OK) ABORT(fs, FR_DISK_ERR);	/* Move sector window */
-		mem_cpy(rbuff, fs->win + fp->fptr % SS(fs), rcnt);	/* Extract partial sector */
+	if (fs->winsect - *sect < cc) {				/* The sector window holds one of the sectors */
+		if (sync_window(fs) != FR_OK) ABORT(fs, FR_DISK_ERR);	/* Write-back it for the transfer */
+		if (mode == FA_WRITE) fs->winsect = (LBA_t)0 - 1;	/* and invalidate it as it gets outdated */
+	}
 #else
-		mem_cpy(rbuff, fp->buf + fp->fptr % SS(fs), rcnt);	/* Extract partial sector */
+	if (fp->sect - *sect < cc) {				/* The sector cache holds one of the sectors */
+		if (fp->flag & FA_DIRTY) {				/* Write-back it for the transfer */
+			if (p_io->disk_write(fs->pdrv, fp->buf, fp->sect, 1) != RES_OK) ABORT(fs, FR_DISK_ERR);
+			fp->flag &= (BYTE)~FA_DIRTY;
+		}
+		if (mode == FA_WRITE) fp->sect = 0;		/* and invalidate it as it gets outdated */
+	}
 #endif
+#endif
+	*sc = cc;
+	fp->fptr += (FSIZE_t)cc * SS(fs);			/* Move the file pointer behind the sectors */
+#if !FF_FS_READONLY
+	if (mode == FA_WRITE) {
+		if (fp->fptr > fp->obj.objsize) fp->obj.objsize = fp->fptr;
+		fp->flag |= FA_MODIFIED;				/* Set file change flag */
 	}
+#endif
 
 	LEAVE_FF(fs, FR_OK);
 }
+#endif
 
 
 
@@ -3884,6 +5002,9 @@ FRESULT FatFs::f_write (
 	res = validate(&fp->obj, &fs);			/* Check validity of the file object */
 	if (res != FR_OK || (res = (FRESULT)fp->err) != FR_OK) LEAVE_FF(fs, res);	/* Check validity */
 	if (!(fp->flag & FA_WRITE)) LEAVE_FF(fs, FR_DENIED);	/* Check access mode */
+#if FF_USE_READAHEAD
+	fp->ra_cnt = 0;		/* The sectors read ahead may get outdated */
+#endif
 
 	/* Check fptr wrap-around (file size cannot reach 4 GiB at FAT volume) */
 	if ((!FF_FS_EXFAT || fs->fs_type != FS_EXFAT) && (DWORD)(fp->fptr + btw) < (DWORD)fp->fptr) {
@@ -3920,8 +5041,12 @@ FRESULT FatFs::f_write (
 			if (fs->winsect == fp->sect && sync_window(fs) != FR_OK) ABORT(fs, FR_DISK_ERR);	/* Write-back sector cache */
 #else
 			if (fp->flag & FA_DIRTY) {		/* Write-back sector cache */
+#if FF_USE_WRITEBEHIND
+				if (put_fbuf(fp) != FR_OK) ABORT(fs, FR_DISK_ERR);	/* (collected with the following sectors) */
+#else
 				if (p_io->disk_write(fs->pdrv, fp->buf, fp->sect, 1) != RES_OK) ABORT(fs, FR_DISK_ERR);
 				fp->flag &= (BYTE)~FA_DIRTY;
+#endif
 			}
 #endif
 			sect = clst2sect(fs, fp->clust);	/* Get current sector */
@@ -4001,10 +5126,17 @@ FRESULT FatFs::f_sync (
 	if (res == FR_OK) {
 		if (fp->flag & FA_MODIFIED) {	/* Is there any change to the file? */
 #if !FF_FS_TINY
+#if FF_USE_WRITEBEHIND
+			if (fp->flag & FA_DIRTY) {	/* Write-back cached data together with the collected sectors */
+				if (put_fbuf(fp) != FR_OK) LEAVE_FF(fs, FR_DISK_ERR);
+			}
+			if (sync_wbuf(fp) != FR_OK) LEAVE_FF(fs, FR_DISK_ERR);
+#else
 			if (fp->flag & FA_DIRTY) {	/* Write-back cached data if needed */
 				if (p_io->disk_write(fs->pdrv, fp->buf, fp->sect, 1) != RES_OK) LEAVE_FF(fs, FR_DISK_ERR);
 				fp->flag &= (BYTE)~FA_DIRTY;
 			}
+#endif
 #endif
 			/* Update the directory entry */
 			tm = GET_FATTIME();				/* Modified time */
@@ -4059,11 +5191,75 @@ FRESULT FatFs::f_sync (
 	LEAVE_FF(fs, res);
 }
 
+
+
+#if FF_USE_WRITEBEHIND
+/*-----------------------------------------------------------------------*/
+/* Assign a Write-Behind Buffer to the File                              */
+/*-----------------------------------------------------------------------*/
+
+FRESULT FatFs::f_setwbuf (
+	FIL* fp,		/* Pointer to the file object */
+	void* buff,		/* Buffer for the collected sectors (NULL:no buffer) */
+	UINT len		/* Size of the buffer in unit of byte */
+)
+{
+	FRESULT res;
+	FATFS *fs;
+
+
+	res = validate(&fp->obj, &fs);	/* Check validity of the file object */
+	if (res == FR_OK) res = (FRESULT)fp->err;
+	if (res == FR_OK) {
+		if (buff && len / SS(fs) < 2) res = FR_INVALID_PARAMETER;	/* Nothing to collect in a single sector */
+		if (res == FR_OK) res = sync_wbuf(fp);	/* Write the sectors collected in the current buffer */
+		if (res == FR_OK) {
+			fp->wbuf = (BYTE*)buff;
+			fp->wb_size = buff ? len / SS(fs) : 0;	/* Number of sectors which fit in the buffer */
+		}
+	}
+
+	LEAVE_FF(fs, res);
+}
+#endif
+
 #endif /* !FF_FS_READONLY */
 
 
 
 
+#if FF_USE_READAHEAD
+/*-----------------------------------------------------------------------*/
+/* Assign a Read-Ahead Buffer to the File                                */
+/*-----------------------------------------------------------------------*/
+
+FRESULT FatFs::f_setrbuf (
+	FIL* fp,		/* Pointer to the file object */
+	void* buff,		/* Buffer for the sectors read ahead (NULL:no buffer) */
+	UINT len		/* Size of the buffer in unit of byte */
+)
+{
+	FRESULT res;
+	FATFS *fs;
+
+
+	res = validate(&fp->obj, &fs);	/* Check validity of the file object */
+	if (res == FR_OK) res = (FRESULT)fp->err;
+	if (res == FR_OK && buff && len / SS(fs) < 2) res = FR_INVALID_PARAMETER;	/* Nothing to read ahead with a single sector */
+	if (res == FR_OK) {
+		fp->rbuf = (BYTE*)buff;
+		fp->ra_size = buff ? len / SS(fs) : 0;	/* Number of sectors which fit in the buffer */
+		fp->ra_win = fp->ra_cnt = 0;
+		fp->ra_hit = fp->ra_miss = 0;
+	}
+
+	LEAVE_FF(fs, res);
+}
+#endif
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Close File                                                            */
 /*-----------------------------------------------------------------------*/
@@ -4306,6 +5502,9 @@ FRESULT FatFs::f_lseek (
 	}
 #endif
 	if (res != FR_OK) LEAVE_FF(fs, res);
+#if FF_USE_WRITEBEHIND && !FF_FS_READONLY
+	if (sync_wbuf(fp) != FR_OK) ABORT(fs, FR_DISK_ERR);	/* The collected sectors need to be on the disk */
+#endif
 
 #if FF_USE_FASTSEEK
 	if (fp->cltbl) {	/* Fast seek */
@@ -4343,6 +5542,9 @@ FRESULT FatFs::f_lseek (
 				if (dsc == 0) ABORT(fs, FR_INT_ERR);
 				dsc += (DWORD)((ofs - 1) / SS(fs)) & (fs->csize - 1);
 				if (fp->fptr % SS(fs) && dsc != fp->sect) {	/* Refill sector cache if needed */
+#if FF_USE_READAHEAD
+					if (dsc != fp->sect + 1) fp->ra_win = 0;	/* Random access */
+#endif
 #if !FF_FS_TINY
 #if !FF_FS_READONLY
 					if (fp->flag & FA_DIRTY) {		/* Write-back dirty sector cache */
@@ -4423,6 +5625,9 @@ FRESULT FatFs::f_lseek (
 			fp->flag |= FA_MODIFIED;
 		}
 		if (fp->fptr % SS(fs) && nsect != fp->sect) {	/* Fill sector cache if needed */
+#if FF_USE_READAHEAD
+			if (nsect != fp->sect + 1) fp->ra_win = 0;	/* Random access */
+#endif
 #if !FF_FS_TINY
 #if !FF_FS_READONLY
 			if (fp->flag & FA_DIRTY) {			/* Write-back dirty sector cache */
@@ -4550,8 +5755,9 @@ FRESULT FatFs::f_readdir (
 	DEF_NAMBUF
 
 
-	res = validate(&dp->obj, &fs);	/* Check validity of the directory object */
+	res = validate(&dp->obj, &fs, 1);	/* Check validity of the directory object (shared with other readers) */
 	if (res == FR_OK) {
+		LOCK_WIN(fs);					/* The directory is read through the sector window */
 		if (!fno) {
 			res = dir_sdi(dp, 0);			/* Rewind the directory object */
 		} else {
@@ -4565,6 +5771,7 @@ FRESULT FatFs::f_readdir (
 			}
 			FREE_NAMBUF();
 		}
+		UNLOCK_WIN(fs);
 	}
 	LEAVE_FF(fs, res);
 }
@@ -4639,8 +5846,9 @@ FRESULT FatFs::f_stat (
 
 
 	/* Get logical drive */
-	res = mount_volume(&path, &dj.obj.fs, 0);
+	res = mount_volume(&path, &dj.obj.fs, 0, 1);	/* (shared with other readers) */
 	if (res == FR_OK) {
+		LOCK_WIN(dj.obj.fs);			/* The path is followed through the sector window */
 		INIT_NAMBUF(dj.obj.fs);
 		res = follow_path(&dj, path);	/* Follow the file path */
 		if (res == FR_OK) {				/* Follow completed */
@@ -4651,6 +5859,7 @@ FRESULT FatFs::f_stat (
 			}
 		}
 		FREE_NAMBUF();
+		UNLOCK_WIN(dj.obj.fs);
 	}
 
 	LEAVE_FF(dj.obj.fs, res);
@@ -4659,6 +5868,205 @@ FRESULT FatFs::f_stat (
 
 
 #if !FF_FS_READONLY
+/*-----------------------------------------------------------------------*/
+/* Count free entries/bits of a FAT or allocation bitmap sector          */
+/*-----------------------------------------------------------------------*/
+
+#if FF_INTDEF == 2
+typedef QWORD CNTWORD;	/* Word size used to count free bits */
+#else
+typedef DWORD CNTWORD;
+#endif
+
+static UINT count_ones (	/* Number of bits set in the word */
+	CNTWORD w
+)
+{
+#if defined(__GNUC__) || defined(__clang__)
+	return (UINT)(sizeof w > 4 ? __builtin_popcountll(w) : __builtin_popcount((DWORD)w));
+#else
+	UINT n;
+
+	for (n = 0; w; n++) w &= w - 1;
+	return n;
+#endif
+}
+
+
+static DWORD count_free_bits (	/* Number of zero bits (free clusters) */
+	const BYTE* p,	/* Allocation bitmap data */
+	DWORD nbit		/* Number of bits to check (from b0 of p[0]) */
+)
+{
+	DWORD n = 0;
+	CNTWORD w;
+
+
+	for ( ; nbit >= sizeof w * 8; nbit -= sizeof w * 8, p += sizeof w) {	/* Whole words (order of the bits does not matter) */
+		mem_cpy(&w, p, sizeof w);
+		n += sizeof w * 8 - count_ones(w);
+	}
+	for ( ; nbit >= 8; nbit -= 8) n += 8 - count_ones(*p++);	/* Whole bytes */
+	if (nbit) n += nbit - count_ones(*p & ((1 << nbit) - 1));	/* Leading bits of the last byte */
+	return n;
+}
+
+
+static DWORD count_free_fat16 (	/* Number of zero entries (free clusters) */
+	const BYTE* p,	/* FAT data */
+	UINT nent		/* Number of entries */
+)
+{
+	DWORD n = 0;
+	UINT i = 0;
+
+#if FF_SIMD_AVX2
+	const __m256i z = _mm256_setzero_si256();
+
+	for ( ; i + 16 <= nent; i += 16) {	/* 16 entries per compare, 2 mask bits per entry */
+		__m256i v = _mm256_loadu_si256((const __m256i*)(p + i * 2));
+		n += count_ones((DWORD)_mm256_movemask_epi8(_mm256_cmpeq_epi16(v, z))) / 2;
+	}
+#elif FF_SIMD_SSE2
+	const __m128i z = _mm_setzero_si128();
+
+	for ( ; i + 8 <= nent; i += 8) {	/* 8 entries per compare, 2 mask bits per entry */
+		__m128i v = _mm_loadu_si128((const __m128i*)(p + i * 2));
+		n += count_ones((DWORD)_mm_movemask_epi8(_mm_cmpeq_epi16(v, z))) / 2;
+	}
+#elif FF_SIMD_NEON
+	for ( ; i + 8 <= nent; i += 8) {	/* 8 entries per compare */
+		uint16x8_t v = vld1q_u16((const uint16_t*)(p + i * 2));
+		n += vaddvq_u16(vshrq_n_u16(vceqzq_u16(v), 15));
+	}
+#endif
+	for ( ; i < nent; i++) {
+		if (ld_word(p + i * 2) == 0) n++;
+	}
+	return n;
+}
+
+
+static DWORD count_free_fat32 (	/* Number of zero entries (free clusters) */
+	const BYTE* p,	/* FAT data */
+	UINT nent		/* Number of entries */
+)
+{
+	DWORD n = 0;
+	UINT i = 0;
+
+#if FF_SIMD_AVX2
+	const __m256i z = _mm256_setzero_si256(), m = _mm256_set1_epi32(0x0FFFFFFF);
+
+	for ( ; i + 8 <= nent; i += 8) {	/* 8 entries per compare (upper 4 bits are reserved) */
+		__m256i v = _mm256_and_si256(_mm256_loadu_si256((const __m256i*)(p + i * 4)), m);
+		n += count_ones((DWORD)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(v, z))));
+	}
+#elif FF_SIMD_SSE2
+	const __m128i z = _mm_setzero_si128(), m = _mm_set1_epi32(0x0FFFFFFF);
+
+	for ( ; i + 4 <= nent; i += 4) {	/* 4 entries per compare (upper 4 bits are reserved) */
+		__m128i v = _mm_and_si128(_mm_loadu_si128((const __m128i*)(p + i * 4)), m);
+		n += count_ones((DWORD)_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(v, z))));
+	}
+#elif FF_SIMD_NEON
+	const uint32x4_t m = vdupq_n_u32(0x0FFFFFFF);
+
+	for ( ; i + 4 <= nent; i += 4) {	/* 4 entries per compare (upper 4 bits are reserved) */
+		uint32x4_t v = vandq_u32(vld1q_u32((const uint32_t*)(p + i * 4)), m);
+		n += vaddvq_u32(vshrq_n_u32(vceqzq_u32(v), 31));
+	}
+#endif
+	for ( ; i < nent; i++) {
+		if ((ld_dword(p + i * 4) & 0x0FFFFFFF) == 0) n++;
+	}
+	return n;
+}
+#endif /* !FF_FS_READONLY */
+
+
+
+#if !FF_FS_READONLY
+/*-----------------------------------------------------------------------*/
+/* Count free clusters (stops early when the limit has been reached)     */
+/*-----------------------------------------------------------------------*/
+/* The count continues where the previous call has stopped: the clusters
+/  below fcnt_clst have been counted, and fcnt_free of them are free, which
+/  is kept up to date by the allocation. free_clst gets valid when the count
+/  reaches the end of the volume, so the FAT is scanned at most once. */
+
+FRESULT FatFs::count_free (	/* FR_OK(0):succeeded, !=0:error */
+	FATFS* fs,		/* Filesystem object */
+	DWORD limit,	/* Stop when at least this number of free clusters was found */
+	DWORD* nclst	/* Pointer to a variable to return number of free clusters found */
+)
+{
+	FRESULT res = FR_OK;
+	DWORD nfree, clst, stat, n;
+	UINT i;
+	FFOBJID obj;
+
+
+	if (fs->free_clst <= fs->n_fatent - 2) {	/* Is the free cluster counter valid? */
+		*nclst = fs->free_clst;
+		return FR_OK;
+	}
+#if FF_USE_FREEMAP
+	if (fs->fmap && fs->fmap->size()) {	/* Scan FAT once to fill the free cluster map, which counts the free clusters as well */
+		res = build_freemap(fs);
+		if (res == FR_OK) *nclst = fs->free_clst;
+		return res;
+	}
+#endif
+	nfree = fs->fcnt_free;
+	clst = fs->fcnt_clst;
+	if (fs->fs_type == FS_FAT12) {	/* FAT12: Scan bit field FAT entries */
+		obj.fs = fs;
+		for ( ; clst < fs->n_fatent && nfree < limit; clst++) {
+			stat = get_fat(&obj, clst);
+			if (stat == 0xFFFFFFFF) { res = FR_DISK_ERR; break; }
+			if (stat == 1) { res = FR_INT_ERR; break; }
+			if (stat == 0) nfree++;
+		}
+	} else {
+#if FF_FS_EXFAT
+		if (fs->fs_type == FS_EXFAT) {	/* exFAT: Scan allocation bitmap (the count stops at sector boundaries only) */
+			while (clst < fs->n_fatent && nfree < limit) {	/* Counts numbuer of bits with zero in the bitmap, a sector at a time */
+				res = move_window(fs, fs->bitbase + (clst - 2) / ((DWORD)SS(fs) * 8));
+				if (res != FR_OK) break;
+				n = fs->n_fatent - clst;
+				if (n > (DWORD)SS(fs) * 8) n = (DWORD)SS(fs) * 8;
+				nfree += count_free_bits(fs->win, n);
+				clst += n;
+			}
+		} else
+#endif
+		{	/* FAT16/32: Scan WORD/DWORD FAT entries */
+			n = SS(fs) / (fs->fs_type == FS_FAT16 ? 2 : 4);	/* Entries per sector */
+			while (clst < fs->n_fatent && nfree < limit) {	/* Counts numbuer of entries with zero in the FAT, a sector at a time */
+				res = move_window(fs, fs->fatbase + clst / n);
+				if (res != FR_OK) break;
+				i = (UINT)(clst % n);	/* First entry to be counted in the sector */
+				stat = n - i;
+				if (stat > fs->n_fatent - clst) stat = fs->n_fatent - clst;
+				nfree += (fs->fs_type == FS_FAT16) ? count_free_fat16(fs->win + i * 2, (UINT)stat) : count_free_fat32(fs->win + i * 4, (UINT)stat);
+				clst += stat;
+			}
+		}
+	}
+	fs->fcnt_clst = clst;	/* The next call continues here */
+	fs->fcnt_free = nfree;
+	if (res == FR_OK && clst >= fs->n_fatent) {	/* Has the whole volume been counted? */
+		fs->free_clst = nfree;	/* Now free_clst is valid */
+		fs->fsi_flag |= 1;		/* FAT32: FSInfo is to be updated */
+	}
+	*nclst = nfree;
+	return res;
+}
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Get Number of Free Clusters                                           */
 /*-----------------------------------------------------------------------*/
@@ -4671,76 +6079,66 @@ FRESULT FatFs::f_getfree (
 {
 	FRESULT res;
 	FATFS *fs;
-	DWORD nfree, clst, stat;
-	LBA_t sect;
-	UINT i;
-	FFOBJID obj;
 
 
 	/* Get logical drive */
 	res = mount_volume(&path, &fs, 0);
 	if (res == FR_OK) {
 		*fatfs = fs;				/* Return ptr to the fs object */
-		/* If free_clst is valid, return it without full FAT scan */
-		if (fs->free_clst <= fs->n_fatent - 2) {
-			*nclst = fs->free_clst;
-		} else {
-			/* Scan FAT to obtain number of free clusters */
-			nfree = 0;
-			if (fs->fs_type == FS_FAT12) {	/* FAT12: Scan bit field FAT entries */
-				clst = 2; obj.fs = fs;
-				do {
-					stat = get_fat(&obj, clst);
-					if (stat == 0xFFFFFFFF) { res = FR_DISK_ERR; break; }
-					if (stat == 1) { res = FR_INT_ERR; break; }
-					if (stat == 0) nfree++;
-				} while (++clst < fs->n_fatent);
-			} else {
-#if FF_FS_EXFAT
-				if (fs->fs_type == FS_EXFAT) {	/* exFAT: Scan allocation bitmap */
-					BYTE bm;
-					UINT b;
-
-					clst = fs->n_fatent - 2;	/* Number of clusters */
-					sect = fs->bitbase;			/* Bitmap sector */
-					i = 0;						/* Offset in the sector */
-					do {	/* Counts numbuer of bits with zero in the bitmap */
-						if (i == 0) {
-							res = move_window(fs, sect++);
-							if (res != FR_OK) break;
-						}
-						for (b = 8, bm = fs->win[i]; b && clst; b--, clst--) {
-							if (!(bm & 1)) nfree++;
-							bm >>= 1;
-						}
-						i = (i + 1) % SS(fs);
-					} while (clst);
-				} else
-#endif
-				{	/* FAT16/32: Scan WORD/DWORD FAT entries */
-					clst = fs->n_fatent;	/* Number of entries */
-					sect = fs->fatbase;		/* Top of the FAT */
-					i = 0;					/* Offset in the sector */
-					do {	/* Counts numbuer of entries with zero in the FAT */
-						if (i == 0) {
-							res = move_window(fs, sect++);
-							if (res != FR_OK) break;
-						}
-						if (fs->fs_type == FS_FAT16) {
-							if (ld_word(fs->win + i) == 0) nfree++;
-							i += 2;
-						} else {
-							if ((ld_dword(fs->win + i) & 0x0FFFFFFF) == 0) nfree++;
-							i += 4;
-						}
-						i %= SS(fs);
-					} while (--clst);
-				}
-			}
-			*nclst = nfree;			/* Return the free clusters */
-			fs->free_clst = nfree;	/* Now free_clst is valid */
-			fs->fsi_flag |= 1;		/* FAT32: FSInfo is to be updated */
-		}
+		res = count_free(fs, 0xFFFFFFFF, nclst);	/* Without FAT scan if free_clst is valid */
+	}
+
+	LEAVE_FF(fs, res);
+}
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Check for a Minimum Number of Free Clusters                           */
+/*-----------------------------------------------------------------------*/
+
+FRESULT FatFs::f_getfree_min (
+	const TCHAR* path,	/* Logical drive number */
+	DWORD ncl,			/* Number of free clusters which are needed */
+	DWORD* nclst,		/* Pointer to a variable to return number of free clusters (>= ncl if available) */
+	FATFS** fatfs		/* Pointer to return pointer to corresponding filesystem object */
+)
+{
+	FRESULT res;
+	FATFS *fs;
+
+
+	/* Get logical drive */
+	res = mount_volume(&path, &fs, 0);
+	if (res == FR_OK) {
+		*fatfs = fs;				/* Return ptr to the fs object */
+		res = count_free(fs, ncl, nclst);	/* Scan FAT only until enough free clusters were found */
+	}
+
+	LEAVE_FF(fs, res);
+}
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Check for a Minimum Number of Free Clusters on the Volume of a File   */
+/*-----------------------------------------------------------------------*/
+
+FRESULT FatFs::f_getfree_file (
+	FIL* fp,			/* Pointer to the file object */
+	DWORD ncl,			/* Number of free clusters which are needed */
+	DWORD* nclst		/* Pointer to a variable to return number of free clusters (>= ncl if available) */
+)
+{
+	FRESULT res;
+	FATFS *fs;
+
+
+	res = validate(&fp->obj, &fs);	/* Check validity of the file object */
+	if (res == FR_OK) {
+		res = count_free(fs, ncl, nclst);	/* Scan FAT only until enough free clusters were found */
 	}
 
 	LEAVE_FF(fs, res);
@@ -4765,6 +6163,12 @@ FRESULT FatFs::f_truncate (
 	res = validate(&fp->obj, &fs);	/* Check validity of the file object */
 	if (res != FR_OK || (res = (FRESULT)fp->err) != FR_OK) LEAVE_FF(fs, res);
 	if (!(fp->flag & FA_WRITE)) LEAVE_FF(fs, FR_DENIED);	/* Check access mode */
+#if FF_USE_READAHEAD
+	fp->ra_cnt = 0;		/* The sectors read ahead may get outdated */
+#endif
+#if FF_USE_WRITEBEHIND && !FF_FS_READONLY
+	if (sync_wbuf(fp) != FR_OK) ABORT(fs, FR_DISK_ERR);	/* The collected sectors need to be on the disk */
+#endif
 
 	if (fp->fptr < fp->obj.objsize) {	/* Process when fptr is not on the eof */
 		if (fp->fptr == 0) {	/* When set file size to zero, remove entire cluster chain */
@@ -4874,6 +6278,12 @@ FRESULT FatFs::f_unlink (
 			}
 			if (res == FR_OK) {
 				res = dir_remove(&dj);			/* Remove the directory entry */
+#if FF_USE_DIRINDEX
+				if (dj.obj.attr & AM_DIR) dir_index_clear(fs, dclst);
+#endif
+#if FF_USE_PATHCACHE
+				if (dj.obj.attr & AM_DIR) fs->pcache->remove(dclst);	/* Drop the removed directory */
+#endif
 				if (res == FR_OK && dclst != 0) {	/* Remove the cluster chain if exist */
 #if FF_FS_EXFAT
 					res = remove_chain(&obj, dclst, 0);
@@ -4927,6 +6337,12 @@ FRESULT FatFs::f_mkdir (
 			if (dcl == 0xFFFFFFFF) res = FR_DISK_ERR;	/* Disk error? */
 			tm = GET_FATTIME();
 			if (res == FR_OK) {
+#if FF_USE_DIRINDEX
+				dir_index_clear(fs, dcl);		/* The cluster may have held a removed directory */
+#endif
+#if FF_USE_PATHCACHE
+				fs->pcache->remove(dcl);
+#endif
 				res = dir_clear(fs, dcl);		/* Clean up the new table */
 				if (res == FR_OK) {
 					if (!FF_FS_EXFAT || fs->fs_type != FS_EXFAT) {	/* Create dot entries (FAT only) */
@@ -5007,6 +6423,9 @@ FRESULT FatFs::f_rename (
 		}
 #endif
 		if (res == FR_OK) {						/* Object to be renamed is found */
+#if FF_USE_PATHCACHE
+			if (djo.obj.attr & AM_DIR) fs->pcache->clear();	/* The paths of the directory tree change */
+#endif
 #if FF_FS_EXFAT
 			if (fs->fs_type == FS_EXFAT) {	/* At exFAT volume */
 				BYTE nf, nn;
@@ -5475,6 +6894,9 @@ FRESULT FatFs::f_expand (
 				fs->free_clst -= tcl;
 				fs->fsi_flag |= 1;
 			}
+			if (scl < fs->fcnt_clst) {	/* Update the count in progress */
+				fs->fcnt_free -= (scl + tcl <= fs->fcnt_clst) ? tcl : fs->fcnt_clst - scl;
+			}
 		}
 	}
 
@@ -5510,6 +6932,9 @@ FRESULT FatFs::f_forward (
 	res = validate(&fp->obj, &fs);		/* Check validity of the file object */
 	if (res != FR_OK || (res = (FRESULT)fp->err) != FR_OK) LEAVE_FF(fs, res);
 	if (!(fp->flag & FA_READ)) LEAVE_FF(fs, FR_DENIED);	/* Check access mode */
+#if FF_USE_WRITEBEHIND && !FF_FS_READONLY
+	if (sync_wbuf(fp) != FR_OK) ABORT(fs, FR_DISK_ERR);	/* The collected sectors need to be on the disk */
+#endif
 
 	remain = fp->obj.objsize - fp->fptr;
 	if (btf > remain) btf = (UINT)remain;			/* Truncate btf by remaining bytes */
@@ -5540,7 +6965,11 @@ FRESULT FatFs::f_forward (
 				fp->flag &= (BYTE)~FA_DIRTY;
 			}
 #endif
+#if FF_USE_READAHEAD
+			if (load_fbuf(fp, sect, csect) != FR_OK) ABORT(fs, FR_DISK_ERR);
+#else
 			if (p_io->disk_read(fs->pdrv, fp->buf, sect, 1) != RES_OK) ABORT(fs, FR_DISK_ERR);
+#endif
 		}
 		dbuf = fp->buf;
 #endif
@@ -22,6 +22,10 @@
 #include <cstdlib>
 #include "ffconf.h"  // FatFs configuration options
 #include "ffdef.h"   // common structures and defines
+#if FF_USE_WINCACHE || FF_USE_FATCACHE || FF_USE_FREEMAP || FF_USE_DIRINDEX || \
+    FF_USE_PATHCACHE
+#include "ffcache.h"  // sector/FAT/path caches, free cluster map, dir index
+#endif
 // Relative to ff/, not this file's own directory root: quote-includes
 // resolve relative to the including file's directory first, so a plain
 // "driver/IO.h" here would look for ff/driver/IO.h (which doesn't
@@ -46,6 +50,72 @@ class FatFs {
   FatFs(IO& io) { setDriver(io); }
   void setDriver(IO& io) { p_io = &io; }
   IO* getDriver() {return p_io;}
+
+#if FF_USE_WINCACHE
+  /// Constructor which is providing the io driver and the number of sectors
+  /// which are cached per volume under the disk access window
+  FatFs(IO& io, UINT cacheSectors) {
+    setDriver(io);
+    setSectorCacheSize(cacheSectors);
+  }
+  /// Defines the number of sectors cached per volume (0: no cache). This is
+  /// applied when a volume gets mounted.
+  void setSectorCacheSize(UINT sectors) { wcache_sectors = sectors; }
+  /// Provides the number of sectors cached per volume
+  UINT sectorCacheSize() { return wcache_sectors; }
+  /// Provides access to the sector cache (e.g. hit/miss counters) of a volume
+  SectorCache& getSectorCache(BYTE vol = 0) { return WinCache[vol]; }
+#endif
+#if FF_USE_FATCACHE
+  /// Defines the number of FAT regions (the decoded cluster links of one FAT
+  /// sector each) which are cached per volume (0: no cache). This is applied
+  /// when a volume gets mounted.
+  void setFatCacheSize(UINT regions) { fcache_regions = regions; }
+  /// Provides the number of FAT regions cached per volume
+  UINT fatCacheSize() { return fcache_regions; }
+  /// Provides access to the FAT chain cache (e.g. hit/miss counters) of a volume
+  FatCache& getFatCache(BYTE vol = 0) { return FatCaches[vol]; }
+#endif
+#if FF_USE_FREEMAP
+  /// Defines the memory in bytes which is used per volume for the map of free
+  /// clusters (0: no map). This is applied when a volume gets mounted.
+  void setFreeMapSize(UINT bytes) { fmap_bytes = bytes; }
+  /// Provides the memory in bytes which is used per volume for the free map
+  UINT freeMapSize() { return fmap_bytes; }
+  /// Provides access to the free cluster map (e.g. its granule) of a volume
+  FreeMap& getFreeMap(BYTE vol = 0) { return FreeMaps[vol]; }
+#endif
+#if FF_USE_DIRINDEX
+  /// Defines the number of names per volume which can be kept in the
+  /// directory hash index (0: no index). This is applied when a volume gets
+  /// mounted.
+  void setDirIndexSize(UINT entries) { dindex_entries = entries; }
+  /// Provides the number of names which can be kept in the directory index
+  UINT dirIndexSize() { return dindex_entries; }
+  /// Provides access to a directory hash index (0..FF_DIRINDEX_DIRS-1) of a
+  /// volume
+  DirIndex& getDirIndex(BYTE vol = 0, UINT slot = 0) {
+    return DirIndexes[vol][slot];
+  }
+#endif
+#if FF_USE_PATHCACHE
+  /// Defines the number of resolved directory paths which are cached per
+  /// volume (0: no cache). This is applied when a volume gets mounted.
+  void setPathCacheSize(UINT entries) { pcache_entries = entries; }
+  /// Provides the number of directory paths cached per volume
+  UINT pathCacheSize() { return pcache_entries; }
+  /// Provides access to the path cache (e.g. hit/miss counters) of a volume
+  PathCache& getPathCache(BYTE vol = 0) { return PathCaches[vol]; }
+#endif
+#if FF_FS_SHARED_READ
+  /// Lets f_read(), f_readview(), f_stat() and f_readdir() of several threads
+  /// share the lock of a volume (true, default) or locks it exclusively for
+  /// every call (false). Readers only share it if the driver allows
+  /// concurrent reads (IO::allowsConcurrentReads()).
+  void setSharedRead(bool active) { shared_read = active; }
+  /// Provides true if read-only operations share the lock of a volume
+  bool isSharedRead() { return shared_read; }
+#endif
   /*!<--------------------------------------------------------------*/
   /*!< FatFs module application interface                           */
 
@@ -60,6 +130,22 @@ class FatFs {
                   FSIZE_t ofs); /*!< Move file pointer of the file object */
   FRESULT f_truncate(FIL* fp);  /*!< Truncate the file */
   FRESULT f_sync(FIL* fp);      /*!< Flush cached data of the writing file */
+#if FF_USE_WRITEBEHIND && !FF_FS_READONLY
+  FRESULT f_setwbuf(FIL* fp, void* buff,
+                    UINT len); /*!< Assign a write-behind buffer to the file */
+#endif
+#if FF_USE_READAHEAD
+  FRESULT f_setrbuf(FIL* fp, void* buff,
+                    UINT len); /*!< Assign a read-ahead buffer to the file */
+#endif
+#if FF_USE_READVIEW
+  FRESULT f_readview(FIL* fp, const BYTE** data, UINT btr,
+                     UINT* br); /*!< Read data from the file without copying */
+#endif
+#if FF_USE_ASYNC
+  FRESULT f_mapsect(FIL* fp, UINT btx, BYTE mode, LBA_t* sect,
+                    UINT* sc); /*!< Map the next sectors of the file for a direct transfer */
+#endif
   FRESULT f_opendir(DIR* dp, const TCHAR* path); /*!< Open a directory */
   FRESULT f_closedir(DIR* dp);                   /*!< Close an open directory */
   FRESULT f_readdir(DIR* dp, FILINFO* fno);      /*!< Read a directory item */
@@ -82,6 +168,14 @@ class FatFs {
   FRESULT f_getfree(
       const TCHAR* path, DWORD* nclst,
       FATFS** fatfs); /*!< Get number of free clusters on the drive */
+  FRESULT f_getfree_min(
+      const TCHAR* path, DWORD ncl, DWORD* nclst,
+      FATFS** fatfs); /*!< Get number of free clusters, scanning only until ncl
+                         were found if the count is not known (the next call
+                         continues the scan) */
+  FRESULT f_getfree_file(
+      FIL* fp, DWORD ncl,
+      DWORD* nclst); /*!< Like f_getfree_min() for the volume of the file */
   FRESULT f_getlabel(const TCHAR* path, TCHAR* label,
                      DWORD* vsn);         /*!< Get volume label */
   FRESULT f_setlabel(const TCHAR* label); /*!< Set volume label */
@@ -122,14 +216,6 @@ class FatFs {
   DWORD get_fattime(void);
 #endif
 
-/*!< Sync functions */
-#if FF_FS_REENTRANT
-  int ff_cre_syncobj(BYTE vol, FF_SYNC_t* sobj); /*!< Create a sync object */
-  int ff_req_grant(FF_SYNC_t sobj);              /*!< Lock sync object */
-  void ff_rel_grant(FF_SYNC_t sobj);             /*!< Unlock sync object */
-  int ff_del_syncobj(FF_SYNC_t sobj);            /*!< Delete a sync object */
-#endif
-
  protected:
   IO* p_io = nullptr;
 
@@ -160,6 +246,45 @@ class FatFs {
                                   drives) */
   WORD Fsid = 0;                   /*!< Filesystem mount ID */
 
+#if FF_USE_WRITEBEHIND && FF_FS_TINY
+#error FF_USE_WRITEBEHIND can not be used with FF_FS_TINY
+#endif
+#if FF_USE_READAHEAD && FF_FS_TINY
+#error FF_USE_READAHEAD can not be used with FF_FS_TINY
+#endif
+#if FF_USE_WINCACHE
+#if FF_FS_TINY
+#error FF_USE_WINCACHE can not be used with FF_FS_TINY
+#endif
+  SectorCache WinCache[FF_VOLUMES]; /*!< Sector caches under the window of each
+                                       volume */
+  UINT wcache_sectors = FF_WINCACHE_SECTORS; /*!< Cached sectors per volume */
+#endif
+#if FF_USE_FATCACHE
+  FatCache FatCaches[FF_VOLUMES]; /*!< FAT chain caches of each volume */
+  UINT fcache_regions = FF_FATCACHE_REGIONS; /*!< Cached FAT regions per volume */
+#endif
+#if FF_USE_FREEMAP
+  FreeMap FreeMaps[FF_VOLUMES]; /*!< Free cluster maps of each volume */
+  UINT fmap_bytes = FF_FREEMAP_BYTES; /*!< Memory of the free map per volume */
+#endif
+#if FF_USE_DIRINDEX
+#if !FF_USE_LFN
+#error FF_USE_DIRINDEX requires FF_USE_LFN
+#endif
+  DirIndex DirIndexes[FF_VOLUMES][FF_DIRINDEX_DIRS]; /*!< Directory hash indexes
+                                                        of each volume */
+  UINT dindex_entries = FF_DIRINDEX_ENTRIES; /*!< Names per directory index */
+#endif
+#if FF_USE_PATHCACHE
+  PathCache PathCaches[FF_VOLUMES]; /*!< Resolved directory paths of each
+                                       volume */
+  UINT pcache_entries = FF_PATHCACHE_ENTRIES; /*!< Cached paths per volume */
+#endif
+#if FF_FS_SHARED_READ
+  bool shared_read = true; /*!< Readers share the volume lock */
+#endif
+
 #if FF_FS_RPATH != 0
   BYTE CurrVol = 0; /*!< Current drive */
 #endif
@@ -288,27 +413,55 @@ class FatFs {
   void flush(putbuff* pb);
   void putc_bfd(putbuff* pb, TCHAR c);
   int putc_flush(putbuff* pb);
-  FRESULT validate(FFOBJID* obj, FATFS** rfs);
+  FRESULT validate(FFOBJID* obj, FATFS** rfs, BYTE shared = 0);
   FRESULT sync_window(FATFS* fs);
   FRESULT move_window(FATFS* fs, LBA_t sect);
+#if FF_USE_WINCACHE
+  FRESULT cache_write_back(FATFS* fs, int idx);
+  FRESULT cache_store(FATFS* fs);
+  FRESULT cache_flush(FATFS* fs);
+  void cache_invalidate(FATFS* fs, LBA_t sect, DWORD count);
+#endif
   FRESULT sync_fs(FATFS* fs);
+#if FF_USE_WRITEBEHIND && !FF_FS_READONLY
+  FRESULT sync_wbuf(FIL* fp);
+  FRESULT put_fbuf(FIL* fp);
+#endif
+#if FF_USE_READAHEAD
+  FRESULT load_fbuf(FIL* fp, LBA_t sect, UINT csect);
+#endif
+  DWORD decode_fat(FATFS* fs, DWORD clst);
+  DWORD read_fat(FATFS* fs, DWORD clst);
   DWORD get_fat(FFOBJID* obj, DWORD clst);
   FRESULT put_fat(FATFS* fs, DWORD clst, DWORD val);
   DWORD find_bitmap(FATFS* fs, DWORD clst, DWORD ncl);
   FRESULT remove_chain(FFOBJID* obj, DWORD clst, DWORD pclst);
+#if FF_USE_FREEMAP
+  FRESULT build_freemap(FATFS* fs);
+  DWORD find_free(FFOBJID* obj, DWORD scl);
+#endif
   DWORD create_chain(FFOBJID* obj, DWORD clst);
+  FRESULT count_free(FATFS* fs, DWORD limit, DWORD* nclst);
   FRESULT dir_clear(FATFS* fs, DWORD clst);
   FRESULT dir_sdi(DIR* dp, DWORD ofs);
   FRESULT dir_next(DIR* dp, int stretch);
   FRESULT dir_alloc(DIR* dp, UINT nent);
   FRESULT dir_read(DIR* dp, int vol);
   FRESULT dir_find(DIR* dp);
+#if FF_USE_DIRINDEX
+  DirIndex* dir_index_get(DIR* dp);
+  FRESULT dir_index_build(DIR* dp, DirIndex* di);
+  FRESULT dir_index_find(DIR* dp, DirIndex* di);
+  void dir_index_add(DIR* dp, DWORD ofs, BYTE nsflag);
+  void dir_index_remove(DIR* dp, DWORD ofs);
+#endif
   FRESULT dir_register(DIR* dp);
   FRESULT dir_remove(DIR* dp);
   FRESULT follow_path(DIR* dp, const TCHAR* path);
   UINT check_fs(FATFS* fs, LBA_t sect);
   UINT find_volume(FATFS* fs, UINT part);
-  FRESULT mount_volume(const TCHAR** path, FATFS** rfs, BYTE mode);
+  FRESULT mount_volume(const TCHAR** path, FATFS** rfs, BYTE mode,
+                       BYTE shared = 0);
   int cmp_lfn(const WCHAR* lfnbuf, BYTE* dir);
   int pick_lfn(WCHAR* lfnbuf, BYTE* dir);
   void put_lfn(const WCHAR* lfn, BYTE* dir, BYTE ord, BYTE sum);
@@ -351,6 +504,19 @@ class FatFs {
 #endif
 };
 
+/* Sync functions (defined in ffsystem-inc.h) */
+#if FF_FS_REENTRANT
+inline int ff_cre_syncobj(BYTE vol, FF_SYNC_t* sobj); /*!< Create a sync object */
+inline int ff_req_grant(FF_SYNC_t sobj);              /*!< Lock sync object */
+inline void ff_rel_grant(FF_SYNC_t sobj);             /*!< Unlock sync object */
+inline int ff_del_syncobj(FF_SYNC_t sobj);            /*!< Delete a sync object */
+#if FF_FS_SHARED_READ
+inline int ff_req_shared(FF_SYNC_t sobj);  /*!< Lock sync object for reading */
+inline void ff_req_window(FF_SYNC_t sobj); /*!< Lock the sector window */
+inline void ff_rel_window(FF_SYNC_t sobj); /*!< Unlock the sector window */
+#endif
+#endif
+
 /* LFN support functions */
 #if FF_USE_LFN >= 1 /*!< Code conversion (defined in unicode.c) */
 WCHAR ff_oem2uni(WCHAR oem, WORD cp); /*!< OEM code to Unicode conversion */
@@ -0,0 +1,587 @@
+// SPDX-License-Identifier: MIT
+#pragma once
+#include <cstdlib>
+#include <cstring>
+#include "ffdef.h"
+
+namespace fatfs {
+
+/**
+ * @brief N-way, sector granular write-back cache which is layered under the
+ * disk access window (FATFS::win) by FatFs::move_window(). Every sector that
+ * the window leaves is parked here together with its dirty state, so that
+ * workloads which alternate between FAT, directory and bitmap sectors are
+ * served from RAM instead of issuing a disk_read() on every switch.
+ *
+ * The cache only holds the data: writing back dirty sectors (and mirroring
+ * them to the 2nd FAT) is done by FatFs, which knows the volume layout.
+ * Entries are replaced in least recently used order.
+ * @ingroup ff
+ */
+class SectorCache {
+ public:
+  SectorCache() = default;
+  SectorCache(const SectorCache&) = delete;
+  SectorCache& operator=(const SectorCache&) = delete;
+  ~SectorCache() { end(); }
+
+  /// allocates (or reallocates) the buffers for the indicated number of
+  /// sectors: returns false if the memory is not available
+  bool begin(UINT sectors, UINT sectorSize) {
+    if (sectors == n_entries && sectorSize == sector_size) {
+      clear();
+      return true;
+    }
+    end();
+    if (sectors == 0) return true;
+    data = (BYTE*)malloc((size_t)sectors * sectorSize);
+    entries = (Entry*)malloc(sectors * sizeof(Entry));
+    if (data == nullptr || entries == nullptr) {
+      end();
+      return false;
+    }
+    n_entries = sectors;
+    sector_size = sectorSize;
+    clear();
+    return true;
+  }
+
+  /// releases all memory
+  void end() {
+    free(data);
+    free(entries);
+    data = nullptr;
+    entries = nullptr;
+    n_entries = 0;
+  }
+
+  /// number of sectors which can be cached
+  UINT size() { return n_entries; }
+
+  /// drops all entries (dirty data is lost)
+  void clear() {
+    for (UINT j = 0; j < n_entries; j++) {
+      entries[j].sect = INVALID;
+      entries[j].dirty = 0;
+      entries[j].used = 0;
+    }
+    tick = 0;
+  }
+
+  /// returns the index of the entry which holds the sector or -1
+  int find(LBA_t sect) {
+    for (UINT j = 0; j < n_entries; j++) {
+      if (entries[j].sect == sect) return (int)j;
+    }
+    return -1;
+  }
+
+  /// returns the index of a free entry or of the least recently used one
+  int victim() {
+    UINT result = 0;
+    for (UINT j = 0; j < n_entries; j++) {
+      if (entries[j].sect == INVALID) return (int)j;
+      if (entries[j].used < entries[result].used) result = j;
+    }
+    return (int)result;
+  }
+
+  /// assigns the entry to the indicated sector and marks it as recently used
+  void assign(int idx, LBA_t sect, bool dirty) {
+    entries[idx].sect = sect;
+    entries[idx].dirty = dirty;
+    touch(idx);
+  }
+
+  /// marks the entry as most recently used
+  void touch(int idx) { entries[idx].used = ++tick; }
+
+  BYTE* buffer(int idx) { return data + (size_t)idx * sector_size; }
+  LBA_t sector(int idx) { return entries[idx].sect; }
+  bool isDirty(int idx) { return entries[idx].dirty; }
+  void setDirty(int idx, bool dirty) { entries[idx].dirty = dirty; }
+
+  /// drops all entries in the sector range without writing them back: used
+  /// when the sectors are released or overwritten by a direct disk access
+  void invalidate(LBA_t sect, DWORD count) {
+    for (UINT j = 0; j < n_entries; j++) {
+      if (entries[j].sect != INVALID && entries[j].sect - sect < count) {
+        entries[j].sect = INVALID;
+        entries[j].dirty = 0;
+      }
+    }
+  }
+
+  /// number of lookups which were served from the cache
+  DWORD hits() { return hit_count; }
+  /// number of lookups which needed to access the disk
+  DWORD misses() { return miss_count; }
+  void resetStatistics() { hit_count = miss_count = 0; }
+
+  /// used by FatFs to maintain the statistics
+  void countHit() { hit_count++; }
+  void countMiss() { miss_count++; }
+
+ protected:
+  struct Entry {
+    LBA_t sect;
+    DWORD used;
+    BYTE dirty;
+  };
+  static constexpr LBA_t INVALID = (LBA_t)0 - 1;
+  BYTE* data = nullptr;
+  Entry* entries = nullptr;
+  UINT n_entries = 0;
+  UINT sector_size = 0;
+  DWORD tick = 0;
+  DWORD hit_count = 0;
+  DWORD miss_count = 0;
+};
+
+/**
+ * @brief Cache of decoded FAT entries (cluster links) which is consulted by
+ * FatFs::get_fat(). Each entry holds the links of one FAT region of
+ * span() clusters, so following a chain only needs to touch the FAT once
+ * per region instead of moving the disk access window at every cluster
+ * boundary. put_fat() keeps the cached links coherent.
+ * @ingroup ff
+ */
+class FatCache : public SectorCache {
+ public:
+  /// allocates the buffers for the indicated number of regions with span
+  /// cluster links each: returns false if the memory is not available
+  bool begin(UINT regions, UINT span) {
+    span_ = span;
+    return SectorCache::begin(regions, span * sizeof(DWORD));
+  }
+
+  /// number of cluster links per region
+  UINT span() { return span_; }
+
+  /// returns the index of the entry which holds the link of the cluster or -1
+  int findCluster(DWORD clst) { return find(clst / span_); }
+
+  /// decoded links of the entry (indexed by cluster % span())
+  DWORD* links(int idx) { return (DWORD*)buffer(idx); }
+
+  /// updates the cached link of the cluster if its region is cached
+  void update(DWORD clst, DWORD val) {
+    if (size() == 0) return;
+    int idx = findCluster(clst);
+    if (idx >= 0) links(idx)[clst % span_] = val;
+  }
+
+ protected:
+  UINT span_ = 1;
+};
+
+
+/**
+ * @brief In-memory map of the free clusters of a FAT12/16/32 volume which is
+ * used by FatFs::create_chain() and FatFs::f_getfree() instead of scanning
+ * the FAT, similar to the allocation bitmap of exFAT. Each bit covers a group
+ * of granule() clusters: with a granule of 1 the map is exact, with a larger
+ * granule it is a coarse summary where a set bit only tells that the group
+ * may contain a free cluster, while a cleared bit guarantees that it is full.
+ * The granule is the smallest power of two which keeps the map within the
+ * requested number of bytes.
+ * @ingroup ff
+ */
+class FreeMap {
+ public:
+  FreeMap() = default;
+  FreeMap(const FreeMap&) = delete;
+  FreeMap& operator=(const FreeMap&) = delete;
+  ~FreeMap() { end(); }
+
+  /// allocates the map for the indicated number of FAT entries using at most
+  /// maxBytes of memory: returns false if the memory is not available
+  bool begin(DWORD entries, UINT maxBytes) {
+    DWORD gran = 1;
+    while (maxBytes && gran < entries && (entries + gran - 1) / gran > (DWORD)maxBytes * 8) {
+      gran *= 2;
+    }
+    DWORD groups = maxBytes == 0 ? 0 : (entries + gran - 1) / gran;
+    DWORD words = (groups + 31) / 32;
+    if (words != n_words) {
+      end();
+      if (words > 0) {
+        bits = (DWORD*)malloc(words * sizeof(DWORD));
+        if (bits == nullptr) return false;
+        n_words = words;
+      }
+    }
+    granule_ = gran;
+    n_groups = groups;
+    built = false;
+    return true;
+  }
+
+  /// releases all memory
+  void end() {
+    free(bits);
+    bits = nullptr;
+    n_words = 0;
+    n_groups = 0;
+    built = false;
+  }
+
+  /// number of groups (0: the map is not active)
+  DWORD size() { return n_groups; }
+  /// number of clusters covered by one bit
+  DWORD granule() { return granule_; }
+  /// true after the map has been filled by scanning the FAT
+  bool isValid() { return built; }
+
+  /// marks all groups as full: used before the FAT gets scanned
+  void clear() {
+    memset(bits, 0, n_words * sizeof(DWORD));
+    built = false;
+  }
+  /// confirms that the map reflects the FAT
+  void setValid() { built = true; }
+
+  /// group which contains the cluster
+  DWORD group(DWORD clst) { return clst / granule_; }
+
+  /// records that the cluster has been freed or allocated
+  void update(DWORD clst, bool isFree) {
+    if (!built) return;
+    DWORD g = group(clst);
+    if (g >= n_groups) return;
+    if (isFree) {
+      bits[g / 32] |= (DWORD)1 << (g % 32);
+    } else if (granule_ == 1) {
+      bits[g / 32] &= ~((DWORD)1 << (g % 32));
+    }
+  }
+
+  /// marks the group as containing a free cluster
+  void setFree(DWORD g) { bits[g / 32] |= (DWORD)1 << (g % 32); }
+  /// marks the group as full
+  void setFull(DWORD g) { bits[g / 32] &= ~((DWORD)1 << (g % 32)); }
+
+  /// returns the first group >= g which may contain a free cluster or size()
+  DWORD next(DWORD g) {
+    while (g < n_groups) {
+      DWORD w = bits[g / 32] >> (g % 32);
+      if (w) {
+        while (!(w & 1)) {
+          w >>= 1;
+          g++;
+        }
+        return g < n_groups ? g : n_groups;
+      }
+      g = (g / 32 + 1) * 32;  // skip the rest of an empty word
+    }
+    return n_groups;
+  }
+
+ protected:
+  DWORD* bits = nullptr;
+  DWORD n_words = 0;
+  DWORD n_groups = 0;
+  DWORD granule_ = 1;
+  bool built = false;
+};
+
+
+/**
+ * @brief Hash index of the entries of one directory which is used by
+ * FatFs::dir_find() instead of comparing the name of every entry. It maps a
+ * 16 bit name hash (the exFAT name hash or a hash of the up-cased LFN/SFN) to
+ * the offsets of the entry blocks with this hash, which are then verified
+ * against the directory on the disk. The index is built by the first search
+ * in a directory and kept up to date by FatFs::dir_register() and
+ * FatFs::dir_remove(); the entries of removed names are reused. If the
+ * directory has more names than entries are available, the index is marked
+ * as too large and the directory gets scanned as usual. FatFs keeps FF_DIRINDEX_DIRS of them per volume which are
+ * replaced in least recently used order.
+ * @ingroup ff
+ */
+class DirIndex {
+ public:
+  /// key for entries which can not be hashed (non ASCII SFN)
+  static constexpr DWORD WILD = 0x10000;
+  /// offset of an entry which has been removed
+  static constexpr DWORD INVALID = 0xFFFFFFFF;
+
+  DirIndex() = default;
+  DirIndex(const DirIndex&) = delete;
+  DirIndex& operator=(const DirIndex&) = delete;
+  ~DirIndex() { end(); }
+
+  /// allocates the index for the indicated number of names: returns false
+  /// if the memory is not available
+  bool begin(UINT entries) {
+    valid = too_large = false;
+    used = 0;
+    if (entries == n_entries) return true;
+    end();
+    if (entries == 0) return true;
+    n_buckets = 1;
+    while (n_buckets < entries / 2) n_buckets *= 2;
+    ent = (Entry*)malloc(entries * sizeof(Entry));
+    heads = (int*)malloc((n_buckets + 1) * sizeof(int));
+    if (ent == nullptr || heads == nullptr) {
+      end();
+      return false;
+    }
+    n_entries = entries;
+    return true;
+  }
+
+  /// releases all memory
+  void end() {
+    free(ent);
+    free(heads);
+    ent = nullptr;
+    heads = nullptr;
+    n_entries = 0;
+    n_buckets = 0;
+    valid = too_large = false;
+  }
+
+  /// maximum number of names (0: the index is not active)
+  UINT size() { return n_entries; }
+  /// number of names in the index
+  UINT count() { return n_used - n_free; }
+
+  /// true if the index holds all names of the indicated directory
+  bool isIndexed(DWORD dir) { return valid && dir_id == dir; }
+  /// true if the directory has more names than the index can hold
+  bool isTooLarge(DWORD dir) { return too_large && dir_id == dir; }
+
+  /// starts a new (empty) index for the indicated directory
+  void reset(DWORD dir) {
+    for (UINT j = 0; j <= n_buckets; j++) heads[j] = -1;
+    n_used = n_free = 0;
+    free_list = -1;
+    dir_id = dir;
+    valid = true;
+    too_large = false;
+  }
+
+  /// drops the index
+  void clear() { valid = too_large = false; }
+  /// drops the index if it belongs to the indicated directory
+  void clear(DWORD dir) {
+    if (dir_id == dir) clear();
+  }
+
+  /// adds a name: the index gets dropped if it is full
+  void add(DWORD key, DWORD ofs) {
+    if (!valid) return;
+    int idx;
+    if (free_list >= 0) {  // reuse the entry of a removed name
+      idx = free_list;
+      free_list = ent[idx].next;
+      n_free--;
+    } else if (n_used < n_entries) {
+      idx = (int)n_used++;
+    } else {
+      valid = false;
+      too_large = true;
+      return;
+    }
+    int b = bucket(key);
+    ent[idx].ofs = ofs;
+    ent[idx].key = key;
+    ent[idx].next = heads[b];
+    heads[b] = idx;
+  }
+
+  /// removes all names of the entry block at the offset: their entries
+  /// get reused by add()
+  void remove(DWORD ofs) {
+    if (!valid || ofs == INVALID) return;
+    for (UINT j = 0; j < n_used; j++) {
+      if (ent[j].ofs != ofs) continue;
+      int* link = &heads[bucket(ent[j].key)];
+      while (*link != (int)j) link = &ent[*link].next;
+      *link = ent[j].next;
+      ent[j].ofs = INVALID;
+      ent[j].next = free_list;
+      free_list = (int)j;
+      n_free++;
+    }
+  }
+
+  /// first candidate for the key (or -1): check key() and offset()
+  int first(DWORD key) { return heads[bucket(key)]; }
+  /// next candidate (or -1)
+  int next(int idx) { return ent[idx].next; }
+  DWORD key(int idx) { return ent[idx].key; }
+  DWORD offset(int idx) { return ent[idx].ofs; }
+
+  /// last use (for the replacement of the least recently used index)
+  DWORD lastUsed() { return used; }
+  void touch(DWORD tick) { used = tick; }
+
+ protected:
+  struct Entry {
+    DWORD ofs;
+    DWORD key;
+    int next;
+  };
+  Entry* ent = nullptr;
+  int* heads = nullptr;
+  UINT n_entries = 0;
+  UINT n_buckets = 0;
+  UINT n_used = 0;  // entries which have been used
+  UINT n_free = 0;  // entries of removed names
+  int free_list = -1;
+  DWORD dir_id = 0;
+  DWORD used = 0;
+  bool valid = false;
+  bool too_large = false;
+
+  int bucket(DWORD key) {
+    return key == WILD ? (int)n_buckets : (int)(key & (n_buckets - 1));
+  }
+};
+
+/**
+ * @brief Cache of resolved directory paths which lets FatFs::follow_path()
+ * continue at the deepest known directory of a path instead of searching
+ * every path segment starting from the root directory.
+ *
+ * The keys are the directory paths relative to the root directory in
+ * normalized form (ASCII upper case, single '/' separators). They map to the
+ * start cluster of the directory and on exFAT to its size, allocation status
+ * and the location of its entry in the containing directory. Entries are
+ * replaced in least recently used order.
+ * @ingroup ff
+ */
+class PathCache {
+ public:
+  /// resolved directory
+  struct Entry {
+    DWORD hash;
+    UINT len;
+    DWORD used;
+    DWORD sclust;
+#if FF_FS_EXFAT
+    BYTE stat;
+    FSIZE_t objsize;
+    DWORD c_scl;
+    DWORD c_size;
+    DWORD c_ofs;
+#endif
+  };
+
+  PathCache() = default;
+  PathCache(const PathCache&) = delete;
+  PathCache& operator=(const PathCache&) = delete;
+  ~PathCache() { end(); }
+
+  /// allocates the cache for the indicated number of directories with paths
+  /// of up to pathLen characters: returns false if the memory is not available
+  bool begin(UINT entries, UINT pathLen) {
+    n_hits = n_misses = 0;
+    if (entries == n_entries && pathLen == max_len) {
+      clear();
+      return true;
+    }
+    end();
+    if (entries == 0 || pathLen == 0) return true;
+    ent = (Entry*)malloc(entries * sizeof(Entry));
+    keys = (TCHAR*)malloc(entries * pathLen * sizeof(TCHAR));
+    if (ent == nullptr || keys == nullptr) {
+      end();
+      return false;
+    }
+    n_entries = entries;
+    max_len = pathLen;
+    clear();
+    return true;
+  }
+
+  /// releases all memory
+  void end() {
+    free(ent);
+    free(keys);
+    ent = nullptr;
+    keys = nullptr;
+    n_entries = 0;
+    max_len = 0;
+  }
+
+  /// maximum number of directories (0: the cache is not active)
+  UINT size() { return n_entries; }
+  /// maximum length of a cached path
+  UINT pathLength() { return max_len; }
+  /// number of path resolutions which started at a cached directory
+  unsigned long hits() { return n_hits; }
+  /// number of path resolutions which started at the root directory
+  unsigned long misses() { return n_misses; }
+  /// counts a path resolution
+  void record(bool hit) { hit ? n_hits++ : n_misses++; }
+
+  /// drops all directories
+  void clear() {
+    for (UINT j = 0; j < n_entries; j++) ent[j].len = 0;
+  }
+
+  /// drops the directory with the indicated start cluster and the
+  /// directories which are located in it
+  void remove(DWORD clst) {
+    for (UINT j = 0; j < n_entries; j++) {
+      if (ent[j].sclust == clst
+#if FF_FS_EXFAT
+          || ent[j].c_scl == clst
+#endif
+      ) {
+        ent[j].len = 0;
+      }
+    }
+  }
+
+  /// provides the directory with the normalized path (or null)
+  Entry* find(const TCHAR* key, UINT len, DWORD hash) {
+    for (UINT j = 0; j < n_entries; j++) {
+      Entry& e = ent[j];
+      if (e.len == len && e.hash == hash &&
+          memcmp(keys + j * max_len, key, len * sizeof(TCHAR)) == 0) {
+        e.used = ++tick;
+        return &e;
+      }
+    }
+    return nullptr;
+  }
+
+  /// adds (or replaces) a directory: paths which are too long are ignored
+  void add(const TCHAR* key, UINT len, DWORD hash, const FFOBJID* obj) {
+    if (len == 0 || len > max_len) return;
+    Entry* e = find(key, len, hash);
+    if (e == nullptr) {
+      e = ent;
+      for (UINT j = 1; j < n_entries && e->len; j++) {
+        if (ent[j].len == 0 || ent[j].used < e->used) e = &ent[j];
+      }
+      memcpy(keys + (e - ent) * max_len, key, len * sizeof(TCHAR));
+      e->hash = hash;
+      e->len = len;
+      e->used = ++tick;
+    }
+    e->sclust = obj->sclust;
+#if FF_FS_EXFAT
+    e->stat = obj->stat;
+    e->objsize = obj->objsize;
+    e->c_scl = obj->c_scl;
+    e->c_size = obj->c_size;
+    e->c_ofs = obj->c_ofs;
+#endif
+  }
+
+ protected:
+  Entry* ent = nullptr;
+  TCHAR* keys = nullptr;
+  UINT n_entries = 0;
+  UINT max_len = 0;
+  DWORD tick = 0;
+  unsigned long n_hits = 0;
+  unsigned long n_misses = 0;
+};
+
+}  // namespace fatfs
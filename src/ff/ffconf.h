@@ -45,7 +45,7 @@
 /* This option switches f_mkfs() function. (0:Disable or 1:Enable) */
 
 
-#define FF_USE_FASTSEEK	0
+#define FF_USE_FASTSEEK	1
 /* This option switches fast seek function. (0:Disable or 1:Enable) */
 
 
@@ -64,7 +64,7 @@
 /  (0:Disable or 1:Enable) */
 
 
-#define FF_USE_FORWARD	0
+#define FF_USE_FORWARD	1
 /* This option switches f_forward() function. (0:Disable or 1:Enable) */
 
 
@@ -103,7 +103,11 @@
 
 
 //#define	FF_USE_LFN	0
+#if !defined(ARDUINO) || defined(ESP32) || defined(ESP_PLATFORM)
+#define	FF_USE_LFN	2	/* Thread-safe working buffer for FF_FS_REENTRANT */
+#else
 #define	FF_USE_LFN	1
+#endif
 #define FF_MAX_LFN	255
 /* The FF_USE_LFN switches the support for LFN (long file name).
 /
@@ -256,11 +260,19 @@
 /  These options have no effect in read-only configuration (FF_FS_READONLY = 1). */
 
 
+#ifndef FF_FS_NOFSINFO
 //#define FF_FS_NOFSINFO	0
 #define FF_FS_NOFSINFO	1
+#endif
 /* If you need to know correct free space on the FAT32 volume, set bit 0 of this
 /  option, and f_getfree() function at first time after volume mount will force
 /  a full FAT scan. Bit 1 controls the use of last allocated cluster number.
+/  The free cluster count is maintained by every allocation and release and is
+/  written back to the FSINFO on each sync. A volume which is only written by
+/  FatFs can be built with FF_FS_NOFSINFO=0: the count is then known right after
+/  mount and f_getfree() (and File::availableForWrite()) do not scan the FAT. The
+/  default keeps the scan, because a volume which was last written by another
+/  system or removed without sync may have a wrong count in the FSINFO.
 /
 /  bit0=0: Use free cluster count in the FSINFO if available.
 /  bit0=1: Do not trust free cluster count in the FSINFO.
@@ -281,10 +293,19 @@
 /      lock control is independent of re-entrancy. */
 
 
-/* #include <somertos.h>	// O/S definitions */
+#if !defined(ARDUINO)
+#define FF_FS_REENTRANT	1
+#define FF_SYNC_t		VolumeLock*
+#elif defined(ESP32) || defined(ESP_PLATFORM)
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#define FF_FS_REENTRANT	1
+#define FF_SYNC_t		SemaphoreHandle_t
+#else
 #define FF_FS_REENTRANT	0
-#define FF_FS_TIMEOUT	1000
 #define FF_SYNC_t		HANDLE
+#endif
+#define FF_FS_TIMEOUT	1000
 /* The option FF_FS_REENTRANT switches the re-entrancy (thread safe) of the FatFs
 /  module itself. Note that regardless of this option, file access to different
 /  volume is always re-entrant and volume control functions, f_mount(), f_mkfs()
@@ -300,7 +321,159 @@
 /  The FF_FS_TIMEOUT defines timeout period in unit of time tick.
 /  The FF_SYNC_t defines O/S dependent sync object type. e.g. HANDLE, ID, OS_EVENT*,
 /  SemaphoreHandle_t and etc. A header file for O/S definitions needs to be
-/  included somewhere in the scope of ff.h. */
+/  included somewhere in the scope of ff.h.
+/
+/  The handlers are provided in ffsystem-inc.h for host builds (VolumeLock, based on
+/  std::mutex) and for the ESP32 (FreeRTOS recursive mutex), where re-entrancy is
+/  enabled by default and FF_FS_TIMEOUT is in milliseconds. Each volume has its own lock, so
+/  tasks which access different volumes (e.g. the drives of a MultiIO) do not wait
+/  for each other. Re-entrancy needs the LFN working buffer on the stack or on the
+/  heap (FF_USE_LFN 2 or 3). */
+
+
+#if FF_FS_REENTRANT && !defined(ARDUINO)
+#define FF_FS_SHARED_READ	1
+#else
+#define FF_FS_SHARED_READ	0
+#endif
+/* The option FF_FS_SHARED_READ lets read-only operations on a volume run in
+/  parallel (host builds with re-entrancy only). f_read() and f_readview() on
+/  open files, f_stat() and f_readdir() take the volume lock in shared mode, all
+/  other functions still lock it exclusively. Readers work in the sector buffer
+/  of their file and only serialize on a short window lock per volume while they
+/  follow the FAT or read directories through the sector window.
+/
+/   0: All functions lock the volume exclusively.
+/   1: Enable shared read access for the disk drivers which accept disk_read()
+/      calls from several threads at the same time (IO::allowsConcurrentReads():
+/      RamIO, CompressedRamIO, FileIO, PosixFileIO, MmapFileIO, and MultiIO if
+/      all of its drivers do). With all other drivers, including StreamIO,
+/      AsyncRamIO and the own IO subclasses which do not override it, every call
+/      still locks the volume exclusively. FatFs::setSharedRead(false) switches
+/      it off at runtime. */
+
+/*---------------------------------------------------------------------------/
+/ Performance Configurations
+/---------------------------------------------------------------------------*/
+
+#define FF_USE_WINCACHE		1
+#define FF_WINCACHE_SECTORS	0
+/* FF_USE_WINCACHE switches the multi-sector write-back cache which is layered
+/  under the disk access window (FATFS::win) of each volume. (0:Disable or 1:Enable)
+/  FF_WINCACHE_SECTORS defines the default number of cached sectors per volume.
+/  It can be changed at run time by FatFs::setSectorCacheSize() before the volume
+/  gets mounted, and 0 keeps the cache inactive. Each cached sector costs FF_MAX_SS
+/  bytes of heap memory. Dirty sectors are written back when they get evicted and
+/  on every sync (f_sync(), f_close(), ...), where FAT sectors are reflected to the
+/  2nd FAT as well. This option can not be combined with FF_FS_TINY. */
+
+
+#define FF_USE_FATCACHE		1
+#define FF_FATCACHE_REGIONS	0
+/* FF_USE_FATCACHE switches the FAT chain cache which keeps decoded cluster links
+/  of recently used FAT regions, so that get_fat() at the cluster boundaries of
+/  f_read(), f_write() and f_lseek() does not need to move the disk access window.
+/  (0:Disable or 1:Enable)
+/  FF_FATCACHE_REGIONS defines the default number of cached regions per volume.
+/  Each region holds the links of the clusters of one FAT sector, (sector size / 4)
+/  on FAT32 and exFAT and (sector size / 2) on FAT12/16, and costs one (FAT32,
+/  exFAT) or two (FAT12/16) sector sizes of heap memory. It can be changed at run
+/  time by FatFs::setFatCacheSize() before the volume gets mounted, and 0 keeps
+/  the cache inactive. */
+
+
+#define FF_USE_FREEMAP		1
+#define FF_FREEMAP_BYTES	0
+/* FF_USE_FREEMAP switches the in-memory map of free clusters on FAT12/16/32
+/  volumes, which is used by create_chain() and f_getfree() instead of scanning
+/  the FAT. (0:Disable or 1:Enable) The map is filled by a single FAT scan on the
+/  first allocation or f_getfree() after mount and is kept up to date by put_fat().
+/  FF_FREEMAP_BYTES defines the default heap memory per volume for the map. It can
+/  be changed at run time by FatFs::setFreeMapSize() before the volume gets mounted,
+/  and 0 keeps the map inactive. If the volume has more clusters than bits are
+/  available, each bit summarizes a group of clusters (coarse map), which still
+/  lets the allocator skip all full groups. exFAT volumes use their own bitmap. */
+
+
+#define FF_USE_SIMD		1
+/* FF_USE_SIMD lets f_getfree() count free FAT entries with SSE2/AVX2 or NEON
+/  compares on host (non Arduino) builds when the compiler targets these instruction
+/  sets. Otherwise (and with 0) the entries are counted by portable code, where the
+/  exFAT allocation bitmap is still processed by a 64-bit popcount. */
+
+
+#define FF_USE_DIRINDEX		1
+#define FF_DIRINDEX_ENTRIES	0
+#define FF_DIRINDEX_DIRS	2
+/* FF_USE_DIRINDEX switches the directory hash index which lets dir_find() (and so
+/  f_open(), f_stat(), f_unlink() ...) check only the entries whose name hash
+/  matches instead of comparing the names of all entries. (0:Disable or 1:Enable)
+/  FF_DIRINDEX_DIRS directories are indexed per volume (the least recently used one
+/  gets replaced): an index is built by the first search in a directory and is
+/  maintained when entries are created or removed.
+/  FF_DIRINDEX_ENTRIES defines the default number of names per index, where a file
+/  with LFN needs 2 and every name costs 12 bytes of heap memory. It can be changed
+/  at run time by FatFs::setDirIndexSize() before the volume gets mounted, and 0
+/  keeps the index inactive. Directories with more names are searched as usual.
+/  This option requires FF_USE_LFN. */
+
+
+#define FF_USE_PATHCACHE	1
+#define FF_PATHCACHE_ENTRIES	0
+#define FF_PATHCACHE_PATHLEN	64
+/* FF_USE_PATHCACHE switches the cache of resolved directory paths, which lets the
+/  path resolution of f_open(), f_stat(), f_unlink(), f_rename() ... continue at
+/  the deepest known directory of a path instead of searching every directory from
+/  the root. (0:Disable or 1:Enable) The cache is dropped on unmount, and removed,
+/  created or renamed directories are dropped from it.
+/  FF_PATHCACHE_ENTRIES defines the default number of cached directories per volume.
+/  It can be changed at run time by FatFs::setPathCacheSize() before the volume gets
+/  mounted, and 0 keeps the cache inactive. FF_PATHCACHE_PATHLEN defines the maximum
+/  length of a cached directory path in characters (deeper directories of longer
+/  paths are resolved as usual). Each directory costs FF_PATHCACHE_PATHLEN * sizeof
+/  (TCHAR) + 24 (exFAT: 48) bytes of heap memory. */
+
+
+#define FF_USE_WRITEBEHIND	1
+/* FF_USE_WRITEBEHIND switches the write-behind buffer of file objects, which can
+/  be assigned by f_setwbuf() (or File::setWriteBuffer()). (0:Disable or 1:Enable)
+/  The sectors which f_write() completes one at a time (unaligned or small writes)
+/  are collected in the buffer as long as they are consecutive, and are written by
+/  a single multi-sector disk_write() when the buffer is full, when the run of
+/  sectors breaks, and on f_sync(), f_read(), f_lseek() and f_truncate(). This
+/  option can not be combined with FF_FS_TINY. */
+
+
+#define FF_USE_READAHEAD	1
+/* FF_USE_READAHEAD switches the read-ahead buffer of file objects, which can be
+/  assigned by f_setrbuf() (or File::setReadBuffer()). (0:Disable or 1:Enable)
+/  When f_read() needs to load a sector for a small read and the access is
+/  sequential, the following sectors are read by the same multi-sector disk_read(),
+/  at most up to the end of the contiguous cluster run and of the file. The window
+/  opens after two sequential loads with 2 sectors and is doubled on every further
+/  sequential load up to the buffer size, and a random access closes it. The
+/  window and the hit counters are kept in the file object. This option can not
+/  be combined with FF_FS_TINY. */
+
+
+#define FF_USE_READVIEW		1
+/* FF_USE_READVIEW switches f_readview() (File::readView()), which reads without
+/  copying: it provides a pointer to the file data in the sector buffer of the
+/  file object (or in the read-ahead buffer, where a view can span several
+/  sectors) instead of copying it. (0:Disable or 1:Enable) */
+
+
+#define FF_USE_ASYNC		1
+#define FF_ASYNC_DEPTH		4
+/* FF_USE_ASYNC switches the asynchronous extension of the IO drivers (requests
+/  which are submitted, polled and completed by their id) and f_mapsect(), which
+/  lets File::readAsync() and File::writeAsync() transfer the sectors of a file
+/  with cluster-sized requests while the following clusters are already mapped
+/  and submitted. (0:Disable or 1:Enable) Drivers without own implementation
+/  execute the requests synchronously on submit.
+/  FF_ASYNC_DEPTH defines the maximum number of requests which are kept in flight
+/  by a file (and which the synchronous adapter can keep the results of). */
+
 
 /*---------------------------------------------------------------------------/
 / Arduino API
@@ -327,5 +500,6 @@
 #define FF_IO_USE_IOCTL 1 /* 1: Enable disk_ioctl function */
 
 #define FF_SPI_SPEED_FAST 20000000 /* SPI fast speed in Hz for SD card access */
+#define FF_SPI_PIPELINE 1 /* 1: Pipelined multi-block transfers (CMD18/CMD25) in ArduinoSpiIO */
 
 /*--- End of configuration options ---*/
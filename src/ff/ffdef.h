@@ -93,6 +93,25 @@ typedef DWORD LBA_t;
 
 namespace fatfs {
 
+#if FF_FS_REENTRANT && !defined(ARDUINO)
+class VolumeLock;	/* Lock of a volume for host builds (ffsystem-inc.h) */
+#endif
+#if FF_USE_WINCACHE
+class SectorCache;	/* Sector cache layered under the window (ffcache.h) */
+#endif
+#if FF_USE_FATCACHE
+class FatCache;		/* Cache of decoded FAT entries (ffcache.h) */
+#endif
+#if FF_USE_FREEMAP
+class FreeMap;		/* Map of the free clusters (ffcache.h) */
+#endif
+#if FF_USE_DIRINDEX
+class DirIndex;		/* Hash index of a directory (ffcache.h) */
+#endif
+#if FF_USE_PATHCACHE
+class PathCache;	/* Cache of resolved directory paths (ffcache.h) */
+#endif
+
 /* Filesystem object structure (FATFS) */
 
 struct FATFS {
@@ -119,6 +138,8 @@ struct FATFS {
 #if !FF_FS_READONLY
   DWORD last_clst; /* Last allocated cluster */
   DWORD free_clst; /* Number of free clusters */
+  DWORD fcnt_clst; /* Free cluster count in progress: next cluster to count */
+  DWORD fcnt_free; /* Free cluster count in progress: free clusters so far */
 #endif
 #if FF_FS_RPATH
   DWORD cdir; /* Current directory start cluster (0:root) */
@@ -138,6 +159,22 @@ struct FATFS {
   LBA_t database; /* Data base sector */
 #if FF_FS_EXFAT
   LBA_t bitbase; /* Allocation bitmap base sector */
+#endif
+#if FF_USE_WINCACHE
+  SectorCache* wcache; /* Sector cache under the win[] (null:not used) */
+#endif
+#if FF_USE_FATCACHE
+  FatCache* fcache;    /* Cache of decoded FAT entries (null:not used) */
+#endif
+#if FF_USE_FREEMAP
+  FreeMap* fmap;       /* Map of the free clusters (null:not used) */
+#endif
+#if FF_USE_DIRINDEX
+  DirIndex* dindex;    /* Hash indexes of directories (null:not used) */
+  DWORD dindex_tick;   /* Use counter of the directory indexes */
+#endif
+#if FF_USE_PATHCACHE
+  PathCache* pcache;   /* Cache of resolved directory paths (null:not used) */
 #endif
   LBA_t winsect;       /* Current sector appearing in the win[] */
   BYTE win[FF_MAX_SS]; /* Disk access window for Directory, FAT (and file data
@@ -190,6 +227,21 @@ struct FIL {
   DWORD* cltbl; /* Pointer to the cluster link map table (nulled on open, set by
                    application) */
 #endif
+#if FF_USE_WRITEBEHIND && !FF_FS_READONLY
+  BYTE* wbuf;    /* Write-behind buffer of consecutive sectors (null:not used) */
+  UINT wb_size;  /* Size of the write-behind buffer [sectors] */
+  UINT wb_cnt;   /* Number of sectors in the write-behind buffer */
+  LBA_t wb_sect; /* First sector in the write-behind buffer */
+#endif
+#if FF_USE_READAHEAD
+  BYTE* rbuf;    /* Read-ahead buffer (null:not used) */
+  UINT ra_size;  /* Size of the read-ahead buffer [sectors] */
+  UINT ra_win;   /* Current read-ahead window [sectors] (0:random access) */
+  UINT ra_cnt;   /* Number of sectors in the read-ahead buffer */
+  LBA_t ra_sect; /* First sector in the read-ahead buffer */
+  DWORD ra_hit;  /* Number of sector loads served by the read-ahead buffer */
+  DWORD ra_miss; /* Number of sector loads which needed a disk read */
+#endif
 #if !FF_FS_TINY
   BYTE buf[FF_MAX_SS]; /* File private data read/write window */
 #endif
@@ -10,11 +10,111 @@
 
 #include "ff.h"
 
+#if FF_FS_REENTRANT
+#if !defined(ARDUINO)
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <vector>
+#elif !defined(ESP32) && !defined(ESP_PLATFORM)
+#error FF_FS_REENTRANT is only implemented for host builds and the ESP32
+#endif
+#endif
+
 namespace fatfs {
 
 #if FF_FS_REENTRANT /* Mutal exclusion */
 
-#error locking not implemented
+/* Each volume gets its own recursive lock: the task which holds the lock
+/  can enter FatFs again (e.g. from an IO driver), other tasks wait for it. */
+
+#if !defined(ARDUINO)
+/**
+ * @brief Recursive lock with timeout of a volume for host builds. It only
+ * uses std::mutex and std::condition_variable (unlike the timed mutexes of
+ * the standard library these are fully supported by ThreadSanitizer).
+ * With FF_FS_SHARED_READ it is a reader/writer lock: several readers hold it
+ * at the same time and a waiting writer keeps new readers out, so that it
+ * does not starve. The readers serialize on the window lock whenever they
+ * work with the shared state of the volume.
+ */
+class VolumeLock {
+ public:
+  /// exclusive access
+  bool lock(long timeoutMs) {
+    std::unique_lock<std::mutex> guard(mtx);
+    std::thread::id self = std::this_thread::get_id();
+    if (depth > 0 && owner == self) {
+      depth++;
+      return true;
+    }
+    writers++;
+    bool result = free.wait_for(guard, std::chrono::milliseconds(timeoutMs),
+                                [this] { return depth == 0 && readers.empty(); });
+    writers--;
+    if (!result) {
+      free.notify_all();  // readers which waited behind this writer
+      return false;
+    }
+    owner = self;
+    depth = 1;
+    return true;
+  }
+
+  /// shared access: also granted to the owner of the exclusive lock and to
+  /// the readers which already hold it (re-entrant drivers)
+  bool lockShared(long timeoutMs) {
+    std::unique_lock<std::mutex> guard(mtx);
+    std::thread::id self = std::this_thread::get_id();
+    if (depth > 0 && owner == self) {
+      depth++;
+      return true;
+    }
+    bool holder = false;
+    for (auto& id : readers) holder = holder || id == self;
+    if (!holder &&
+        !free.wait_for(guard, std::chrono::milliseconds(timeoutMs),
+                       [this] { return depth == 0 && writers == 0; }))
+      return false;
+    readers.push_back(self);
+    return true;
+  }
+
+  /// releases the exclusive or shared access of the calling thread
+  void unlock() {
+    std::lock_guard<std::mutex> guard(mtx);
+    std::thread::id self = std::this_thread::get_id();
+    if (depth > 0 && owner == self) {
+      if (--depth == 0) free.notify_all();
+      return;
+    }
+    for (size_t j = 0; j < readers.size(); j++) {
+      if (readers[j] == self) {
+        readers[j] = readers.back();
+        readers.pop_back();
+        if (readers.empty()) free.notify_all();
+        return;
+      }
+    }
+  }
+
+  /// serializes the readers on the sector window, FAT and directory caches
+  void lockWindow() { window.lock(); }
+  void unlockWindow() { window.unlock(); }
+
+ protected:
+  std::mutex mtx;
+  std::condition_variable free;
+  std::thread::id owner;
+  unsigned depth = 0;
+  unsigned writers = 0;                 // waiting for exclusive access
+  std::vector<std::thread::id> readers;  // one entry per shared access
+  std::recursive_mutex window;
+};
+#endif
+
 /*------------------------------------------------------------------------*/
 /* Create a Synchronization Object                                        */
 /*------------------------------------------------------------------------*/
@@ -23,32 +123,27 @@ namespace fatfs {
 /  When a 0 is returned, the f_mount() function fails with FR_INT_ERR.
 */
 
-// const osMutexDef_t Mutex[FF_VOLUMES];	/* Table of CMSIS-RTOS mutex */
-
-int ff_cre_syncobj(/* 1:Function succeeded, 0:Could not create the sync object
+inline int ff_cre_syncobj(/* 1:Function succeeded, 0:Could not create the sync object
                     */
                    BYTE vol, /* Corresponding volume (logical drive number) */
                    FF_SYNC_t*
                        sobj /* Pointer to return the created sync object */
 ) {
+#if !defined(ARDUINO)
+  /* C++ standard library */
+  (void)vol;
+  *sobj = new (std::nothrow) VolumeLock();
+  return (int)(*sobj != nullptr);
+#else
+  /* FreeRTOS */
+  *sobj = xSemaphoreCreateRecursiveMutex();
+  return (int)(*sobj != NULL);
+#endif
+
   /* Win32 */
   // *sobj = CreateMutex(NULL, FALSE, NULL);
   // return (int)(*sobj != INVALID_HANDLE_VALUE);
 
-  /* uITRON */
-  //	T_CSEM csem = {TA_TPRI,1,1};
-  //	*sobj = acre_sem(&csem);
-  //	return (int)(*sobj > 0);
-
-  /* uC/OS-II */
-  //	OS_ERR err;
-  //	*sobj = OSMutexCreate(0, &err);
-  //	return (int)(err == OS_NO_ERR);
-
-  /* FreeRTOS */
-  //	*sobj = xSemaphoreCreateMutex();
-  //	return (int)(*sobj != NULL);
-
   /* CMSIS-RTOS */
   //	*sobj = osMutexCreate(&Mutex[vol]);
   //	return (int)(*sobj != NULL);
@@ -62,26 +157,24 @@ int ff_cre_syncobj(/* 1:Function succeeded, 0:Could not create the sync object
 /  the f_mount() function fails with FR_INT_ERR.
 */
 
-int ff_del_syncobj(/* 1:Function succeeded, 0:Could not delete due to an error
+inline int ff_del_syncobj(/* 1:Function succeeded, 0:Could not delete due to an error
                     */
                    FF_SYNC_t sobj /* Sync object tied to the logical drive to be
                                      deleted */
 ) {
+#if !defined(ARDUINO)
+  /* C++ standard library */
+  delete sobj;
+  return 1;
+#else
+  /* FreeRTOS */
+  vSemaphoreDelete(sobj);
+  return 1;
+#endif
+
   /* Win32 */
   // return (int)CloseHandle(sobj);
 
-  /* uITRON */
-  //	return (int)(del_sem(sobj) == E_OK);
-
-  /* uC/OS-II */
-  //	OS_ERR err;
-  //	OSMutexDel(sobj, OS_DEL_ALWAYS, &err);
-  //	return (int)(err == OS_NO_ERR);
-
-  /* FreeRTOS */
-  //  vSemaphoreDelete(sobj);
-  //	return 1;
-
   /* CMSIS-RTOS */
   //	return (int)(osMutexDelete(sobj) == osOK);
 }
@@ -93,24 +186,21 @@ int ff_del_syncobj(/* 1:Function succeeded, 0:Could not delete due to an error
 /  When a 0 is returned, the file function fails with FR_TIMEOUT.
 */
 
-int ff_req_grant(/* 1:Got a grant to access the volume, 0:Could not get a grant
+inline int ff_req_grant(/* 1:Got a grant to access the volume, 0:Could not get a grant
                   */
                  FF_SYNC_t sobj /* Sync object to wait */
 ) {
+#if !defined(ARDUINO)
+  /* C++ standard library */
+  return (int)sobj->lock(FF_FS_TIMEOUT);
+#else
+  /* FreeRTOS */
+  return (int)(xSemaphoreTakeRecursive(sobj, pdMS_TO_TICKS(FF_FS_TIMEOUT)) == pdTRUE);
+#endif
+
   /* Win32 */
   // return (int)(WaitForSingleObject(sobj, FF_FS_TIMEOUT) == WAIT_OBJECT_0);
 
-  /* uITRON */
-  //	return (int)(wai_sem(sobj) == E_OK);
-
-  /* uC/OS-II */
-  //	OS_ERR err;
-  //	OSMutexPend(sobj, FF_FS_TIMEOUT, &err));
-  //	return (int)(err == OS_NO_ERR);
-
-  /* FreeRTOS */
-  //	return (int)(xSemaphoreTake(sobj, FF_FS_TIMEOUT) == pdTRUE);
-
   /* CMSIS-RTOS */
   //	return (int)(osMutexWait(sobj, FF_FS_TIMEOUT) == osOK);
 }
@@ -121,24 +211,57 @@ int ff_req_grant(/* 1:Got a grant to access the volume, 0:Could not get a grant
 /* This function is called on leaving file functions to unlock the volume.
  */
 
-void ff_rel_grant(FF_SYNC_t sobj /* Sync object to be signaled */
+inline void ff_rel_grant(FF_SYNC_t sobj /* Sync object to be signaled */
 ) {
+#if !defined(ARDUINO)
+  /* C++ standard library */
+  sobj->unlock();
+#else
+  /* FreeRTOS */
+  xSemaphoreGiveRecursive(sobj);
+#endif
+
   /* Win32 */
   //ReleaseMutex(sobj);
 
-  /* uITRON */
-  //	sig_sem(sobj);
+  /* CMSIS-RTOS */
+  //	osMutexRelease(sobj);
+}
 
-  /* uC/OS-II */
-  //	OSMutexPost(sobj);
+#if FF_FS_SHARED_READ
+/*------------------------------------------------------------------------*/
+/* Request Shared Grant to Access the Volume                              */
+/*------------------------------------------------------------------------*/
+/* This function is called on entering read-only file functions to lock the
+/  volume in shared mode. It is released with ff_rel_grant(). When a 0 is
+/  returned, the file function fails with FR_TIMEOUT.
+*/
 
-  /* FreeRTOS */
-  //	xSemaphoreGive(sobj);
+inline int ff_req_shared(/* 1:Got a grant to read the volume, 0:Could not get a grant
+                  */
+                 FF_SYNC_t sobj /* Sync object to wait */
+) {
+  return (int)sobj->lockShared(FF_FS_TIMEOUT);
+}
 
-  /* CMSIS-RTOS */
-  //	osMutexRelease(sobj);
+/*------------------------------------------------------------------------*/
+/* Lock/Unlock the Sector Window of a Volume                              */
+/*------------------------------------------------------------------------*/
+/* These functions are called by the holders of a shared grant around the
+/  access to the sector window, the FAT and the directories of the volume.
+*/
+
+inline void ff_req_window(FF_SYNC_t sobj /* Sync object of the volume */
+) {
+  sobj->lockWindow();
 }
 
+inline void ff_rel_window(FF_SYNC_t sobj /* Sync object of the volume */
+) {
+  sobj->unlockWindow();
+}
+#endif
+
 #endif
 
 }
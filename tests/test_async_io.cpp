@@ -0,0 +1,228 @@
+/* Asynchronous request test (FF_USE_ASYNC): File::readAsync() and
+ * writeAsync() keep the driver busy with several cluster-sized requests
+ * while the caller handles the data, so the main thing to verify is that
+ * this overlap does not change what ends up in the file. On an AsyncRamIO
+ * the parts must arrive in file order and match read()/write(), also at
+ * unaligned positions, across fragments, at the end of the file and when
+ * data still sits in the sector buffer of the file. The synchronous adapter
+ * of IO is checked on its own: it completes the requests with their results
+ * and calls the callback, and it starts no request while the results of
+ * FF_ASYNC_DEPTH requests are pending, in which case readAsync() transfers
+ * directly. Finally a write error in the middle of writeAsync() must not
+ * leave the file longer than the data which reached the disk.
+ */
+#include <cstring>
+
+#include "fatfs.h"
+#include "test_common.h"
+
+using namespace fatfs;
+
+RamIO ram{100, 512};
+AsyncRamIO drv{4000, 512, 50, 1};
+
+static const int SIZE = 48 * 1024 + 300;
+static uint8_t data[SIZE];
+static uint8_t buf[SIZE];
+
+static int callbacks;
+static io_request_t last_req;
+static DRESULT last_result;
+
+static void on_request(io_request_t req, DRESULT result, void*) {
+  callbacks++;
+  last_req = req;
+  last_result = result;
+}
+
+static void check_adapter() {
+  uint8_t out[1024], in[1024];
+  for (int i = 0; i < 1024; i++) out[i] = (uint8_t)(i * 3);
+  CHECK(ram.disk_initialize(0) == STA_CLEAR, "disk_initialize failed");
+  ram.setCompletionCallback(on_request);
+  io_request_t w = ram.disk_write_submit(0, out, 10, 2);
+  CHECK(w != 0 && callbacks == 1 && last_req == w, "write not completed");
+  io_request_t r = ram.disk_read_submit(0, in, 10, 2);
+  CHECK(r != 0 && r != w, "read not submitted");
+  io_request_t bad = ram.disk_read_submit(0, in, 1000, 1);
+  CHECK(last_req == bad && last_result == RES_ERROR, "error not reported");
+  CHECK(ram.disk_poll(r), "synchronous request is pending");
+  CHECK(ram.disk_complete(w) == RES_OK, "write failed");
+  CHECK(ram.disk_complete(r) == RES_OK, "read failed");
+  CHECK(ram.disk_complete(bad) == RES_ERROR, "wrong result");
+  CHECK(ram.disk_complete(r) == RES_PARERR, "request completed twice");
+  CHECK(memcmp(in, out, sizeof(in)) == 0, "data mismatch");
+  ram.setCompletionCallback(nullptr);
+
+  // no result gets dropped: all slots are taken
+  io_request_t pending[FF_ASYNC_DEPTH];
+  for (int j = 0; j < FF_ASYNC_DEPTH; j++) {
+    pending[j] = ram.disk_read_submit(0, in, 10, 1);
+    CHECK(pending[j] != 0, "read not submitted");
+  }
+  memset(in, 0, sizeof(in));
+  CHECK(ram.disk_read_submit(0, in + 512, 11, 1) == 0, "too many requests");
+  CHECK(memcmp(in + 512, out + 512, 512) != 0,
+        "request without slot was transferred");
+  for (int j = 0; j < FF_ASYNC_DEPTH; j++) {
+    CHECK(ram.disk_complete(pending[j]) == RES_OK, "result dropped");
+  }
+  io_request_t again = ram.disk_read_submit(0, in, 10, 1);
+  CHECK(again != 0 && ram.disk_complete(again) == RES_OK,
+        "slots not released");
+}
+
+/// buffer of a transfer which starts at the file position pos
+struct Transfer {
+  const uint8_t* buffer;
+  size_t pos;
+};
+
+static size_t next_pos;
+static int parts;
+
+static void on_part(const uint8_t* part, size_t len, void* ref) {
+  Transfer* t = (Transfer*)ref;
+  CHECK(part == t->buffer + (next_pos - t->pos), "parts not in file order");
+  next_pos += len;
+  parts++;
+}
+
+static void check_file() {
+  SDClass sd(drv);
+  CHECK(sd.begin(), "SD.begin() failed");
+  for (int i = 0; i < SIZE; i++) data[i] = (uint8_t)(i * 7 + (i >> 10));
+
+  // write from an unaligned position, interleaved with a second file
+  File f = sd.open("0:/async.bin", FA_READ | FA_WRITE | FA_CREATE_ALWAYS);
+  File g = sd.open("0:/other.bin", FA_READ | FA_WRITE | FA_CREATE_ALWAYS);
+  CHECK(f.write(data, 100) == 100, "write failed");
+  Transfer t = {data + 100, 100};
+  next_pos = 100;
+  parts = 0;
+  CHECK(f.writeAsync(data + 100, 20000, on_part, &t) == 20000,
+        "writeAsync failed");
+  CHECK(next_pos == 20100 && parts > 2, "parts not delivered");
+  CHECK(drv.maxPending() > 1, "requests not pipelined");
+  CHECK(g.writeAsync(data, 8192) == 8192, "writeAsync failed");
+  CHECK(f.writeAsync(data + 20100, SIZE - 20100) == SIZE - 20100,
+        "writeAsync failed");
+  CHECK(f.size() == SIZE, "wrong size");
+  g.close();
+  f.close();
+
+  f = sd.open("0:/async.bin", FILE_READ);
+  memset(buf, 0, sizeof(buf));
+  CHECK(f.read(buf, SIZE) == SIZE, "read failed");
+  CHECK(memcmp(buf, data, SIZE) == 0, "written data mismatch");
+
+  // read from unaligned positions up to the end of the file
+  const size_t starts[] = {0, 1, 511, 512, 2048, 5000, SIZE - 700};
+  for (size_t start : starts) {
+    memset(buf, 0, sizeof(buf));
+    CHECK(f.seek(start), "seek failed");
+    t = {buf, start};
+    next_pos = start;
+    CHECK(f.readAsync(buf, SIZE, on_part, &t) == SIZE - start,
+          "readAsync failed");
+    CHECK(next_pos == SIZE, "parts not delivered");
+    CHECK(f.position() == SIZE, "position not advanced");
+    CHECK(memcmp(buf, data + start, SIZE - start) == 0, "read data mismatch");
+  }
+
+  // one request at a time
+  drv.setCompletionCallback(nullptr);
+  f.setAsyncDepth(1);
+  size_t max = drv.maxPending();
+  CHECK(f.seek(0) && f.readAsync(buf, SIZE) == SIZE, "readAsync failed");
+  CHECK(memcmp(buf, data, SIZE) == 0, "read data mismatch");
+  CHECK(drv.maxPending() == max && drv.pending() == 0, "requests pending");
+  f.close();
+
+  // data in the sector buffer of the file
+  f = sd.open("0:/async.bin", FA_READ | FA_WRITE);
+  uint8_t patch[10] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10};
+  CHECK(f.seek(1000) && f.write(patch, 10) == 10, "write failed");
+  CHECK(f.seek(512) && f.readAsync(buf, 1024) == 1024, "readAsync failed");
+  CHECK(memcmp(buf + 488, patch, 10) == 0, "dirty sector not read");
+  CHECK(f.seek(0) && f.writeAsync(data, 4096) == 4096, "writeAsync failed");
+  CHECK(f.seek(1000) && f.read(buf, 10) == 10, "read failed");
+  CHECK(memcmp(buf, data + 1000, 10) == 0, "sector buffer not updated");
+  f.close();
+  sd.end();
+}
+
+/// RamIO which fails the indicated write of file data
+class FailingIO : public RamIO {
+ public:
+  using RamIO::RamIO;
+  int fail_at = -1;  // number of data writes before the failing one
+
+  DRESULT disk_write(BYTE pdrv, const BYTE* buff, LBA_t sector,
+                     UINT count) override {
+    if (sector >= fatfs.database && fail_at >= 0 && fail_at-- == 0)
+      return RES_ERROR;
+    return RamIO::disk_write(pdrv, buff, sector, count);
+  }
+};
+
+static void check_failed_write() {
+  FailingIO disk{4000, 512};
+  SDClass sd(disk);
+  CHECK(sd.begin(), "SD.begin() failed");
+  File f = sd.open("0:/failed.bin", FA_READ | FA_WRITE | FA_CREATE_ALWAYS);
+  CHECK(f.write(data, 1000) == 1000, "write failed");
+
+  // grows the file: the second request fails while more are mapped
+  disk.fail_at = 1;
+  size_t n = f.writeAsync(data + 1000, 30000);
+  CHECK(n > 0 && n < 30000, "write did not fail");
+  CHECK(f.position() == 1000 + n, "wrong position");
+  CHECK(f.size() == 1000 + n, "file contains data which was not written");
+
+  // within the file: the size is kept
+  disk.fail_at = 0;
+  CHECK(f.seek(0) && f.writeAsync(data, 5000) < 5000, "write did not fail");
+  CHECK(f.size() == 1000 + n, "size changed");
+  f.close();
+  sd.end();
+}
+
+/// all result slots of the synchronous adapter are taken by other requests
+static void check_no_slot() {
+  RamIO disk{400, 512};
+  SDClass sd(disk);
+  CHECK(sd.begin(), "SD.begin() failed");
+  File f = sd.open("0:/full.bin", FA_READ | FA_WRITE | FA_CREATE_ALWAYS);
+  CHECK(f.write(data, 20000) == 20000, "write failed");
+  CHECK(f.seek(0), "seek failed");
+
+  uint8_t sector[512];
+  io_request_t pending[FF_ASYNC_DEPTH];
+  for (int j = 0; j < FF_ASYNC_DEPTH; j++) {
+    pending[j] = disk.disk_read_submit(0, sector, 0, 1);
+  }
+  memset(buf, 0, sizeof(buf));
+  CHECK(f.readAsync(buf, 20000) == 20000, "readAsync failed");
+  CHECK(memcmp(buf, data, 20000) == 0, "read data mismatch");
+  CHECK(f.seek(0) && f.writeAsync(data + 1, 20000) == 20000,
+        "writeAsync failed");
+  for (int j = 0; j < FF_ASYNC_DEPTH; j++) {
+    CHECK(disk.disk_complete(pending[j]) == RES_OK, "result dropped");
+  }
+  CHECK(f.seek(0) && f.read(buf, 20000) == 20000, "read failed");
+  CHECK(memcmp(buf, data + 1, 20000) == 0, "written data mismatch");
+  f.close();
+  sd.end();
+}
+
+void setup() {
+  check_adapter();
+  check_file();
+  check_no_slot();
+  check_failed_write();
+  printf("PASS: async io\n");
+  TEST_EXIT_OK();
+}
+
+void loop() {}
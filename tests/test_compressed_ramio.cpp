@@ -0,0 +1,122 @@
+/* CompressedRamIO test: a RAM disk which keeps its sectors compressed, so
+ * that larger volumes fit into the memory of a microcontroller. The codec
+ * is checked on its own first: typical and incompressible sectors must
+ * round-trip and corrupt data must be rejected. The driver must keep the
+ * sectors across the eviction from the LRU cache and CTRL_SYNC, empty
+ * sectors must not take any memory and CTRL_TRIM must release them. A FatFs
+ * volume with text files has to compress well and keep its content when it
+ * is mounted again.
+ */
+#include <cstring>
+
+#include "fatfs.h"
+#include "test_common.h"
+
+using namespace fatfs;
+
+static void check_codec() {
+  static uint16_t table[Lz4Codec::HASH_SIZE];
+  uint8_t in[512], packed[600], out[512];
+  uint32_t rnd = 1;
+  for (int mode = 0; mode < 3; mode++) {
+    for (int i = 0; i < 512; i++) {
+      in[i] = mode == 0   ? (uint8_t)("hello fat world "[i % 16])
+              : mode == 1 ? (uint8_t)(i < 300 ? 0 : i % 8)
+                          : (uint8_t)((rnd = rnd * 1103515245 + 12345) >> 16);
+    }
+    size_t len = Lz4Codec::compress(in, 512, packed, sizeof(packed), table);
+    CHECK(len > 0, "compress failed");
+    if (mode < 2) CHECK(len < 100, "data not compressed");
+    memset(out, 0, sizeof(out));
+    CHECK(Lz4Codec::decompress(packed, len, out, 512), "decompress failed");
+    CHECK(memcmp(in, out, 512) == 0, "codec round trip failed");
+    if (mode == 2) {
+      CHECK(Lz4Codec::compress(in, 512, packed, 511, table) == 0,
+            "random data compressed");
+    }
+    if (mode == 0) {
+      CHECK(!Lz4Codec::decompress(packed, len - 1, out, 512),
+            "truncated data accepted");
+      CHECK(!Lz4Codec::decompress(packed, len, out, 256),
+            "overflow not detected");
+    }
+  }
+}
+
+static void check_sectors() {
+  CompressedRamIO drv{256, 512, 4};
+  uint8_t out[512], in[512];
+  CHECK(drv.disk_initialize(0) == STA_CLEAR, "disk_initialize failed");
+  for (int s = 0; s < 32; s++) {
+    for (int i = 0; i < 512; i++) out[i] = (uint8_t)(s + i / 64);
+    CHECK(drv.disk_write(0, out, s, 1) == RES_OK, "write failed");
+  }
+  // 28 sectors were evicted and compressed, 4 are still in the cache
+  CHECK(drv.rawBytes() == 28 * 512, "wrong raw bytes");
+  CHECK(drv.disk_ioctl(0, CTRL_SYNC, nullptr) == RES_OK, "sync failed");
+  CHECK(drv.rawBytes() == 32 * 512, "sync did not compress");
+  CHECK(drv.compressionRatio() > 4, "sectors not compressed");
+  for (int s = 0; s < 32; s++) {
+    CHECK(drv.disk_read(0, in, s, 1) == RES_OK, "read failed");
+    CHECK(in[0] == (uint8_t)s && in[511] == (uint8_t)(s + 7), "wrong data");
+  }
+  CHECK(drv.getCache().misses() >= 28, "sectors not decompressed");
+
+  // empty sectors take no memory
+  memset(out, 0, sizeof(out));
+  CHECK(drv.disk_write(0, out, 100, 1) == RES_OK, "write failed");
+  CHECK(drv.disk_ioctl(0, CTRL_SYNC, nullptr) == RES_OK, "sync failed");
+  CHECK(drv.rawBytes() == 32 * 512, "empty sector stored");
+
+  DWORD range[2] = {0, 15};
+  CHECK(drv.disk_ioctl(0, CTRL_TRIM, range) == RES_OK, "trim failed");
+  CHECK(drv.rawBytes() == 16 * 512, "trim did not release sectors");
+  CHECK(drv.disk_read(0, in, 3, 1) == RES_OK && in[0] == 0 && in[511] == 0,
+        "trimmed sector not empty");
+  range[1] = 256;
+  CHECK(drv.disk_ioctl(0, CTRL_TRIM, range) == RES_PARERR, "bad trim range");
+  CHECK(drv.disk_read(0, in, 256, 1) == RES_ERROR, "read beyond the end");
+}
+
+static void check_volume() {
+  CompressedRamIO drv{8192, 512};  // 4 MB
+  FatFs fs(drv);
+  FIL fil;
+  UINT n;
+  char line[64], text[64];
+  CHECK(drv.mount(fs) == FR_OK, "mount failed");
+  CHECK(fs.f_open(&fil, "0:/log.txt", FA_WRITE | FA_CREATE_ALWAYS) == FR_OK,
+        "f_open failed");
+  for (int i = 0; i < 5000; i++) {
+    int len = snprintf(line, sizeof(line), "%05d INFO sensor %d value %02d\n",
+                       i, i % 4, (i * 7) % 100);
+    CHECK(fs.f_write(&fil, line, len, &n) == FR_OK && n == (UINT)len,
+          "f_write failed");
+  }
+  CHECK(fs.f_close(&fil) == FR_OK, "f_close failed");
+  CHECK(drv.un_mount(fs) == FR_OK, "un_mount failed");
+  CHECK(drv.disk_ioctl(0, CTRL_SYNC, nullptr) == RES_OK, "sync failed");
+  CHECK(drv.compressionRatio() > 2, "volume not compressed");
+  CHECK(drv.memoryUsage() < 8192 * 512 / 8, "volume uses too much memory");
+
+  CHECK(drv.mount(fs) == FR_OK, "mount failed");
+  CHECK(fs.f_open(&fil, "0:/log.txt", FA_READ) == FR_OK, "file lost");
+  UINT len = snprintf(line, sizeof(line), "%05d INFO sensor %d value %02d\n",
+                      4321, 1, (4321 * 7) % 100);
+  CHECK(fs.f_lseek(&fil, 4321 * len) == FR_OK, "f_lseek failed");
+  memset(text, 0, sizeof(text));
+  CHECK(fs.f_read(&fil, text, len, &n) == FR_OK && n == len, "f_read failed");
+  CHECK(strcmp(text, line) == 0, "wrong file content");
+  fs.f_close(&fil);
+  CHECK(drv.un_mount(fs) == FR_OK, "un_mount failed");
+}
+
+void setup() {
+  check_codec();
+  check_sectors();
+  check_volume();
+  printf("PASS: compressed ramio\n");
+  TEST_EXIT_OK();
+}
+
+void loop() {}
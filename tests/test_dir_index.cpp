@@ -0,0 +1,158 @@
+/* Directory hash index test (FF_USE_DIRINDEX). The index only replaces the
+ * linear search of dir_find(), so every lookup must give the same answer as
+ * without it: the test runs on a FAT and an exFAT volume and finally
+ * compares with a plain FatFs after remount. It covers long names, 8.3
+ * names and colliding short names (found case-insensitively, also by the
+ * generated short name), removed and renamed entries which must no longer
+ * be found, and a directory with more names than the index can hold, which
+ * falls back to the search. A directory whose files are created and removed
+ * many times must stay indexed, because the entries of removed names are
+ * reused.
+ */
+#include <cstring>
+
+#include "fatfs.h"
+#include "test_common.h"
+
+using namespace fatfs;
+
+RamIO drvFat{4000, 512};
+RamIO drvExFat{20000, 512};
+
+static const int N = 120;
+
+static void create(FatFs& fs, const char* path) {
+  FIL fil;
+  UINT bw;
+  CHECK(fs.f_open(&fil, path, FA_WRITE | FA_CREATE_NEW) == FR_OK,
+        "could not create file");
+  CHECK(fs.f_write(&fil, path, strlen(path), &bw) == FR_OK, "f_write failed");
+  fs.f_close(&fil);
+}
+
+static bool exists(FatFs& fs, const char* path) {
+  FILINFO info;
+  FRESULT res = fs.f_stat(path, &info);
+  CHECK(res == FR_OK || res == FR_NO_FILE, "f_stat failed");
+  return res == FR_OK;
+}
+
+static void check_names(FatFs& fs, bool isExFat) {
+  char path[64];
+  for (int j = 0; j < N; j++) {
+    snprintf(path, sizeof(path), "0:/logs/Data-Logger-File-%04d.csv", j);
+    CHECK(exists(fs, path) == (j % 3 != 0), "long name lookup failed");
+    snprintf(path, sizeof(path), "0:/LOGS/data-logger-file-%04d.CSV", j);
+    CHECK(exists(fs, path) == (j % 3 != 0), "case-insensitive lookup failed");
+    snprintf(path, sizeof(path), "0:/logs/L%d.TXT", j);
+    CHECK(exists(fs, path), "short name lookup failed");
+    snprintf(path, sizeof(path), "0:/logs/l%d.txt", j);
+    CHECK(exists(fs, path), "lower case short name lookup failed");
+  }
+  CHECK(exists(fs, "0:/logs/renamed file.bin"), "renamed file not found");
+  CHECK(!exists(fs, "0:/logs/Data-Logger-File-9999.csv"), "found a ghost");
+  if (!isExFat) {
+    // the generated short names of the long names
+    CHECK(exists(fs, "0:/logs/DATA-L~1.CSV"), "generated SFN not found");
+    CHECK(exists(fs, "0:/logs/data-l~2.csv"), "generated SFN not found");
+  }
+}
+
+/// creates and removes many more files than the index has entries
+static void check_churn(RamIO& drv) {
+  const int KEEP = 3;
+  FatFs fs(drv);
+  fs.setDirIndexSize(16);
+  CHECK(fs.f_mount(&drv.fatfs, "0:", 1) == FR_OK, "remount failed");
+  CHECK(fs.f_mkdir("0:/churn") == FR_OK, "f_mkdir churn failed");
+  char path[64];
+  for (int j = 0; j < 200; j++) {
+    snprintf(path, sizeof(path), "0:/churn/Rotating-Log-%03d.txt", j);
+    create(fs, path);
+    if (j < KEEP) continue;
+    snprintf(path, sizeof(path), "0:/churn/Rotating-Log-%03d.txt", j - KEEP);
+    CHECK(fs.f_unlink(path) == FR_OK, "f_unlink failed");
+    CHECK(!exists(fs, path), "removed file found");
+  }
+  for (int j = 200 - KEEP; j < 200; j++) {
+    snprintf(path, sizeof(path), "0:/churn/rotating-log-%03d.TXT", j);
+    CHECK(exists(fs, path), "file not found");
+  }
+
+  DIR dir;
+  CHECK(fs.f_opendir(&dir, "0:/churn") == FR_OK, "f_opendir failed");
+  DWORD id = dir.obj.sclust;
+  fs.f_closedir(&dir);
+  bool indexed = false;
+  for (UINT j = 0; j < FF_DIRINDEX_DIRS; j++) {
+    DirIndex& di = fs.getDirIndex(0, j);
+    // the dot entries, a long and a short name per file
+    if (di.isIndexed(id) && di.count() <= 2 + 2 * KEEP) indexed = true;
+  }
+  CHECK(indexed, "index dropped by removed names");
+  CHECK(fs.f_unmount("0:") == FR_OK, "f_unmount failed");
+}
+
+static void run(RamIO& drv, BYTE fmt) {
+  static uint8_t work[FF_MAX_SS];
+  FatFs fs(drv);
+  fs.setDirIndexSize(1000);
+  MKFS_PARM opt = {fmt, 1, 0, 0, 0};
+  CHECK(fs.f_mkfs("0:", &opt, work, sizeof(work)) == FR_OK, "f_mkfs failed");
+  CHECK(fs.f_mount(&drv.fatfs, "0:", 1) == FR_OK, "f_mount failed");
+  bool isExFat = drv.fatfs.fs_type == FS_EXFAT;
+  CHECK(fs.f_mkdir("0:/logs") == FR_OK, "f_mkdir failed");
+
+  char path[64];
+  for (int j = 0; j < N; j++) {
+    snprintf(path, sizeof(path), "0:/logs/Data-Logger-File-%04d.csv", j);
+    create(fs, path);
+    snprintf(path, sizeof(path), "0:/logs/L%d.TXT", j);
+    create(fs, path);
+  }
+  CHECK(fs.getDirIndex(0, 0).size() == 1000, "index not allocated");
+  for (int j = 0; j < N; j += 3) {
+    snprintf(path, sizeof(path), "0:/logs/Data-Logger-File-%04d.csv", j);
+    CHECK(fs.f_unlink(path) == FR_OK, "f_unlink failed");
+  }
+  CHECK(fs.f_rename("0:/logs/Data-Logger-File-0004.csv",
+                    "0:/logs/renamed file.bin") == FR_OK,
+        "f_rename failed");
+  create(fs, "0:/logs/Data-Logger-File-0004.csv");  // reuse the old name
+  check_names(fs, isExFat);
+  CHECK(fs.getDirIndex(0, 0).count() + fs.getDirIndex(0, 1).count() > N,
+        "directory has not been indexed");
+
+  // a removed directory whose cluster gets reused must not keep its index
+  CHECK(fs.f_mkdir("0:/tmp") == FR_OK, "f_mkdir tmp failed");
+  create(fs, "0:/tmp/a.txt");
+  CHECK(exists(fs, "0:/tmp/a.txt"), "file in tmp not found");
+  CHECK(fs.f_unlink("0:/tmp/a.txt") == FR_OK, "f_unlink a failed");
+  CHECK(fs.f_unlink("0:/tmp") == FR_OK, "f_unlink tmp failed");
+  CHECK(fs.f_mkdir("0:/new") == FR_OK, "f_mkdir new failed");
+  CHECK(!exists(fs, "0:/new/a.txt"), "stale index of a removed directory");
+  CHECK(fs.f_unmount("0:") == FR_OK, "f_unmount failed");
+
+  // index too small for the directory: falls back to a linear search
+  FatFs small(drv);
+  small.setDirIndexSize(16);
+  CHECK(small.f_mount(&drv.fatfs, "0:", 1) == FR_OK, "remount failed");
+  check_names(small, isExFat);
+  CHECK(small.f_unmount("0:") == FR_OK, "f_unmount failed");
+
+  FatFs plain(drv);
+  CHECK(plain.f_mount(&drv.fatfs, "0:", 1) == FR_OK, "remount failed");
+  check_names(plain, isExFat);
+  plain.f_unmount("0:");
+
+  check_churn(drv);
+}
+
+void setup() {
+  run(drvFat, FM_FAT);
+  run(drvExFat, FM_EXFAT);
+  printf("PASS: directory index\n");
+  TEST_EXIT_OK();
+}
+
+void loop() {}
@@ -0,0 +1,85 @@
+/* Fast seek test (FF_USE_FASTSEEK) with File::enableFastSeek(). The cluster
+ * link map table lets seek() skip following the FAT chain, so on a
+ * fragmented file seek() + read() must deliver exactly the same data with
+ * and without it. The automatically sized table has to cover all fragments
+ * and a table which is too small has to be rejected. Appending data can not
+ * use the table, so the test also checks that appending works and that the
+ * next seek() rebuilds the table.
+ */
+#include <cstring>
+
+#include "fatfs.h"
+#include "test_common.h"
+
+using namespace fatfs;
+
+RamIO drv{4000, 512};
+
+static const int CHUNK = 2048;
+static const int CHUNKS = 40;
+
+static uint8_t value(int pos) { return (uint8_t)(pos * 13 + pos / 251); }
+
+static void write_data(File& f, int pos, int len) {
+  uint8_t buf[CHUNK];
+  for (int i = 0; i < len; i++) buf[i] = value(pos + i);
+  CHECK(f.write(buf, len) == (size_t)len, "write failed");
+}
+
+static void check_at(File& f, int pos) {
+  uint8_t buf[100];
+  CHECK(f.seek(pos), "seek failed");
+  CHECK(f.read(buf, sizeof(buf)) == sizeof(buf), "read failed");
+  for (int i = 0; i < (int)sizeof(buf); i++) {
+    CHECK(buf[i] == value(pos + i), "data mismatch");
+  }
+}
+
+void setup() {
+  static uint8_t work[FF_MAX_SS];
+  FatFs fs(drv);
+  MKFS_PARM opt = {FM_FAT, 1, 0, 1024, 0};
+  CHECK(fs.f_mkfs("0:", &opt, work, sizeof(work)) == FR_OK, "f_mkfs failed");
+  SDClass sd(drv);
+  CHECK(sd.begin(), "SD.begin() failed");
+
+  // the clusters of data.bin and other.bin alternate chunk by chunk
+  File f = sd.open("0:/data.bin", FILE_WRITE);
+  File other = sd.open("0:/other.bin", FILE_WRITE);
+  for (int j = 0; j < CHUNKS; j++) {
+    write_data(f, j * CHUNK, CHUNK);
+    f.flush();
+    write_data(other, j * CHUNK, CHUNK);
+    other.flush();
+  }
+  other.close();
+  f.close();
+
+  f = sd.open("0:/data.bin", FA_READ | FA_WRITE);
+  CHECK((bool)f, "could not open file");
+  CHECK(!f.enableFastSeek(4), "too small table accepted");
+  CHECK(!f.isFastSeek(), "fast seek active after failure");
+  check_at(f, 5000);  // the file is still usable
+  CHECK(f.enableFastSeek(), "enableFastSeek failed");
+  CHECK(f.fastSeekFragments() == CHUNKS, "unexpected number of fragments");
+
+  srand(1);
+  for (int j = 0; j < 200; j++) check_at(f, rand() % (CHUNKS * CHUNK - 100));
+
+  // append: the table gets rebuilt on the next seek
+  other = sd.open("0:/other.bin", FA_WRITE | FA_OPEN_APPEND);
+  write_data(other, 0, CHUNK);
+  other.close();
+  CHECK(f.seek(f.size()), "seek to end failed");
+  for (int j = CHUNKS; j < CHUNKS + 4; j++) write_data(f, j * CHUNK, CHUNK);
+  CHECK(f.isFastSeek(), "fast seek lost");
+  for (int j = 0; j < 200; j++) check_at(f, rand() % ((CHUNKS + 4) * CHUNK - 100));
+  CHECK(f.fastSeekFragments() == CHUNKS + 1, "table not rebuilt");
+  f.close();
+  sd.end();
+
+  printf("PASS: fast seek\n");
+  TEST_EXIT_OK();
+}
+
+void loop() {}
@@ -0,0 +1,135 @@
+/* FAT chain cache test (FF_USE_FATCACHE). get_fat() consults the cache
+ * before it reads the FAT, so a stale link would silently send a file into
+ * the wrong cluster. The test therefore uses a cache of only two regions
+ * (one FAT sector each) on a FAT16 and a FAT32 volume, follows interleaved
+ * chains which keep evicting the regions, and changes links with put_fat()
+ * (truncate, remove, extend) while they are cached. A remount without the
+ * cache must read the same files.
+ */
+#include <cstring>
+
+#include "fatfs.h"
+#include "test_common.h"
+
+using namespace fatfs;
+
+RamIO drv16{9000, 512};
+RamIO drv32{70000, 512};
+
+static const int FILES = 3;
+static const int CLUSTERS = 400;  // per file: more than two FAT sectors
+
+static void path_of(char* path, int f) { snprintf(path, 16, "0:/f%d.bin", f); }
+
+static void fill(uint8_t* buf, int f, int cl) {
+  for (int i = 0; i < 512; i++) buf[i] = (uint8_t)(f * 71 + cl * 13 + i);
+}
+
+/// writes the files cluster by cluster in turn: their chains interleave
+static void write_files(FatFs& fs, int clusters) {
+  FIL fil[FILES];
+  char path[16];
+  uint8_t buf[512];
+  UINT bw;
+  for (int f = 0; f < FILES; f++) {
+    path_of(path, f);
+    CHECK(fs.f_open(&fil[f], path, FA_WRITE | FA_OPEN_APPEND) == FR_OK,
+          "f_open failed");
+  }
+  for (int cl = 0; cl < clusters; cl++) {
+    for (int f = 0; f < FILES; f++) {
+      fill(buf, f, (int)(fs.f_tell(&fil[f]) / 512));
+      CHECK(fs.f_write(&fil[f], buf, 512, &bw) == FR_OK && bw == 512,
+            "f_write failed");
+    }
+  }
+  for (int f = 0; f < FILES; f++) fs.f_close(&fil[f]);
+}
+
+/// reads the files in turn, one cluster each, and checks their content
+static void check_files(FatFs& fs, const int clusters[FILES]) {
+  FIL fil[FILES];
+  char path[16];
+  uint8_t buf[512], expected[512];
+  UINT br;
+  int most = 0;
+  for (int f = 0; f < FILES; f++) {
+    path_of(path, f);
+    if (clusters[f] < 0) {
+      FILINFO info;
+      CHECK(fs.f_stat(path, &info) == FR_NO_FILE, "removed file found");
+      continue;
+    }
+    CHECK(fs.f_open(&fil[f], path, FA_READ) == FR_OK, "f_open failed");
+    CHECK(fs.f_size(&fil[f]) == (FSIZE_t)clusters[f] * 512, "wrong size");
+    if (clusters[f] > most) most = clusters[f];
+  }
+  for (int cl = 0; cl < most; cl++) {
+    for (int f = 0; f < FILES; f++) {
+      if (cl >= clusters[f]) continue;
+      fill(expected, f, cl);
+      CHECK(fs.f_read(&fil[f], buf, 512, &br) == FR_OK && br == 512,
+            "f_read failed");
+      CHECK(memcmp(buf, expected, 512) == 0, "wrong cluster in the chain");
+    }
+  }
+  for (int f = 0; f < FILES; f++) {
+    if (clusters[f] >= 0) fs.f_close(&fil[f]);
+  }
+}
+
+static void run(RamIO& drv, BYTE fmt, BYTE type) {
+  static uint8_t work[FF_MAX_SS];
+  FatFs fs(drv);
+  fs.setFatCacheSize(2);
+#if FF_USE_WINCACHE
+  fs.setSectorCacheSize(0);  // every FAT access goes to the FAT cache or disk
+#endif
+  MKFS_PARM opt = {fmt, 1, 0, 512, 0};
+  CHECK(fs.f_mkfs("0:", &opt, work, sizeof(work)) == FR_OK, "f_mkfs failed");
+  CHECK(fs.f_mount(&drv.fatfs, "0:", 1) == FR_OK, "f_mount failed");
+  CHECK(drv.fatfs.fs_type == type, "wrong FAT type");
+  FatCache& cache = fs.getFatCache(0);
+  CHECK(cache.size() == 2, "cache not active");
+  CHECK(cache.span() == (type == FS_FAT32 ? 128u : 256u),
+        "region does not cover a FAT sector");
+
+  write_files(fs, CLUSTERS);
+  int clusters[FILES] = {CLUSTERS, CLUSTERS, CLUSTERS};
+  DWORD misses = cache.misses();
+  check_files(fs, clusters);
+  CHECK(cache.misses() - misses > 2, "regions were not evicted");
+  CHECK(cache.hits() > cache.misses(), "chains not served from the cache");
+
+  // put_fat(): cut one chain, free another and reuse the clusters
+  FIL fil;
+  CHECK(fs.f_open(&fil, "0:/f0.bin", FA_WRITE) == FR_OK, "f_open failed");
+  CHECK(fs.f_lseek(&fil, 150 * 512) == FR_OK && fs.f_truncate(&fil) == FR_OK,
+        "f_truncate failed");
+  fs.f_close(&fil);
+  CHECK(fs.f_unlink("0:/f1.bin") == FR_OK, "f_unlink failed");
+  clusters[0] = 150;
+  clusters[1] = -1;
+  check_files(fs, clusters);
+  write_files(fs, 300);  // recreates f1 and takes the freed clusters
+  clusters[0] += 300;
+  clusters[1] = 300;
+  clusters[2] += 300;
+  check_files(fs, clusters);
+  CHECK(fs.f_unmount("0:") == FR_OK, "f_unmount failed");
+
+  FatFs plain(drv);
+  plain.setFatCacheSize(0);
+  CHECK(plain.f_mount(&drv.fatfs, "0:", 1) == FR_OK, "remount failed");
+  check_files(plain, clusters);
+  plain.f_unmount("0:");
+}
+
+void setup() {
+  run(drv16, FM_FAT, FS_FAT16);
+  run(drv32, FM_FAT32, FS_FAT32);
+  printf("PASS: FAT chain cache\n");
+  TEST_EXIT_OK();
+}
+
+void loop() {}
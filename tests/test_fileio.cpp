@@ -6,6 +6,9 @@
  * reopening a disk image that already has a filesystem on it. Also checks
  * that a brand new image gets auto-formatted on first mount, and that a
  * pre-existing image does NOT get reformatted (which would destroy data).
+ * Finally a new image is created as the second volume of a MultiIO, where
+ * mount() gets the logical drive 1 while the image itself is drive 0, and
+ * must still be auto-formatted.
  */
 #include <cstdio>
 #include <cstring>
@@ -63,6 +66,23 @@ void setup() {
 
   remove(IMG_PATH);
 
+  // a new image as volume "1:" of a MultiIO, after a RAM disk on "0:"
+  {
+    RamIO ram(200, 512);
+    FileIO drv(IMG_PATH, 200, 512);
+    MultiIO multi;
+    multi.add(ram);
+    multi.add(drv);
+    FatFs fs;
+    fs.setDriver(multi);
+    CHECK(multi.mount(fs) == FR_OK, "FileIO mount at drive 1 failed");
+    CHECK(fs.f_mkdir("1:/data") == FR_OK,
+          "new image at drive 1 of a MultiIO was not formatted");
+    multi.un_mount(fs);
+  }
+
+  remove(IMG_PATH);
+
   printf("PASS: FileIO persists data across independent instances\n");
   TEST_EXIT_OK();
 }
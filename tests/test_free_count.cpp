@@ -0,0 +1,121 @@
+/* Free space test: the free cluster count and the bounded query of
+ * File::availableForWrite(limit). On a FAT32 volume the count is written to
+ * the FSINFO (FF_FS_NOFSINFO=0), so it must be known right after the next
+ * mount without a FAT scan. The bounded query only scans the FAT as far as
+ * it needs to; the FAT reads are counted to make sure that repeated queries
+ * continue the scan instead of reading the FAT again, and the result must
+ * agree with the full count when the volume gets full. It also has to count
+ * the volume of the file when that is not the default volume.
+ */
+#include <cstring>
+
+#include "fatfs.h"
+#include "test_common.h"
+
+using namespace fatfs;
+
+/// RamIO which counts the reads of FAT sectors
+class FatCountingIO : public RamIO {
+ public:
+  using RamIO::RamIO;
+  size_t fat_reads = 0;
+
+  DRESULT disk_read(BYTE pdrv, BYTE* buffer, LBA_t sectorNo,
+                    UINT sectorCount) override {
+    if (fatfs.fs_type != 0 && sectorNo >= fatfs.fatbase &&
+        sectorNo < fatfs.fatbase + fatfs.fsize)
+      fat_reads += sectorCount;
+    return RamIO::disk_read(pdrv, buffer, sectorNo, sectorCount);
+  }
+};
+
+RamIO drv32{70000, 512};
+FatCountingIO drv16{9000, 512};
+
+static void check_fsinfo() {
+  static uint8_t work[FF_MAX_SS];
+  FatFs fs(drv32);
+  MKFS_PARM opt = {FM_FAT32, 1, 0, 512, 0};
+  CHECK(fs.f_mkfs("0:", &opt, work, sizeof(work)) == FR_OK, "f_mkfs failed");
+  CHECK(fs.f_mount(&drv32.fatfs, "0:", 1) == FR_OK, "f_mount failed");
+  CHECK(drv32.fatfs.fs_type == FS_FAT32, "not formatted as FAT32");
+
+  FIL fil;
+  UINT bw;
+  static uint8_t buf[4096];
+  CHECK(fs.f_open(&fil, "0:/a.bin", FA_WRITE | FA_CREATE_ALWAYS) == FR_OK,
+        "f_open failed");
+  for (int j = 0; j < 10; j++) fs.f_write(&fil, buf, sizeof(buf), &bw);
+  fs.f_close(&fil);
+  DWORD nfree;
+  FATFS* fatfs;
+  CHECK(fs.f_getfree("0:", &nfree, &fatfs) == FR_OK, "f_getfree failed");
+  CHECK(fs.f_unmount("0:") == FR_OK, "f_unmount failed");
+
+  FatFs fs2(drv32);
+  CHECK(fs2.f_mount(&drv32.fatfs, "0:", 1) == FR_OK, "remount failed");
+  CHECK(drv32.fatfs.free_clst == nfree, "free count not known after mount");
+  fs2.f_unmount("0:");
+}
+
+static void check_bounded() {
+  SDClass sd(drv16);
+  CHECK(sd.begin(), "SD.begin() failed");
+  File f = sd.open("0:/b.bin", FILE_WRITE);
+  CHECK((bool)f, "could not create file");
+
+  // an empty volume has plenty of space: found in the first FAT sector
+  CHECK(f.availableForWrite(1000) == 1000, "bounded query failed");
+  CHECK(drv16.fatfs.free_clst == 0xFFFFFFFF, "bounded query scanned the FAT");
+
+  // fill the volume, keeping the bounded and the full query consistent
+  static uint8_t buf[4096];
+  size_t writes = 0;
+  drv16.fat_reads = 0;
+  while (f.availableForWrite(sizeof(buf)) == sizeof(buf)) {
+    CHECK(f.write(buf, sizeof(buf)) == sizeof(buf), "write failed");
+    writes++;
+  }
+  // each query continues the scan of the previous one: besides the reads
+  // of the allocation, the FAT is read only once
+  printf("%zu writes, %zu FAT reads, FAT of %u sectors\n", writes,
+         drv16.fat_reads, (unsigned)drv16.fatfs.fsize);
+  CHECK(drv16.fat_reads <= writes + 2 * drv16.fatfs.fsize,
+        "the FAT is scanned again and again");
+  size_t rest = f.availableForWrite(sizeof(buf));
+  CHECK(rest == (size_t)f.availableForWrite(), "bounded and full query differ");
+  CHECK(f.write(buf, rest) == rest, "could not write the remaining space");
+  CHECK(f.availableForWrite(1) == 0, "volume is not full");
+  f.close();
+  sd.end();
+}
+
+static void check_volume() {
+  RamIO small{300, 512}, large{3000, 512};
+  MultiIO multi;
+  multi.add(small);
+  multi.add(large);
+  SDClass sd(multi);
+  CHECK(sd.begin(), "SD.begin() failed");
+  File f = sd.open("1:/c.bin", FILE_WRITE);
+  CHECK((bool)f, "could not create file");
+  DWORD nfree;
+  FATFS* fatfs;
+  CHECK(sd.getFatFs()->f_getfree("1:", &nfree, &fatfs) == FR_OK,
+        "f_getfree failed");
+  size_t bytes = (size_t)nfree * fatfs->csize * 512;
+  CHECK(f.availableForWrite(10 * 1024 * 1024) == bytes,
+        "free space of another volume");
+  f.close();
+  sd.end();
+}
+
+void setup() {
+  check_fsinfo();
+  check_bounded();
+  check_volume();
+  printf("PASS: free cluster counter\n");
+  TEST_EXIT_OK();
+}
+
+void loop() {}
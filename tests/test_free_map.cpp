@@ -0,0 +1,120 @@
+/* Free cluster map test (FF_USE_FREEMAP). create_chain() and f_getfree()
+ * use the map instead of the FAT, so the map has to agree with the FAT at
+ * all times. The same allocation pattern runs with an exact map (FAT12, one
+ * bit per cluster) and with a coarse one (FAT16, one bit per group of
+ * clusters): clusters released by f_unlink() must be reused, the volume
+ * must fill up completely, f_getfree() must match the FAT scan of a plain
+ * FatFs after remount, and the file contents must be intact.
+ */
+#include <cstring>
+
+#include "fatfs.h"
+#include "test_common.h"
+
+using namespace fatfs;
+
+RamIO drv12{3000, 512};
+RamIO drv16{9000, 512};
+
+static FRESULT write_file(FatFs& fs, const char* path, int len, BYTE seed,
+                          int* written) {
+  FIL fil;
+  UINT bw = 0;
+  uint8_t buf[512];
+  *written = 0;
+  FRESULT res = fs.f_open(&fil, path, FA_WRITE | FA_CREATE_ALWAYS);
+  if (res != FR_OK) return res;
+  for (int j = 0; j < len; j += sizeof(buf)) {
+    for (UINT i = 0; i < sizeof(buf); i++) buf[i] = (uint8_t)(seed + j + i);
+    res = fs.f_write(&fil, buf, sizeof(buf), &bw);
+    *written += bw;
+    if (res != FR_OK || bw < sizeof(buf)) break;
+  }
+  fs.f_close(&fil);
+  return res;
+}
+
+static void check_file(FatFs& fs, const char* path, int len, BYTE seed) {
+  FIL fil;
+  UINT br;
+  uint8_t buf[512];
+  CHECK(fs.f_open(&fil, path, FA_READ) == FR_OK, "f_open for read failed");
+  CHECK((int)fs.f_size(&fil) == len, "file size mismatch");
+  for (int j = 0; j < len; j += sizeof(buf)) {
+    CHECK(fs.f_read(&fil, buf, sizeof(buf), &br) == FR_OK, "f_read failed");
+    for (UINT i = 0; i < br; i++) {
+      CHECK(buf[i] == (uint8_t)(seed + j + i), "file content mismatch");
+    }
+  }
+  fs.f_close(&fil);
+}
+
+static DWORD free_clusters(FatFs& fs) {
+  DWORD nclst = 0;
+  FATFS* fatfs;
+  CHECK(fs.f_getfree("0:", &nclst, &fatfs) == FR_OK, "f_getfree failed");
+  return nclst;
+}
+
+static void run(RamIO& drv, BYTE fmt, UINT mapBytes, DWORD expectedGranule) {
+  static uint8_t work[FF_MAX_SS];
+  FatFs fs(drv);
+  fs.setFreeMapSize(mapBytes);
+  MKFS_PARM opt = {fmt, 1, 0, 512, 0};
+  CHECK(fs.f_mkfs("0:", &opt, work, sizeof(work)) == FR_OK, "f_mkfs failed");
+  CHECK(fs.f_mount(&drv.fatfs, "0:", 1) == FR_OK, "f_mount failed");
+  FreeMap& map = fs.getFreeMap(0);
+  CHECK(map.size() > 0, "free map not allocated");
+  CHECK(map.granule() == expectedGranule, "unexpected granule");
+
+  DWORD total = free_clusters(fs);
+  CHECK(map.isValid(), "f_getfree did not fill the free map");
+
+  // fragment the volume: create files, delete every 2nd one
+  char path[32];
+  int written;
+  for (int j = 0; j < 8; j++) {
+    snprintf(path, sizeof(path), "0:/f%d.bin", j);
+    CHECK(write_file(fs, path, 20 * 1024, (BYTE)j, &written) == FR_OK,
+          "write failed");
+  }
+  for (int j = 1; j < 8; j += 2) {
+    snprintf(path, sizeof(path), "0:/f%d.bin", j);
+    CHECK(fs.f_unlink(path) == FR_OK, "f_unlink failed");
+  }
+  DWORD before = free_clusters(fs);
+
+  // fill the rest of the volume: this needs all the released holes
+  write_file(fs, "0:/fill.bin", 8 * 1024 * 1024, 99, &written);
+  CHECK(written > 0, "nothing written");
+  CHECK(free_clusters(fs) == 0, "volume is not full");
+  CHECK((DWORD)written / (drv.fatfs.csize * 512) == before,
+        "released clusters were not reused");
+  printf("granule %u: %u clusters, %u free after unlink, %d bytes filled\n",
+         (unsigned)map.granule(), (unsigned)total, (unsigned)before, written);
+
+  // release the fill file again and compare with a plain FAT scan
+  CHECK(fs.f_unlink("0:/fill.bin") == FR_OK, "f_unlink fill failed");
+  DWORD with_map = free_clusters(fs);
+  CHECK(with_map == before, "free count not restored");
+  CHECK(fs.f_unmount("0:") == FR_OK, "f_unmount failed");
+
+  FatFs plain(drv);
+  plain.setFreeMapSize(0);
+  CHECK(plain.f_mount(&drv.fatfs, "0:", 1) == FR_OK, "remount failed");
+  CHECK(free_clusters(plain) == with_map, "free count differs from FAT scan");
+  for (int j = 0; j < 8; j += 2) {
+    snprintf(path, sizeof(path), "0:/f%d.bin", j);
+    check_file(plain, path, 20 * 1024, (BYTE)j);
+  }
+  plain.f_unmount("0:");
+}
+
+void setup() {
+  run(drv12, FM_FAT, 1024, 1);  // exact map
+  run(drv16, FM_FAT, 64, 16);   // coarse map: 512 bits for ~4400 clusters
+  printf("PASS: free cluster map\n");
+  TEST_EXIT_OK();
+}
+
+void loop() {}
@@ -0,0 +1,123 @@
+/* MmapFileIO test: like FileIO, but the disk image is mapped into memory.
+ * A new image must be formatted on the first mount and an existing one
+ * reopened as-is, and FileIO must read the same image, so that the two
+ * drivers can be exchanged. CTRL_TRIM has to clear the sectors (and punch
+ * a hole where supported) and reject invalid ranges, and requests beyond
+ * the end must fail. On 64 bit hosts a sparse image checks that sectors
+ * beyond 4 GB are written at the right offset, also when they are read
+ * back with FileIO.
+ */
+#include <sys/stat.h>
+
+#include <cstdio>
+#include <cstring>
+
+#include "fatfs.h"
+#include "test_common.h"
+
+using namespace fatfs;
+
+static const char* IMG_PATH = "fatfs_test_mmap.img";
+
+static void check_volume() {
+  const char* content = "written through the mapping";
+  char buf[64] = {0};
+  {
+    MmapFileIO drv(IMG_PATH, 4096, 512);
+    SDClass sd(drv);
+    CHECK(sd.begin(), "mount (auto-format) failed");
+    File f = sd.open("mmap.txt", FILE_WRITE);
+    CHECK((bool)f, "could not create file");
+    CHECK(f.write((const uint8_t*)content, strlen(content)) == strlen(content),
+          "write failed");
+    f.close();
+    sd.end();
+  }
+  {
+    FileIO drv(IMG_PATH, 4096, 512);
+    SDClass sd(drv);
+    CHECK(sd.begin(), "FileIO mount failed");
+    File f = sd.open("mmap.txt", FILE_READ);
+    CHECK((bool)f && f.size() == strlen(content), "file missing in FileIO");
+    f.readBytes((uint8_t*)buf, strlen(content));
+    f.close();
+    sd.end();
+    CHECK(strcmp(buf, content) == 0, "content mismatch in FileIO");
+  }
+  {
+    MmapFileIO drv(IMG_PATH, 4096, 512);
+    SDClass sd(drv);
+    CHECK(sd.begin(), "reopen failed");
+    CHECK(sd.exists("mmap.txt"), "image was reformatted");
+    sd.end();
+  }
+  remove(IMG_PATH);
+}
+
+static void check_trim() {
+  MmapFileIO drv(IMG_PATH, 1024, 512);
+  uint8_t out[512 * 64], in[512];
+  memset(out, 0x5A, sizeof(out));
+  CHECK(drv.disk_initialize(0) == STA_CLEAR, "disk_initialize failed");
+  CHECK(drv.disk_write(0, out, 64, 64) == RES_OK, "write failed");
+  CHECK(drv.disk_ioctl(0, CTRL_SYNC, nullptr) == RES_OK, "sync failed");
+  struct stat before, after;
+  stat(IMG_PATH, &before);
+
+  LBA_t range[2] = {64, 127};
+  CHECK(drv.disk_ioctl(0, CTRL_TRIM, range) == RES_OK, "trim failed");
+  CHECK(drv.disk_read(0, in, 100, 1) == RES_OK && in[0] == 0 && in[511] == 0,
+        "trimmed sector not cleared");
+  stat(IMG_PATH, &after);
+  CHECK(after.st_size == before.st_size, "trim changed the image size");
+  if (after.st_blocks >= before.st_blocks) {
+    printf("(no hole punching on this file system)\n");
+  }
+  range[1] = 1024;
+  CHECK(drv.disk_ioctl(0, CTRL_TRIM, range) == RES_PARERR, "bad trim range");
+  CHECK(drv.disk_read(0, in, 1023, 2) == RES_ERROR, "read beyond the end");
+  CHECK(drv.disk_write(0, out, 1024, 1) == RES_ERROR, "write beyond the end");
+}
+
+static void check_large() {
+  if (sizeof(void*) < 8) return;
+  const size_t sectors = 12 * 1024 * 1024;  // 6 GB, sparse
+  const LBA_t last = sectors - 1;
+  uint8_t out[512], in[512];
+  memset(out, 0xC3, sizeof(out));
+  {
+    MmapFileIO drv(IMG_PATH, sectors, 512);
+    if (drv.disk_initialize(0) != STA_CLEAR) {
+      printf("(no sparse 6 GB image possible here)\n");
+      remove(IMG_PATH);
+      return;
+    }
+    CHECK(drv.disk_write(0, out, last, 1) == RES_OK, "write failed");
+    CHECK(drv.disk_ioctl(0, CTRL_SYNC, nullptr) == RES_OK, "sync failed");
+  }
+  struct stat st;
+  stat(IMG_PATH, &st);
+  CHECK((uint64_t)st.st_size == (uint64_t)sectors * 512, "wrong image size");
+  FileIO drv(IMG_PATH, sectors, 512);
+  CHECK(drv.disk_initialize(0) == STA_CLEAR, "FileIO disk_initialize failed");
+  CHECK(drv.disk_read(0, in, last, 1) == RES_OK && in[0] == 0xC3 &&
+            in[511] == 0xC3,
+        "wrong offset beyond 4 GB");
+  LBA_t count = 0;
+  CHECK(drv.disk_ioctl(0, GET_SECTOR_COUNT, &count) == RES_OK &&
+            count == (LBA_t)sectors,
+        "wrong sector count");
+  remove(IMG_PATH);
+}
+
+void setup() {
+  remove(IMG_PATH);
+  check_volume();
+  check_trim();
+  remove(IMG_PATH);
+  check_large();
+  printf("PASS: mmap fileio\n");
+  TEST_EXIT_OK();
+}
+
+void loop() {}
@@ -0,0 +1,143 @@
+/* MultiIO concatenation test (MULTI_CONCAT): the sectors of the drivers
+ * follow each other, so the sector count is their sum and every sector has
+ * to end up on the right driver. The interesting cases are requests which
+ * cross the end of one or more drivers. A FatFs volume on StreamIO drivers
+ * of different sizes must keep its files, requests beyond the end must fail
+ * and CTRL_TRIM is passed on to each driver for its part of the range.
+ */
+#include <cstring>
+#include <vector>
+
+#include "fatfs.h"
+#include "driver/StreamIO.h"
+#include "test_common.h"
+
+using namespace fatfs;
+
+/// in-memory stand-in for a small flash chip
+class FlashStream {
+ public:
+  FlashStream(size_t sectors) : data(sectors * 512, 0) {}
+
+  int sectorSize() { return 512; }
+  bool begin() { return true; }
+  void seek(uint64_t pos) { position = pos; }
+  void flush() {}
+  uint32_t sectorCount() { return (uint32_t)(data.size() / 512); }
+  void eraseSector(uint32_t from, uint32_t to) {
+    memset(data.data() + from * 512, 0, (to - from + 1) * 512);
+  }
+
+  size_t readBytes(uint8_t* buf, size_t len) {
+    if (position + len > data.size()) return 0;
+    memcpy(buf, data.data() + position, len);
+    position += len;
+    return len;
+  }
+
+  size_t write(const uint8_t* buf, size_t len) {
+    if (position + len > data.size()) return 0;
+    memcpy(data.data() + position, buf, len);
+    position += len;
+    return len;
+  }
+
+ protected:
+  std::vector<uint8_t> data;
+  uint64_t position = 0;
+};
+
+static void check_layout() {
+  RamIO a{100, 512}, b{37, 512}, c{1, 512}, d{200, 512};
+  MultiIO multi;
+  multi.add(a);
+  multi.add(b);
+  multi.add(c);
+  multi.add(d);
+  multi.setMode(MULTI_CONCAT);
+  CHECK(multi.disk_initialize(0) == STA_CLEAR, "disk_initialize failed");
+  LBA_t count = 0;
+  CHECK(multi.disk_ioctl(0, GET_SECTOR_COUNT, &count) == RES_OK &&
+            count == 338,
+        "wrong sector count");
+
+  // every sector contains its number
+  std::vector<uint8_t> data(count * 512);
+  for (LBA_t s = 0; s < count; s++) memset(&data[s * 512], (uint8_t)s, 512);
+  CHECK(multi.disk_write(0, data.data() + 90 * 512, 90, 60) == RES_OK,
+        "write over three drivers failed");
+  CHECK(multi.disk_write(0, data.data(), 0, 90) == RES_OK, "write failed");
+  CHECK(multi.disk_write(0, data.data() + 150 * 512, 150, count - 150) ==
+            RES_OK,
+        "write failed");
+
+  uint8_t sector[512];
+  RamIO* members[4] = {&a, &b, &c, &d};
+  const LBA_t first[4] = {0, 100, 137, 138};
+  for (LBA_t s = 0; s < count; s++) {
+    int m = s < 100 ? 0 : s < 137 ? 1 : s < 138 ? 2 : 3;
+    CHECK(members[m]->disk_read(0, sector, s - first[m], 1) == RES_OK &&
+              sector[0] == (uint8_t)s && sector[511] == (uint8_t)s,
+          "sector on wrong driver");
+  }
+  std::vector<uint8_t> in(count * 512);
+  CHECK(multi.disk_read(0, in.data(), 0, count) == RES_OK, "read failed");
+  CHECK(memcmp(in.data(), data.data(), in.size()) == 0, "wrong data");
+  CHECK(multi.disk_read(0, sector, 137, 1) == RES_OK && sector[0] == 137,
+        "single sector driver");
+
+  CHECK(multi.disk_read(0, sector, count, 1) == RES_PARERR,
+        "read beyond the end");
+  CHECK(multi.disk_read(0, in.data(), count - 1, 2) == RES_PARERR,
+        "read over the end");
+  CHECK(multi.disk_read(1, sector, 0, 1) == RES_PARERR, "wrong drive");
+  LBA_t range[2] = {98, 140};
+  CHECK(multi.disk_ioctl(0, CTRL_TRIM, range) == RES_OK, "trim failed");
+  CHECK(a.disk_read(0, sector, 99, 1) == RES_OK && sector[0] == 0 &&
+            b.disk_read(0, sector, 36, 1) == RES_OK && sector[0] == 0 &&
+            d.disk_read(0, sector, 2, 1) == RES_OK && sector[0] == 0,
+        "not trimmed");
+  CHECK(multi.disk_read(0, sector, 97, 1) == RES_OK && sector[0] == 97 &&
+            multi.disk_read(0, sector, 141, 1) == RES_OK && sector[0] == 141,
+        "trimmed too much");
+}
+
+static void check_volume() {
+  FlashStream chip_a{1024}, chip_b{1536}, chip_c{2048};
+  StreamIO<FlashStream> a{chip_a}, b{chip_b}, c{chip_c};
+  MultiIO multi;
+  multi.add(a);
+  multi.add(b);
+  multi.add(c);
+  multi.setMode(MULTI_CONCAT);
+  SDClass sd(multi);
+  CHECK(sd.mkfs(), "mkfs failed");
+  CHECK(sd.begin(), "mount failed");
+
+  // larger than the first two chips
+  std::vector<uint8_t> data(1500000);
+  for (size_t i = 0; i < data.size(); i++) data[i] = (uint8_t)(i * 7 + i / 251);
+  File f = sd.open("span.bin", FILE_WRITE);
+  CHECK((bool)f, "could not create file");
+  CHECK(f.write(data.data(), data.size()) == data.size(), "write failed");
+  f.close();
+  sd.end();
+
+  CHECK(sd.begin(), "mount failed");
+  std::vector<uint8_t> in(data.size());
+  File r = sd.open("span.bin", FILE_READ);
+  CHECK((bool)r && r.size() == data.size(), "file missing");
+  CHECK(r.readBytes(in.data(), in.size()) == in.size(), "short read");
+  r.close();
+  CHECK(in == data, "content mismatch");
+  sd.end();
+}
+
+void setup() {
+  check_layout();
+  check_volume();
+  printf("PASS: MultiIO concatenation\n");
+  TEST_EXIT_OK();
+}
+
+void loop() {}
@@ -0,0 +1,153 @@
+/* MultiIO mirroring test (MULTI_MIRROR): every sector is stored on all
+ * drivers, so that the device survives the failure of one of them. Writes
+ * must reach all drivers while the reads are distributed over them. A
+ * driver with a read or write error is marked as failed and the device
+ * keeps working (degraded) with the data of the other driver. A replaced
+ * driver gets the writes right away and contains the same data after
+ * resync(). Only when no driver with all data is left may the device fail.
+ */
+#include <cstring>
+#include <vector>
+
+#include "fatfs.h"
+#include "test_common.h"
+
+using namespace fatfs;
+
+static const int SECTORS = 2048;
+
+/// forwards all calls and counts them; the reads or writes can fail
+class FaultyIO : public IO {
+ public:
+  FaultyIO(IO& io) : p_io(&io) {}
+
+  DSTATUS disk_initialize(BYTE pdrv) override {
+    return p_io->disk_initialize(pdrv);
+  }
+  DSTATUS disk_status(BYTE pdrv) override { return p_io->disk_status(pdrv); }
+
+  DRESULT disk_read(BYTE pdrv, BYTE* buff, LBA_t sector, UINT count) override {
+    reads++;
+    if (fail_reads) return RES_ERROR;
+    return p_io->disk_read(pdrv, buff, sector, count);
+  }
+
+  DRESULT disk_write(BYTE pdrv, const BYTE* buff, LBA_t sector,
+                     UINT count) override {
+    writes++;
+    if (fail_writes) return RES_ERROR;
+    return p_io->disk_write(pdrv, buff, sector, count);
+  }
+
+  DRESULT disk_ioctl(BYTE pdrv, ioctl_cmd_t cmd, void* buff) override {
+    return p_io->disk_ioctl(pdrv, cmd, buff);
+  }
+
+  IO* p_io;
+  int reads = 0;
+  int writes = 0;
+  bool fail_reads = false;
+  bool fail_writes = false;
+};
+
+static bool same(RamIO& a, RamIO& b) {
+  std::vector<uint8_t> x(512), y(512);
+  for (LBA_t s = 0; s < SECTORS; s++) {
+    if (a.disk_read(0, x.data(), s, 1) != RES_OK ||
+        b.disk_read(0, y.data(), s, 1) != RES_OK || x != y)
+      return false;
+  }
+  return true;
+}
+
+static bool read_file(SDClass& sd, const char* path, const char* expected) {
+  char buf[64] = {0};
+  File f = sd.open(path, FILE_READ);
+  if (!f) return false;
+  f.readBytes((uint8_t*)buf, sizeof(buf) - 1);
+  f.close();
+  return strcmp(buf, expected) == 0;
+}
+
+static bool write_file(SDClass& sd, const char* path, const char* text) {
+  File f = sd.open(path, FILE_WRITE);
+  if (!f) return false;
+  size_t n = f.write((const uint8_t*)text, strlen(text));
+  f.close();
+  return n == strlen(text);
+}
+
+void setup() {
+  RamIO ram_a{SECTORS, 512}, ram_b{SECTORS, 512}, ram_c{SECTORS, 512};
+  FaultyIO a{ram_a}, b{ram_b};
+  MultiIO multi;
+  multi.add(a);
+  multi.add(b);
+  multi.setMode(MULTI_MIRROR, 16);
+  SDClass sd(multi);
+  CHECK(sd.mkfs(), "mkfs failed");
+  CHECK(sd.begin(), "mount failed");
+  LBA_t count = 0;
+  CHECK(multi.disk_ioctl(0, GET_SECTOR_COUNT, &count) == RES_OK &&
+            count == SECTORS,
+        "wrong sector count");
+
+  // writes go to both drivers, reads are shared
+  CHECK(write_file(sd, "a.txt", "mirrored"), "write failed");
+  sd.end();
+  CHECK(same(ram_a, ram_b), "drivers differ");
+  a.reads = b.reads = 0;
+  std::vector<uint8_t> buf(256 * 512);
+  CHECK(multi.disk_read(0, buf.data(), 0, 256) == RES_OK, "read failed");
+  for (int j = 0; j < 8; j++) multi.disk_read(0, buf.data(), j, 1);
+  CHECK(a.reads == 12 && b.reads == 12, "reads not distributed");
+  CHECK(!multi.isDegraded(), "degraded without error");
+
+  // a failing driver: reads fall back to the other one
+  CHECK(sd.begin(), "mount failed");
+  a.fail_reads = true;
+  CHECK(read_file(sd, "a.txt", "mirrored"), "degraded read failed");
+  CHECK(multi.disk_read(0, buf.data(), 0, 256) == RES_OK, "read failed");
+  CHECK(multi.getState(0) == MIRROR_FAILED && multi.errors(0) == 1,
+        "driver not marked as failed");
+  CHECK(multi.isDegraded(), "not degraded");
+  int writes = a.writes;
+  CHECK(write_file(sd, "b.txt", "degraded"), "degraded write failed");
+  CHECK(a.writes == writes, "failed driver still used");
+  sd.end();
+
+  // replace the failed driver and rebuild it
+  CHECK(multi.replace(0, ram_c), "replace failed");
+  CHECK(multi.getState(0) == MIRROR_REBUILDING, "not rebuilding");
+  CHECK(sd.begin(), "mount failed");
+  CHECK(write_file(sd, "c.txt", "rebuilding"), "write during rebuild failed");
+  sd.end();
+  int steps = 1;
+  while (!multi.resync(100)) steps++;
+  CHECK(steps == (SECTORS + 99) / 100, "wrong number of resync steps");
+  CHECK(multi.getState(0) == MIRROR_OK && !multi.isDegraded(),
+        "not rebuilt");
+  CHECK(same(ram_b, ram_c), "rebuilt driver differs");
+  CHECK(sd.begin(), "mount failed");
+  CHECK(read_file(sd, "a.txt", "mirrored") &&
+            read_file(sd, "b.txt", "degraded") &&
+            read_file(sd, "c.txt", "rebuilding"),
+        "files lost");
+
+  sd.end();
+
+  // write errors on the last complete driver: the device fails
+  multi.setFailed(0);
+  b.fail_writes = true;
+  CHECK(multi.disk_write(0, buf.data(), 100, 1) == RES_ERROR,
+        "write without complete driver");
+  CHECK(multi.getState(1) == MIRROR_FAILED, "driver not marked as failed");
+  CHECK(multi.disk_read(0, buf.data(), 0, 1) == RES_ERROR,
+        "read without drivers");
+  CHECK(multi.disk_status(0) == STA_NOINIT, "status without drivers");
+
+  printf("PASS: MultiIO mirroring\n");
+  TEST_EXIT_OK();
+}
+
+void loop() {}
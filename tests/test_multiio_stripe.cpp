@@ -0,0 +1,105 @@
+/* MultiIO striping test (MULTI_STRIPE): several drivers form one device and
+ * the sectors are distributed over them in stripes, in turn. The sector
+ * count is the number of complete stripes of the smallest driver times the
+ * number of drivers, and requests which start or end within a stripe must
+ * still reach the right sectors. A FatFs volume on a RamIO and a FileIO
+ * driver must keep its files, requests beyond the end must fail and
+ * CTRL_TRIM is passed on to each driver.
+ */
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "fatfs.h"
+#include "test_common.h"
+
+using namespace fatfs;
+
+static const char* IMG_PATH = "fatfs_test_stripe.img";
+static const UINT STRIPE = 8;
+
+static void check_layout() {
+  RamIO a{100, 512}, b{100, 512}, c{120, 512};
+  MultiIO multi;
+  multi.add(a);
+  multi.add(b);
+  multi.add(c);
+  multi.setMode(MULTI_STRIPE, STRIPE);
+  CHECK(multi.disk_initialize(0) == STA_CLEAR, "disk_initialize failed");
+  LBA_t count = 0;
+  CHECK(multi.disk_ioctl(0, GET_SECTOR_COUNT, &count) == RES_OK &&
+            count == 3 * 96,
+        "wrong sector count");
+
+  // every sector contains its number
+  std::vector<uint8_t> data(count * 512);
+  for (LBA_t s = 0; s < count; s++) memset(&data[s * 512], (uint8_t)s, 512);
+  CHECK(multi.disk_write(0, data.data() + 3 * 512, 3, 50) == RES_OK,
+        "unaligned write failed");
+  CHECK(multi.disk_write(0, data.data(), 0, 3) == RES_OK, "write failed");
+  CHECK(multi.disk_write(0, data.data() + 53 * 512, 53, count - 53) == RES_OK,
+        "write failed");
+
+  uint8_t sector[512];
+  RamIO* members[3] = {&a, &b, &c};
+  for (LBA_t s = 0; s < count; s += 5) {
+    LBA_t stripe = s / STRIPE;
+    RamIO* member = members[stripe % 3];
+    LBA_t pos = stripe / 3 * STRIPE + s % STRIPE;
+    CHECK(member->disk_read(0, sector, pos, 1) == RES_OK &&
+              sector[0] == (uint8_t)s && sector[511] == (uint8_t)s,
+          "sector on wrong driver");
+  }
+  std::vector<uint8_t> in(count * 512);
+  CHECK(multi.disk_read(0, in.data(), 0, count) == RES_OK, "read failed");
+  CHECK(memcmp(in.data(), data.data(), in.size()) == 0, "wrong data");
+
+  CHECK(multi.disk_read(0, sector, count, 1) == RES_PARERR,
+        "read beyond the end");
+  CHECK(multi.disk_read(1, sector, 0, 1) == RES_PARERR, "wrong drive");
+  LBA_t range[2] = {4, 20};
+  CHECK(multi.disk_ioctl(0, CTRL_TRIM, range) == RES_OK, "trim failed");
+  CHECK(multi.disk_read(0, sector, 12, 1) == RES_OK && sector[0] == 0 &&
+            b.disk_read(0, sector, 4, 1) == RES_OK && sector[0] == 0,
+        "not trimmed");
+  CHECK(multi.disk_read(0, sector, 21, 1) == RES_OK && sector[0] == 21,
+        "trimmed too much");
+}
+
+static void check_volume() {
+  remove(IMG_PATH);
+  RamIO a{4096, 512};
+  FileIO b{IMG_PATH, 4096, 512};
+  MultiIO multi;
+  multi.add(a);
+  multi.add(b);
+  multi.setMode(MULTI_STRIPE, 16);
+  SDClass sd(multi);
+  CHECK(sd.mkfs(), "mkfs failed");
+  CHECK(sd.begin(), "mount failed");
+
+  std::vector<uint8_t> data(300000);
+  for (size_t i = 0; i < data.size(); i++) data[i] = (uint8_t)(i * 7 + i / 251);
+  File f = sd.open("stripe.bin", FILE_WRITE);
+  CHECK((bool)f, "could not create file");
+  CHECK(f.write(data.data(), data.size()) == data.size(), "write failed");
+  f.close();
+
+  std::vector<uint8_t> in(data.size());
+  File r = sd.open("stripe.bin", FILE_READ);
+  CHECK((bool)r && r.size() == data.size(), "file missing");
+  CHECK(r.readBytes(in.data(), in.size()) == in.size(), "short read");
+  r.close();
+  CHECK(in == data, "content mismatch");
+  sd.end();
+  remove(IMG_PATH);
+}
+
+void setup() {
+  check_layout();
+  check_volume();
+  printf("PASS: MultiIO striping\n");
+  TEST_EXIT_OK();
+}
+
+void loop() {}
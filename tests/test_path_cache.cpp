@@ -0,0 +1,125 @@
+/* Path cache test (FF_USE_PATHCACHE). follow_path() takes the resolved
+ * directories from the cache, so an entry must never outlive the directory
+ * it describes. On a FAT and an exFAT volume deep paths are resolved from
+ * the cache, also when they are written in a different case or with other
+ * separators. Renamed and removed directories must no longer be found under
+ * their old path, even when a new directory gets the same cluster, while
+ * directories which grow (exFAT: new size) and paths which are too long for
+ * the cache must still be resolved. A plain FatFs without cache must see
+ * the same tree after remount.
+ */
+#include <cstring>
+
+#include "fatfs.h"
+#include "test_common.h"
+
+using namespace fatfs;
+
+RamIO drvFat{4000, 512};
+RamIO drvExFat{20000, 512};
+
+static const int N = 60;
+static const char* LONG_DIR =
+    "0:/a-directory-with-a-name-which-is-longer-than-the-cached-paths-can-be";
+
+static void create(FatFs& fs, const char* path) {
+  FIL fil;
+  UINT bw;
+  CHECK(fs.f_open(&fil, path, FA_WRITE | FA_CREATE_NEW) == FR_OK,
+        "could not create file");
+  CHECK(fs.f_write(&fil, path, strlen(path), &bw) == FR_OK, "f_write failed");
+  fs.f_close(&fil);
+}
+
+static FRESULT stat(FatFs& fs, const char* path) {
+  FILINFO info;
+  return fs.f_stat(path, &info);
+}
+
+static void check_tree(FatFs& fs) {
+  char path[160];
+  for (int j = 0; j < N; j++) {
+    snprintf(path, sizeof(path), "0:/logs/2026/11/16/sensor-%d.csv", j);
+    CHECK(stat(fs, path) == FR_OK, "file not found");
+  }
+  CHECK(stat(fs, "0:/logs/2026/10/16/sensor-1.csv") == FR_NO_PATH,
+        "renamed directory found under its old path");
+  CHECK(stat(fs, "0:/logs/2026/11/17/sensor-1.csv") == FR_NO_FILE,
+        "file of a removed directory found");
+  snprintf(path, sizeof(path), "%s/sub/x.txt", LONG_DIR);
+  CHECK(stat(fs, path) == FR_OK, "file in long path not found");
+}
+
+static void run(RamIO& drv, BYTE fmt) {
+  static uint8_t work[FF_MAX_SS];
+  FatFs fs(drv);
+  fs.setPathCacheSize(8);
+  MKFS_PARM opt = {fmt, 1, 0, 0, 0};
+  CHECK(fs.f_mkfs("0:", &opt, work, sizeof(work)) == FR_OK, "f_mkfs failed");
+  CHECK(fs.f_mount(&drv.fatfs, "0:", 1) == FR_OK, "f_mount failed");
+  PathCache& cache = fs.getPathCache(0);
+  CHECK(cache.size() == 8, "cache not allocated");
+
+  CHECK(fs.f_mkdir("0:/logs") == FR_OK, "f_mkdir failed");
+  CHECK(fs.f_mkdir("0:/logs/2026") == FR_OK, "f_mkdir failed");
+  CHECK(fs.f_mkdir("0:/logs/2026/10") == FR_OK, "f_mkdir failed");
+  CHECK(fs.f_mkdir("0:/logs/2026/10/16") == FR_OK, "f_mkdir failed");
+  CHECK(fs.f_mkdir("0:/logs/2026/10/17") == FR_OK, "f_mkdir failed");
+
+  // many files: the directory needs more than one cluster
+  char path[160];
+  unsigned long hits = cache.hits();
+  for (int j = 0; j < N; j++) {
+    snprintf(path, sizeof(path), "0:/logs/2026/10/16/sensor-%d.csv", j);
+    create(fs, path);
+  }
+  CHECK(cache.hits() - hits == N, "deep paths not resolved by cache");
+  CHECK(stat(fs, "0:\\LOGS\\2026//10/16/SENSOR-3.CSV") == FR_OK,
+        "normalized path not found");
+  CHECK(stat(fs, "0:/logs/2026/10/16/sensor-3.csv/x") == FR_NO_PATH,
+        "file used as directory");
+
+  // rename a cached directory
+  CHECK(fs.f_rename("0:/logs/2026/10", "0:/logs/2026/11") == FR_OK,
+        "f_rename failed");
+  CHECK(stat(fs, "0:/logs/2026/10/16/sensor-1.csv") == FR_NO_PATH,
+        "renamed directory found under its old path");
+
+  // remove a cached directory and reuse its cluster
+  create(fs, "0:/logs/2026/11/17/sensor-1.csv");
+  CHECK(stat(fs, "0:/logs/2026/11/17/sensor-1.csv") == FR_OK, "not found");
+  CHECK(fs.f_unlink("0:/logs/2026/11/17/sensor-1.csv") == FR_OK,
+        "f_unlink failed");
+  CHECK(fs.f_unlink("0:/logs/2026/11/17") == FR_OK, "f_unlink dir failed");
+  CHECK(fs.f_mkdir("0:/logs/2026/11/17") == FR_OK, "f_mkdir failed");
+
+  CHECK(fs.f_mkdir(LONG_DIR) == FR_OK, "f_mkdir long failed");
+  snprintf(path, sizeof(path), "%s/sub", LONG_DIR);
+  CHECK(fs.f_mkdir(path) == FR_OK, "f_mkdir sub failed");
+  snprintf(path, sizeof(path), "%s/sub/x.txt", LONG_DIR);
+  create(fs, path);
+
+  check_tree(fs);
+  CHECK(fs.f_unmount("0:") == FR_OK, "f_unmount failed");
+
+  FatFs plain(drv);
+  CHECK(plain.f_mount(&drv.fatfs, "0:", 1) == FR_OK, "remount failed");
+  check_tree(plain);
+  plain.f_unmount("0:");
+
+  // the cache starts empty after a remount
+  CHECK(fs.f_mount(&drv.fatfs, "0:", 1) == FR_OK, "remount failed");
+  CHECK(cache.hits() == 0, "cache not reset");
+  check_tree(fs);
+  CHECK(cache.hits() > 0, "cache not used after remount");
+  fs.f_unmount("0:");
+}
+
+void setup() {
+  run(drvFat, FM_FAT);
+  run(drvExFat, FM_EXFAT);
+  printf("PASS: path cache\n");
+  TEST_EXIT_OK();
+}
+
+void loop() {}
@@ -0,0 +1,135 @@
+/* PosixFileIO test: a disk image accessed with positional I/O
+ * (pread/pwrite), optionally with O_DIRECT. As with FileIO, a new image is
+ * formatted on the first mount, an existing one is reopened, and FileIO
+ * must read the same image. O_DIRECT is what sets this driver apart, so
+ * aligned and unaligned buffers and multi-sector requests larger than the
+ * internal buffer must transfer the right data with it (where the file
+ * system supports it). GET_BLOCK_SIZE has to report st_blksize, requests
+ * beyond the end must fail, and on 64 bit hosts a sparse image checks that
+ * sectors beyond 4 GB are written at the right offset.
+ */
+#include <stdlib.h>
+#include <sys/stat.h>
+
+#include <cstdio>
+#include <cstring>
+
+#include "fatfs.h"
+#include "test_common.h"
+
+using namespace fatfs;
+
+static const char* IMG_PATH = "fatfs_test_posix.img";
+
+static void check_volume(bool direct) {
+  const char* content = "written with pwrite";
+  char buf[64] = {0};
+  remove(IMG_PATH);
+  {
+    PosixFileIO drv(IMG_PATH, 4096, 512);
+    drv.setDirect(direct);
+    SDClass sd(drv);
+    CHECK(sd.begin(), "mount (auto-format) failed");
+    if (direct && !drv.isDirect()) printf("(O_DIRECT not supported here)\n");
+    File f = sd.open("posix.txt", FILE_WRITE);
+    CHECK((bool)f, "could not create file");
+    CHECK(f.write((const uint8_t*)content, strlen(content)) == strlen(content),
+          "write failed");
+    f.close();
+    sd.end();
+  }
+  {
+    FileIO drv(IMG_PATH, 4096, 512);
+    SDClass sd(drv);
+    CHECK(sd.begin(), "FileIO mount failed");
+    File f = sd.open("posix.txt", FILE_READ);
+    CHECK((bool)f && f.size() == strlen(content), "file missing in FileIO");
+    f.readBytes((uint8_t*)buf, strlen(content));
+    f.close();
+    sd.end();
+    CHECK(strcmp(buf, content) == 0, "content mismatch in FileIO");
+  }
+  {
+    PosixFileIO drv(IMG_PATH, 4096, 512);
+    drv.setDirect(direct);
+    SDClass sd(drv);
+    CHECK(sd.begin(), "reopen failed");
+    CHECK(sd.exists("posix.txt"), "image was reformatted");
+    sd.end();
+  }
+  remove(IMG_PATH);
+}
+
+static void check_sectors() {
+  const UINT count = 300;  // more than the internal O_DIRECT buffer
+  uint8_t* mem = nullptr;
+  CHECK(posix_memalign((void**)&mem, 4096, (count + 1) * 512 + 4096) == 0,
+        "posix_memalign failed");
+  uint8_t* in = mem + count * 512 + 512;
+  remove(IMG_PATH);
+  PosixFileIO drv(IMG_PATH, 1024, 512);
+  drv.setDirect(true);
+  CHECK(drv.disk_initialize(0) == STA_CLEAR, "disk_initialize failed");
+  for (UINT i = 0; i < count * 512; i++) mem[i] = (uint8_t)(i * 7 + i / 511);
+  CHECK(drv.disk_write(0, mem, 10, count) == RES_OK, "aligned write failed");
+  memset(mem + 1, 0, count * 512);
+  CHECK(drv.disk_read(0, mem + 1, 10, count) == RES_OK,
+        "unaligned read failed");
+  bool same = true;
+  for (UINT i = 0; i < count * 512; i++) {
+    same = same && mem[i + 1] == (uint8_t)(i * 7 + i / 511);
+  }
+  CHECK(same, "wrong data");
+  CHECK(drv.disk_write(0, mem + 1, 500, count) == RES_OK,
+        "unaligned write failed");
+  CHECK(drv.disk_read(0, in, 500 + count - 1, 1) == RES_OK &&
+            memcmp(in, mem + 1 + (count - 1) * 512, 512) == 0,
+        "wrong data");
+  CHECK(drv.disk_ioctl(0, CTRL_SYNC, nullptr) == RES_OK, "sync failed");
+
+  struct stat st;
+  stat(IMG_PATH, &st);
+  DWORD block = 0;
+  CHECK(drv.disk_ioctl(0, GET_BLOCK_SIZE, &block) == RES_OK &&
+            block == (st.st_blksize >= 512 ? st.st_blksize / 512 : 1),
+        "wrong block size");
+  CHECK(drv.disk_read(0, in, 1023, 2) == RES_ERROR, "read beyond the end");
+  CHECK(drv.disk_write(0, in, 1024, 1) == RES_ERROR, "write beyond the end");
+  free(mem);
+  remove(IMG_PATH);
+}
+
+static void check_large() {
+  if (sizeof(off_t) < 8) return;
+  const size_t sectors = 12 * 1024 * 1024;  // 6 GB, sparse
+  const LBA_t last = sectors - 1;
+  uint8_t out[512], in[512];
+  memset(out, 0xC3, sizeof(out));
+  remove(IMG_PATH);
+  PosixFileIO drv(IMG_PATH, sectors, 512);
+  if (drv.disk_initialize(0) != STA_CLEAR) {
+    printf("(no sparse 6 GB image possible here)\n");
+    remove(IMG_PATH);
+    return;
+  }
+  CHECK(drv.disk_write(0, out, last, 1) == RES_OK, "write failed");
+  CHECK(drv.disk_read(0, in, last, 1) == RES_OK && in[0] == 0xC3,
+        "wrong data");
+  struct stat st;
+  stat(IMG_PATH, &st);
+  CHECK((uint64_t)st.st_size == (uint64_t)sectors * 512, "wrong image size");
+  CHECK(drv.disk_read(0, in, last - (1u << 23), 1) == RES_OK && in[0] == 0,
+        "offset wrapped around");
+  remove(IMG_PATH);
+}
+
+void setup() {
+  check_volume(false);
+  check_volume(true);
+  check_sectors();
+  check_large();
+  printf("PASS: posix fileio\n");
+  TEST_EXIT_OK();
+}
+
+void loop() {}
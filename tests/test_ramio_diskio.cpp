@@ -4,7 +4,8 @@
 /-----------------------------------------------------------------------/
 / Drives RamIO::disk_initialize/disk_read/disk_write/disk_ioctl directly,
 / bypassing FatFs mounting. Exercises the sector-count/sector-size math
-/ and bounds checks fixed in RamIO.
+/ and bounds checks fixed in RamIO, and transfers which cross the chunks of
+/ its arena, and the sparse mode.
 */
 
 #include <stdio.h>
@@ -136,11 +137,94 @@ int test_diskio(BYTE pdrv, UINT ncyc, DWORD* buff, UINT sz_buff) {
   return 0;
 }
 
+/* The arena is split into chunks of 16 sectors (the last one is shorter):
+   multi-sector transfers and TRIM which cross chunk borders */
+static void test_chunks() {
+  static BYTE out[40 * 512], in[40 * 512];
+  RamIO ram{200, 512};
+  ram.setChunkSize(16);
+  CHECK(ram.disk_initialize(0) == STA_CLEAR, "disk_initialize failed");
+  CHECK(ram.chunkSize() == 16 && ram.chunkCount() == 13, "wrong chunks");
+  CHECK(drv.chunkCount() == 1 && drv.chunkSize() == 200, "no single arena");
+
+  for (UINT i = 0; i < sizeof(out); i++) out[i] = (BYTE)(i * 7 + i / 512);
+  CHECK(ram.disk_write(0, out, 10, 40) == RES_OK, "write failed");
+  CHECK(ram.disk_write(0, out, 170, 30) == RES_OK, "write at end failed");
+  CHECK(ram.disk_read(0, in, 10, 40) == RES_OK, "read failed");
+  CHECK(memcmp(in, out, sizeof(out)) == 0, "data mismatch");
+  CHECK(ram.disk_read(0, in, 170, 30) == RES_OK, "read at end failed");
+  CHECK(memcmp(in, out, 30 * 512) == 0, "data mismatch at end");
+  CHECK(ram.disk_read(0, in, 180, 21) != RES_OK, "read beyond end");
+
+  DWORD range[2] = {15, 33};
+  CHECK(ram.disk_ioctl(0, CTRL_TRIM, range) == RES_OK, "trim failed");
+  CHECK(ram.disk_read(0, in, 10, 40) == RES_OK, "read failed");
+  for (UINT s = 0; s < 40; s++) {
+    bool trimmed = s + 10 >= 15 && s + 10 <= 33;
+    BYTE expected = trimmed ? 0 : out[s * 512 + 1];
+    CHECK(in[s * 512 + 1] == expected, "wrong trimmed range");
+  }
+}
+
+/* Sparse mode: an 8 GB disk only allocates the chunks which get data */
+static void test_sparse() {
+  static BYTE out[64 * 512], in[64 * 512];
+  const DWORD SECTORS = 16UL * 1024 * 1024;
+  const size_t CHUNK = RamIO::SPARSE_CHUNK_SECTORS * 512;
+  RamIO ram{(int)SECTORS, 512};
+  ram.setSparse(true);
+  CHECK(ram.disk_initialize(0) == STA_CLEAR, "disk_initialize failed");
+  CHECK(ram.residentBytes() == 0, "memory allocated up front");
+
+  memset(in, 0xFF, sizeof(in));
+  CHECK(ram.disk_read(0, in, SECTORS - 64, 64) == RES_OK, "read failed");
+  for (UINT i = 0; i < sizeof(in); i++) CHECK(in[i] == 0, "not zero");
+  memset(out, 0, sizeof(out));
+  CHECK(ram.disk_write(0, out, 1000, 64) == RES_OK, "write failed");
+  CHECK(ram.residentBytes() == 0, "zeros allocated memory");
+
+  for (UINT i = 0; i < sizeof(out); i++) out[i] = (BYTE)(i * 3 + 1);
+  CHECK(ram.disk_write(0, out, 40, 64) == RES_OK, "write failed");
+  CHECK(ram.residentBytes() == 3 * CHUNK, "wrong resident bytes");
+  CHECK(ram.disk_read(0, in, 40, 64) == RES_OK, "read failed");
+  CHECK(memcmp(in, out, sizeof(out)) == 0, "data mismatch");
+
+  // sectors 32..63 are released, 64..95 and 96..103 only cleared
+  DWORD range[2] = {30, 71};
+  CHECK(ram.disk_ioctl(0, CTRL_TRIM, range) == RES_OK, "trim failed");
+  CHECK(ram.residentBytes() == 2 * CHUNK, "trim did not release memory");
+  CHECK(ram.disk_read(0, in, 40, 64) == RES_OK, "read failed");
+  for (UINT s = 0; s < 64; s++) {
+    BYTE expected = s + 40 <= 71 ? 0 : out[s * 512 + 7];
+    CHECK(in[s * 512 + 7] == expected, "wrong trimmed range");
+  }
+
+  // a formatted volume with a file
+  FatFs fs(ram);
+  CHECK(ram.mount(fs) == FR_OK, "mount failed");
+  FIL fil;
+  UINT n;
+  CHECK(fs.f_open(&fil, "0:/sparse.bin", FA_WRITE | FA_CREATE_NEW) == FR_OK,
+        "f_open failed");
+  CHECK(fs.f_write(&fil, out, sizeof(out), &n) == FR_OK, "f_write failed");
+  CHECK(fs.f_close(&fil) == FR_OK, "f_close failed");
+  DWORD nclst;
+  FATFS* fatfs;
+  CHECK(fs.f_getfree("0:", &nclst, &fatfs) == FR_OK, "f_getfree failed");
+  CHECK((uint64_t)nclst * fatfs->csize * 512 > 7ULL * 1024 * 1024 * 1024,
+        "wrong free space");
+  printf("sparse 8 GB volume: %zu resident bytes\n", ram.residentBytes());
+  CHECK(ram.residentBytes() < 1024 * 1024, "too much memory resident");
+  ram.un_mount(fs);
+}
+
 void setup() {
   DWORD buff[FF_MAX_SS]; /* Working buffer (4 sector in size) */
 
   int rc = test_diskio(0, 3, buff, sizeof buff);
   CHECK(rc == 0, "RamIO diskio conformance test failed");
+  test_chunks();
+  test_sparse();
 
   printf("PASS: RamIO diskio conformance\n");
   TEST_EXIT_OK();
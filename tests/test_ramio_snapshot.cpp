@@ -0,0 +1,131 @@
+/* RamIO snapshot test: copy-on-write snapshots and clones, which give each
+ * test run its own copy of a formatted and populated (golden) volume. A
+ * clone must mount without formatting and share all its memory with the
+ * golden volume. Its changes may only copy the touched chunks and must stay
+ * invisible to the golden volume and to other clones, and the other way
+ * round. restore() rolls a drive back to a snapshot, also after the chunks
+ * were trimmed, and rejects snapshots of another geometry.
+ */
+#include <cstring>
+
+#include "fatfs.h"
+#include "test_common.h"
+
+using namespace fatfs;
+
+static const int SECTORS = 8192;  // 4 MB
+
+static bool read_file(FatFs& fs, const char* path, char* text, UINT len) {
+  FIL fil;
+  UINT n;
+  memset(text, 0, len);
+  if (fs.f_open(&fil, path, FA_READ) != FR_OK) return false;
+  FRESULT res = fs.f_read(&fil, text, len - 1, &n);
+  fs.f_close(&fil);
+  return res == FR_OK;
+}
+
+static bool write_file(FatFs& fs, const char* path, const char* text) {
+  FIL fil;
+  UINT n;
+  if (fs.f_open(&fil, path, FA_WRITE | FA_CREATE_ALWAYS) != FR_OK) return false;
+  FRESULT res = fs.f_write(&fil, text, strlen(text), &n);
+  return fs.f_close(&fil) == FR_OK && res == FR_OK;
+}
+
+static void populate(RamIO& golden) {
+  golden.setSparse(true);
+  FatFs fs(golden);
+  CHECK(golden.mount(fs) == FR_OK, "mount failed");
+  CHECK(fs.f_mkdir("0:/data") == FR_OK, "f_mkdir failed");
+  CHECK(write_file(fs, "0:/data/a.txt", "golden a"), "write failed");
+  CHECK(write_file(fs, "0:/data/b.txt", "golden b"), "write failed");
+  CHECK(golden.un_mount(fs) == FR_OK, "un_mount failed");
+}
+
+static void check_clones(RamIO& golden) {
+  char text[32];
+  size_t resident = golden.residentBytes();
+  RamIO clone1 = golden.clone();
+  RamIO clone2{golden};
+  CHECK(golden.sharedBytes() == resident, "memory not shared");
+  CHECK(clone1.residentBytes() == resident, "wrong resident bytes");
+
+  FatFs fs1(clone1), fs2(clone2);
+  CHECK(clone1.mount(fs1) == FR_OK, "mount of clone failed");
+  CHECK(read_file(fs1, "0:/data/a.txt", text, sizeof(text)) &&
+            strcmp(text, "golden a") == 0,
+        "clone not populated");
+  CHECK(write_file(fs1, "0:/data/a.txt", "clone 1"), "write failed");
+  CHECK(write_file(fs1, "0:/new.txt", "new"), "write failed");
+  CHECK(fs1.f_unlink("0:/data/b.txt") == FR_OK, "f_unlink failed");
+  CHECK(clone1.sharedBytes() > 0 && clone1.sharedBytes() < resident,
+        "chunks not copied on write");
+
+  CHECK(clone2.mount(fs2) == FR_OK, "mount of clone failed");
+  CHECK(read_file(fs2, "0:/data/a.txt", text, sizeof(text)) &&
+            strcmp(text, "golden a") == 0,
+        "change visible in other clone");
+  FILINFO info;
+  CHECK(fs2.f_stat("0:/new.txt", &info) == FR_NO_FILE, "new file visible");
+  CHECK(fs2.f_stat("0:/data/b.txt", &info) == FR_OK, "removed file missing");
+  CHECK(clone1.un_mount(fs1) == FR_OK, "un_mount failed");
+  CHECK(clone2.un_mount(fs2) == FR_OK, "un_mount failed");
+
+  // the golden volume is unchanged
+  FatFs fs(golden);
+  CHECK(golden.mount(fs) == FR_OK, "mount failed");
+  CHECK(read_file(fs, "0:/data/a.txt", text, sizeof(text)) &&
+            strcmp(text, "golden a") == 0,
+        "change visible in golden volume");
+  CHECK(golden.un_mount(fs) == FR_OK, "un_mount failed");
+}
+
+static void check_restore(RamIO& golden) {
+  char text[32];
+  RamSnapshot snapshot = golden.snapshot();
+  CHECK((bool)snapshot, "empty snapshot");
+  RamIO drv{snapshot};
+  FatFs fs(drv);
+  CHECK(drv.mount(fs) == FR_OK, "mount failed");
+  CHECK(write_file(fs, "0:/data/a.txt", "changed"), "write failed");
+  CHECK(drv.un_mount(fs) == FR_OK, "un_mount failed");
+
+  // trim everything before the rollback
+  DWORD range[2] = {0, SECTORS - 1};
+  CHECK(drv.disk_ioctl(0, CTRL_TRIM, range) == RES_OK, "trim failed");
+  CHECK(drv.residentBytes() == 0, "trim did not release chunks");
+  CHECK(drv.restore(snapshot), "restore failed");
+  CHECK(drv.mount(fs) == FR_OK, "mount after restore failed");
+  CHECK(read_file(fs, "0:/data/a.txt", text, sizeof(text)) &&
+            strcmp(text, "golden a") == 0,
+        "not rolled back");
+  CHECK(drv.un_mount(fs) == FR_OK, "un_mount failed");
+
+  RamIO other{SECTORS / 2, 512};
+  CHECK(!other.restore(snapshot), "restored other geometry");
+
+  // raw sectors of a snapshot of a drive with one chunk
+  RamIO arena{64, 512};
+  uint8_t out[512], in[512];
+  memset(out, 0x5A, sizeof(out));
+  CHECK(arena.disk_initialize(0) == STA_CLEAR, "disk_initialize failed");
+  CHECK(arena.disk_write(0, out, 3, 1) == RES_OK, "write failed");
+  RamSnapshot before = arena.snapshot();
+  memset(out, 0xA5, sizeof(out));
+  CHECK(arena.disk_write(0, out, 3, 1) == RES_OK, "write failed");
+  CHECK(arena.restore(before) && arena.disk_read(0, in, 3, 1) == RES_OK,
+        "restore failed");
+  CHECK(in[0] == 0x5A && in[511] == 0x5A, "sector not rolled back");
+}
+
+void setup() {
+  RamIO golden{SECTORS, 512};
+  populate(golden);
+  check_clones(golden);
+  check_restore(golden);
+  printf("PASS: ramio snapshot\n");
+  TEST_EXIT_OK();
+}
+
+void loop() {}
@@ -0,0 +1,147 @@
+/* Read-ahead test (FF_USE_READAHEAD): the file object reads ahead, so that
+ * small sequential reads turn into multi-sector driver reads. The window
+ * has to grow up to the buffer size and stop at the end of a contiguous
+ * cluster run. Random access resets it, and data written after a read-ahead
+ * must be read back instead of the stale copy in the buffer.
+ */
+#include <cstring>
+
+#include "fatfs.h"
+#include "test_common.h"
+
+using namespace fatfs;
+
+/// RamIO which records the sizes of the read requests
+class RecordingIO : public RamIO {
+ public:
+  RecordingIO(int sectors, int sectorSize) : RamIO(sectors, sectorSize) {}
+
+  DRESULT disk_read(BYTE pdrv, BYTE* buff, LBA_t sector, UINT count) override {
+    reads++;
+    if (count > max_count) max_count = count;
+    return RamIO::disk_read(pdrv, buff, sector, count);
+  }
+
+  void reset() { reads = max_count = 0; }
+
+  unsigned long reads = 0;
+  UINT max_count = 0;
+};
+
+RecordingIO drv{4000, 512};
+
+static const int SIZE = 64 * 1024;
+static const int RBUF_SECTORS = 16;
+static uint8_t rbuf[RBUF_SECTORS * 512];
+
+static uint8_t value(int pos, int seed) { return (uint8_t)(pos * 7 + seed); }
+
+static void check_read(File& f, int pos, int len, int seed) {
+  uint8_t buf[64];
+  CHECK(f.read(buf, len) == len, "read failed");
+  for (int i = 0; i < len; i++) {
+    CHECK(buf[i] == value(pos + i, seed), "data mismatch");
+  }
+}
+
+static void create_files(SDClass& sd) {
+  // a.bin is contiguous, the clusters of b.bin and c.bin alternate
+  uint8_t buf[512];
+  File a = sd.open("0:/a.bin", FILE_WRITE);
+  for (int j = 0; j < SIZE; j += 512) {
+    for (int i = 0; i < 512; i++) buf[i] = value(j + i, 1);
+    a.write(buf, 512);
+  }
+  a.close();
+  File b = sd.open("0:/b.bin", FILE_WRITE);
+  File c = sd.open("0:/c.bin", FILE_WRITE);
+  for (int j = 0; j < SIZE; j += 512) {
+    for (int i = 0; i < 512; i++) buf[i] = value(j + i, 2);
+    b.write(buf, 512);
+    b.flush();
+    c.write(buf, 512);
+    c.flush();
+  }
+  b.close();
+  c.close();
+}
+
+static void check_sequential(SDClass& sd) {
+  File f = sd.open("0:/a.bin", FILE_READ);
+  CHECK(f.setReadBuffer(rbuf, sizeof(rbuf)), "setReadBuffer failed");
+  drv.reset();
+  for (int pos = 0; pos < SIZE; pos += 37) {
+    check_read(f, pos, pos + 37 <= SIZE ? 37 : SIZE - pos, 1);
+  }
+  printf("sequential: %lu reads for %d sectors, %u hits, %u misses\n",
+         drv.reads, SIZE / 512, (unsigned)f.readAheadHits(),
+         (unsigned)f.readAheadMisses());
+  CHECK(drv.max_count == RBUF_SECTORS, "window did not grow");
+  CHECK(f.readAheadWindow() == RBUF_SECTORS, "unexpected window");
+  CHECK(drv.reads * 8 < SIZE / 512, "read-ahead does not save reads");
+  CHECK(f.readAheadHits() + f.readAheadMisses() == SIZE / 512,
+        "unexpected statistics");
+  f.close();
+}
+
+static void check_fragmented(SDClass& sd) {
+  File f = sd.open("0:/b.bin", FILE_READ);
+  CHECK(f.setReadBuffer(rbuf, sizeof(rbuf)), "setReadBuffer failed");
+  drv.reset();
+  for (int pos = 0; pos < SIZE; pos += 50) {
+    check_read(f, pos, pos + 50 <= SIZE ? 50 : SIZE - pos, 2);
+  }
+  FATFS* fatfs = f.getFIL()->obj.fs;
+  CHECK(drv.max_count == fatfs->csize, "read-ahead crossed a fragment");
+  f.close();
+}
+
+static void check_random_and_write(SDClass& sd) {
+  File f = sd.open("0:/a.bin", FA_READ | FA_WRITE);
+  CHECK(f.setReadBuffer(rbuf, sizeof(rbuf)), "setReadBuffer failed");
+  for (int pos = 0; pos < 4096; pos += 32) check_read(f, pos, 32, 1);
+  CHECK(f.readAheadWindow() > 0, "no read-ahead");
+  srand(1);
+  for (int j = 0; j < 100; j++) {
+    int pos = rand() % (SIZE - 64);
+    f.seek(pos);
+    check_read(f, pos, 64, 1);
+  }
+  CHECK(f.readAheadWindow() < RBUF_SECTORS, "window not reset");
+
+  // overwrite data which has been read ahead
+  f.seek(0);
+  check_read(f, 0, 10, 1);
+  uint8_t buf[600];
+  memset(buf, 0xA5, sizeof(buf));
+  f.seek(1000);
+  CHECK(f.write(buf, sizeof(buf)) == sizeof(buf), "write failed");
+  f.seek(990);
+  uint8_t rd[620];
+  CHECK(f.read(rd, sizeof(rd)) == sizeof(rd), "read failed");
+  for (int i = 0; i < 620; i++) {
+    int pos = 990 + i;
+    uint8_t expected = (pos >= 1000 && pos < 1600) ? 0xA5 : value(pos, 1);
+    CHECK(rd[i] == expected, "written data not read back");
+  }
+  f.close();
+}
+
+void setup() {
+  static uint8_t work[FF_MAX_SS];
+  FatFs fs(drv);
+  MKFS_PARM opt = {FM_FAT, 1, 0, 1024, 0};
+  CHECK(fs.f_mkfs("0:", &opt, work, sizeof(work)) == FR_OK, "f_mkfs failed");
+
+  SDClass sd(drv);
+  CHECK(sd.begin(), "SD.begin() failed");
+  create_files(sd);
+  check_sequential(sd);
+  check_fragmented(sd);
+  check_random_and_write(sd);
+  sd.end();
+  printf("PASS: read-ahead buffer\n");
+  TEST_EXIT_OK();
+}
+
+void loop() {}
@@ -0,0 +1,127 @@
+/* Zero-copy read test: File::readView() (FF_USE_READVIEW) and
+ * File::forward() (FF_USE_FORWARD) hand out the file data without copying
+ * it, so they must provide exactly what readBytes() would, across sector
+ * and cluster boundaries and for odd request sizes. With a read buffer the
+ * views span several sectors and need no further driver reads. Views can
+ * be mixed with seek(), read() and write(), and forward() must pass the
+ * file data to the callback.
+ */
+#include <cstring>
+
+#include "fatfs.h"
+#include "test_common.h"
+
+using namespace fatfs;
+
+RamIO drv{4000, 512};
+
+static const int SIZE = 40 * 1024 + 123;
+static const int RBUF_SECTORS = 8;
+static uint8_t rbuf[RBUF_SECTORS * 512];
+
+static uint8_t value(int pos) { return (uint8_t)(pos * 13 + (pos >> 9)); }
+
+static void check_view(const uint8_t* data, int pos, int len) {
+  for (int i = 0; i < len; i++) {
+    CHECK(data[i] == value(pos + i), "data mismatch");
+  }
+}
+
+/// reads the whole file with views of at most chunk bytes
+static size_t read_views(File& f, size_t chunk, size_t* maxView) {
+  const uint8_t* data;
+  size_t pos = 0, len;
+  *maxView = 0;
+  CHECK(f.seek(0), "seek failed");
+  while ((len = f.readView(&data, chunk)) > 0) {
+    CHECK(len <= chunk, "view is too long");
+    check_view(data, pos, len);
+    pos += len;
+    if (len > *maxView) *maxView = len;
+  }
+  CHECK(f.position() == pos, "position not advanced");
+  return pos;
+}
+
+static int fwd_pos;
+static UINT fwd_calls;
+
+static UINT receive(const BYTE* data, UINT len) {
+  if (len == 0) return 1;  // sense call: ready to receive
+  check_view(data, fwd_pos, len);
+  fwd_pos += len;
+  fwd_calls++;
+  return len;
+}
+
+void setup() {
+  SDClass sd(drv);
+  CHECK(sd.begin(), "SD.begin() failed");
+  File f = sd.open("0:/view.bin", FILE_WRITE);
+  CHECK((bool)f, "could not create file");
+  static uint8_t buf[SIZE];
+  for (int i = 0; i < SIZE; i++) buf[i] = value(i);
+  CHECK(f.write(buf, SIZE) == SIZE, "write failed");
+  f.close();
+
+  f = sd.open("0:/view.bin", FILE_READ);
+  CHECK((bool)f, "could not open file");
+  size_t maxView;
+  const size_t chunks[] = {1, 100, 511, 512, 513, 5000, 100000};
+  for (size_t chunk : chunks) {
+    CHECK(read_views(f, chunk, &maxView) == SIZE, "not all data provided");
+    CHECK(maxView <= 512, "view larger than the sector buffer");
+  }
+
+  // views from the read buffer span several sectors
+  CHECK(f.setReadBuffer(rbuf, sizeof(rbuf)), "setReadBuffer failed");
+  for (size_t chunk : chunks) {
+    CHECK(read_views(f, chunk, &maxView) == SIZE, "not all data provided");
+  }
+  CHECK(maxView > 512, "views not provided from the read buffer");
+  CHECK(f.readAheadHits() > 0, "read buffer not used");
+
+  // mixed with seek() and read()
+  const uint8_t* data;
+  uint8_t tmp[700];
+  CHECK(f.seek(1000), "seek failed");
+  CHECK(f.readView(&data, 24) == 24, "readView failed");
+  check_view(data, 1000, 24);
+  CHECK(f.read(tmp, 700) == 700, "read failed");
+  check_view(tmp, 1024, 700);
+  size_t len = f.readView(&data, 3000);
+  CHECK(len > 0, "readView failed");
+  check_view(data, 1724, len);
+  CHECK(f.seek(SIZE - 10), "seek failed");
+  CHECK(f.readView(&data, 100) == 10, "view not clipped at end of file");
+  check_view(data, SIZE - 10, 10);
+  CHECK(f.readView(&data, 100) == 0, "view after end of file");
+
+  // forward() passes the whole file to the callback
+  CHECK(f.seek(7), "seek failed");
+  fwd_pos = 7;
+  fwd_calls = 0;
+  CHECK(f.forward(SIZE, receive) == SIZE - 7, "forward failed");
+  CHECK(fwd_pos == SIZE && fwd_calls > 0, "data not forwarded");
+  f.close();
+
+  // views of a file which is being written
+  f = sd.open("0:/view.bin", FA_READ | FA_WRITE);
+  CHECK(f.seek(600), "seek failed");
+  uint8_t patch[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+  CHECK(f.write(patch, sizeof(patch)) == sizeof(patch), "write failed");
+  CHECK(f.seek(0), "seek failed");
+  len = f.readView(&data, 1024);
+  CHECK(len == 512, "readView failed");
+  check_view(data, 0, 512);
+  len = f.readView(&data, 1024);
+  CHECK(len == 512 && memcmp(data + 88, patch, sizeof(patch)) == 0,
+        "written data not visible");
+  f.close();
+  sd.end();
+
+  printf("PASS: read view\n");
+  TEST_EXIT_OK();
+}
+
+void loop() {}
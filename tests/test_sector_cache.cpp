@@ -0,0 +1,107 @@
+/* Sector cache test (FF_USE_WINCACHE): the cache sits under
+ * FatFs::move_window(), so alternating FAT and directory accesses should be
+ * served from it (counted as hits). Since it also holds dirty sectors, the
+ * important part is that they reach the disk on f_sync()/f_close(): a fresh
+ * remount with the cache disabled must see exactly the same data, and FAT
+ * sectors written back from the cache must be mirrored to the 2nd FAT.
+ */
+#include <cstring>
+
+#include "fatfs.h"
+#include "test_common.h"
+
+using namespace fatfs;
+
+RamIO drv{4000, 512};
+
+static void write_file(FatFs& fs, const char* path, int len, BYTE seed) {
+  FIL fil;
+  UINT bw;
+  uint8_t buf[700];
+  CHECK(fs.f_open(&fil, path, FA_WRITE | FA_CREATE_ALWAYS) == FR_OK,
+        "f_open for write failed");
+  for (int j = 0; j < len; j += sizeof(buf)) {
+    UINT n = len - j < (int)sizeof(buf) ? len - j : sizeof(buf);
+    for (UINT i = 0; i < n; i++) buf[i] = (uint8_t)(seed + j + i);
+    CHECK(fs.f_write(&fil, buf, n, &bw) == FR_OK && bw == n, "f_write failed");
+  }
+  CHECK(fs.f_close(&fil) == FR_OK, "f_close failed");
+}
+
+static void check_file(FatFs& fs, const char* path, int len, BYTE seed) {
+  FIL fil;
+  UINT br;
+  uint8_t buf[700];
+  CHECK(fs.f_open(&fil, path, FA_READ) == FR_OK, "f_open for read failed");
+  CHECK((int)fs.f_size(&fil) == len, "file size mismatch");
+  for (int j = 0; j < len; j += sizeof(buf)) {
+    UINT n = len - j < (int)sizeof(buf) ? len - j : sizeof(buf);
+    CHECK(fs.f_read(&fil, buf, n, &br) == FR_OK && br == n, "f_read failed");
+    for (UINT i = 0; i < n; i++) {
+      CHECK(buf[i] == (uint8_t)(seed + j + i), "file content mismatch");
+    }
+  }
+  fs.f_close(&fil);
+}
+
+void setup() {
+  static uint8_t work[FF_MAX_SS];
+  FatFs fs(drv, 16);
+  CHECK(fs.sectorCacheSize() == 16, "cache size not taken from constructor");
+
+  // format with 2 FATs so that the mirroring can be verified
+  MKFS_PARM opt = {FM_FAT, 2, 0, 0, 0};
+  CHECK(fs.f_mkfs("0:", &opt, work, sizeof(work)) == FR_OK, "f_mkfs failed");
+  CHECK(fs.f_mount(&drv.fatfs, "0:", 1) == FR_OK, "f_mount failed");
+  CHECK(drv.fatfs.n_fats == 2, "volume has not been formatted with 2 FATs");
+  CHECK(fs.getSectorCache(0).size() == 16, "sector cache not allocated");
+
+  // create files in several directories: this switches between FAT and
+  // directory sectors all the time
+  CHECK(fs.f_mkdir("0:/a") == FR_OK, "f_mkdir a failed");
+  CHECK(fs.f_mkdir("0:/b") == FR_OK, "f_mkdir b failed");
+  char path[32];
+  for (int j = 0; j < 10; j++) {
+    snprintf(path, sizeof(path), "0:/%c/file%d.txt", j % 2 ? 'a' : 'b', j);
+    write_file(fs, path, 1500 + j * 300, (BYTE)j);
+  }
+  SectorCache& cache = fs.getSectorCache(0);
+  printf("sector cache: %u hits, %u misses\n", (unsigned)cache.hits(),
+         (unsigned)cache.misses());
+  CHECK(cache.hits() > cache.misses(), "sector cache is not effective");
+
+  // 2nd FAT must be identical to the 1st one after the cache was flushed
+  uint8_t fat1[FF_MAX_SS], fat2[FF_MAX_SS];
+  for (DWORD s = 0; s < drv.fatfs.fsize; s++) {
+    CHECK(drv.disk_read(0, fat1, drv.fatfs.fatbase + s, 1) == RES_OK,
+          "read 1st FAT failed");
+    CHECK(drv.disk_read(0, fat2, drv.fatfs.fatbase + drv.fatfs.fsize + s,
+                        1) == RES_OK,
+          "read 2nd FAT failed");
+    CHECK(memcmp(fat1, fat2, sizeof(fat1)) == 0, "2nd FAT is not mirrored");
+  }
+
+  // deleting files and creating new ones reuses released clusters
+  CHECK(fs.f_unlink("0:/a/file1.txt") == FR_OK, "f_unlink failed");
+  CHECK(fs.f_unlink("0:/b/file2.txt") == FR_OK, "f_unlink failed");
+  write_file(fs, "0:/a/new.txt", 5000, 77);
+
+  // remount without cache: everything must have reached the disk
+  CHECK(fs.f_unmount("0:") == FR_OK, "f_unmount failed");
+  FatFs plain(drv);
+  CHECK(plain.f_mount(&drv.fatfs, "0:", 1) == FR_OK, "remount failed");
+  for (int j = 0; j < 10; j++) {
+    if (j == 1 || j == 2) continue;
+    snprintf(path, sizeof(path), "0:/%c/file%d.txt", j % 2 ? 'a' : 'b', j);
+    check_file(plain, path, 1500 + j * 300, (BYTE)j);
+  }
+  check_file(plain, "0:/a/new.txt", 5000, 77);
+  FILINFO info;
+  CHECK(plain.f_stat("0:/a/file1.txt", &info) == FR_NO_FILE,
+        "deleted file still exists");
+
+  printf("PASS: sector cache\n");
+  TEST_EXIT_OK();
+}
+
+void loop() {}
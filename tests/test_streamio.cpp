@@ -8,6 +8,8 @@
  *  - disk_ioctl's GET_SECTOR_COUNT/GET_BLOCK_SIZE copying through
  *    memcpy(buff, &result, ...) (was passing the DWORD value itself as the
  *    source pointer)
+ *  - sequential transfers not seeking again, 64 bit seek offsets and the
+ *    readSectors()/writeSectors() fast path of the stream
  */
 #include <cstring>
 #include <vector>
@@ -59,6 +61,65 @@ class MemStream {
   size_t position = 0;
 };
 
+// Stream which counts the seeks and only records the offset
+class SeekStream : public MemStream {
+ public:
+  SeekStream() : MemStream(64, 512) {}
+  void seek(uint64_t pos) {
+    seeks++;
+    last_seek = pos;
+    MemStream::seek(pos % (64 * 512));
+  }
+  int seeks = 0;
+  uint64_t last_seek = 0;
+};
+
+// Stream with the multi-sector fast path
+class SectorStream : public MemStream {
+ public:
+  SectorStream() : MemStream(64, 512) {}
+  bool readSectors(uint8_t* data, uint64_t sector, size_t count) {
+    calls++;
+    MemStream::seek(sector * 512);
+    return readBytes(data, count * 512) == count * 512;
+  }
+  bool writeSectors(const uint8_t* data, uint64_t sector, size_t count) {
+    calls++;
+    MemStream::seek(sector * 512);
+    return write(data, count * 512) == count * 512;
+  }
+  int calls = 0;
+};
+
+static void check_positions() {
+  uint8_t buf[4 * 512];
+  SeekStream seek_stream;
+  StreamIO<SeekStream> io(seek_stream);
+  CHECK(io.disk_initialize(0) == STA_CLEAR, "disk_initialize failed");
+  for (LBA_t s = 0; s < 16; s += 4) {
+    CHECK(io.disk_read(0, buf, s, 4) == RES_OK, "sequential read failed");
+  }
+  CHECK(seek_stream.seeks == 1, "sequential reads did seek");
+  CHECK(io.disk_write(0, buf, 16, 4) == RES_OK, "write failed");
+  CHECK(seek_stream.seeks == 1, "sequential write did seek");
+  CHECK(io.disk_read(0, buf, 2, 1) == RES_OK, "read failed");
+  CHECK(seek_stream.seeks == 2, "random read did not seek");
+  CHECK(io.disk_read(0, buf, 0x900000, 1) == RES_OK, "read failed");
+  CHECK(seek_stream.last_seek == (uint64_t)0x900000 * 512,
+        "seek offset truncated to 32 bits");
+
+  SectorStream sector_stream;
+  StreamIO<SectorStream> fast(sector_stream);
+  memset(buf, 0x3C, sizeof(buf));
+  CHECK(fast.disk_initialize(0) == STA_CLEAR, "disk_initialize failed");
+  CHECK(fast.disk_write(0, buf, 5, 4) == RES_OK, "writeSectors failed");
+  memset(buf, 0, sizeof(buf));
+  CHECK(fast.disk_read(0, buf, 5, 4) == RES_OK && buf[2047] == 0x3C,
+        "readSectors failed");
+  CHECK(sector_stream.calls == 2, "fast path not used");
+  printf("PASS: StreamIO positions and fast path\n");
+}
+
 void setup() {
   // --- low level: exercise the disk_* contract directly ---
   MemStream mem(64, 512);
@@ -93,6 +154,7 @@ void setup() {
         "multi-sector round-trip data mismatch");
 
   printf("PASS: StreamIO low-level diskio contract\n");
+  check_positions();
 
   // --- high level: full FatFs stack on top of StreamIO ---
   // unlike RamIO, StreamIO does not auto-format on mount (a real Stream-
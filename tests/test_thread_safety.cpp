@@ -0,0 +1,400 @@
+/* Re-entrancy test (FF_FS_REENTRANT) with one lock per volume. It runs in
+ * the regular build, but is meant to be run with -DFATFS_SANITIZE_THREAD=ON
+ * (ThreadSanitizer) as well. Several threads per volume create, write,
+ * read, list and remove files on a RamIO and a FileIO volume of the same
+ * MultiIO at the same time and must not lose or mix up data. A thread which
+ * holds the lock of one volume (blocked in the driver) must not block the
+ * other volume, while the same volume times out. Readers share the lock
+ * (FF_FS_SHARED_READ): while one reader is blocked, other threads can still
+ * read files, get their status and read directories, but writers time out,
+ * and nothing is shared when the driver does not allow concurrent reads.
+ * Finally the synchronous default of the asynchronous requests must keep
+ * the results of several threads apart, and striped, mirrored and
+ * concatenated MultiIO devices must accept reads from several threads
+ * without a mirror dropping one of its drivers.
+ */
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "fatfs.h"
+#include "test_common.h"
+
+using namespace fatfs;
+
+/// RamIO whose reads (of all sectors or of one sector) can be held back
+/// until the gate gets opened
+class GatedIO : public RamIO {
+ public:
+  GatedIO(int sectors, int sectorSize) : RamIO(sectors, sectorSize) {}
+
+  DRESULT disk_read(BYTE pdrv, BYTE* buff, LBA_t sector, UINT count) override {
+    if (closed && (held == ALL || (held >= sector && held - sector < count))) {
+      std::unique_lock<std::mutex> lock(mtx);
+      blocked = true;
+      cond.notify_all();
+      cond.wait(lock, [this] { return !closed; });
+    }
+    return RamIO::disk_read(pdrv, buff, sector, count);
+  }
+
+  void close(LBA_t sector = ALL) {
+    std::lock_guard<std::mutex> lock(mtx);
+    held = sector;
+    blocked = false;
+    closed = true;
+  }
+
+  void open() {
+    std::lock_guard<std::mutex> lock(mtx);
+    closed = false;
+    cond.notify_all();
+  }
+
+  void waitBlocked() {
+    std::unique_lock<std::mutex> lock(mtx);
+    cond.wait(lock, [this] { return blocked; });
+  }
+
+ protected:
+  static const LBA_t ALL = (LBA_t)-1;
+  std::atomic<bool> closed{false};
+  std::atomic<LBA_t> held{ALL};
+  bool blocked = false;
+  std::mutex mtx;
+  std::condition_variable cond;
+};
+
+/// GatedIO whose reads must not overlap
+class ExclusiveIO : public GatedIO {
+ public:
+  using GatedIO::GatedIO;
+  bool allowsConcurrentReads() override { return false; }
+};
+
+static const char* IMG_PATH = "fatfs_test_thread_safety.img";
+static const int THREADS = 4;  // per volume
+static const int FILES = 40;   // per thread
+
+GatedIO ram{8000, 512};
+MultiIO multi;
+FatFs fs;
+std::atomic<int> failures{0};
+
+static void fail(const char* msg, int vol, int id, int res) {
+  printf("thread %d:%d: %s (%d)\n", vol, id, msg, res);
+  failures++;
+}
+
+static uint8_t value(int id, int k, int i) { return (uint8_t)(id * 31 + k * 7 + i); }
+
+static void worker(int vol, int id) {
+  char path[48];
+  static thread_local uint8_t buf[3000];
+  FIL fil;
+  UINT n;
+  FRESULT res;
+  snprintf(path, sizeof(path), "%d:/t%d", vol, id);
+  if ((res = fs.f_mkdir(path)) != FR_OK) return fail("f_mkdir", vol, id, res);
+
+  for (int k = 0; k < FILES; k++) {
+    // own directory and shared directory in turns
+    if (k % 2)
+      snprintf(path, sizeof(path), "%d:/t%d/f%d.bin", vol, id, k);
+    else
+      snprintf(path, sizeof(path), "%d:/shared/t%d-f%d.bin", vol, id, k);
+    UINT len = 1 + (k * 397 + id * 131) % sizeof(buf);
+    for (UINT i = 0; i < len; i++) buf[i] = value(id, k, i);
+    if ((res = fs.f_open(&fil, path, FA_WRITE | FA_CREATE_NEW)) != FR_OK)
+      return fail("f_open write", vol, id, res);
+    res = fs.f_write(&fil, buf, len, &n);
+    if (res != FR_OK || n != len) fail("f_write", vol, id, res);
+    if ((res = fs.f_close(&fil)) != FR_OK) fail("f_close", vol, id, res);
+    FILINFO info;
+    res = fs.f_stat(path, &info);
+    if (res != FR_OK || info.fsize != len) fail("f_stat", vol, id, res);
+
+    memset(buf, 0, sizeof(buf));
+    if ((res = fs.f_open(&fil, path, FA_READ)) != FR_OK)
+      return fail("f_open read", vol, id, res);
+    res = fs.f_read(&fil, buf, sizeof(buf), &n);
+    if (res != FR_OK || n != len) fail("f_read", vol, id, res);
+    for (UINT i = 0; i < n; i++) {
+      if (buf[i] != value(id, k, i)) {
+        fail("data mismatch", vol, id, k);
+        break;
+      }
+    }
+    fs.f_close(&fil);
+    if (k % 4 == 3 && (res = fs.f_unlink(path)) != FR_OK)
+      fail("f_unlink", vol, id, res);
+
+    if (k % 8 == 0) {
+      DWORD nfree;
+      FATFS* fatfs;
+      snprintf(path, sizeof(path), "%d:", vol);
+      if ((res = fs.f_getfree(path, &nfree, &fatfs)) != FR_OK)
+        fail("f_getfree", vol, id, res);
+    }
+  }
+}
+
+/// counts the entries of a directory
+static int count(const char* path) {
+  DIR dir;
+  FILINFO info;
+  int result = 0;
+  if (fs.f_opendir(&dir, path) != FR_OK) return -1;
+  while (fs.f_readdir(&dir, &info) == FR_OK && info.fname[0]) result++;
+  fs.f_closedir(&dir);
+  return result;
+}
+
+static void check_stress() {
+  std::vector<std::thread> threads;
+  for (int vol = 0; vol < 2; vol++) {
+    char path[16];
+    snprintf(path, sizeof(path), "%d:/shared", vol);
+    CHECK(fs.f_mkdir(path) == FR_OK, "f_mkdir shared failed");
+    for (int id = 0; id < THREADS; id++) threads.emplace_back(worker, vol, id);
+  }
+  for (auto& t : threads) t.join();
+  CHECK(failures == 0, "thread failed");
+
+  // every thread removed every 4th file
+  for (int vol = 0; vol < 2; vol++) {
+    char path[16];
+    snprintf(path, sizeof(path), "%d:/shared", vol);
+    CHECK(count(path) == THREADS * FILES / 2, "wrong number of shared files");
+    for (int id = 0; id < THREADS; id++) {
+      snprintf(path, sizeof(path), "%d:/t%d", vol, id);
+      CHECK(count(path) == FILES / 4, "wrong number of own files");
+    }
+  }
+}
+
+static void check_volume_locks() {
+  FIL fil;
+  UINT n;
+  uint8_t data[512] = {1, 2, 3};
+  CHECK(fs.f_open(&fil, "0:/gate.bin", FA_READ | FA_WRITE | FA_CREATE_NEW) ==
+            FR_OK, "f_open failed");
+  CHECK(fs.f_write(&fil, data, sizeof(data), &n) == FR_OK, "f_write failed");
+  CHECK(fs.f_lseek(&fil, 0) == FR_OK, "f_lseek failed");
+
+  // this thread keeps the lock of volume 0 while it waits in the driver
+  ram.close();
+  FRESULT blocked_res = FR_INT_ERR;
+  std::thread holder([&] {
+    uint8_t buf[512];
+    UINT br;
+    blocked_res = fs.f_read(&fil, buf, sizeof(buf), &br);
+  });
+  ram.waitBlocked();
+
+  // volume 1 is not affected
+  FIL other;
+  CHECK(fs.f_open(&other, "1:/free.bin", FA_WRITE | FA_CREATE_NEW) == FR_OK,
+        "volume 1 blocked by volume 0");
+  CHECK(fs.f_write(&other, data, sizeof(data), &n) == FR_OK, "f_write failed");
+  CHECK(fs.f_close(&other) == FR_OK, "f_close failed");
+
+  // volume 0 times out
+  FILINFO info;
+  CHECK(fs.f_mkdir("0:/locked") == FR_TIMEOUT, "volume 0 not locked");
+
+  ram.open();
+  holder.join();
+  CHECK(blocked_res == FR_OK, "f_read failed");
+  CHECK(fs.f_close(&fil) == FR_OK, "f_close failed");
+  CHECK(fs.f_stat("0:/gate.bin", &info) == FR_OK, "volume 0 still locked");
+}
+
+/// first sector of the data of a file
+static LBA_t data_sector(FIL& fil) {
+  FATFS* fatfs = fil.obj.fs;
+  return fatfs->database + (LBA_t)fatfs->csize * (fil.obj.sclust - 2);
+}
+
+static void check_shared_read() {
+  FIL fil[2];
+  UINT n;
+  uint8_t data[512];
+  const char* paths[2] = {"0:/reader1.bin", "0:/reader2.bin"};
+  for (int j = 0; j < 2; j++) {
+    memset(data, j + 1, sizeof(data));
+    CHECK(fs.f_open(&fil[j], paths[j], FA_WRITE | FA_CREATE_NEW) == FR_OK,
+          "f_open failed");
+    CHECK(fs.f_write(&fil[j], data, sizeof(data), &n) == FR_OK,
+          "f_write failed");
+    CHECK(fs.f_close(&fil[j]) == FR_OK, "f_close failed");
+    CHECK(fs.f_open(&fil[j], paths[j], FA_READ) == FR_OK, "f_open failed");
+  }
+  DIR dir;
+  CHECK(fs.f_opendir(&dir, "0:/") == FR_OK, "f_opendir failed");
+
+  // this reader keeps the shared lock of volume 0 while it waits in the
+  // driver for the data of the first file
+  ram.close(data_sector(fil[0]));
+  FRESULT blocked_res = FR_INT_ERR;
+  uint8_t blocked_data[512] = {0};
+  std::thread holder([&] {
+    UINT br;
+    blocked_res = fs.f_read(&fil[0], blocked_data, sizeof(blocked_data), &br);
+  });
+  ram.waitBlocked();
+
+  // other readers proceed
+  memset(data, 0, sizeof(data));
+  CHECK(fs.f_read(&fil[1], data, sizeof(data), &n) == FR_OK && n == 512,
+        "reader blocked by reader");
+  CHECK(data[0] == 2 && data[511] == 2, "wrong data");
+  FILINFO info;
+  CHECK(fs.f_stat(paths[1], &info) == FR_OK && info.fsize == 512,
+        "f_stat blocked by reader");
+  CHECK(fs.f_readdir(&dir, &info) == FR_OK && info.fname[0],
+        "f_readdir blocked by reader");
+
+  // writers wait for the readers
+  FIL other;
+  CHECK(fs.f_open(&other, "0:/writer.bin", FA_WRITE | FA_CREATE_NEW) ==
+            FR_TIMEOUT, "writer not blocked by reader");
+
+  ram.open();
+  holder.join();
+  CHECK(blocked_res == FR_OK && blocked_data[0] == 1, "f_read failed");
+  CHECK(fs.f_closedir(&dir) == FR_OK, "f_closedir failed");
+  for (int j = 0; j < 2; j++) {
+    CHECK(fs.f_close(&fil[j]) == FR_OK, "f_close failed");
+  }
+  CHECK(fs.f_open(&other, "0:/writer.bin", FA_WRITE | FA_CREATE_NEW) == FR_OK,
+        "writer still blocked");
+  CHECK(fs.f_close(&other) == FR_OK, "f_close failed");
+}
+
+/// the readers of a driver without concurrent reads wait for each other
+static void check_exclusive_read() {
+  static uint8_t work[FF_MAX_SS];
+  ExclusiveIO drv{2000, 512};
+  FatFs own(drv);
+  CHECK(own.f_mkfs("0:", nullptr, work, sizeof(work)) == FR_OK,
+        "f_mkfs failed");
+  CHECK(own.f_mount(&drv.fatfs, "0:", 1) == FR_OK, "f_mount failed");
+  FIL fil[2];
+  UINT n;
+  uint8_t data[512];
+  const char* paths[2] = {"0:/first.bin", "0:/second.bin"};
+  for (int j = 0; j < 2; j++) {
+    memset(data, j + 1, sizeof(data));
+    CHECK(own.f_open(&fil[j], paths[j], FA_WRITE | FA_CREATE_NEW) == FR_OK,
+          "f_open failed");
+    CHECK(own.f_write(&fil[j], data, sizeof(data), &n) == FR_OK,
+          "f_write failed");
+    CHECK(own.f_close(&fil[j]) == FR_OK, "f_close failed");
+    CHECK(own.f_open(&fil[j], paths[j], FA_READ) == FR_OK, "f_open failed");
+  }
+
+  drv.close(data_sector(fil[0]));
+  FRESULT blocked_res = FR_INT_ERR;
+  std::thread holder([&] {
+    UINT br;
+    uint8_t buf[512];
+    blocked_res = own.f_read(&fil[0], buf, sizeof(buf), &br);
+  });
+  drv.waitBlocked();
+  CHECK(own.f_read(&fil[1], data, sizeof(data), &n) == FR_TIMEOUT,
+        "reader not blocked by reader");
+  drv.open();
+  holder.join();
+  CHECK(blocked_res == FR_OK, "f_read failed");
+  CHECK(own.f_read(&fil[1], data, sizeof(data), &n) == FR_OK && n == 512 &&
+            data[0] == 2,
+        "reader still blocked");
+  for (int j = 0; j < 2; j++) own.f_close(&fil[j]);
+  own.f_unmount("0:");
+}
+
+#if FF_USE_ASYNC
+static void check_async_adapter() {
+  RamIO disk{64, 512};
+  CHECK(disk.disk_initialize(0) == STA_CLEAR, "disk_initialize failed");
+  std::atomic<int> errors{0};
+  std::vector<std::thread> threads;
+  for (int id = 0; id < THREADS; id++) {
+    threads.emplace_back([&, id] {
+      uint8_t buf[512];
+      for (int k = 0; k < 5000; k++) {
+        io_request_t req = disk.disk_read_submit(0, buf, id, 1);
+        std::this_thread::yield();  // let the other threads submit
+        if (disk.disk_complete(req) != RES_OK) errors++;
+      }
+    });
+  }
+  for (auto& t : threads) t.join();
+  CHECK(errors == 0, "results of other threads");
+}
+#endif
+
+/// several threads read different sectors of a combined MultiIO device
+static void check_multiio_readers(MultiIOMode mode) {
+  bool mirror = mode == MULTI_MIRROR;
+  LBA_t count = mirror ? 4096 : 8192;
+  RamIO a{4096, 512}, b{4096, 512};
+  MultiIO combined;
+  combined.add(a);
+  combined.add(b);
+  combined.setMode(mode, 8);
+  CHECK(combined.disk_initialize(0) == STA_CLEAR, "disk_initialize failed");
+  static uint8_t data[8192 * 512];
+  for (size_t i = 0; i < sizeof(data); i++) data[i] = (uint8_t)(i / 512);
+  CHECK(combined.disk_write(0, data, 0, count) == RES_OK, "write failed");
+
+  std::atomic<int> errors{0};
+  std::vector<std::thread> threads;
+  for (int id = 0; id < THREADS; id++) {
+    threads.emplace_back([&, id] {
+      static thread_local uint8_t buf[64 * 512];
+      for (int k = 0; k < 200; k++) {
+        LBA_t sector = (LBA_t)((id * 977 + k * 131) % (count - 64));
+        if (combined.disk_read(0, buf, sector, 64) != RES_OK ||
+            memcmp(buf, data + sector * 512, sizeof(buf)) != 0)
+          errors++;
+        std::this_thread::yield();
+      }
+    });
+  }
+  for (auto& t : threads) t.join();
+  CHECK(errors == 0, "concurrent MultiIO reads failed");
+  CHECK(!mirror || !combined.isDegraded(), "driver of mirror failed");
+}
+
+void setup() {
+  remove(IMG_PATH);
+  FileIO file{IMG_PATH, 8000, 512};
+  multi.add(ram);
+  multi.add(file);
+  fs.setDriver(multi);
+  CHECK(multi.mount(fs) == FR_OK, "mount failed");
+
+  check_stress();
+  check_volume_locks();
+  check_shared_read();
+  check_exclusive_read();
+#if FF_USE_ASYNC
+  check_async_adapter();
+#endif
+  check_multiio_readers(MULTI_STRIPE);
+  check_multiio_readers(MULTI_MIRROR);
+  check_multiio_readers(MULTI_CONCAT);
+
+  multi.un_mount(fs);
+  remove(IMG_PATH);
+  printf("PASS: thread safety\n");
+  TEST_EXIT_OK();
+}
+
+void loop() {}
@@ -0,0 +1,129 @@
+/* Write-behind test (FF_USE_WRITEBEHIND): the file object collects small
+ * writes, so a log file written with print() sized lines should reach the
+ * driver in multi-sector writes. Reading and seeking back while writing
+ * must still see all written data, and a plain FatFs must read the complete
+ * file after remount.
+ */
+#include <cstring>
+
+#include "fatfs.h"
+#include "test_common.h"
+
+using namespace fatfs;
+
+/// RamIO which records the sizes of the write requests
+class RecordingIO : public RamIO {
+ public:
+  RecordingIO(int sectors, int sectorSize) : RamIO(sectors, sectorSize) {}
+
+  DRESULT disk_write(BYTE pdrv, const BYTE* buff, LBA_t sector,
+                     UINT count) override {
+    writes++;
+    if (count > max_count) max_count = count;
+    return RamIO::disk_write(pdrv, buff, sector, count);
+  }
+
+  unsigned long writes = 0;
+  UINT max_count = 0;
+};
+
+RecordingIO drv{4000, 512};
+
+static const int LINES = 2000;
+static const int WBUF_SECTORS = 8;
+
+static int line(char* buf, int j) {
+  return snprintf(buf, 64, "%06d;sensor-%d;%d.%02d\n", j, j % 7, j * 3, j % 100);
+}
+
+static void check_lines(FatFs& fs, FIL* fil, int n) {
+  char expected[64];
+  char actual[64];
+  UINT br;
+  CHECK(fs.f_lseek(fil, 0) == FR_OK, "f_lseek failed");
+  for (int j = 0; j < n; j++) {
+    int len = line(expected, j);
+    CHECK(fs.f_read(fil, actual, len, &br) == FR_OK && (int)br == len,
+          "f_read failed");
+    CHECK(memcmp(expected, actual, len) == 0, "data mismatch");
+  }
+}
+
+static unsigned long write_log(bool useBuffer) {
+  static uint8_t wbuf[WBUF_SECTORS * 512];
+  SDClass sd(drv);
+  CHECK(sd.begin(), "SD.begin() failed");
+  sd.remove("0:/log.csv");
+  File f = sd.open("0:/log.csv", FILE_WRITE);
+  CHECK((bool)f, "could not create file");
+  if (useBuffer) {
+    CHECK(!f.setWriteBuffer(wbuf, 512), "single sector buffer accepted");
+    CHECK(f.setWriteBuffer(wbuf, sizeof(wbuf)), "setWriteBuffer failed");
+  }
+  char buf[64];
+  drv.writes = 0;
+  drv.max_count = 0;
+  for (int j = 0; j < LINES; j++) {
+    int len = line(buf, j);
+    CHECK(f.write((uint8_t*)buf, len) == (size_t)len, "write failed");
+  }
+  f.flush();
+  unsigned long writes = drv.writes;
+  f.close();
+  sd.end();
+  return writes;
+}
+
+static void check_mixed() {
+  static uint8_t wbuf[WBUF_SECTORS * 512];
+  FatFs fs(drv);
+  FIL fil;
+  UINT bw;
+  char buf[64];
+  CHECK(fs.f_mount(&drv.fatfs, "0:", 1) == FR_OK, "f_mount failed");
+  CHECK(fs.f_open(&fil, "0:/mixed.csv", FA_READ | FA_WRITE | FA_CREATE_ALWAYS) ==
+            FR_OK,
+        "f_open failed");
+  CHECK(fs.f_setwbuf(&fil, wbuf, sizeof(wbuf)) == FR_OK, "f_setwbuf failed");
+  for (int j = 0; j < LINES; j++) {
+    int len = line(buf, j);
+    CHECK(fs.f_write(&fil, buf, len, &bw) == FR_OK, "f_write failed");
+    if (j % 500 == 499) {
+      check_lines(fs, &fil, j + 1);  // read back the collected sectors
+      CHECK(fs.f_lseek(&fil, fs.f_size(&fil)) == FR_OK, "f_lseek failed");
+    }
+  }
+  CHECK(fs.f_close(&fil) == FR_OK, "f_close failed");
+  fs.f_unmount("0:");
+
+  FatFs plain(drv);
+  CHECK(plain.f_mount(&drv.fatfs, "0:", 1) == FR_OK, "remount failed");
+  CHECK(plain.f_open(&fil, "0:/log.csv", FA_READ) == FR_OK, "f_open failed");
+  check_lines(plain, &fil, LINES);
+  plain.f_close(&fil);
+  CHECK(plain.f_open(&fil, "0:/mixed.csv", FA_READ) == FR_OK, "f_open failed");
+  check_lines(plain, &fil, LINES);
+  plain.f_close(&fil);
+  plain.f_unmount("0:");
+}
+
+void setup() {
+  static uint8_t work[FF_MAX_SS];
+  FatFs fs(drv);
+  MKFS_PARM opt = {FM_FAT, 16, 0, 0, 0};
+  CHECK(fs.f_mkfs("0:", &opt, work, sizeof(work)) == FR_OK, "f_mkfs failed");
+
+  unsigned long plain = write_log(false);
+  CHECK(drv.max_count == 1, "unexpected multi-sector write");
+  unsigned long buffered = write_log(true);
+  CHECK(drv.max_count == WBUF_SECTORS, "no multi-sector write");
+  printf("disk writes for %d lines: %lu without, %lu with write-behind buffer\n",
+         LINES, plain, buffered);
+  CHECK(buffered * 4 < plain, "write-behind buffer does not save writes");
+
+  check_mixed();
+  printf("PASS: write-behind buffer\n");
+  TEST_EXIT_OK();
+}
+
+void loop() {}